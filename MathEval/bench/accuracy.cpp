@@ -0,0 +1,159 @@
+// comment out the below definition if using elsewhere
+// uncomment out below definition to run the accuracy sweep
+//#define MATH_EVAL_ACCURACY_MAIN
+#ifdef MATH_EVAL_ACCURACY_MAIN
+#include "../include/ExpressionEvaluation.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+ error of exp/sin/cos for every precision (fast_math.h) on every instruction set the cpu has
+ inputs are float bit patterns 0, stride, 2*stride, ... over all 2^32 (NaNs skipped), the reference is the
+ double libm result, errors are in ulps of the float the reference rounds to
+ scalar is also what Evaluate and the scalar jit run, avx2 what the batch jit runs
+ usage: accuracy [--stride n]   (--stride 1 checks every float, takes a while)
+ exits 1 if a ULPn mode goes over n ulp, DEFAULT and EXACT are only reported
+*/
+
+namespace
+{
+	struct function_entry
+	{
+		const char* name;
+		double (*reference)(double);
+	};
+
+	struct error_stats
+	{
+		double max = 0.0;
+		double sum = 0.0;
+		size_t count = 0;
+		float worst = 0.0f;
+	};
+
+	double Exp(double x) { return std::exp(x); }
+	double Sin(double x) { return std::sin(x); }
+	double Cos(double x) { return std::cos(x); }
+
+	// distance from y to the exact value in ulps of the float the exact value rounds to
+	double UlpError(float y, double exact)
+	{
+		if (std::isnan(exact))
+			return std::isnan(y) ? 0.0 : INFINITY;
+		float rounded = static_cast<float>(exact);
+		if (std::isinf(rounded) || std::isinf(y))
+			return y == rounded ? 0.0 : INFINITY;
+		if (std::isnan(y))
+			return INFINITY;
+		int exponent = exact == 0.0 ? -126 : std::max(std::ilogb(exact), -126);
+		double ulp = std::ldexp(1.0, exponent - 23);
+		return std::fabs(static_cast<double>(y) - exact) / ulp;
+	}
+
+	double Bound(MathEval::precision p)
+	{
+		switch (p)
+		{
+		case MathEval::precision::ULP1: return 1.0;
+		case MathEval::precision::ULP2: return 2.0;
+		case MathEval::precision::ULP4: return 4.0;
+		default:                        return INFINITY;
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	uint64_t stride = 97;
+	for (int i = 1; i < argc; i++)
+	{
+		if (!std::strcmp(argv[i], "--stride") && i + 1 < argc)
+			stride = std::max<uint64_t>(1, std::strtoull(argv[++i], nullptr, 10));
+		else
+		{
+			std::cerr << "usage: " << argv[0] << " [--stride n]\n";
+			return 1;
+		}
+	}
+
+	MathEvaluator<1>::Setup();
+	std::unordered_map<std::string, size_t> definition = { { "x", 0 } };
+	const function_entry functions[] = { { "exp", Exp }, { "sin", Sin }, { "cos", Cos } };
+	const MathEval::precision precisions[] = { MathEval::precision::DEFAULT, MathEval::precision::EXACT,
+		MathEval::precision::ULP1, MathEval::precision::ULP2, MathEval::precision::ULP4 };
+	std::vector<MathEval::isa> targets;
+	for (int t = 0; t <= static_cast<int>(MathEval::GetSupportedIsa()); t++)
+		targets.push_back(static_cast<MathEval::isa>(t));
+
+	static constexpr size_t BLOCK = 1 << 16;
+	std::vector<float> x(BLOCK), y(BLOCK);
+	std::vector<double> exact(BLOCK);
+	bool failed = false;
+	std::printf("%-5s %-8s %-8s %12s %12s %16s\n", "func", "isa", "mode", "max ulp", "mean ulp", "worst x");
+	for (const function_entry& f : functions)
+	{
+		MathEvaluator<1> evaluator(std::string(f.name) + "(x)", definition);
+		const MathEval::program& prog = evaluator.GetProgram();
+		std::vector<error_stats> stats(targets.size() * 5);
+
+		uint64_t bits = 0;
+		while (bits <= UINT32_MAX)
+		{
+			size_t count = 0;
+			for (; count < BLOCK && bits <= UINT32_MAX; bits += stride)
+			{
+				uint32_t pattern = static_cast<uint32_t>(bits);
+				float v;
+				std::memcpy(&v, &pattern, sizeof(v));
+				if (std::isnan(v))
+					continue;
+				x[count] = v;
+				exact[count] = f.reference(v);
+				count++;
+			}
+			const float* columns[] = { x.data() };
+			for (size_t t = 0; t < targets.size(); t++)
+			{
+				for (size_t m = 0; m < 5; m++)
+				{
+					MathEval::RunBatch(prog, columns, y.data(), count, targets[t], precisions[m]);
+					error_stats& s = stats[t * 5 + m];
+					for (size_t i = 0; i < count; i++)
+					{
+						double e = UlpError(y[i], exact[i]);
+						if (e > s.max)
+						{
+							s.max = e;
+							s.worst = x[i];
+						}
+						if (!std::isinf(e))
+							s.sum += e;
+						s.count++;
+					}
+				}
+			}
+		}
+
+		for (size_t t = 0; t < targets.size(); t++)
+		{
+			for (size_t m = 0; m < 5; m++)
+			{
+				const error_stats& s = stats[t * 5 + m];
+				bool over = s.max > Bound(precisions[m]);
+				failed |= over;
+				std::printf("%-5s %-8s %-8s %12.4g %12.4g %16.9g%s\n", f.name, MathEval::GetIsaName(targets[t]),
+					MathEval::GetPrecisionName(precisions[m]), s.max, s.sum / s.count, s.worst, over ? "  over bound" : "");
+			}
+		}
+	}
+	return failed ? 1 : 0;
+}
+
+#endif /* MATH_EVAL_ACCURACY_MAIN */
@@ -0,0 +1,108 @@
+// comment out the below definition if using elsewhere
+// uncomment out below definition to run the cache scaling benchmark
+//#define MATH_EVAL_CACHE_BENCH_MAIN
+#ifdef MATH_EVAL_CACHE_BENCH_MAIN
+#include "../include/ExpressionEvaluation.h"
+#include <unordered_map>
+#include <iostream>
+#include <iomanip>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+/*
+ many threads calling Evaluate(inputs, true) on one shared evaluator
+ every lookup is a hit with probability hit_rate (a hot set that fits in the cache and is warmed up first),
+ the rest are keys nobody has seen, which miss and get inserted
+ prints million evaluations per second for 1..32 threads, single lock vs sharded
+*/
+
+static const char* EXPRESSION = "sin(a)*cos(b) + exp(a/10) - a*b/(1+a*a)";
+static const size_t HOT_KEYS = 1024;
+static const size_t CAPACITY = 1 << 16;
+static const size_t CALLS_PER_THREAD = 200000;
+
+static double Run(MathEvaluator<2>& evaluator, size_t threads, double hit_rate)
+{
+	std::atomic<size_t> ready{ 0 };
+	std::atomic<bool> go{ false };
+	std::vector<std::thread> workers;
+	std::vector<float> sink(threads);
+	for (size_t t = 0; t < threads; t++)
+	{
+		workers.emplace_back([&, t]
+		{
+			uint32_t state = 0x9E3779B9u * static_cast<uint32_t>(t + 1);
+			uint32_t threshold = static_cast<uint32_t>(hit_rate * 4294967295.0);
+			float cold = 0.0f;
+			float sum = 0.0f;
+			ready++;
+			while (!go.load())
+				std::this_thread::yield();
+			for (size_t i = 0; i < CALLS_PER_THREAD; i++)
+			{
+				state = state * 1664525u + 1013904223u;
+				std::array<float, 2> inputs;
+				if (state < threshold || threshold == 4294967295u)
+				{
+					inputs = { static_cast<float>((state >> 8) % HOT_KEYS), 0.5f };
+				}
+				else
+				{
+					// b tells the threads apart, so cold keys never repeat
+					cold += 1.0f;
+					inputs = { -cold, static_cast<float>(t + 1) };
+				}
+				sum += evaluator.Evaluate(inputs, true);
+			}
+			sink[t] = sum;
+		});
+	}
+	while (ready.load() != threads)
+		std::this_thread::yield();
+	auto start = std::chrono::steady_clock::now();
+	go.store(true);
+	for (std::thread& worker : workers)
+		worker.join();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return threads * CALLS_PER_THREAD / seconds / 1e6;
+}
+
+int main()
+{
+	std::unordered_map<std::string, size_t> definition;
+	definition["a"] = 0;
+	definition["b"] = 1;
+	MathEvaluator<2>::Setup();
+
+	const double hit_rates[] = { 0.0, 0.5, 0.9, 0.99 };
+	const size_t thread_counts[] = { 1, 2, 4, 8, 16, 32 };
+
+	std::cout << "hardware threads: " << std::thread::hardware_concurrency() << "\n";
+	std::cout << "million Evaluate calls per second\n";
+	std::cout << std::setw(8) << "hit" << std::setw(9) << "threads" << std::setw(14) << "single lock" << std::setw(10) << "sharded" << std::setw(10) << "no cache" << "\n";
+	for (double hit_rate : hit_rates)
+	{
+		for (size_t threads : thread_counts)
+		{
+			double result[3];
+			for (int mode = 0; mode < 3; mode++)
+			{
+				MathEvaluatorOptions options;
+				options.cache_capacity = mode == 2 ? 0 : CAPACITY;
+				options.cache_shards = mode == 0 ? 1 : 0;
+				MathEvaluator<2> evaluator(EXPRESSION, definition, options);
+				for (size_t k = 0; k < HOT_KEYS; k++)
+					evaluator.Evaluate({ static_cast<float>(k), 0.5f }, true);
+				result[mode] = Run(evaluator, threads, hit_rate);
+			}
+			std::cout << std::setw(8) << hit_rate << std::setw(9) << threads << std::fixed << std::setprecision(2)
+				<< std::setw(14) << result[0] << std::setw(10) << result[1] << std::setw(10) << result[2] << "\n" << std::defaultfloat;
+		}
+	}
+	return 0;
+}
+
+#endif /* MATH_EVAL_CACHE_BENCH_MAIN */
@@ -0,0 +1,725 @@
+// comment out the below definition if using elsewhere
+// uncomment out below definition to run the benchmark suite
+//#define MATH_EVAL_BENCHMARK_MAIN
+#ifdef MATH_EVAL_BENCHMARK_MAIN
+#include "../include/ExpressionEvaluation.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+ benchmark suite, every case is timed the same way:
+   - warmup: the iteration count doubles until one sample takes SAMPLE_SECONDS, those runs also warm caches and branch predictors
+   - SAMPLES timed samples of that many iterations, each reported as ns per operation
+   - min/median/mean/stddev/max over the samples, median is the number to compare between releases
+ cases (every expression of the corpus unless noted)
+   lex/<expr>                       LexicalAnalyzer over the text
+   parse/<expr>                     lex + pratt parse into the flat tree
+   compile/private/<expr>           full MathEvaluator construction, nothing shared
+   compile/registry/<expr>          construction when the registry already has the expression
+   compile/archive/<expr>           construction from an archive (serialize.h) in memory, Load plus the evaluator
+   eval/uncached/<expr>             Evaluate on the interpreter
+   eval/jit/<expr>                  Evaluate on jit code (same as uncached where there's no jit)
+   eval/cached/h<rate>/<expr>       Evaluate(inputs, true), hit probability swept from 0 to 1
+   batch/<points>/<expr>            EvaluateBatch, ns per point for batch sizes 1..64k
+   precision/eval/<mode>/<expr>     Evaluate under each MathEvaluatorOptions::precision (fast_math.h)
+   precision/batch/<mode>/<expr>    EvaluateBatch of 4096 points under each precision, ns per point
+   grid/hoisted/<expr>              EvaluateGrid over 256x256 (b outer, a inner, c = d = 1), ns per point
+   grid/batch/<expr>                the same points through EvaluateBatch
+   incremental/<expr>               CreateIncremental().Evaluate with one of the 4 inputs changed per call
+   incremental/<k>of12              12 inputs, k of them changed per call, against full/12 (Evaluate, no cache)
+   multi/separate/<n>, multi/fused/<n>  n related expressions per record, one MathEvaluator each vs one MultiMathEvaluator
+   multi/separate_batch/<n>, multi/fused_batch/<n>  the same over 4096 records, ns per record
+   bulk/serial, bulk/pool           1024 expressions (the corpus over and over, every 8th one malformed) through
+                                    TryCompileExpression one by one vs CompileBulk on the default pool, ns per expression
+   interval/eval/<expr>             EvaluateInterval over the box every input in [0.1, 2]
+   interval/search/<expr>           FindCrossings of that box at the value in its middle, up to 4096 enclosures
+ usage: benchmark [--json file] [--filter substring] [--quick]
+ the json has one object per case, keep it next to the release to diff against later
+*/
+
+namespace
+{
+	struct corpus_entry
+	{
+		std::string name;
+		std::string text;
+	};
+
+	struct result
+	{
+		std::string name;
+		size_t iterations = 0; // per sample
+		std::vector<double> ns; // per operation, one per sample
+		double min = 0, median = 0, mean = 0, stddev = 0, max = 0;
+	};
+
+	struct settings
+	{
+		double sample_seconds = 0.02;
+		size_t samples = 15;
+		std::string filter;
+		std::string json;
+	};
+
+	// results land here so the optimizer can't drop the work
+	volatile float g_sink;
+
+	// 4 inputs, expressions use any subset of them
+	std::unordered_map<std::string, size_t> Definition()
+	{
+		return { { "a", 0 }, { "b", 1 }, { "c", 2 }, { "d", 3 } };
+	}
+
+	// deterministic random expression of the given depth
+	void Generate(std::string& out, uint32_t& state, int depth)
+	{
+		state = state * 1664525u + 1013904223u;
+		uint32_t pick = state >> 24;
+		if (depth == 0)
+		{
+			if (pick % 4 == 0)
+				out += std::to_string(1 + pick % 9) + "." + std::to_string(pick % 10);
+			else
+				out += static_cast<char>('a' + pick % 4);
+			return;
+		}
+		if (pick % 8 == 0)
+		{
+			static const char* functions[] = { "sin", "cos", "exp" };
+			out += functions[pick % 3];
+			out += "(";
+			Generate(out, state, depth - 1);
+			out += pick % 3 == 2 ? "/10)" : ")"; // keeps exp from running off to inf
+			return;
+		}
+		static const char ops[] = { '+', '-', '*', '/' };
+		out += "(";
+		Generate(out, state, depth - 1);
+		out += ops[pick % 4];
+		Generate(out, state, depth - 1);
+		out += ")";
+	}
+
+	std::vector<corpus_entry> Corpus()
+	{
+		std::vector<corpus_entry> corpus = {
+			{ "tiny", "a+b" },
+			{ "small", "a * sin(3.14) - cos(2)" },
+			{ "medium", "sin(a)*cos(b) + exp(a/10) - a*b/(1+a*a)" },
+			{ "shared", "sin(a*b)*c + sin(a*b)*d + exp(c/(1+d*d)) - a/b" },
+			// the same polynomial twice, ^ goes through the multiply chains of EmitPower (bytecode.h)
+			{ "power", "a^4 - 3*b^3 + c^-2 + d^0.5" },
+			{ "power_mult", "a*a*a*a - 3*b*b*b + 1/(c*c) + sqrt(d)" },
+			{ "functions", "tan(a)*arctan(b) + sqrt(c*c + d*d) - arcsin(a/4) + -arccos(b/4)" },
+		};
+		// long and flat: 64 terms in a row
+		std::string flat;
+		for (int i = 0; i < 64; i++)
+		{
+			if (i)
+				flat += i % 3 ? " + " : " - ";
+			flat += std::string(1, static_cast<char>('a' + i % 4)) + "*" + std::to_string(i + 1);
+		}
+		corpus.push_back({ "flat64", flat });
+		// deep: 32 nested functions
+		std::string deep = "a";
+		for (int i = 0; i < 32; i++)
+			deep = (i % 2 ? "cos(" : "sin(") + deep + "+b)";
+		corpus.push_back({ "deep32", deep });
+		// random trees, 2^depth leaves at most
+		for (int depth : { 5, 9 })
+		{
+			uint32_t state = 12345u + depth;
+			std::string text;
+			Generate(text, state, depth);
+			corpus.push_back({ "random_d" + std::to_string(depth), text });
+		}
+		return corpus;
+	}
+
+	void Summarize(result& r)
+	{
+		std::vector<double> sorted = r.ns;
+		std::sort(sorted.begin(), sorted.end());
+		size_t n = sorted.size();
+		r.min = sorted.front();
+		r.max = sorted.back();
+		r.median = n % 2 ? sorted[n / 2] : 0.5 * (sorted[n / 2 - 1] + sorted[n / 2]);
+		double sum = 0.0;
+		for (double v : sorted)
+			sum += v;
+		r.mean = sum / n;
+		double square = 0.0;
+		for (double v : sorted)
+			square += (v - r.mean) * (v - r.mean);
+		r.stddev = n > 1 ? std::sqrt(square / (n - 1)) : 0.0;
+	}
+
+	class runner
+	{
+	public:
+		explicit runner(const settings& config) : config(config) {}
+
+		bool Wants(const std::string& name) const { return config.filter.empty() || name.find(config.filter) != std::string::npos; }
+
+		// body(iterations) does iterations calls, each one counts as ops_per_iteration operations
+		void Run(const std::string& name, const std::function<void(size_t)>& body, size_t ops_per_iteration = 1)
+		{
+			if (!Wants(name))
+				return;
+			// warmup, doubling until a sample is long enough to time
+			size_t iterations = 1;
+			for (;;)
+			{
+				double seconds = Time(body, iterations);
+				if (seconds >= config.sample_seconds || iterations >= (size_t(1) << 40))
+					break;
+				// jump most of the way in one step once there's a usable measurement
+				if (seconds > config.sample_seconds / 64)
+					iterations = static_cast<size_t>(iterations * config.sample_seconds / seconds) + 1;
+				else
+					iterations *= 2;
+			}
+
+			result r;
+			r.name = name;
+			r.iterations = iterations;
+			for (size_t s = 0; s < config.samples; s++)
+				r.ns.push_back(Time(body, iterations) * 1e9 / (static_cast<double>(iterations) * ops_per_iteration));
+			Summarize(r);
+			std::cout << std::left << std::setw(44) << r.name << std::right << std::fixed << std::setprecision(2)
+				<< std::setw(12) << r.median << std::setw(12) << r.min << std::setw(10) << r.stddev << "\n" << std::defaultfloat;
+			results.push_back(r);
+		}
+
+		void WriteJson(std::ostream& out) const
+		{
+			out << "{\n  \"schema\": 1,\n  \"unit\": \"ns/op\",\n";
+			out << "  \"isa\": \"" << MathEval::GetIsaName(MathEval::GetSupportedIsa()) << "\",\n";
+			out << "  \"samples\": " << config.samples << ",\n  \"results\": [\n";
+			for (size_t i = 0; i < results.size(); i++)
+			{
+				const result& r = results[i];
+				out << "    { \"name\": \"" << r.name << "\", \"iterations\": " << r.iterations << std::setprecision(6)
+					<< ", \"min\": " << r.min << ", \"median\": " << r.median << ", \"mean\": " << r.mean
+					<< ", \"stddev\": " << r.stddev << ", \"max\": " << r.max << " }" << (i + 1 < results.size() ? "," : "") << "\n";
+			}
+			out << "  ]\n}\n";
+		}
+	private:
+		settings config;
+		std::vector<result> results;
+
+		static double Time(const std::function<void(size_t)>& body, size_t iterations)
+		{
+			auto start = std::chrono::steady_clock::now();
+			body(iterations);
+			return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		}
+	};
+
+	// points in [0.1, 2), away from the poles of the generated divisions as much as a simple grid can be
+	std::vector<std::array<float, 4>> Points(size_t count)
+	{
+		std::vector<std::array<float, 4>> points(count);
+		uint32_t state = 777u;
+		for (auto& p : points)
+		{
+			for (float& v : p)
+			{
+				state = state * 1664525u + 1013904223u;
+				v = 0.1f + 1.9f * static_cast<float>(state >> 8) / 16777216.0f;
+			}
+		}
+		return points;
+	}
+
+	void FrontEnd(runner& bench, const corpus_entry& e)
+	{
+		std::unordered_map<std::string, size_t> definition = Definition();
+		bench.Run("lex/" + e.name, [&](size_t iterations)
+		{
+			for (size_t i = 0; i < iterations; i++)
+			{
+				Lexer::LexicalAnalyzer lex(e.text);
+				g_sink = static_cast<float>(lex.GetNumOfToks());
+			}
+		});
+		bench.Run("parse/" + e.name, [&](size_t iterations)
+		{
+			for (size_t i = 0; i < iterations; i++)
+			{
+				Lexer::parser parser(e.text);
+				g_sink = static_cast<float>(parser.parse());
+			}
+		});
+		MathEvaluatorOptions options;
+		options.cache_capacity = 0;
+		options.registry = nullptr;
+		bench.Run("compile/private/" + e.name, [&](size_t iterations)
+		{
+			for (size_t i = 0; i < iterations; i++)
+			{
+				MathEvaluator<4> evaluator(e.text, definition, options);
+				g_sink = static_cast<float>(evaluator.GetProgram().GetNumOfInstructions());
+			}
+		});
+		options.registry = &MathEval::expression_registry::GetDefault();
+		bench.Run("compile/registry/" + e.name, [&](size_t iterations)
+		{
+			for (size_t i = 0; i < iterations; i++)
+			{
+				MathEvaluator<4> evaluator(e.text, definition, options);
+				g_sink = static_cast<float>(evaluator.GetProgram().GetNumOfInstructions());
+			}
+		});
+		MathEval::archive_writer writer;
+		writer.Add(e.name, *MathEvaluator<4>(e.text, definition, options).GetCompiled());
+		std::string file = writer.Finish();
+		MathEval::expression_archive archive(file.data(), file.size());
+		bench.Run("compile/archive/" + e.name, [&](size_t iterations)
+		{
+			for (size_t i = 0; i < iterations; i++)
+			{
+				MathEvaluator<4> evaluator(archive.Load(e.name), options);
+				g_sink = static_cast<float>(evaluator.GetProgram().GetNumOfInstructions());
+			}
+		});
+	}
+
+	void Evaluation(runner& bench, const corpus_entry& e)
+	{
+		static const size_t POINTS = 4096; // fits in L1/L2 with room to spare, the inputs never come from memory
+		std::unordered_map<std::string, size_t> definition = Definition();
+		std::vector<std::array<float, 4>> points = Points(POINTS);
+
+		MathEvaluatorOptions options;
+		options.cache_capacity = 0;
+		MathEvaluator<4> plain(e.text, definition, options);
+		bench.Run("eval/uncached/" + e.name, [&](size_t iterations)
+		{
+			float sum = 0.0f;
+			for (size_t i = 0; i < iterations; i++)
+				sum += plain.Evaluate(points[i % POINTS]);
+			g_sink = sum;
+		});
+
+		options.jit = true;
+		MathEvaluator<4> jit(e.text, definition, options);
+		bench.Run("eval/jit/" + e.name, [&](size_t iterations)
+		{
+			float sum = 0.0f;
+			for (size_t i = 0; i < iterations; i++)
+				sum += jit.Evaluate(points[i % POINTS]);
+			g_sink = sum;
+		});
+
+		// a hot set that fits in the cache is warmed first, a lookup hits it with probability rate,
+		// the rest are inputs never seen before
+		static const size_t HOT_KEYS = 1024;
+		for (double rate : { 0.0, 0.5, 0.9, 0.99, 1.0 })
+		{
+			std::ostringstream name;
+			name << "eval/cached/h" << std::fixed << std::setprecision(2) << rate << "/" << e.name;
+			MathEvaluatorOptions cached_options;
+			cached_options.cache_capacity = 1 << 16;
+			MathEvaluator<4> cached(e.text, definition, cached_options);
+			for (size_t k = 0; k < HOT_KEYS; k++)
+				cached.Evaluate(points[k], true);
+			uint32_t threshold = rate >= 1.0 ? UINT32_MAX : static_cast<uint32_t>(rate * 4294967296.0);
+			uint32_t state = 99u;
+			float cold = 0.0f;
+			bench.Run(name.str(), [&](size_t iterations)
+			{
+				float sum = 0.0f;
+				for (size_t i = 0; i < iterations; i++)
+				{
+					state = state * 1664525u + 1013904223u;
+					std::array<float, 4> inputs;
+					if (state < threshold || threshold == UINT32_MAX)
+						inputs = points[(state >> 8) % HOT_KEYS];
+					else
+					{
+						// negative a never repeats and never collides with the hot set
+						cold -= 1.0f;
+						inputs = points[(state >> 8) % POINTS];
+						inputs[0] = cold;
+					}
+					sum += cached.Evaluate(inputs, true);
+				}
+				g_sink = sum;
+			});
+		}
+	}
+
+	void Batch(runner& bench, const corpus_entry& e)
+	{
+		std::unordered_map<std::string, size_t> definition = Definition();
+		MathEvaluatorOptions options;
+		options.cache_capacity = 0;
+		MathEvaluator<4> evaluator(e.text, definition, options);
+		for (size_t points : { size_t(1), size_t(16), size_t(256), size_t(4096), size_t(65536) })
+		{
+			std::vector<std::array<float, 4>> rows = Points(points);
+			std::vector<float> columns[4];
+			for (size_t s = 0; s < 4; s++)
+			{
+				columns[s].resize(points);
+				for (size_t i = 0; i < points; i++)
+					columns[s][i] = rows[i][s];
+			}
+			std::array<const float*, 4> pointers = { columns[0].data(), columns[1].data(), columns[2].data(), columns[3].data() };
+			std::vector<float> output(points);
+			bench.Run("batch/" + std::to_string(points) + "/" + e.name, [&](size_t iterations)
+			{
+				for (size_t i = 0; i < iterations; i++)
+					evaluator.EvaluateBatch(pointers, output.data(), points);
+				g_sink = output[0];
+			}, points);
+		}
+	}
+
+	void Precision(runner& bench, const corpus_entry& e)
+	{
+		static const size_t POINTS = 4096;
+		std::unordered_map<std::string, size_t> definition = Definition();
+		std::vector<std::array<float, 4>> rows = Points(POINTS);
+		std::vector<float> columns[4];
+		for (size_t s = 0; s < 4; s++)
+		{
+			columns[s].resize(POINTS);
+			for (size_t i = 0; i < POINTS; i++)
+				columns[s][i] = rows[i][s];
+		}
+		std::array<const float*, 4> pointers = { columns[0].data(), columns[1].data(), columns[2].data(), columns[3].data() };
+		std::vector<float> output(POINTS);
+
+		for (MathEval::precision p : { MathEval::precision::DEFAULT, MathEval::precision::EXACT,
+			MathEval::precision::ULP1, MathEval::precision::ULP2, MathEval::precision::ULP4 })
+		{
+			MathEvaluatorOptions options;
+			options.cache_capacity = 0;
+			options.precision = p;
+			MathEvaluator<4> evaluator(e.text, definition, options);
+			std::string mode = MathEval::GetPrecisionName(p);
+			bench.Run("precision/eval/" + mode + "/" + e.name, [&](size_t iterations)
+			{
+				float sum = 0.0f;
+				for (size_t i = 0; i < iterations; i++)
+					sum += evaluator.Evaluate(rows[i % POINTS]);
+				g_sink = sum;
+			});
+			bench.Run("precision/batch/" + mode + "/" + e.name, [&](size_t iterations)
+			{
+				for (size_t i = 0; i < iterations; i++)
+					evaluator.EvaluateBatch(pointers, output.data(), POINTS);
+				g_sink = output[0];
+			}, POINTS);
+		}
+	}
+
+	void Grid(runner& bench, const corpus_entry& e)
+	{
+		static const size_t SIDE = 256;
+		std::unordered_map<std::string, size_t> definition = Definition();
+		MathEvaluatorOptions options;
+		options.cache_capacity = 0;
+		MathEvaluator<4> evaluator(e.text, definition, options);
+		std::array<MathEval::grid_axis, 4> axes;
+		axes[0] = { 1, 0.1f, 2.0f, SIDE };
+		axes[1] = { 0, 0.1f, 2.0f, SIDE };
+		axes[2] = { 2, 1.0f, 1.0f, 1 };
+		axes[3] = { 3, 1.0f, 1.0f, 1 };
+		std::vector<float> output(SIDE * SIDE);
+		bench.Run("grid/hoisted/" + e.name, [&](size_t iterations)
+		{
+			for (size_t i = 0; i < iterations; i++)
+				evaluator.EvaluateGrid(axes, output.data());
+			g_sink = output[0];
+		}, SIDE * SIDE);
+
+		std::vector<float> columns[4];
+		for (std::vector<float>& column : columns)
+			column.assign(SIDE * SIDE, 1.0f);
+		for (size_t i = 0; i < SIDE * SIDE; i++)
+		{
+			columns[0][i] = 0.1f + 1.9f * static_cast<float>(i % SIDE) / (SIDE - 1);
+			columns[1][i] = 0.1f + 1.9f * static_cast<float>(i / SIDE) / (SIDE - 1);
+		}
+		std::array<const float*, 4> pointers = { columns[0].data(), columns[1].data(), columns[2].data(), columns[3].data() };
+		bench.Run("grid/batch/" + e.name, [&](size_t iterations)
+		{
+			for (size_t i = 0; i < iterations; i++)
+				evaluator.EvaluateBatch(pointers, output.data(), SIDE * SIDE);
+			g_sink = output[0];
+		}, SIDE * SIDE);
+	}
+
+	void Incremental(runner& bench, const corpus_entry& e)
+	{
+		static const size_t POINTS = 1024;
+		std::unordered_map<std::string, size_t> definition = Definition();
+		std::vector<std::array<float, 4>> points = Points(POINTS);
+		MathEvaluatorOptions options;
+		options.cache_capacity = 0;
+		MathEvaluator<4> evaluator(e.text, definition, options);
+		MathEval::incremental_evaluator incremental = evaluator.CreateIncremental();
+		std::array<float, 4> inputs = points[0];
+		bench.Run("incremental/" + e.name, [&](size_t iterations)
+		{
+			float sum = 0.0f;
+			for (size_t i = 0; i < iterations; i++)
+			{
+				inputs[i % 4] = points[i % POINTS][i % 4];
+				sum += incremental.Evaluate(inputs.data());
+			}
+			g_sink = sum;
+		});
+	}
+
+	// a simulation step: 12 inputs, a few of them move per call
+	void IncrementalWide(runner& bench)
+	{
+		static const size_t SLOTS = 12, POINTS = 1024;
+		std::unordered_map<std::string, size_t> definition;
+		std::string text;
+		for (size_t i = 0; i < SLOTS; i++)
+		{
+			std::string x(1, static_cast<char>('a' + i)), y(1, static_cast<char>('a' + (i + 1) % SLOTS)), z(1, static_cast<char>('a' + (i + 5) % SLOTS));
+			definition[x] = i;
+			text += (i ? " + " : "") + ("sin(" + x + "*" + y + ")*exp(" + x + "/10)/(1+" + z + "*" + z + ")");
+		}
+		MathEvaluatorOptions options;
+		options.cache_capacity = 0;
+		MathEvaluator<SLOTS> evaluator(text, definition, options);
+		std::vector<float> values(POINTS);
+		for (size_t i = 0; i < POINTS; i++)
+			values[i] = 0.1f + 1.9f * static_cast<float>((i * 2654435761u) % 4096) / 4096.0f;
+
+		std::array<float, SLOTS> inputs;
+		inputs.fill(1.0f);
+		bench.Run("incremental/full/12", [&](size_t iterations)
+		{
+			float sum = 0.0f;
+			for (size_t i = 0; i < iterations; i++)
+			{
+				inputs[i % SLOTS] = values[i % POINTS];
+				sum += evaluator.Evaluate(inputs);
+			}
+			g_sink = sum;
+		});
+		for (size_t changed : { size_t(1), size_t(2), size_t(4) })
+		{
+			MathEval::incremental_evaluator incremental = evaluator.CreateIncremental();
+			bench.Run("incremental/" + std::to_string(changed) + "of12", [&](size_t iterations)
+			{
+				float sum = 0.0f;
+				for (size_t i = 0; i < iterations; i++)
+				{
+					for (size_t k = 0; k < changed; k++)
+						inputs[(i * 5 + k * 3) % SLOTS] = values[(i + k) % POINTS];
+					sum += incremental.Evaluate(inputs.data());
+				}
+				g_sink = sum;
+			});
+		}
+	}
+
+	// n expressions built from a small pool of subexpressions, like a set of derived columns over one record
+	void Multi(runner& bench, size_t n)
+	{
+		static const size_t POINTS = 4096;
+		static const char* pool[] = { "sin(a*b)", "exp(c/(1+d*d))", "a/b", "cos(c-d)", "a*b*c", "exp(0-a*a)" };
+		std::vector<std::string> texts;
+		for (size_t k = 0; k < n; k++)
+		{
+			texts.push_back(std::string(pool[k % 6]) + "*" + std::to_string(k + 1) + " + " + pool[(k * 7 + 3) % 6]
+				+ " - " + pool[(k * 5 + 1) % 6] + "/" + std::to_string(k + 2));
+		}
+		std::unordered_map<std::string, size_t> definition = Definition();
+		MathEvaluatorOptions options;
+		options.cache_capacity = 0;
+		std::vector<std::unique_ptr<MathEvaluator<4>>> separate;
+		for (const std::string& text : texts)
+			separate.emplace_back(new MathEvaluator<4>(text, definition, options));
+		MultiMathEvaluator<4> fused(texts, definition, options);
+
+		std::vector<std::array<float, 4>> rows = Points(POINTS);
+		std::vector<float> outputs(n);
+		std::string suffix = "/" + std::to_string(n);
+		bench.Run("multi/separate" + suffix, [&](size_t iterations)
+		{
+			for (size_t i = 0; i < iterations; i++)
+			{
+				for (size_t k = 0; k < n; k++)
+					outputs[k] = separate[k]->Evaluate(rows[i % POINTS]);
+			}
+			g_sink = outputs[0];
+		});
+		bench.Run("multi/fused" + suffix, [&](size_t iterations)
+		{
+			for (size_t i = 0; i < iterations; i++)
+				fused.Evaluate(rows[i % POINTS], outputs.data());
+			g_sink = outputs[0];
+		});
+
+		std::vector<float> columns[4];
+		for (size_t s = 0; s < 4; s++)
+		{
+			columns[s].resize(POINTS);
+			for (size_t i = 0; i < POINTS; i++)
+				columns[s][i] = rows[i][s];
+		}
+		std::array<const float*, 4> pointers = { columns[0].data(), columns[1].data(), columns[2].data(), columns[3].data() };
+		std::vector<std::vector<float>> output_columns(n, std::vector<float>(POINTS));
+		std::vector<float*> output_pointers;
+		for (std::vector<float>& column : output_columns)
+			output_pointers.push_back(column.data());
+		bench.Run("multi/separate_batch" + suffix, [&](size_t iterations)
+		{
+			for (size_t i = 0; i < iterations; i++)
+			{
+				for (size_t k = 0; k < n; k++)
+					separate[k]->EvaluateBatch(pointers, output_pointers[k], POINTS);
+			}
+			g_sink = output_pointers[0][0];
+		}, POINTS);
+		bench.Run("multi/fused_batch" + suffix, [&](size_t iterations)
+		{
+			for (size_t i = 0; i < iterations; i++)
+				fused.EvaluateBatch(pointers, output_pointers.data(), POINTS);
+			g_sink = output_pointers[0][0];
+		}, POINTS);
+	}
+
+	void Bulk(runner& bench, const std::vector<corpus_entry>& corpus)
+	{
+		static const size_t COUNT = 1024;
+		std::vector<std::string> texts;
+		for (size_t i = 0; i < COUNT; i++)
+			texts.push_back(corpus[i % corpus.size()].text + (i % 8 == 7 ? " +" : ""));
+		std::unordered_map<std::string, size_t> definition = Definition();
+		MathEval::compile_options options;
+		bench.Run("bulk/serial", [&](size_t iterations)
+		{
+			size_t compiled = 0;
+			for (size_t i = 0; i < iterations; i++)
+			{
+				for (const std::string& text : texts)
+					compiled += MathEval::TryCompileExpression(text, definition, 4, options).Ok();
+			}
+			g_sink = static_cast<float>(compiled);
+		}, COUNT);
+		bench.Run("bulk/pool", [&](size_t iterations)
+		{
+			size_t compiled = 0;
+			for (size_t i = 0; i < iterations; i++)
+			{
+				for (const MathEval::compile_result& result : MathEval::CompileBulk(texts, definition, 4, options))
+					compiled += result.Ok();
+			}
+			g_sink = static_cast<float>(compiled);
+		}, COUNT);
+	}
+
+	void Interval(runner& bench, const corpus_entry& e)
+	{
+		std::unordered_map<std::string, size_t> definition = Definition();
+		MathEvaluatorOptions options;
+		options.cache_capacity = 0;
+		MathEvaluator<4> evaluator(e.text, definition, options);
+		std::array<MathEval::interval, 4> box;
+		box.fill({ 0.1f, 2.0f });
+		bench.Run("interval/eval/" + e.name, [&](size_t iterations)
+		{
+			float sum = 0.0f;
+			for (size_t i = 0; i < iterations; i++)
+				sum += evaluator.EvaluateInterval(box).hi;
+			g_sink = sum;
+		});
+		std::array<float, 4> middle;
+		middle.fill(1.05f);
+		float threshold = evaluator.Evaluate(middle);
+		MathEval::box_search_options search;
+		search.max_boxes = 4096;
+		bench.Run("interval/search/" + e.name, [&](size_t iterations)
+		{
+			size_t leaves = 0;
+			for (size_t i = 0; i < iterations; i++)
+				leaves += evaluator.FindCrossings(box, threshold, search).size();
+			g_sink = static_cast<float>(leaves);
+		});
+	}
+}
+
+int main(int argc, char** argv)
+{
+	settings config;
+	for (int i = 1; i < argc; i++)
+	{
+		if (!std::strcmp(argv[i], "--json") && i + 1 < argc)
+			config.json = argv[++i];
+		else if (!std::strcmp(argv[i], "--filter") && i + 1 < argc)
+			config.filter = argv[++i];
+		else if (!std::strcmp(argv[i], "--quick"))
+		{
+			config.sample_seconds = 0.002;
+			config.samples = 5;
+		}
+		else
+		{
+			std::cerr << "usage: " << argv[0] << " [--json file] [--filter substring] [--quick]\n";
+			return 1;
+		}
+	}
+
+	MathEvaluator<4>::Setup();
+	runner bench(config);
+	std::cout << std::left << std::setw(44) << "case" << std::right << std::setw(12) << "median ns" << std::setw(12) << "min ns" << std::setw(10) << "stddev" << "\n";
+	std::vector<corpus_entry> corpus = Corpus();
+	for (const corpus_entry& e : corpus)
+		FrontEnd(bench, e);
+	for (const corpus_entry& e : corpus)
+		Evaluation(bench, e);
+	for (const corpus_entry& e : corpus)
+		Batch(bench, e);
+	for (const corpus_entry& e : corpus)
+		Precision(bench, e);
+	for (const corpus_entry& e : corpus)
+		Grid(bench, e);
+	for (const corpus_entry& e : corpus)
+		Incremental(bench, e);
+	IncrementalWide(bench);
+	Multi(bench, 8);
+	Multi(bench, 40);
+	Bulk(bench, corpus);
+	for (const corpus_entry& e : corpus)
+		Interval(bench, e);
+
+	if (!config.json.empty())
+	{
+		std::ofstream out(config.json);
+		if (!out)
+		{
+			std::cerr << "can't write " << config.json << "\n";
+			return 1;
+		}
+		bench.WriteJson(out);
+	}
+	return 0;
+}
+
+#endif /* MATH_EVAL_BENCHMARK_MAIN */
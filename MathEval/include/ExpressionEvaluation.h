@@ -3,36 +3,81 @@
 #define EXPRESSION_EVALUATION_H
 
 #include "../src/parser.h"
+#include "../src/static_parser.h"
+#include "../src/optimizer.h"
+#include "../src/bytecode.h"
+#include "../src/batch.h"
+#include "../src/jit.h"
+#include "../src/autodiff.h"
+#include "../src/thread_pool.h"
+#include "../src/eval_cache.h"
+#include "../src/registry.h"
+#include "../src/interval.h"
+#include "../src/grid.h"
+#include "../src/incremental.h"
+#include "../src/multi_expression.h"
+#include "../src/serialize.h"
+#include "../src/bulk_compile.h"
+#ifdef MATH_EVAL_PROFILE
+#include "../src/profiler.h"
+#endif
 #include <unordered_map>
+#include <atomic>
+#include <memory>
+#include <chrono>
 #include <string>
 #include <vector>
 #include <functional>
 #include <math.h>
 #include <numeric>    // for std::accumulate
+#include <stdexcept>
 
 
 
-// Custom hash function for std::array<float, S>
-template<std::size_t S>
-struct std::hash<std::array<float, S>> {
-    std::size_t operator()(const std::array<float, S>& arr) const {
-        std::size_t seed = 0;
-        for (const float& val : arr) {
-            // Combine the hash of each element with the seed using a prime number
-            seed ^= std::hash<float>{}(val)+0x9e3779b9 + (seed << 6) + (seed >> 2);
-        }
-        return seed;
-    }
-};
-
 // overload computation funcs
 float add(float t1, float t2);
 float sub(float t1, float t2);
 float mult(float t1, float t2);
 float divide(float t1, float t2);
+float power(float t1, float t2);
 float func_exp(float t1);
 float func_sin(float t1);
 float func_cos(float t1);
+float func_tan(float t1);
+float func_arcsin(float t1);
+float func_arccos(float t1);
+float func_arctan(float t1);
+float func_minus(float t1);
+float func_sqrt(float t1);
+
+// construction time knobs, the defaults never change what Evaluate returns; folding computes constant exp/sin/cos
+// with the scalar functions of precision, so under DEFAULT EvaluateBatch gets libm's value for sin(1) where its
+// polynomial runs for sin(a) at a = 1
+struct MathEvaluatorOptions
+{
+    // fold constant subtrees and drop identities like x*1 (see optimizer.h)
+    bool fold_constants = true;
+    // also allow rewrites that can change NaN/inf/-0 results, ie: x*0 -> 0
+    bool relaxed_fp = false;
+    // share identical subtrees so each one is computed once per evaluation
+    bool eliminate_common_subexpressions = true;
+    // compile to native x86-64 code (see jit.h), quietly stays on the interpreter where that isn't possible
+    bool jit = false;
+    // exp/sin/cos: DEFAULT is libm for Evaluate and fast polynomials for EvaluateBatch, EXACT is libm everywhere,
+    // ULP1/ULP2/ULP4 use the same bounded polynomials everywhere (see fast_math.h for the error bounds)
+    // EvaluateWithGradient follows Evaluate, EvaluateTree stays on libm whatever this is, tan/arcsin/arccos/arctan
+    // are libm everywhere but EvaluateBatch under DEFAULT
+    MathEval::precision precision = MathEval::precision::DEFAULT;
+    // Evaluate(inputs, true) memo, fixed size and allocated by the first store, 0 turns it off (see eval_cache.h)
+    size_t cache_capacity = 4096;
+    MathEval::cache_policy cache_policy = MathEval::cache_policy::CLOCK;
+    // the cache is split into this many independently locked shards so concurrent Evaluate calls don't queue
+    // on one lock, 0 sizes it from the hardware thread count, 1 is a single lock
+    size_t cache_shards = 0;
+    // evaluators of the same expression (same text up to whitespace, same slot per variable, same knobs above)
+    // share one compiled copy through this, nullptr compiles a private one
+    MathEval::expression_registry* registry = &MathEval::expression_registry::GetDefault();
+};
 
 // Evaluates arbitrary math functions
 template <size_t S>
@@ -41,17 +86,75 @@ class MathEvaluator
 public:
 	MathEvaluator() = delete;
 	// function_inputs corresponds string -> idx, idx element of (0, S-1)
-	MathEvaluator(const std::string& math_expr_input, std::unordered_map<std::string, size_t>& function_inputs);
-    ~MathEvaluator();
+	// throws Lexer::syntax_error (lexer.h) for malformed text, std::out_of_range for a variable it can't map and
+	// std::length_error for text nested too deep (Lexer::grammar::MAX_DEPTH),
+	// MathEval::CompileBulk (bulk_compile.h) compiles many at once and reports errors per expression instead
+	MathEvaluator(const std::string& math_expr_input, std::unordered_map<std::string, size_t>& function_inputs, const MathEvaluatorOptions& options = MathEvaluatorOptions());
+	// an expression compiled earlier, ie: loaded from an archive (serialize.h) with no parsing at all
+	// only the cache knobs of options apply, throws std::invalid_argument if it was compiled for more than S inputs
+	MathEvaluator(std::shared_ptr<const MathEval::compiled_expression> compiled, const MathEvaluatorOptions& options = MathEvaluatorOptions());
+    ~MathEvaluator() = default;
+	// safe to call from several threads at once, the cache is sharded behind per-shard locks
 	float Evaluate(const std::array<float, S>& inputs, bool store = false);
+	// evaluates count points at once, columns[idx] holds count values of input idx
+	// picks the widest simd kernel the cpu supports, doesn't touch the cache
+	void EvaluateBatch(const std::array<const float*, S>& columns, float* output, size_t count) const;
+	// EvaluateBatch split over a thread pool, output is bit-identical to EvaluateBatch whatever the scheduling
+	// chunk 0 picks the chunk size from how long a probe batch took on the first call
+	void EvaluateParallel(const std::array<const float*, S>& columns, float* output, size_t count,
+		MathEval::thread_pool& pool = MathEval::thread_pool::GetDefault(), size_t chunk = 0) const;
+	// value plus the partial derivative for every input slot in one pass, gradient[idx] is d/d input idx
+	// costs a few evaluations whatever S is: forward mode while S is small, reverse mode over the expression DAG above that
+	float EvaluateWithGradient(const std::array<float, S>& inputs, std::array<float, S>& gradient) const;
+	// batch version, gradient[idx] gets count partials of input idx (nullptr skips it)
+	// runs on the EvaluateBatch kernels, so output matches EvaluateBatch rather than Evaluate
+	void EvaluateBatchWithGradient(const std::array<const float*, S>& columns, float* output, const std::array<float*, S>& gradient, size_t count) const;
+	// range holding every value Evaluate gives (and the exact one) for inputs anywhere inside box, see interval.h
+	MathEval::interval EvaluateInterval(const std::array<MathEval::interval, S>& box) const;
+	// pieces of box where the output may cross threshold, the rest of the box is proven above or below it
+	std::vector<std::array<MathEval::interval, S>> FindCrossings(const std::array<MathEval::interval, S>& box, float threshold,
+		const MathEval::box_search_options& options = MathEval::box_search_options(), MathEval::box_search_stats* stats = nullptr) const;
+	// every point of a grid, axes[0] the outermost loop, one axis per input slot (grid.h)
+	// output gets the product of the steps floats, row-major with the last axis contiguous
+	// subexpressions are computed once per step of the innermost axis they depend on instead of once per point
+	void EvaluateGrid(const std::array<MathEval::grid_axis, S>& axes, float* output) const;
+	// evaluator for call sequences that change a few inputs at a time, only what depends on the changed inputs
+	// is recomputed (incremental.h); one per thread, same results as Evaluate
+	inline MathEval::incremental_evaluator CreateIncremental() const { return MathEval::incremental_evaluator(m_compiled, S); }
+	// walks the parsed tree directly, kept as a reference for the compiled program
+	float EvaluateTree(const std::array<float, S>& inputs);
+	inline const MathEval::program& GetProgram() const { return m_compiled->prog; }
+	inline const MathEval::program& GetGradientProgram() const { return m_compiled->gradient_program; }
+	inline const Lexer::optimize_stats& GetOptimizeStats() const { return m_compiled->optimize_stats; }
+	inline const std::shared_ptr<const MathEval::compiled_expression>& GetCompiled() const { return m_compiled; }
+	inline bool IsJitCompiled() const { return m_compiled->jit.IsCompiled(); }
+	// hits/misses/evictions/probe lengths of the Evaluate cache, compare hits against misses to see if caching pays off
+	MathEval::cache_stats GetCacheStats() const;
+	// drops every entry and zeroes the counters, a profile in progress still reports the cache from its start
+	void ClearCache();
+#ifdef MATH_EVAL_PROFILE
+	// from here on Evaluate goes through a profiler (profiler.h) on the interpreter, never the jit: every evaluation is
+	// counted and one in sample_period has each instruction timed, starting again drops what was collected
+	// not safe while other threads are inside Evaluate, Evaluate itself stays safe
+	void StartProfiling(uint32_t sample_period = MathEval::expression_profiler::DEFAULT_SAMPLE_PERIOD);
+	// Evaluate is back on its usual path, the profile is kept for Explain
+	void StopProfiling();
+	// EXPLAIN style report of the profile: the tree annotated with costs, totals per opcode and how the cache did
+	// over the same time, as text or json; throws std::logic_error if profiling never started
+	std::string Explain(bool json = false) const;
+#endif
 	static void Setup(void);
 private:
-	Lexer::parser* m_pParser;
-	Lexer::tree_node* m_root;
-	std::unordered_map<std::array<float, S>, float> m_cache;
-    std::unordered_map<std::string, float> m_cache_constants;
-    void ConvertConstantsToFloats();
-	std::unordered_map<std::string, size_t> *m_function_inputs;
+	// tree, programs and jit code, possibly shared with every other evaluator of the same expression (registry.h)
+	std::shared_ptr<const MathEval::compiled_expression> m_compiled;
+	MathEval::sharded_cache<S> m_cache;
+	mutable std::atomic<float> m_parallel_ns_per_point{ 0.0f }; // measured by the first EvaluateParallel, 0 until then
+#ifdef MATH_EVAL_PROFILE
+	std::unique_ptr<MathEval::expression_profiler> m_profiler; // nullptr until StartProfiling
+	bool m_profiling = false;
+	MathEval::cache_stats m_profile_cache_start; // cache counters when profiling started
+	MathEval::cache_stats m_profile_cache_stop; // and when it stopped
+#endif
 	// function pointer array
 	// 2-parameter functions
 	static std::vector<std::function<float(float, float)>> s_twoParameterFunctions;
@@ -59,7 +162,14 @@ private:
 	static std::vector<std::function<float(float)>> s_oneParameterFunctions;
 
 private: // herlper functions
-	float Evaluate_recursive(const std::array<float, S>&, Lexer::tree_node* curr);
+	float Evaluate_recursive(const std::array<float, S>&, uint32_t curr);
+	float Evaluate_program(const std::array<float, S>&) const;
+	// programs with more registers than this spill their register file to the heap
+	static constexpr uint32_t MAX_STACK_REGISTERS = 64;
+	// up to this many inputs a gradient carries S tangents forward, past it one backward sweep is cheaper
+	static constexpr size_t FORWARD_GRADIENT_MAX_SLOTS = 4;
+	// points EvaluateParallel times on the calling thread before picking a chunk size
+	static constexpr size_t PARALLEL_PROBE_POINTS = 1024;
 
 private: // functions
 };
@@ -71,19 +181,29 @@ template <size_t S>
 std::vector<std::function<float(float)>> MathEvaluator<S>::s_oneParameterFunctions;
 
 template <size_t S>
-MathEvaluator<S>::~MathEvaluator()
+MathEvaluator<S>::MathEvaluator(const std::string& math_expr_input, std::unordered_map<std::string, size_t>& function_inputs, const MathEvaluatorOptions& options)
+    : m_cache(options.cache_capacity, options.cache_policy, options.cache_shards)
 {
-    if (m_pParser)
-        delete m_pParser;
+    MathEval::compile_options compile;
+    compile.fold_constants = options.fold_constants;
+    compile.relaxed_fp = options.relaxed_fp;
+    compile.eliminate_common_subexpressions = options.eliminate_common_subexpressions;
+    compile.jit = options.jit;
+    compile.precision = options.precision;
+    if (options.registry)
+        m_compiled = options.registry->Get(math_expr_input, function_inputs, S, compile);
+    else
+        m_compiled = MathEval::CompileExpression(math_expr_input, function_inputs, S, compile);
 }
 
 template <size_t S>
-MathEvaluator<S>::MathEvaluator(const std::string& math_expr_input, std::unordered_map<std::string, size_t>& function_inputs)
+MathEvaluator<S>::MathEvaluator(std::shared_ptr<const MathEval::compiled_expression> compiled, const MathEvaluatorOptions& options)
+    : m_compiled(std::move(compiled)), m_cache(options.cache_capacity, options.cache_policy, options.cache_shards)
 {
-    m_pParser = new Lexer::parser(math_expr_input);
-    m_root = m_pParser->parse();
-    m_function_inputs = &function_inputs;
-    ConvertConstantsToFloats();
+    if (!m_compiled)
+        throw std::invalid_argument("MathEvaluator: no compiled expression");
+    if (m_compiled->number_of_slots > S)
+        throw std::invalid_argument("MathEvaluator: expression compiled for " + std::to_string(m_compiled->number_of_slots) + " inputs");
 }
 
 
@@ -91,94 +211,239 @@ template <size_t S>
 float MathEvaluator<S>::Evaluate(const std::array<float, S>& inputs, bool store)
 {
     // check cache
-    if (m_cache.find(inputs) != m_cache.end())
-    {
-        return m_cache.at(inputs);
-    }
+    float cached;
+    if (m_cache.Find(inputs, cached))
+        return cached;
 
     // compute
-    float result = Evaluate_recursive(inputs, m_root);
+#ifdef MATH_EVAL_PROFILE
+    float result = m_profiling ? m_profiler->Evaluate(inputs.data())
+        : (m_compiled->jit.IsCompiled() ? m_compiled->jit.Evaluate(inputs.data()) : Evaluate_program(inputs));
+#else
+    float result = m_compiled->jit.IsCompiled() ? m_compiled->jit.Evaluate(inputs.data()) : Evaluate_program(inputs);
+#endif
 
     // cache if store
     if (store)
     {
-        m_cache[inputs] = result;
+        m_cache.Insert(inputs, result);
     }
     return result;
 }
 
 template <size_t S>
-float MathEvaluator<S>::Evaluate_recursive(const std::array<float, S>& inputs, Lexer::tree_node* curr)
+MathEval::cache_stats MathEvaluator<S>::GetCacheStats() const
 {
-    float result;
-    // either binary operation or function operation on single variable input
-    if (curr->type == Lexer::node_type::BINARY_OP)
+    return m_cache.GetStats();
+}
+
+template <size_t S>
+void MathEvaluator<S>::ClearCache()
+{
+#ifdef MATH_EVAL_PROFILE
+    // the counters start again from 0, a profile in progress keeps what it counted so far by moving its start
+    // back by that much (unsigned, so end - start in Explain wraps round to the right totals)
+    if (m_profiling)
     {
-        float L = Evaluate_recursive(inputs, curr->binary_op.lhs);
-        float R = Evaluate_recursive(inputs, curr->binary_op.rhs);
-        // L op R
-        result = s_twoParameterFunctions.at(static_cast<int>(curr->binary_op.op_type))(L, R);
+        MathEval::cache_stats now = m_cache.GetStats();
+        m_profile_cache_start.hits -= now.hits;
+        m_profile_cache_start.misses -= now.misses;
+        m_profile_cache_start.insertions -= now.insertions;
+        m_profile_cache_start.evictions -= now.evictions;
+        m_profile_cache_start.probes -= now.probes;
     }
+#endif
+    m_cache.Clear();
+}
+
+#ifdef MATH_EVAL_PROFILE
+template <size_t S>
+void MathEvaluator<S>::StartProfiling(uint32_t sample_period)
+{
+    m_profiler = std::make_unique<MathEval::expression_profiler>(m_compiled, sample_period);
+    m_profile_cache_start = m_cache.GetStats();
+    m_profiling = true;
+}
+
+template <size_t S>
+void MathEvaluator<S>::StopProfiling()
+{
+    if (!m_profiling)
+        return;
+    m_profiling = false;
+    m_profile_cache_stop = m_cache.GetStats();
+}
+
+template <size_t S>
+std::string MathEvaluator<S>::Explain(bool json) const
+{
+    if (!m_profiler)
+        throw std::logic_error("MathEvaluator: Explain before StartProfiling");
+    const MathEval::cache_stats& end = m_profiling ? m_cache.GetStats() : m_profile_cache_stop;
+    MathEval::cache_stats cache;
+    cache.hits = end.hits - m_profile_cache_start.hits;
+    cache.misses = end.misses - m_profile_cache_start.misses;
+    cache.insertions = end.insertions - m_profile_cache_start.insertions;
+    cache.evictions = end.evictions - m_profile_cache_start.evictions;
+    cache.probes = end.probes - m_profile_cache_start.probes;
+    cache.max_probe = end.max_probe;
+    return json ? m_profiler->ExplainJson(&cache) : m_profiler->Explain(&cache);
+}
+#endif
+
+template <size_t S>
+void MathEvaluator<S>::EvaluateBatch(const std::array<const float*, S>& columns, float* output, size_t count) const
+{
+    if (m_compiled->jit.IsBatchCompiled())
+        m_compiled->jit.EvaluateBatch(columns.data(), output, count);
     else
+        MathEval::RunBatch(m_compiled->prog, columns.data(), output, count, MathEval::GetSupportedIsa(), m_compiled->precision);
+}
+
+template <size_t S>
+void MathEvaluator<S>::EvaluateParallel(const std::array<const float*, S>& columns, float* output, size_t count, MathEval::thread_pool& pool, size_t chunk) const
+{
+    size_t done = 0;
+    if (chunk == 0)
     {
-        // either NUM or single operation
-        Lexer::unary_op operation = curr->prefix_op.op;
-        if (operation == Lexer::unary_op::NUM_OP || operation == Lexer::unary_op::ID_OP)
+        float ns_per_point = m_parallel_ns_per_point.load(std::memory_order_relaxed);
+        if (ns_per_point == 0.0f && count != 0)
         {
-            // plug in number if ID, else float NUM 
-            if (operation == Lexer::unary_op::NUM_OP)
-            {
-                result = m_cache_constants.at(*(curr->prefix_op.lexeme));
-            }
-            else
-            {
-                // shouldn't run but avoids the exception
-                if (m_function_inputs->find(*(curr->prefix_op.lexeme)) == m_function_inputs->end())
-                {
-                    __debugbreak();
-                }
-
-                result = inputs[m_function_inputs->at(*(curr->prefix_op.lexeme))];
-            }
-        }
-        else
-        {
-            // compute child then op(CHILD)
-            float child = Evaluate_recursive(inputs, curr->prefix_op.next);
-            // op(child)
-            result = s_oneParameterFunctions.at(static_cast<int>(curr->prefix_op.op))(child);
+            // time the first points here, their results are kept
+            done = count < PARALLEL_PROBE_POINTS ? count : PARALLEL_PROBE_POINTS;
+            auto start = std::chrono::steady_clock::now();
+            EvaluateBatch(columns, output, done);
+            double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            ns_per_point = static_cast<float>(elapsed / done);
+            if (ns_per_point <= 0.0f)
+                ns_per_point = 0.01f;
+            m_parallel_ns_per_point.store(ns_per_point, std::memory_order_relaxed);
         }
+        chunk = MathEval::AutoChunkSize(ns_per_point, count - done, pool.GetNumOfThreads());
     }
 
+    // every chunk writes its own slice of output, so the ordering never depends on which thread ran it
+    pool.ParallelFor(count - done, chunk, [&](size_t begin, size_t end)
+    {
+        std::array<const float*, S> slice;
+        for (size_t s = 0; s < S; s++)
+            slice[s] = columns[s] ? columns[s] + done + begin : nullptr;
+        EvaluateBatch(slice, output + done + begin, end - begin);
+    });
+}
+
+template <size_t S>
+float MathEvaluator<S>::EvaluateWithGradient(const std::array<float, S>& inputs, std::array<float, S>& gradient) const
+{
+    if constexpr (S <= FORWARD_GRADIENT_MAX_SLOTS)
+        return MathEval::ForwardGradient<S>(m_compiled->prog, inputs.data(), gradient.data(), m_compiled->precision);
+    else
+        return MathEval::RunGradient(m_compiled->gradient_program, inputs.data(), gradient.data(), S, m_compiled->precision);
+}
+
+template <size_t S>
+void MathEvaluator<S>::EvaluateBatchWithGradient(const std::array<const float*, S>& columns, float* output, const std::array<float*, S>& gradient, size_t count) const
+{
+    MathEval::RunGradientBatch(m_compiled->gradient_program, columns.data(), output, gradient.data(), S, count, MathEval::GetSupportedIsa(), m_compiled->precision);
+}
+
+template <size_t S>
+MathEval::interval MathEvaluator<S>::EvaluateInterval(const std::array<MathEval::interval, S>& box) const
+{
+    return MathEval::RunInterval(m_compiled->prog, box.data(), m_compiled->precision);
+}
+
+template <size_t S>
+std::vector<std::array<MathEval::interval, S>> MathEvaluator<S>::FindCrossings(const std::array<MathEval::interval, S>& box, float threshold,
+    const MathEval::box_search_options& options, MathEval::box_search_stats* stats) const
+{
+    std::vector<MathEval::interval> leaves;
+    MathEval::box_search_stats local_stats;
+    MathEval::box_search_stats& search_stats = stats ? *stats : local_stats;
+    size_t leaves_before = search_stats.leaves; // the caller's stats may add up several searches
+    MathEval::SearchBoxes(m_compiled->prog, m_compiled->precision, box.data(), S, threshold, options, leaves, search_stats);
+    std::vector<std::array<MathEval::interval, S>> result(search_stats.leaves - leaves_before);
+    for (size_t i = 0; i < result.size(); i++)
+        std::copy(leaves.begin() + i * S, leaves.begin() + (i + 1) * S, result[i].begin());
     return result;
 }
 
 template <size_t S>
-void  MathEvaluator<S>::ConvertConstantsToFloats()
+void MathEvaluator<S>::EvaluateGrid(const std::array<MathEval::grid_axis, S>& axes, float* output) const
+{
+    MathEval::RunGrid(m_compiled->gradient_program, axes.data(), S, output, MathEval::GetSupportedIsa(), m_compiled->precision);
+}
+
+template <size_t S>
+float MathEvaluator<S>::EvaluateTree(const std::array<float, S>& inputs)
+{
+    return Evaluate_recursive(inputs, m_compiled->root);
+}
+
+template <size_t S>
+float MathEvaluator<S>::Evaluate_program(const std::array<float, S>& inputs) const
 {
-    std::queue<Lexer::tree_node*> q;
-    q.push(m_root);
-    while (!q.empty())
+    // every register is written before it's read (program checks that), gcc can't see it through the switch and
+    // warns at every includer, zeroing 256 bytes is cheaper than one instruction of most programs
+    float stack_registers[MAX_STACK_REGISTERS] = {};
+    std::vector<float> heap_registers;
+    float* reg = stack_registers;
+    if (m_compiled->prog.GetNumOfRegisters() > MAX_STACK_REGISTERS)
     {
-        // check top of queue
-        auto n = q.front();
-        q.pop();
+        heap_registers.resize(m_compiled->prog.GetNumOfRegisters());
+        reg = heap_registers.data();
+    }
 
-        // recursive call
-        if (n->type == Lexer::node_type::BINARY_OP)
-        {
-            q.push(n->binary_op.lhs);
-            q.push(n->binary_op.rhs);
-        }
-        else if (n->prefix_op.next != nullptr)
-        {
-            q.push(n->prefix_op.next);
-        }
-        else if (n->prefix_op.op == Lexer::unary_op::NUM_OP)
+    const MathEval::instruction* ip = m_compiled->prog.GetInstructions();
+    const MathEval::instruction* end = ip + m_compiled->prog.GetNumOfInstructions();
+    for (; ip != end; ++ip)
+    {
+        switch (ip->op)
         {
-            m_cache_constants[*(n->prefix_op.lexeme)] = stof(*(n->prefix_op.lexeme));
+        case MathEval::opcode::LOAD_CONST: reg[ip->dst] = ip->constant;                       break;
+        case MathEval::opcode::LOAD_INPUT: reg[ip->dst] = inputs[ip->a];                      break;
+        case MathEval::opcode::ADD:        reg[ip->dst] = add(reg[ip->a], reg[ip->b]);        break;
+        case MathEval::opcode::SUB:        reg[ip->dst] = sub(reg[ip->a], reg[ip->b]);        break;
+        case MathEval::opcode::MULT:       reg[ip->dst] = mult(reg[ip->a], reg[ip->b]);       break;
+        case MathEval::opcode::DIV:        reg[ip->dst] = divide(reg[ip->a], reg[ip->b]);     break;
+        case MathEval::opcode::POW:        reg[ip->dst] = power(reg[ip->a], reg[ip->b]);      break;
+        case MathEval::opcode::EXP:        reg[ip->dst] = m_compiled->exp_function(reg[ip->a]); break;
+        case MathEval::opcode::SIN:        reg[ip->dst] = m_compiled->sin_function(reg[ip->a]); break;
+        case MathEval::opcode::COS:        reg[ip->dst] = m_compiled->cos_function(reg[ip->a]); break;
+        case MathEval::opcode::TAN:        reg[ip->dst] = func_tan(reg[ip->a]);               break;
+        case MathEval::opcode::ARCSIN:     reg[ip->dst] = func_arcsin(reg[ip->a]);            break;
+        case MathEval::opcode::ARCCOS:     reg[ip->dst] = func_arccos(reg[ip->a]);            break;
+        case MathEval::opcode::ARCTAN:     reg[ip->dst] = func_arctan(reg[ip->a]);            break;
+        case MathEval::opcode::MINUS:      reg[ip->dst] = func_minus(reg[ip->a]);             break;
+        case MathEval::opcode::SQRT:       reg[ip->dst] = func_sqrt(reg[ip->a]);              break;
+        default:
+            // program() refuses anything else
+            throw std::out_of_range("MathEvaluator: unsupported operation");
         }
     }
+    return reg[m_compiled->prog.GetResultRegister()];
+}
+
+template <size_t S>
+float MathEvaluator<S>::Evaluate_recursive(const std::array<float, S>& inputs, uint32_t curr)
+{
+    const Lexer::tree_node& node = m_compiled->tree[curr];
+    // either binary operation or function operation on single variable input
+    if (node.type == Lexer::node_type::BINARY_OP)
+    {
+        float L = Evaluate_recursive(inputs, node.lhs);
+        float R = Evaluate_recursive(inputs, node.rhs);
+        // L op R
+        return s_twoParameterFunctions.at(static_cast<int>(node.op_type))(L, R);
+    }
+    // constants and slots were resolved when the evaluator was built
+    if (node.op == Lexer::unary_op::NUM_OP)
+        return node.constant;
+    if (node.op == Lexer::unary_op::ID_OP)
+        return inputs[node.slot];
+    // compute child then op(CHILD)
+    float child = Evaluate_recursive(inputs, node.next);
+    return s_oneParameterFunctions.at(static_cast<int>(node.op))(child);
 }
 
 // overload computation funcs
@@ -202,6 +467,12 @@ inline float divide(float t1, float t2)
     return t1 / t2;
 }
 
+// a multiply chain for small integer exponents, see MathEval::Power (fast_math.h)
+inline float power(float t1, float t2)
+{
+    return MathEval::Power(t1, t2);
+}
+
 inline float func_exp(float t1)
 {
     return expf(t1);
@@ -217,6 +488,36 @@ inline float func_cos(float t1)
     return cosf(t1);
 }
 
+inline float func_tan(float t1)
+{
+    return tanf(t1);
+}
+
+inline float func_arcsin(float t1)
+{
+    return asinf(t1);
+}
+
+inline float func_arccos(float t1)
+{
+    return acosf(t1);
+}
+
+inline float func_arctan(float t1)
+{
+    return atanf(t1);
+}
+
+inline float func_minus(float t1)
+{
+    return -t1;
+}
+
+inline float func_sqrt(float t1)
+{
+    return sqrtf(t1);
+}
+
 
 
 // setup function pointers used during function evaluation
@@ -225,24 +526,154 @@ void MathEvaluator<S>::Setup(void)
 {
     /*
       EXP_OP, SIN_OP, COS_OP, TAN_OP,
-      ARCSIN_OP, ARCCOS_OP, ARCTAN_OP, MINUS_OP,
+      ARCSIN_OP, ARCCOS_OP, ARCTAN_OP, MINUS_OP, SQRT_OP,
       NUM_OP, ID_OP,
     */
-    // TODO
     s_oneParameterFunctions.push_back(func_exp);
     s_oneParameterFunctions.push_back(func_sin);
     s_oneParameterFunctions.push_back(func_cos);
-    //m_oneParameterFunctions.push_back(func_tan);
-    //m_oneParameterFunctions.push_back(func_arcsin);
-    //m_oneParameterFunctions.push_back(func_arccos);
-    //m_oneParameterFunctions.push_back(func_arctan);
-    //m_oneParameterFunctions.push_back(func_minus);
+    s_oneParameterFunctions.push_back(func_tan);
+    s_oneParameterFunctions.push_back(func_arcsin);
+    s_oneParameterFunctions.push_back(func_arccos);
+    s_oneParameterFunctions.push_back(func_arctan);
+    s_oneParameterFunctions.push_back(func_minus);
+    s_oneParameterFunctions.push_back(func_sqrt);
 
     s_twoParameterFunctions.push_back(add);
     s_twoParameterFunctions.push_back(sub);
     s_twoParameterFunctions.push_back(mult);
     s_twoParameterFunctions.push_back(divide);
+    s_twoParameterFunctions.push_back(power);
 }
 
+/*
+ a set of expressions over the same inputs evaluated as one program (multi_expression.h): subexpressions are shared
+ across the whole set and one pass writes every output, instead of one evaluator, tree and traversal per expression
+ outputs[k] is expressions[k], results match a MathEvaluator per expression built with the same options
+ fold_constants, relaxed_fp, eliminate_common_subexpressions and precision apply, there's no jit or cache
+*/
+template <size_t S>
+class MultiMathEvaluator
+{
+public:
+    MultiMathEvaluator() = delete;
+    MultiMathEvaluator(const std::vector<std::string>& expressions, const std::unordered_map<std::string, size_t>& function_inputs,
+        const MathEvaluatorOptions& options = MathEvaluatorOptions());
+
+    inline size_t GetNumOfOutputs() const { return m_compiled->roots.size(); }
+    // outputs gets GetNumOfOutputs() floats
+    inline void Evaluate(const std::array<float, S>& inputs, float* outputs) const { MathEval::RunMulti(*m_compiled, inputs.data(), outputs); }
+    // outputs[k] gets count values of expression k, on the same kernels as MathEvaluator::EvaluateBatch
+    void EvaluateBatch(const std::array<const float*, S>& columns, float* const* outputs, size_t count) const;
+
+    inline const MathEval::program& GetProgram() const { return m_compiled->prog; }
+    inline const std::shared_ptr<const MathEval::compiled_multi_expression>& GetCompiled() const { return m_compiled; }
+    // nodes one evaluator per expression would run against the nodes of the shared program
+    inline size_t GetSeparateNodes() const { return m_compiled->separate_nodes; }
+    inline size_t GetSharedNodes() const { return m_compiled->shared_nodes; }
+private:
+    std::shared_ptr<const MathEval::compiled_multi_expression> m_compiled;
+};
+
+template <size_t S>
+MultiMathEvaluator<S>::MultiMathEvaluator(const std::vector<std::string>& expressions, const std::unordered_map<std::string, size_t>& function_inputs,
+    const MathEvaluatorOptions& options)
+{
+    MathEval::compile_options compile;
+    compile.fold_constants = options.fold_constants;
+    compile.relaxed_fp = options.relaxed_fp;
+    compile.eliminate_common_subexpressions = options.eliminate_common_subexpressions;
+    compile.precision = options.precision;
+    m_compiled = MathEval::CompileExpressions(expressions, function_inputs, S, compile);
+}
+
+template <size_t S>
+void MultiMathEvaluator<S>::EvaluateBatch(const std::array<const float*, S>& columns, float* const* outputs, size_t count) const
+{
+    MathEval::RunBatchMulti(m_compiled->prog, columns.data(), outputs, count, MathEval::GetSupportedIsa(), m_compiled->precision);
+}
+
+/*
+ compile time counterpart of MathEvaluator, for expressions known when building
+ E is a type with
+   static constexpr std::string_view text = "sin(a)*b + 2";
+   static constexpr std::string_view vars[] = { "a", "b" }; // vars[i] reads input slot i
+ text goes through the same lexer and grammar as MathEvaluator while compiling (static_parser.h),
+ every node becomes its own type and Evaluate inlines to straight-line code, nothing is parsed or walked at runtime
+ a syntax error or an unknown variable fails the build
+ scalar and batch both call the same functions Evaluate does, so results match MathEvaluator<S>::Evaluate
+*/
+template <class E, size_t S>
+class StaticMathEvaluator
+{
+public:
+    static constexpr size_t NUMBER_OF_VARS = sizeof(E::vars) / sizeof(E::vars[0]);
+    static_assert(NUMBER_OF_VARS <= S, "StaticMathEvaluator: more variables than input slots");
+    static constexpr Lexer::static_tree<E::text.size() + 1> tree = Lexer::ParseStatic<E::text.size() + 1>(E::text, E::vars, NUMBER_OF_VARS);
+
+    static inline float Evaluate(const std::array<float, S>& inputs) { return node<tree.root>::Evaluate(inputs); }
+    // columns[slot] points at count floats, plain loop for the compiler to unroll/vectorize
+    static void EvaluateBatch(const std::array<const float*, S>& columns, float* output, size_t count);
+private:
+    template <uint32_t I>
+    struct node;
+
+    // one point of a batch, indexed like the inputs array
+    struct column_point
+    {
+        const std::array<const float*, S>& columns;
+        size_t i;
+        inline float operator[](size_t slot) const { return columns[slot][i]; }
+    };
+};
+
+template <class E, size_t S>
+template <uint32_t I>
+struct StaticMathEvaluator<E, S>::node
+{
+    static constexpr Lexer::static_node n = tree.nodes[I];
+
+    template <class In>
+    static inline float Evaluate(const In& inputs)
+    {
+        if constexpr (n.type == Lexer::node_type::BINARY_OP)
+        {
+            float L = node<n.lhs>::Evaluate(inputs);
+            float R = node<n.rhs>::Evaluate(inputs);
+            if constexpr (n.op_type == Lexer::bin_op::ADD_OP) return add(L, R);
+            else if constexpr (n.op_type == Lexer::bin_op::SUB_OP) return sub(L, R);
+            else if constexpr (n.op_type == Lexer::bin_op::MULT_OP) return mult(L, R);
+            else if constexpr (n.op_type == Lexer::bin_op::DIV_OP) return divide(L, R);
+            // a constant exponent is known here, so power's branches fold away and a chain unrolls
+            else if constexpr (n.op_type == Lexer::bin_op::POW_OP) return power(L, R);
+            else static_assert(sizeof(In) == 0, "StaticMathEvaluator: unsupported binary operation");
+        }
+        else if constexpr (n.op == Lexer::unary_op::NUM_OP)
+            return n.constant;
+        else if constexpr (n.op == Lexer::unary_op::ID_OP)
+            return inputs[n.slot];
+        else
+        {
+            float child = node<n.lhs>::Evaluate(inputs);
+            if constexpr (n.op == Lexer::unary_op::EXP_OP) return func_exp(child);
+            else if constexpr (n.op == Lexer::unary_op::SIN_OP) return func_sin(child);
+            else if constexpr (n.op == Lexer::unary_op::COS_OP) return func_cos(child);
+            else if constexpr (n.op == Lexer::unary_op::TAN_OP) return func_tan(child);
+            else if constexpr (n.op == Lexer::unary_op::ARCSIN_OP) return func_arcsin(child);
+            else if constexpr (n.op == Lexer::unary_op::ARCCOS_OP) return func_arccos(child);
+            else if constexpr (n.op == Lexer::unary_op::ARCTAN_OP) return func_arctan(child);
+            else if constexpr (n.op == Lexer::unary_op::MINUS_OP) return func_minus(child);
+            else if constexpr (n.op == Lexer::unary_op::SQRT_OP) return func_sqrt(child);
+            else static_assert(sizeof(In) == 0, "StaticMathEvaluator: unsupported operation");
+        }
+    }
+};
+
+template <class E, size_t S>
+void StaticMathEvaluator<E, S>::EvaluateBatch(const std::array<const float*, S>& columns, float* output, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        output[i] = node<tree.root>::Evaluate(column_point{ columns, i });
+}
 
 #endif /* EXPRESSION_EVALUATION_H */
\ No newline at end of file
@@ -0,0 +1,165 @@
+#include <algorithm>
+#include <cstdint>
+#include "autodiff.h"
+#include "batch.h"
+
+namespace MathEval
+{
+
+	void CheckGradientProgram(const program& ssa)
+	{
+		const instruction* ins = ssa.GetInstructions();
+		for (size_t i = 0; i < ssa.GetNumOfInstructions(); i++)
+		{
+			if (ins[i].dst != i)
+				throw std::invalid_argument("autodiff: program reuses registers, build it with reuse_registers = false");
+		}
+	}
+
+	/*
+	 one point, value and adjoint hold n floats
+	 input(slot) reads an input, accumulate(slot, g) adds g to that slot's partial
+	*/
+	template <class Input, class Accumulate>
+	static inline float ReverseSweep(const instruction* ins, size_t n, uint32_t result, Input input, Accumulate accumulate, float* value, float* adjoint,
+		unary_function exp_function, unary_function sin_function, unary_function cos_function)
+	{
+		// forward sweep, register i is instruction i
+		for (size_t i = 0; i < n; i++)
+		{
+			const instruction& in = ins[i];
+			switch (in.op)
+			{
+			case opcode::LOAD_CONST: value[i] = in.constant;                    break;
+			case opcode::LOAD_INPUT: value[i] = input(in.a);                    break;
+			case opcode::ADD:        value[i] = value[in.a] + value[in.b];      break;
+			case opcode::SUB:        value[i] = value[in.a] - value[in.b];      break;
+			case opcode::MULT:       value[i] = value[in.a] * value[in.b];      break;
+			case opcode::DIV:        value[i] = value[in.a] / value[in.b];      break;
+			case opcode::POW:        value[i] = Power(value[in.a], value[in.b]); break;
+			case opcode::EXP:        value[i] = exp_function(value[in.a]);      break;
+			case opcode::SIN:        value[i] = sin_function(value[in.a]);      break;
+			case opcode::COS:        value[i] = cos_function(value[in.a]);      break;
+			default:                 value[i] = UnaryValue(in.op, value[in.a]); break;
+			}
+			adjoint[i] = 0.0f;
+		}
+
+		adjoint[result] = 1.0f;
+		// backward sweep, every parent comes after its operands so an adjoint is complete when it's reached
+		for (size_t i = n; i-- > 0;)
+		{
+			const instruction& in = ins[i];
+			float g = adjoint[i];
+			switch (in.op)
+			{
+			case opcode::LOAD_CONST:
+				break;
+			case opcode::LOAD_INPUT:
+				accumulate(in.a, g);
+				break;
+			case opcode::ADD:
+				adjoint[in.a] += g;
+				adjoint[in.b] += g;
+				break;
+			case opcode::SUB:
+				adjoint[in.a] += g;
+				adjoint[in.b] -= g;
+				break;
+			case opcode::MULT:
+				adjoint[in.a] += g * value[in.b];
+				adjoint[in.b] += g * value[in.a];
+				break;
+			case opcode::DIV:
+				adjoint[in.a] += g / value[in.b];
+				adjoint[in.b] -= g * value[i] / value[in.b];
+				break;
+			case opcode::POW:
+			{
+				float da, db;
+				PowerDerivatives(value[in.a], value[in.b], value[i], da, db);
+				adjoint[in.a] += g * da;
+				adjoint[in.b] += g * db;
+				break;
+			}
+			default:
+				adjoint[in.a] += g * UnaryDerivative(in.op, value[in.a], value[i], sin_function, cos_function);
+				break;
+			}
+		}
+		return value[result];
+	}
+
+	float RunGradient(const program& ssa, const float* inputs, float* gradient, size_t number_of_slots, precision p)
+	{
+		static constexpr size_t MAX_STACK_INSTRUCTIONS = 128;
+		float stack_scratch[2 * MAX_STACK_INSTRUCTIONS];
+		std::vector<float> heap_scratch;
+		size_t n = ssa.GetNumOfInstructions();
+		float* scratch = stack_scratch;
+		if (n > MAX_STACK_INSTRUCTIONS)
+		{
+			heap_scratch.resize(2 * n);
+			scratch = heap_scratch.data();
+		}
+		std::fill(gradient, gradient + number_of_slots, 0.0f);
+		return ReverseSweep(ssa.GetInstructions(), n, ssa.GetResultRegister(),
+			[inputs](uint32_t slot) { return inputs[slot]; },
+			[gradient](uint32_t slot, float g) { gradient[slot] += g; },
+			scratch, scratch + n, GetUnaryFunction(opcode::EXP, p), GetUnaryFunction(opcode::SIN, p), GetUnaryFunction(opcode::COS, p));
+	}
+
+	// point by point, same numbers as RunGradient
+	void RunGradientScalar(const instruction* ins, size_t n, uint32_t result, const float* const* columns, float* output,
+		float* const* gradient, size_t number_of_slots, size_t count, float* scratch, precision p)
+	{
+		unary_function exp_function = GetUnaryFunction(opcode::EXP, p);
+		unary_function sin_function = GetUnaryFunction(opcode::SIN, p);
+		unary_function cos_function = GetUnaryFunction(opcode::COS, p);
+		for (size_t i = 0; i < count; i++)
+		{
+			for (size_t s = 0; s < number_of_slots; s++)
+			{
+				if (gradient[s])
+					gradient[s][i] = 0.0f;
+			}
+			output[i] = ReverseSweep(ins, n, result,
+				[columns, i](uint32_t slot) { return columns[slot][i]; },
+				[gradient, i](uint32_t slot, float g) { if (gradient[slot]) gradient[slot][i] += g; },
+				scratch, scratch + n, exp_function, sin_function, cos_function);
+		}
+	}
+
+	void RunGradientBatch(const program& ssa, const float* const* columns, float* output, float* const* gradient, size_t number_of_slots, size_t count)
+	{
+		RunGradientBatch(ssa, columns, output, gradient, number_of_slots, count, GetSupportedIsa());
+	}
+
+	void RunGradientBatch(const program& ssa, const float* const* columns, float* output, float* const* gradient, size_t number_of_slots, size_t count, isa target, precision p)
+	{
+		if (count == 0)
+			return;
+		if (target > GetSupportedIsa())
+			target = GetSupportedIsa();
+		// ops without a lane kernel go one point at a time
+		if (!IsBatchSupported(ssa))
+			target = isa::SCALAR;
+
+		size_t n = ssa.GetNumOfInstructions();
+		size_t width = GetIsaWidth(target);
+		std::vector<float> scratch_memory(2 * n * width + 16);
+		uintptr_t address = reinterpret_cast<uintptr_t>(scratch_memory.data());
+		float* scratch = scratch_memory.data() + ((64 - (address & 63)) & 63) / sizeof(float);
+
+		const instruction* ins = ssa.GetInstructions();
+		uint32_t result = ssa.GetResultRegister();
+		switch (target)
+		{
+		case isa::AVX512: RunGradientAvx512(ins, n, result, columns, output, gradient, number_of_slots, count, scratch, p); break;
+		case isa::AVX2:   RunGradientAvx2(ins, n, result, columns, output, gradient, number_of_slots, count, scratch, p);   break;
+		case isa::SSE4:   RunGradientSse4(ins, n, result, columns, output, gradient, number_of_slots, count, scratch, p);   break;
+		default:          RunGradientScalar(ins, n, result, columns, output, gradient, number_of_slots, count, scratch, p); break;
+		}
+	}
+
+};
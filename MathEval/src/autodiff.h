@@ -0,0 +1,184 @@
+#pragma once
+#ifndef AUTODIFF_H
+#define AUTODIFF_H
+
+#include "bytecode.h"
+#include "batch.h"
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+namespace MathEval
+{
+	/*
+	 value and every partial derivative of a program in one go
+	 reverse mode: one sweep forward keeping every intermediate value, one sweep backwards pushing
+	 d(result)/d(register) down to the inputs, about 3 evaluations worth of work whatever the number of inputs.
+	 needs a program built without register reuse (program(tree, root, false)), shared subtrees get
+	 the adjoints of all their parents added up
+	 forward mode (ForwardGradient below) carries S tangents through a normal program instead,
+	 no tape, so it wins while S is small
+	 values come out of the same float ops and exp/sin/cos Evaluate uses for the precision, so they match it bit for bit,
+	 the partials of the two modes can differ in the last bit (they sum in a different order)
+	*/
+
+	// throws std::invalid_argument if ssa reuses registers
+	void CheckGradientProgram(const program& ssa);
+
+	// gradient gets number_of_slots partials, slots the program never reads get 0
+	float RunGradient(const program& ssa, const float* inputs, float* gradient, size_t number_of_slots, precision p = precision::DEFAULT);
+
+	/*
+	 columns[slot] holds count values, output gets count values, gradient[slot] count partials (nullptr skips the slot)
+	 runs on the same simd kernels as RunBatch, so output matches RunBatch for the isa and precision and the partials of
+	 exp/sin/cos come from the same polynomials; programs with ops the kernels lack go point by point as in RunGradient
+	*/
+	void RunGradientBatch(const program& ssa, const float* const* columns, float* output, float* const* gradient, size_t number_of_slots, size_t count);
+	void RunGradientBatch(const program& ssa, const float* const* columns, float* output, float* const* gradient, size_t number_of_slots, size_t count,
+		isa target, precision p = precision::DEFAULT);
+
+	// derivative of a unary op at x where y = op(x), sin/cos from GetUnaryFunction for the precision
+	inline float UnaryDerivative(opcode op, float x, float y, unary_function sin_function, unary_function cos_function)
+	{
+		switch (op)
+		{
+		case opcode::EXP:    return y;
+		case opcode::SIN:    return cos_function(x);
+		case opcode::COS:    return -sin_function(x);
+		case opcode::TAN:    return 1.0f + y * y;
+		case opcode::ARCSIN: return 1.0f / sqrtf(1.0f - x * x);
+		case opcode::ARCCOS: return -1.0f / sqrtf(1.0f - x * x);
+		case opcode::ARCTAN: return 1.0f / (1.0f + x * x);
+		case opcode::MINUS:  return -1.0f;
+		case opcode::SQRT:   return 0.5f / y;
+		default: throw std::out_of_range("autodiff: unsupported operation");
+		}
+	}
+
+	inline float UnaryValue(opcode op, float x)
+	{
+		switch (op)
+		{
+		case opcode::EXP:    return expf(x);
+		case opcode::SIN:    return sinf(x);
+		case opcode::COS:    return cosf(x);
+		case opcode::TAN:    return tanf(x);
+		case opcode::ARCSIN: return asinf(x);
+		case opcode::ARCCOS: return acosf(x);
+		case opcode::ARCTAN: return atanf(x);
+		case opcode::MINUS:  return -x;
+		case opcode::SQRT:   return sqrtf(x);
+		default: throw std::out_of_range("autodiff: unsupported operation");
+		}
+	}
+
+	// partials of y = Power(a, b), d/db is y*ln(a) and only exists for a > 0, where y is 0 it's taken as 0
+	inline void PowerDerivatives(float a, float b, float y, float& da, float& db)
+	{
+		da = b * Power(a, b - 1.0f);
+		db = y == 0.0f ? 0.0f : y * logf(a);
+	}
+
+	// forward mode, any program, S known at compile time so the tangent loops unroll
+	template <size_t S>
+	float ForwardGradient(const program& prog, const float* inputs, float* gradient, precision p = precision::DEFAULT)
+	{
+		unary_function exp_function = GetUnaryFunction(opcode::EXP, p);
+		unary_function sin_function = GetUnaryFunction(opcode::SIN, p);
+		unary_function cos_function = GetUnaryFunction(opcode::COS, p);
+		static constexpr uint32_t MAX_STACK_REGISTERS = 32;
+		float stack_value[MAX_STACK_REGISTERS];
+		float stack_tangent[MAX_STACK_REGISTERS * S];
+		std::vector<float> heap;
+		float* value = stack_value;
+		float* tangent = stack_tangent;
+		uint32_t registers = prog.GetNumOfRegisters();
+		if (registers > MAX_STACK_REGISTERS)
+		{
+			heap.resize(registers * (S + 1));
+			value = heap.data();
+			tangent = heap.data() + registers;
+		}
+
+		const instruction* ins = prog.GetInstructions();
+		for (size_t i = 0, n = prog.GetNumOfInstructions(); i < n; i++)
+		{
+			const instruction& in = ins[i];
+			float* dt = tangent + in.dst * S;
+			// operands are read before dst is written, dst may reuse an operand's register
+			switch (in.op)
+			{
+			case opcode::LOAD_CONST:
+				value[in.dst] = in.constant;
+				for (size_t k = 0; k < S; k++) dt[k] = 0.0f;
+				break;
+			case opcode::LOAD_INPUT:
+				value[in.dst] = inputs[in.a];
+				for (size_t k = 0; k < S; k++) dt[k] = k == in.a ? 1.0f : 0.0f;
+				break;
+			case opcode::ADD:
+			case opcode::SUB:
+			case opcode::MULT:
+			case opcode::DIV:
+			case opcode::POW:
+			{
+				float a = value[in.a], b = value[in.b];
+				const float* ta = tangent + in.a * S;
+				const float* tb = tangent + in.b * S;
+				float y;
+				float r[S];
+				if (in.op == opcode::ADD)
+				{
+					y = a + b;
+					for (size_t k = 0; k < S; k++) r[k] = ta[k] + tb[k];
+				}
+				else if (in.op == opcode::SUB)
+				{
+					y = a - b;
+					for (size_t k = 0; k < S; k++) r[k] = ta[k] - tb[k];
+				}
+				else if (in.op == opcode::MULT)
+				{
+					y = a * b;
+					for (size_t k = 0; k < S; k++) r[k] = ta[k] * b + a * tb[k];
+				}
+				else if (in.op == opcode::DIV)
+				{
+					y = a / b;
+					for (size_t k = 0; k < S; k++) r[k] = (ta[k] - y * tb[k]) / b;
+				}
+				else
+				{
+					// a partial that doesn't exist (ie: d/db with a < 0) only counts where that operand moves
+					y = Power(a, b);
+					float da, db;
+					PowerDerivatives(a, b, y, da, db);
+					for (size_t k = 0; k < S; k++) r[k] = (ta[k] != 0.0f ? da * ta[k] : 0.0f) + (tb[k] != 0.0f ? db * tb[k] : 0.0f);
+				}
+				value[in.dst] = y;
+				for (size_t k = 0; k < S; k++) dt[k] = r[k];
+				break;
+			}
+			default:
+			{
+				float x = value[in.a];
+				float y = in.op == opcode::EXP ? exp_function(x)
+					: in.op == opcode::SIN ? sin_function(x)
+					: in.op == opcode::COS ? cos_function(x) : UnaryValue(in.op, x);
+				float d = UnaryDerivative(in.op, x, y, sin_function, cos_function);
+				const float* ta = tangent + in.a * S;
+				value[in.dst] = y;
+				for (size_t k = 0; k < S; k++) dt[k] = d * ta[k];
+				break;
+			}
+			}
+		}
+		const float* result = tangent + prog.GetResultRegister() * S;
+		for (size_t k = 0; k < S; k++)
+			gradient[k] = result[k];
+		return value[prog.GetResultRegister()];
+	}
+};
+
+#endif // AUTODIFF_H
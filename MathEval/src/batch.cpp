@@ -0,0 +1,234 @@
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+#include "batch.h"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+namespace MathEval
+{
+
+	static isa DetectIsa()
+	{
+#if defined(__x86_64__) || defined(__i386__)
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx512f"))
+			return isa::AVX512;
+		if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+			return isa::AVX2;
+		if (__builtin_cpu_supports("sse4.1"))
+			return isa::SSE4;
+		return isa::SCALAR;
+#elif defined(_M_X64) || defined(_M_IX86)
+		int info[4];
+		__cpuid(info, 0);
+		int max_leaf = info[0];
+		__cpuid(info, 1);
+		bool sse41 = (info[2] & (1 << 19)) != 0;
+		bool fma = (info[2] & (1 << 12)) != 0;
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		bool avx = (info[2] & (1 << 28)) != 0;
+		// the os has to save the wider registers on context switches too
+		unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+		bool os_ymm = (xcr0 & 0x6) == 0x6;
+		bool os_zmm = (xcr0 & 0xE6) == 0xE6;
+		bool avx2 = false, avx512f = false;
+		if (max_leaf >= 7)
+		{
+			__cpuidex(info, 7, 0);
+			avx2 = (info[1] & (1 << 5)) != 0;
+			avx512f = (info[1] & (1 << 16)) != 0;
+		}
+		if (avx512f && os_zmm)
+			return isa::AVX512;
+		if (avx && avx2 && fma && os_ymm)
+			return isa::AVX2;
+		if (sse41)
+			return isa::SSE4;
+		return isa::SCALAR;
+#else
+		return isa::SCALAR;
+#endif
+	}
+
+	isa GetSupportedIsa()
+	{
+		static const isa supported = DetectIsa();
+		return supported;
+	}
+
+	const char* GetIsaName(isa target)
+	{
+		switch (target)
+		{
+		case isa::SSE4:   return "sse4.1";
+		case isa::AVX2:   return "avx2";
+		case isa::AVX512: return "avx512";
+		default:          return "scalar";
+		}
+	}
+
+	size_t GetIsaWidth(isa target)
+	{
+		switch (target)
+		{
+		case isa::SSE4:   return 4;
+		case isa::AVX2:   return 8;
+		case isa::AVX512: return 16;
+		default:          return 1;
+		}
+	}
+
+	bool IsBatchSupported(const program& prog)
+	{
+		const instruction* ins = prog.GetInstructions();
+		for (size_t i = 0; i < prog.GetNumOfInstructions(); i++)
+		{
+			switch (ins[i].op)
+			{
+			case opcode::LOAD_CONST:
+			case opcode::LOAD_INPUT:
+			case opcode::ADD:
+			case opcode::SUB:
+			case opcode::MULT:
+			case opcode::DIV:
+			case opcode::POW:
+			case opcode::EXP:
+			case opcode::SIN:
+			case opcode::COS:
+			case opcode::TAN:
+			case opcode::ARCSIN:
+			case opcode::ARCCOS:
+			case opcode::ARCTAN:
+			case opcode::MINUS:
+			case opcode::SQRT:
+				break;
+			default:
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void RunBatch(const program& prog, const float* const* columns, float* output, size_t count)
+	{
+		RunBatch(prog, columns, output, count, GetSupportedIsa());
+	}
+
+	void RunBatch(const program& prog, const float* const* columns, float* output, size_t count, isa target, precision p)
+	{
+		if (!IsBatchSupported(prog))
+			throw std::out_of_range("RunBatch: unsupported operation");
+		if (count == 0)
+			return;
+		if (target > GetSupportedIsa())
+			target = GetSupportedIsa();
+
+		// one register is width floats, over-allocate so the register file can start on a 64 byte boundary
+		size_t width = GetIsaWidth(target);
+		std::vector<float> scratch_memory(static_cast<size_t>(prog.GetNumOfRegisters()) * width + 16);
+		uintptr_t address = reinterpret_cast<uintptr_t>(scratch_memory.data());
+		float* scratch = scratch_memory.data() + ((64 - (address & 63)) & 63) / sizeof(float);
+
+		const instruction* ins = prog.GetInstructions();
+		size_t n = prog.GetNumOfInstructions();
+		uint32_t result = prog.GetResultRegister();
+		switch (target)
+		{
+		case isa::AVX512: RunBatchAvx512(ins, n, result, columns, output, count, scratch, p); break;
+		case isa::AVX2:   RunBatchAvx2(ins, n, result, columns, output, count, scratch, p);   break;
+		case isa::SSE4:   RunBatchSse4(ins, n, result, columns, output, count, scratch, p);   break;
+		default:          RunBatchScalar(ins, n, result, columns, output, count, scratch, p); break;
+		}
+	}
+
+	void RunBatchMulti(const program& prog, const float* const* columns, float* const* outputs, size_t count, isa target, precision p)
+	{
+		if (!IsBatchSupported(prog))
+			throw std::out_of_range("RunBatchMulti: unsupported operation");
+		if (count == 0)
+			return;
+		if (target > GetSupportedIsa())
+			target = GetSupportedIsa();
+
+		size_t width = GetIsaWidth(target);
+		std::vector<float> scratch_memory(static_cast<size_t>(prog.GetNumOfRegisters()) * width + 16);
+		uintptr_t address = reinterpret_cast<uintptr_t>(scratch_memory.data());
+		float* scratch = scratch_memory.data() + ((64 - (address & 63)) & 63) / sizeof(float);
+
+		const instruction* ins = prog.GetInstructions();
+		size_t n = prog.GetNumOfInstructions();
+		const uint32_t* results = prog.GetResultRegisters().data();
+		size_t number_of_results = prog.GetResultRegisters().size();
+		switch (target)
+		{
+		case isa::AVX512: RunBatchMultiAvx512(ins, n, results, number_of_results, columns, outputs, count, scratch, p); break;
+		case isa::AVX2:   RunBatchMultiAvx2(ins, n, results, number_of_results, columns, outputs, count, scratch, p);   break;
+		case isa::SSE4:   RunBatchMultiSse4(ins, n, results, number_of_results, columns, outputs, count, scratch, p);   break;
+		default:          RunBatchMultiScalar(ins, n, results, number_of_results, columns, outputs, count, scratch, p); break;
+		}
+	}
+
+	// one point of the scalar fallback, every register is left in reg
+	static inline void RunScalarPoint(const instruction* ins, size_t n, const float* const* columns, size_t i, float* reg,
+		unary_function exp_function, unary_function sin_function, unary_function cos_function)
+	{
+		for (size_t k = 0; k < n; k++)
+		{
+			const instruction& in = ins[k];
+			switch (in.op)
+			{
+			case opcode::LOAD_CONST: reg[in.dst] = in.constant;                 break;
+			case opcode::LOAD_INPUT: reg[in.dst] = columns[in.a][i];            break;
+			case opcode::ADD:        reg[in.dst] = reg[in.a] + reg[in.b];       break;
+			case opcode::SUB:        reg[in.dst] = reg[in.a] - reg[in.b];       break;
+			case opcode::MULT:       reg[in.dst] = reg[in.a] * reg[in.b];       break;
+			case opcode::DIV:        reg[in.dst] = reg[in.a] / reg[in.b];       break;
+			case opcode::EXP:        reg[in.dst] = exp_function(reg[in.a]);     break;
+			case opcode::SIN:        reg[in.dst] = sin_function(reg[in.a]);     break;
+			case opcode::COS:        reg[in.dst] = cos_function(reg[in.a]);     break;
+			case opcode::POW:        reg[in.dst] = Power(reg[in.a], reg[in.b]); break;
+			// no precision modes for the rest, see GetUnaryFunction
+			case opcode::TAN:        reg[in.dst] = tanf(reg[in.a]);             break;
+			case opcode::ARCSIN:     reg[in.dst] = asinf(reg[in.a]);            break;
+			case opcode::ARCCOS:     reg[in.dst] = acosf(reg[in.a]);            break;
+			case opcode::ARCTAN:     reg[in.dst] = atanf(reg[in.a]);            break;
+			case opcode::MINUS:      reg[in.dst] = -reg[in.a];                  break;
+			case opcode::SQRT:       reg[in.dst] = sqrtf(reg[in.a]);            break;
+			default: break;
+			}
+		}
+	}
+
+	// scalar fallback, same results as MathEvaluator::Evaluate point by point
+	void RunBatchScalar(const instruction* ins, size_t n, uint32_t result, const float* const* columns, float* output, size_t count, float* reg, precision p)
+	{
+		unary_function exp_function = GetUnaryFunction(opcode::EXP, p);
+		unary_function sin_function = GetUnaryFunction(opcode::SIN, p);
+		unary_function cos_function = GetUnaryFunction(opcode::COS, p);
+		for (size_t i = 0; i < count; i++)
+		{
+			RunScalarPoint(ins, n, columns, i, reg, exp_function, sin_function, cos_function);
+			output[i] = reg[result];
+		}
+	}
+
+	void RunBatchMultiScalar(const instruction* ins, size_t n, const uint32_t* results, size_t number_of_results, const float* const* columns,
+		float* const* outputs, size_t count, float* reg, precision p)
+	{
+		unary_function exp_function = GetUnaryFunction(opcode::EXP, p);
+		unary_function sin_function = GetUnaryFunction(opcode::SIN, p);
+		unary_function cos_function = GetUnaryFunction(opcode::COS, p);
+		for (size_t i = 0; i < count; i++)
+		{
+			RunScalarPoint(ins, n, columns, i, reg, exp_function, sin_function, cos_function);
+			for (size_t k = 0; k < number_of_results; k++)
+				outputs[k][i] = reg[results[k]];
+		}
+	}
+
+};
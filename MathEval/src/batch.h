@@ -0,0 +1,75 @@
+#pragma once
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "bytecode.h"
+#include "fast_math.h"
+#include <cstddef>
+
+namespace MathEval
+{
+	// instruction sets the batch interpreter has kernels for, ordered from slowest to fastest
+	enum class isa : char
+	{
+		SCALAR = 0, SSE4, AVX2, AVX512,
+	};
+
+	// best instruction set this cpu (and os) supports, detected once
+	isa GetSupportedIsa();
+	const char* GetIsaName(isa);
+	// number of points a kernel handles per step
+	size_t GetIsaWidth(isa);
+
+	/*
+	 evaluates prog for count points
+	 columns[slot] points at count floats for that input slot, output gets count floats
+	 requesting an isa the cpu doesn't support falls back to the best supported one
+	 p picks how exp/sin/cos are computed (fast_math.h)
+	*/
+	void RunBatch(const program& prog, const float* const* columns, float* output, size_t count);
+	void RunBatch(const program& prog, const float* const* columns, float* output, size_t count, isa target, precision p = precision::DEFAULT);
+
+	// every result of a program with several roots (multi_expression.h), outputs[k] gets count values of result k
+	void RunBatchMulti(const program& prog, const float* const* columns, float* const* outputs, size_t count, isa target, precision p = precision::DEFAULT);
+
+	// true if every opcode in prog has a batch kernel
+	bool IsBatchSupported(const program& prog);
+
+	// kernel entry points, one per translation unit
+	// scratch holds GetNumOfRegisters() * width floats, aligned to 64 bytes
+	void RunBatchScalar(const instruction* ins, size_t n, uint32_t result, const float* const* columns, float* output, size_t count, float* scratch, precision p);
+	void RunBatchSse4(const instruction* ins, size_t n, uint32_t result, const float* const* columns, float* output, size_t count, float* scratch, precision p);
+	void RunBatchAvx2(const instruction* ins, size_t n, uint32_t result, const float* const* columns, float* output, size_t count, float* scratch, precision p);
+	void RunBatchAvx512(const instruction* ins, size_t n, uint32_t result, const float* const* columns, float* output, size_t count, float* scratch, precision p);
+
+	// results[k] goes to outputs[k], number_of_results of them
+	void RunBatchMultiScalar(const instruction* ins, size_t n, const uint32_t* results, size_t number_of_results, const float* const* columns,
+		float* const* outputs, size_t count, float* scratch, precision p);
+	void RunBatchMultiSse4(const instruction* ins, size_t n, const uint32_t* results, size_t number_of_results, const float* const* columns,
+		float* const* outputs, size_t count, float* scratch, precision p);
+	void RunBatchMultiAvx2(const instruction* ins, size_t n, const uint32_t* results, size_t number_of_results, const float* const* columns,
+		float* const* outputs, size_t count, float* scratch, precision p);
+	void RunBatchMultiAvx512(const instruction* ins, size_t n, const uint32_t* results, size_t number_of_results, const float* const* columns,
+		float* const* outputs, size_t count, float* scratch, precision p);
+
+	// reverse mode gradient kernels (see autodiff.h), ins is a program built without register reuse
+	// gradient[slot] gets count partials (nullptr skips the slot), scratch holds 2 * n * width floats, aligned to 64 bytes
+	void RunGradientScalar(const instruction* ins, size_t n, uint32_t result, const float* const* columns, float* output,
+		float* const* gradient, size_t number_of_slots, size_t count, float* scratch, precision p);
+	void RunGradientSse4(const instruction* ins, size_t n, uint32_t result, const float* const* columns, float* output,
+		float* const* gradient, size_t number_of_slots, size_t count, float* scratch, precision p);
+	void RunGradientAvx2(const instruction* ins, size_t n, uint32_t result, const float* const* columns, float* output,
+		float* const* gradient, size_t number_of_slots, size_t count, float* scratch, precision p);
+	void RunGradientAvx512(const instruction* ins, size_t n, uint32_t result, const float* const* columns, float* output,
+		float* const* gradient, size_t number_of_slots, size_t count, float* scratch, precision p);
+
+	// avx2 exp/sin/cos on 8 floats in place, the jit calls these so it matches the avx2 kernel
+	void ExpAvx2(float* values);
+	void SinAvx2(float* values);
+	void CosAvx2(float* values);
+	// the same under precision p, ExpAvx2/SinAvx2/CosAvx2 for DEFAULT
+	typedef void (*unary_block_function)(float*);
+	unary_block_function GetUnaryAvx2(opcode op, precision p);
+};
+
+#endif // BATCH_H
@@ -0,0 +1,224 @@
+#include "batch.h"
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#include <immintrin.h>
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx2,fma"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+#endif
+
+#include "batch_kernel.h"
+
+namespace MathEval
+{
+	struct avx2_lane
+	{
+		using reg = __m256;
+		using ireg = __m256i;
+		static constexpr size_t WIDTH = 8;
+
+		static inline reg load(const float* p) { return _mm256_loadu_ps(p); }
+		static inline void store(float* p, reg v) { _mm256_storeu_ps(p, v); }
+		static inline reg load_partial(const float* p, size_t n)
+		{
+			alignas(32) float buf[WIDTH] = {};
+			memcpy(buf, p, n * sizeof(float));
+			return _mm256_load_ps(buf);
+		}
+		static inline void store_partial(float* p, reg v, size_t n)
+		{
+			alignas(32) float buf[WIDTH];
+			_mm256_store_ps(buf, v);
+			memcpy(p, buf, n * sizeof(float));
+		}
+		static inline reg broadcast(float f) { return _mm256_set1_ps(f); }
+
+		static inline reg add(reg a, reg b) { return _mm256_add_ps(a, b); }
+		static inline reg sub(reg a, reg b) { return _mm256_sub_ps(a, b); }
+		static inline reg mul(reg a, reg b) { return _mm256_mul_ps(a, b); }
+		static inline reg div(reg a, reg b) { return _mm256_div_ps(a, b); }
+		static inline reg fmadd(reg a, reg b, reg c) { return _mm256_fmadd_ps(a, b, c); }
+		static inline reg fnmadd(reg a, reg b, reg c) { return _mm256_fnmadd_ps(a, b, c); }
+		static inline reg min(reg a, reg b) { return _mm256_min_ps(a, b); }
+		static inline reg max(reg a, reg b) { return _mm256_max_ps(a, b); }
+		static inline reg floor(reg a) { return _mm256_floor_ps(a); }
+		static inline reg abs(reg a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+		static inline reg xor_(reg a, reg b) { return _mm256_xor_ps(a, b); }
+		static inline reg sqrt(reg a) { return _mm256_sqrt_ps(a); }
+
+		static inline ireg cvtt(reg a) { return _mm256_cvttps_epi32(a); }
+		static inline reg to_float(ireg a) { return _mm256_cvtepi32_ps(a); }
+		static inline ireg iadd(ireg a, int b) { return _mm256_add_epi32(a, _mm256_set1_epi32(b)); }
+		static inline ireg iand(ireg a, int b) { return _mm256_and_si256(a, _mm256_set1_epi32(b)); }
+		static inline ireg iandnot(ireg a, int b) { return _mm256_andnot_si256(a, _mm256_set1_epi32(b)); }
+		template <int N>
+		static inline ireg shl(ireg a) { return _mm256_slli_epi32(a, N); }
+		static inline reg as_float(ireg a) { return _mm256_castsi256_ps(a); }
+
+		static inline reg select_if_zero(ireg i, reg a, reg b)
+		{
+			__m256 zero = _mm256_castsi256_ps(_mm256_cmpeq_epi32(i, _mm256_setzero_si256()));
+			return _mm256_blendv_ps(b, a, zero);
+		}
+		static inline reg select_if_less(reg x, float limit, reg a, reg b)
+		{
+			return _mm256_blendv_ps(b, a, _mm256_cmp_ps(x, _mm256_set1_ps(limit), _CMP_LT_OQ));
+		}
+		static inline unsigned outside(reg x, float lo, float hi)
+		{
+			__m256 inside = _mm256_and_ps(_mm256_cmp_ps(x, _mm256_set1_ps(lo), _CMP_GE_OQ), _mm256_cmp_ps(x, _mm256_set1_ps(hi), _CMP_LE_OQ));
+			return static_cast<unsigned>(~_mm256_movemask_ps(inside)) & 0xFFu;
+		}
+		static inline reg reduce(reg x, reg& k, reg& lo, double inverse, double c1, double c2, double c3)
+		{
+			__m256d k0, k1;
+			__m256d r0 = reduce_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(x)), k0, inverse, c1, c2, c3);
+			__m256d r1 = reduce_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(x, 1)), k1, inverse, c1, c2, c3);
+			__m128 h0 = _mm256_cvtpd_ps(r0), h1 = _mm256_cvtpd_ps(r1);
+			k = _mm256_set_m128(_mm256_cvtpd_ps(k1), _mm256_cvtpd_ps(k0));
+			lo = _mm256_set_m128(_mm256_cvtpd_ps(_mm256_sub_pd(r1, _mm256_cvtps_pd(h1))), _mm256_cvtpd_ps(_mm256_sub_pd(r0, _mm256_cvtps_pd(h0))));
+			return _mm256_set_m128(h1, h0);
+		}
+	private:
+		static inline __m256d reduce_pd(__m256d x, __m256d& k, double inverse, double c1, double c2, double c3)
+		{
+			k = _mm256_floor_pd(_mm256_add_pd(_mm256_mul_pd(x, _mm256_set1_pd(inverse)), _mm256_set1_pd(0.5)));
+			__m256d r = _mm256_sub_pd(x, _mm256_mul_pd(k, _mm256_set1_pd(c1)));
+			r = _mm256_sub_pd(r, _mm256_mul_pd(k, _mm256_set1_pd(c2)));
+			return _mm256_sub_pd(r, _mm256_mul_pd(k, _mm256_set1_pd(c3)));
+		}
+	};
+
+	void RunBatchAvx2(const instruction* ins, size_t n, uint32_t result, const float* const* columns, float* output, size_t count, float* scratch, precision p)
+	{
+		RunBatchKernel<avx2_lane>(ins, n, result, columns, output, count, scratch, p);
+	}
+
+	void RunBatchMultiAvx2(const instruction* ins, size_t n, const uint32_t* results, size_t number_of_results, const float* const* columns,
+		float* const* outputs, size_t count, float* scratch, precision p)
+	{
+		RunBatchMultiKernel<avx2_lane>(ins, n, results, number_of_results, columns, outputs, count, scratch, p);
+	}
+
+	void RunGradientAvx2(const instruction* ins, size_t n, uint32_t result, const float* const* columns, float* output,
+		float* const* gradient, size_t number_of_slots, size_t count, float* scratch, precision p)
+	{
+		RunGradientKernel<avx2_lane>(ins, n, result, columns, output, gradient, number_of_slots, count, scratch, p);
+	}
+
+	void ExpAvx2(float* values) { avx2_lane::store(values, lane_math<avx2_lane>::exp(avx2_lane::load(values))); }
+	void SinAvx2(float* values) { avx2_lane::store(values, lane_math<avx2_lane>::sin(avx2_lane::load(values))); }
+	void CosAvx2(float* values) { avx2_lane::store(values, lane_math<avx2_lane>::cos(avx2_lane::load(values))); }
+
+	template <opcode OP, precision P>
+	static void UnaryAvx2(float* values) { avx2_lane::store(values, UnaryLane<avx2_lane>(OP, avx2_lane::load(values), P)); }
+
+	template <precision P>
+	static unary_block_function UnaryAvx2For(opcode op)
+	{
+		switch (op)
+		{
+		case opcode::EXP:    return UnaryAvx2<opcode::EXP, P>;
+		case opcode::SIN:    return UnaryAvx2<opcode::SIN, P>;
+		case opcode::COS:    return UnaryAvx2<opcode::COS, P>;
+		case opcode::TAN:    return UnaryAvx2<opcode::TAN, P>;
+		case opcode::ARCSIN: return UnaryAvx2<opcode::ARCSIN, P>;
+		case opcode::ARCCOS: return UnaryAvx2<opcode::ARCCOS, P>;
+		case opcode::ARCTAN: return UnaryAvx2<opcode::ARCTAN, P>;
+		case opcode::MINUS:  return UnaryAvx2<opcode::MINUS, P>;
+		default:             return UnaryAvx2<opcode::SQRT, P>;
+		}
+	}
+
+	unary_block_function GetUnaryAvx2(opcode op, precision p)
+	{
+		switch (p)
+		{
+		case precision::EXACT: return UnaryAvx2For<precision::EXACT>(op);
+		case precision::ULP1:  return UnaryAvx2For<precision::ULP1>(op);
+		case precision::ULP2:  return UnaryAvx2For<precision::ULP2>(op);
+		case precision::ULP4:  return UnaryAvx2For<precision::ULP4>(op);
+		default:
+			if (op == opcode::EXP || op == opcode::SIN || op == opcode::COS)
+				return op == opcode::EXP ? ExpAvx2 : (op == opcode::SIN ? SinAvx2 : CosAvx2);
+			return UnaryAvx2For<precision::DEFAULT>(op);
+		}
+	}
+};
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+#else // not x86, never selected by GetSupportedIsa
+
+namespace MathEval
+{
+	void RunBatchAvx2(const instruction* ins, size_t n, uint32_t result, const float* const* columns, float* output, size_t count, float* scratch, precision p)
+	{
+		RunBatchScalar(ins, n, result, columns, output, count, scratch, p);
+	}
+
+	void RunBatchMultiAvx2(const instruction* ins, size_t n, const uint32_t* results, size_t number_of_results, const float* const* columns,
+		float* const* outputs, size_t count, float* scratch, precision p)
+	{
+		RunBatchMultiScalar(ins, n, results, number_of_results, columns, outputs, count, scratch, p);
+	}
+
+	void RunGradientAvx2(const instruction* ins, size_t n, uint32_t result, const float* const* columns, float* output,
+		float* const* gradient, size_t number_of_slots, size_t count, float* scratch, precision p)
+	{
+		RunGradientScalar(ins, n, result, columns, output, gradient, number_of_slots, count, scratch, p);
+	}
+
+	void ExpAvx2(float* values) { for (int i = 0; i < 8; i++) values[i] = expf(values[i]); }
+	void SinAvx2(float* values) { for (int i = 0; i < 8; i++) values[i] = sinf(values[i]); }
+	void CosAvx2(float* values) { for (int i = 0; i < 8; i++) values[i] = cosf(values[i]); }
+
+	template <opcode OP, precision P>
+	static void UnaryAvx2(float* values)
+	{
+		unary_function f = GetUnaryFunction(OP, P);
+		for (int i = 0; i < 8; i++) values[i] = f(values[i]);
+	}
+
+	template <precision P>
+	static unary_block_function UnaryAvx2For(opcode op)
+	{
+		switch (op)
+		{
+		case opcode::EXP:    return UnaryAvx2<opcode::EXP, P>;
+		case opcode::SIN:    return UnaryAvx2<opcode::SIN, P>;
+		case opcode::COS:    return UnaryAvx2<opcode::COS, P>;
+		case opcode::TAN:    return UnaryAvx2<opcode::TAN, P>;
+		case opcode::ARCSIN: return UnaryAvx2<opcode::ARCSIN, P>;
+		case opcode::ARCCOS: return UnaryAvx2<opcode::ARCCOS, P>;
+		case opcode::ARCTAN: return UnaryAvx2<opcode::ARCTAN, P>;
+		case opcode::MINUS:  return UnaryAvx2<opcode::MINUS, P>;
+		default:             return UnaryAvx2<opcode::SQRT, P>;
+		}
+	}
+
+	unary_block_function GetUnaryAvx2(opcode op, precision p)
+	{
+		switch (p)
+		{
+		case precision::ULP1: return UnaryAvx2For<precision::ULP1>(op);
+		case precision::ULP2: return UnaryAvx2For<precision::ULP2>(op);
+		case precision::ULP4: return UnaryAvx2For<precision::ULP4>(op);
+		default:
+			if (op == opcode::EXP || op == opcode::SIN || op == opcode::COS)
+				return op == opcode::EXP ? ExpAvx2 : (op == opcode::SIN ? SinAvx2 : CosAvx2);
+			return UnaryAvx2For<precision::DEFAULT>(op);
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,141 @@
+#include "batch.h"
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#include <immintrin.h>
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx512f"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+#endif
+
+#include "batch_kernel.h"
+
+namespace MathEval
+{
+	struct avx512_lane
+	{
+		using reg = __m512;
+		using ireg = __m512i;
+		static constexpr size_t WIDTH = 16;
+
+		static inline reg load(const float* p) { return _mm512_loadu_ps(p); }
+		static inline void store(float* p, reg v) { _mm512_storeu_ps(p, v); }
+		// masked loads/stores never touch memory past n
+		static inline reg load_partial(const float* p, size_t n) { return _mm512_maskz_loadu_ps(static_cast<__mmask16>((1u << n) - 1), p); }
+		static inline void store_partial(float* p, reg v, size_t n) { _mm512_mask_storeu_ps(p, static_cast<__mmask16>((1u << n) - 1), v); }
+		static inline reg broadcast(float f) { return _mm512_set1_ps(f); }
+
+		static inline reg add(reg a, reg b) { return _mm512_add_ps(a, b); }
+		static inline reg sub(reg a, reg b) { return _mm512_sub_ps(a, b); }
+		static inline reg mul(reg a, reg b) { return _mm512_mul_ps(a, b); }
+		static inline reg div(reg a, reg b) { return _mm512_div_ps(a, b); }
+		static inline reg fmadd(reg a, reg b, reg c) { return _mm512_fmadd_ps(a, b, c); }
+		static inline reg fnmadd(reg a, reg b, reg c) { return _mm512_fnmadd_ps(a, b, c); }
+		static inline reg min(reg a, reg b) { return _mm512_min_ps(a, b); }
+		static inline reg max(reg a, reg b) { return _mm512_max_ps(a, b); }
+		static inline reg floor(reg a) { return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+		// float logic ops need avx512dq, go through the integer ones instead
+		static inline reg abs(reg a) { return _mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(a), _mm512_set1_epi32(0x7FFFFFFF))); }
+		static inline reg xor_(reg a, reg b) { return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(a), _mm512_castps_si512(b))); }
+		static inline reg sqrt(reg a) { return _mm512_sqrt_ps(a); }
+
+		static inline ireg cvtt(reg a) { return _mm512_cvttps_epi32(a); }
+		static inline reg to_float(ireg a) { return _mm512_cvtepi32_ps(a); }
+		static inline ireg iadd(ireg a, int b) { return _mm512_add_epi32(a, _mm512_set1_epi32(b)); }
+		static inline ireg iand(ireg a, int b) { return _mm512_and_si512(a, _mm512_set1_epi32(b)); }
+		static inline ireg iandnot(ireg a, int b) { return _mm512_andnot_si512(a, _mm512_set1_epi32(b)); }
+		template <int N>
+		static inline ireg shl(ireg a) { return _mm512_slli_epi32(a, N); }
+		static inline reg as_float(ireg a) { return _mm512_castsi512_ps(a); }
+
+		static inline reg select_if_zero(ireg i, reg a, reg b)
+		{
+			__mmask16 zero = _mm512_cmpeq_epi32_mask(i, _mm512_setzero_si512());
+			return _mm512_mask_blend_ps(zero, b, a);
+		}
+		static inline reg select_if_less(reg x, float limit, reg a, reg b)
+		{
+			return _mm512_mask_blend_ps(_mm512_cmp_ps_mask(x, _mm512_set1_ps(limit), _CMP_LT_OQ), b, a);
+		}
+		static inline unsigned outside(reg x, float lo, float hi)
+		{
+			__mmask16 inside = _mm512_cmp_ps_mask(x, _mm512_set1_ps(lo), _CMP_GE_OQ) & _mm512_cmp_ps_mask(x, _mm512_set1_ps(hi), _CMP_LE_OQ);
+			return static_cast<unsigned>(~inside) & 0xFFFFu;
+		}
+		static inline reg reduce(reg x, reg& k, reg& lo, double inverse, double c1, double c2, double c3)
+		{
+			__m512d k0, k1;
+			__m512d r0 = reduce_pd(_mm512_cvtps_pd(_mm512_castps512_ps256(x)), k0, inverse, c1, c2, c3);
+			__m512d r1 = reduce_pd(_mm512_cvtps_pd(upper(x)), k1, inverse, c1, c2, c3);
+			__m256 h0 = _mm512_cvtpd_ps(r0), h1 = _mm512_cvtpd_ps(r1);
+			k = join(_mm512_cvtpd_ps(k0), _mm512_cvtpd_ps(k1));
+			lo = join(_mm512_cvtpd_ps(_mm512_sub_pd(r0, _mm512_cvtps_pd(h0))), _mm512_cvtpd_ps(_mm512_sub_pd(r1, _mm512_cvtps_pd(h1))));
+			return join(h0, h1);
+		}
+	private:
+		static inline __m512d reduce_pd(__m512d x, __m512d& k, double inverse, double c1, double c2, double c3)
+		{
+			k = _mm512_roundscale_pd(_mm512_add_pd(_mm512_mul_pd(x, _mm512_set1_pd(inverse)), _mm512_set1_pd(0.5)), _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+			__m512d r = _mm512_sub_pd(x, _mm512_mul_pd(k, _mm512_set1_pd(c1)));
+			r = _mm512_sub_pd(r, _mm512_mul_pd(k, _mm512_set1_pd(c2)));
+			return _mm512_sub_pd(r, _mm512_mul_pd(k, _mm512_set1_pd(c3)));
+		}
+		// 256 bit halves without avx512dq
+		static inline __m256 upper(reg a) { return _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(a), 1)); }
+		static inline reg join(__m256 a, __m256 b)
+		{
+			return _mm512_castpd_ps(_mm512_insertf64x4(_mm512_castps_pd(_mm512_castps256_ps512(a)), _mm256_castps_pd(b), 1));
+		}
+	};
+
+	void RunBatchAvx512(const instruction* ins, size_t n, uint32_t result, const float* const* columns, float* output, size_t count, float* scratch, precision p)
+	{
+		RunBatchKernel<avx512_lane>(ins, n, result, columns, output, count, scratch, p);
+	}
+
+	void RunBatchMultiAvx512(const instruction* ins, size_t n, const uint32_t* results, size_t number_of_results, const float* const* columns,
+		float* const* outputs, size_t count, float* scratch, precision p)
+	{
+		RunBatchMultiKernel<avx512_lane>(ins, n, results, number_of_results, columns, outputs, count, scratch, p);
+	}
+
+	void RunGradientAvx512(const instruction* ins, size_t n, uint32_t result, const float* const* columns, float* output,
+		float* const* gradient, size_t number_of_slots, size_t count, float* scratch, precision p)
+	{
+		RunGradientKernel<avx512_lane>(ins, n, result, columns, output, gradient, number_of_slots, count, scratch, p);
+	}
+};
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+#else // not x86, never selected by GetSupportedIsa
+
+namespace MathEval
+{
+	void RunBatchAvx512(const instruction* ins, size_t n, uint32_t result, const float* const* columns, float* output, size_t count, float* scratch, precision p)
+	{
+		RunBatchScalar(ins, n, result, columns, output, count, scratch, p);
+	}
+
+	void RunBatchMultiAvx512(const instruction* ins, size_t n, const uint32_t* results, size_t number_of_results, const float* const* columns,
+		float* const* outputs, size_t count, float* scratch, precision p)
+	{
+		RunBatchMultiScalar(ins, n, results, number_of_results, columns, outputs, count, scratch, p);
+	}
+
+	void RunGradientAvx512(const instruction* ins, size_t n, uint32_t result, const float* const* columns, float* output,
+		float* const* gradient, size_t number_of_slots, size_t count, float* scratch, precision p)
+	{
+		RunGradientScalar(ins, n, result, columns, output, gradient, number_of_slots, count, scratch, p);
+	}
+};
+
+#endif
@@ -0,0 +1,605 @@
+#pragma once
+#ifndef BATCH_KERNEL_H
+#define BATCH_KERNEL_H
+
+// included by the per-isa translation units after they set their target options.
+// they include batch.h (and every standard header) before that, so standard inline
+// functions never get compiled for a wider isa than the rest of the program
+#include "bytecode.h"
+#include "fast_math.h"
+
+namespace MathEval
+{
+	/*
+	 a lane type V provides
+	   reg, ireg, WIDTH
+	   load/store (+ _partial for the tail), broadcast
+	   add, sub, mul, div, fmadd (a*b+c), fnmadd (c-a*b), min, max, floor, abs, xor_, sqrt
+	   cvtt (truncating float->int), to_float, iadd, iand, iandnot (~i & c), shl<N>, as_float
+	   select_if_zero(i, a, b): a where i == 0, else b
+	   select_if_less(x, limit, a, b): a where x < limit, else b (NaN takes b)
+	   outside(x, lo, hi): bitmask of the lanes where x is not in [lo, hi] (NaN included)
+	   reduce(x, k, lo, inverse, c1, c2, c3): k = round(x*inverse) and x - k*(c1+c2+c3), all in double,
+	       the difference comes back as a float plus the float rest in lo
+	*/
+
+	// lanes the polynomials can't handle get recomputed with libm, one at a time
+	template <class V>
+	inline typename V::reg FixupLanes(typename V::reg x, typename V::reg y, unsigned lanes, float (*f)(float))
+	{
+		alignas(64) float xs[V::WIDTH];
+		alignas(64) float ys[V::WIDTH];
+		V::store(xs, x);
+		V::store(ys, y);
+		for (unsigned k = 0; k < V::WIDTH; k++)
+		{
+			if (lanes & (1u << k))
+				ys[k] = f(xs[k]);
+		}
+		return V::load(ys);
+	}
+
+	// f(a, b) one lane at a time, for pow with an exponent only known at runtime
+	template <class V, class F>
+	inline typename V::reg BinaryLanes(typename V::reg a, typename V::reg b, F f)
+	{
+		alignas(64) float as[V::WIDTH];
+		alignas(64) float bs[V::WIDTH];
+		V::store(as, a);
+		V::store(bs, b);
+		for (unsigned k = 0; k < V::WIDTH; k++)
+			as[k] = f(as[k], bs[k]);
+		return V::load(as);
+	}
+
+	// cephes single precision exp/sin/cos/tan/asin/acos/atan
+	// exp stays within 1 ulp of libm, sin/cos within a few ulp except right next to their
+	// zeros away from the origin, where the error is absolute (~1e-7) rather than relative,
+	// up to 48 ulp measured (fast_math.h has the table)
+	template <class V>
+	struct lane_math
+	{
+		using reg = typename V::reg;
+		using ireg = typename V::ireg;
+
+		static inline reg exp(reg x)
+		{
+			// outside this range the result is inf, 0, a denormal or NaN
+			unsigned slow = V::outside(x, -87.3365448f, 88.3762626f);
+
+			// exp(x) = 2^n * exp(r), n = round(x / ln2)
+			reg fx = V::floor(V::fmadd(x, V::broadcast(1.44269504088896341f), V::broadcast(0.5f)));
+			reg r = V::fnmadd(fx, V::broadcast(0.693359375f), x);
+			r = V::fnmadd(fx, V::broadcast(-2.12194440e-4f), r);
+			reg z = V::mul(r, r);
+
+			reg y = V::broadcast(1.9875691500E-4f);
+			y = V::fmadd(y, r, V::broadcast(1.3981999507E-3f));
+			y = V::fmadd(y, r, V::broadcast(8.3334519073E-3f));
+			y = V::fmadd(y, r, V::broadcast(4.1665795894E-2f));
+			y = V::fmadd(y, r, V::broadcast(1.6666665459E-1f));
+			y = V::fmadd(y, r, V::broadcast(5.0000001201E-1f));
+			y = V::fmadd(y, z, V::add(r, V::broadcast(1.0f)));
+
+			// build 2^n straight into the exponent bits
+			ireg n = V::iadd(V::cvtt(fx), 127);
+			y = V::mul(y, V::as_float(V::template shl<23>(n)));
+
+			if (slow)
+				y = FixupLanes<V>(x, y, slow, expf);
+			return y;
+		}
+
+		static inline reg sin(reg x) { return sincos(x, false); }
+		static inline reg cos(reg x) { return sincos(x, true); }
+
+		static inline reg tan(reg x)
+		{
+			unsigned slow = V::outside(x, -8192.0f, 8192.0f);
+
+			// same octant reduction as sin/cos, r in [-pi/4, pi/4]
+			reg ax = V::abs(x);
+			ireg j = V::cvtt(V::mul(ax, V::broadcast(1.27323954473516f)));
+			j = V::iand(V::iadd(j, 1), ~1);
+			reg fj = V::to_float(j);
+			reg r = V::fmadd(fj, V::broadcast(-0.78515625f), ax);
+			r = V::fmadd(fj, V::broadcast(-2.4187564849853515625e-4f), r);
+			r = V::fmadd(fj, V::broadcast(-3.77489497744594108e-8f), r);
+			reg z = V::mul(r, r);
+
+			reg y = V::broadcast(9.38540185543E-3f);
+			y = V::fmadd(y, z, V::broadcast(3.11992232697E-3f));
+			y = V::fmadd(y, z, V::broadcast(2.44301354525E-2f));
+			y = V::fmadd(y, z, V::broadcast(5.34112807005E-2f));
+			y = V::fmadd(y, z, V::broadcast(1.33387994085E-1f));
+			y = V::fmadd(y, z, V::broadcast(3.33331568548E-1f));
+			y = V::fmadd(V::mul(y, z), r, r);
+
+			// odd quadrants, tan(r + pi/2) = -1/tan(r)
+			y = V::select_if_zero(V::iand(j, 2), y, V::div(V::broadcast(-1.0f), y));
+			y = V::xor_(y, V::xor_(x, ax));
+
+			if (slow)
+				y = FixupLanes<V>(x, y, slow, tanf);
+			return y;
+		}
+
+		static inline reg asin(reg x)
+		{
+			// NaN past [-1, 1], libm gives it
+			unsigned slow = V::outside(x, -1.0f, 1.0f);
+			reg ax = V::abs(x);
+			reg p = asin_part(ax);
+			reg y = V::select_if_less(ax, 0.5f, p, V::fnmadd(p, V::broadcast(2.0f), V::broadcast(1.5707963267948966f)));
+			y = V::xor_(y, V::xor_(x, ax));
+			if (slow)
+				y = FixupLanes<V>(x, y, slow, asinf);
+			return y;
+		}
+
+		static inline reg acos(reg x)
+		{
+			unsigned slow = V::outside(x, -1.0f, 1.0f);
+			reg ax = V::abs(x);
+			reg sign = V::xor_(x, ax);
+			reg p = asin_part(ax);
+			// pi/2 - asin(x) near 0, 2 asin(sqrt((1-x)/2)) towards 1 and pi minus that towards -1
+			reg middle = V::sub(V::broadcast(1.5707963267948966f), V::xor_(p, sign));
+			reg edge = V::add(V::select_if_less(x, 0.0f, V::broadcast(3.141592653589793f), V::broadcast(0.0f)), V::xor_(V::add(p, p), sign));
+			reg y = V::select_if_less(ax, 0.5f, middle, edge);
+			if (slow)
+				y = FixupLanes<V>(x, y, slow, acosf);
+			return y;
+		}
+
+		static inline reg atan(reg x)
+		{
+			reg ax = V::abs(x);
+			reg one = V::broadcast(1.0f);
+			// t = x up to tan(pi/8), (x-1)/(x+1) up to tan(3pi/8) and -1/x past it, atan(x) = base + atan(t)
+			// inf and NaN come out right without libm
+			reg num = V::select_if_less(ax, 2.414213562373095f, V::sub(ax, one), V::broadcast(-1.0f));
+			reg den = V::select_if_less(ax, 2.414213562373095f, V::add(ax, one), ax);
+			reg base = V::select_if_less(ax, 2.414213562373095f, V::broadcast(0.7853981633974483f), V::broadcast(1.5707963267948966f));
+			num = V::select_if_less(ax, 0.4142135623730950f, ax, num);
+			den = V::select_if_less(ax, 0.4142135623730950f, one, den);
+			base = V::select_if_less(ax, 0.4142135623730950f, V::broadcast(0.0f), base);
+			reg t = V::div(num, den);
+			reg z = V::mul(t, t);
+
+			reg y = V::broadcast(8.05374449538e-2f);
+			y = V::fmadd(y, z, V::broadcast(-1.38776856032E-1f));
+			y = V::fmadd(y, z, V::broadcast(1.99777106478E-1f));
+			y = V::fmadd(y, z, V::broadcast(-3.33329491539E-1f));
+			y = V::add(base, V::fmadd(V::mul(y, z), t, t));
+			return V::xor_(y, V::xor_(x, ax));
+		}
+
+	private:
+		// asin(a) for a <= 0.5, past that asin(sqrt((1-a)/2)) for asin(a) = pi/2 - 2 asin(sqrt((1-a)/2))
+		static inline reg asin_part(reg ax)
+		{
+			reg half = V::mul(V::sub(V::broadcast(1.0f), ax), V::broadcast(0.5f));
+			reg z = V::select_if_less(ax, 0.5f, V::mul(ax, ax), half);
+			reg s = V::select_if_less(ax, 0.5f, ax, V::sqrt(half));
+			reg y = V::broadcast(4.2163199048E-2f);
+			y = V::fmadd(y, z, V::broadcast(2.4181311049E-2f));
+			y = V::fmadd(y, z, V::broadcast(4.5470025998E-2f));
+			y = V::fmadd(y, z, V::broadcast(7.4953002686E-2f));
+			y = V::fmadd(y, z, V::broadcast(1.6666752422E-1f));
+			return V::fmadd(V::mul(y, z), s, s);
+		}
+
+		static inline reg sincos(reg x, bool cosine)
+		{
+			// the 3 part pi/4 reduction loses precision past this
+			unsigned slow = V::outside(x, -8192.0f, 8192.0f);
+
+			reg ax = V::abs(x);
+			// octant j, rounded up to even so r ends up in [-pi/4, pi/4]
+			ireg j = V::cvtt(V::mul(ax, V::broadcast(1.27323954473516f))); // 4/pi
+			j = V::iand(V::iadd(j, 1), ~1);
+			reg fj = V::to_float(j);
+
+			ireg sign;
+			if (cosine)
+			{
+				j = V::iadd(j, -2);
+				sign = V::template shl<29>(V::iandnot(j, 4));
+			}
+			else
+			{
+				sign = V::template shl<29>(V::iand(j, 4));
+			}
+			ireg use_sin_poly = V::iand(j, 2);
+
+			reg r = V::fmadd(fj, V::broadcast(-0.78515625f), ax);
+			r = V::fmadd(fj, V::broadcast(-2.4187564849853515625e-4f), r);
+			r = V::fmadd(fj, V::broadcast(-3.77489497744594108e-8f), r);
+			reg z = V::mul(r, r);
+
+			reg yc = V::broadcast(2.443315711809948E-005f);
+			yc = V::fmadd(yc, z, V::broadcast(-1.388731625493765E-003f));
+			yc = V::fmadd(yc, z, V::broadcast(4.166664568298827E-002f));
+			yc = V::mul(V::mul(yc, z), z);
+			yc = V::fnmadd(z, V::broadcast(0.5f), yc);
+			yc = V::add(yc, V::broadcast(1.0f));
+
+			reg ys = V::broadcast(-1.9515295891E-4f);
+			ys = V::fmadd(ys, z, V::broadcast(8.3321608736E-3f));
+			ys = V::fmadd(ys, z, V::broadcast(-1.6666654611E-1f));
+			ys = V::fmadd(V::mul(ys, z), r, r);
+
+			reg y = V::select_if_zero(use_sin_poly, ys, yc);
+			y = V::xor_(y, V::as_float(sign));
+			// sin is odd, put the input's sign back
+			if (!cosine)
+				y = V::xor_(y, V::xor_(x, ax));
+
+			if (slow)
+				y = FixupLanes<V>(x, y, slow, cosine ? cosf : sinf);
+			return y;
+		}
+	};
+
+	// pi/2 in three parts for V::reduce, the first two have 33 bits so k * part is exact in double for k < 2^20
+	constexpr double HALF_PI_1 = 1.57079632673412561417e+00;
+	constexpr double HALF_PI_2 = 6.07710050630396597660e-11;
+	constexpr double HALF_PI_3 = 2.02226624879595063154e-21;
+	// ln2 the same way, k stays below 2^8
+	constexpr double LN2_1 = 6.93147180369123816490e-01;
+	constexpr double LN2_2 = 1.90821492927058770002e-10;
+
+	/*
+	 the ULP1/ULP2/ULP4 kernels (see fast_math.h), the same code runs on scalar_lane (fast_math.cpp) for Evaluate
+	 exp: 2^n * e^r with |r| <= ln2/2, e^r = 1 + r + r^2 * P(r), P degree 4 (ULP1/ULP2) or 3 (ULP4) minimax
+	 sin/cos: r = x - k*pi/2 reduced in double so the result stays accurate right next to the zeros,
+	      sin r = r + r^3 * S(r^2), cos r = 1 - r^2/2 + r^4 * C(r^2), S and C minimax on [-pi/4, pi/4] of degree 3 (ULP1) or 2
+	 ULP1 also carries the rounding error of r and of the leading 1 + ... so only the last add rounds for real
+	 lanes out of range (inf, NaN, exp overflow/underflow, |x| > 1e6 for sin/cos) get libm
+	*/
+	template <class V>
+	struct approx_math
+	{
+		using reg = typename V::reg;
+		using ireg = typename V::ireg;
+
+		static inline reg exp(reg x, precision p)
+		{
+			// 88 keeps 2^n finite, the last bit of range goes through libm
+			unsigned slow = V::outside(x, -87.3365448f, 88.0f);
+
+			reg fx, y;
+			if (p == precision::ULP1)
+			{
+				reg lo;
+				reg r = V::reduce(x, fx, lo, 1.44269504088896340736, LN2_1, LN2_2, 0.0);
+				reg z = V::mul(r, r);
+				y = V::broadcast(1.3813144760206342e-3f);
+				y = V::fmadd(y, r, V::broadcast(8.369418792426586e-3f));
+				y = V::fmadd(y, r, V::broadcast(4.166845604777336e-2f));
+				y = V::fmadd(y, r, V::broadcast(1.6666515171527863e-1f));
+				y = V::fmadd(y, r, V::broadcast(4.999999403953552e-1f));
+				// s + e is exactly 1 + r
+				reg s = V::add(V::broadcast(1.0f), r);
+				reg e = V::add(V::sub(V::broadcast(1.0f), s), r);
+				y = V::add(s, V::add(e, V::fmadd(y, z, lo)));
+			}
+			else
+			{
+				fx = V::floor(V::fmadd(x, V::broadcast(1.44269504088896341f), V::broadcast(0.5f)));
+				// the first part of ln2 has 9 bits, so fx * it and the subtraction are exact
+				reg r = V::fnmadd(fx, V::broadcast(0.693359375f), x);
+				r = V::fnmadd(fx, V::broadcast(-2.12194440e-4f), r);
+				reg z = V::mul(r, r);
+				if (p == precision::ULP4)
+				{
+					y = V::broadcast(8.369872346520424e-3f);
+					y = V::fmadd(y, r, V::broadcast(4.192258417606354e-2f));
+					y = V::fmadd(y, r, V::broadcast(1.6666516661643982e-1f));
+					y = V::fmadd(y, r, V::broadcast(4.999895393848419e-1f));
+				}
+				else
+				{
+					y = V::broadcast(1.3813144760206342e-3f);
+					y = V::fmadd(y, r, V::broadcast(8.369418792426586e-3f));
+					y = V::fmadd(y, r, V::broadcast(4.166845604777336e-2f));
+					y = V::fmadd(y, r, V::broadcast(1.6666515171527863e-1f));
+					y = V::fmadd(y, r, V::broadcast(4.999999403953552e-1f));
+				}
+				y = V::fmadd(y, z, V::add(r, V::broadcast(1.0f)));
+			}
+
+			ireg n = V::iadd(V::cvtt(fx), 127);
+			y = V::mul(y, V::as_float(V::template shl<23>(n)));
+
+			if (slow)
+				y = FixupLanes<V>(x, y, slow, expf);
+			return y;
+		}
+
+		static inline reg sin(reg x, precision p) { return sincos(x, false, p); }
+		static inline reg cos(reg x, precision p) { return sincos(x, true, p); }
+
+	private:
+		static inline reg sincos(reg x, bool cosine, precision p)
+		{
+			// k has to stay below 2^20 for the reduction to be exact
+			unsigned slow = V::outside(x, -1.0e6f, 1.0e6f);
+
+			reg fk, lo;
+			reg r = V::reduce(x, fk, lo, 0.63661977236758134308, HALF_PI_1, HALF_PI_2, HALF_PI_3); // 2/pi
+			reg z = V::mul(r, r);
+
+			// quadrant, cos(x) = sin(x + pi/2)
+			ireg q = V::cvtt(fk);
+			if (cosine)
+				q = V::iadd(q, 1);
+
+			reg ys, yc;
+			if (p == precision::ULP1)
+			{
+				ys = V::broadcast(2.716968083404936e-6f);
+				ys = V::fmadd(ys, z, V::broadcast(-1.983922120416537e-4f));
+				ys = V::fmadd(ys, z, V::broadcast(8.333329111337662e-3f));
+				ys = V::fmadd(ys, z, V::broadcast(-1.666666716337204e-1f));
+				yc = V::broadcast(-2.723398324633308e-7f);
+				yc = V::fmadd(yc, z, V::broadcast(2.479987779224757e-5f));
+				yc = V::fmadd(yc, z, V::broadcast(-1.3888885732740164e-3f));
+				yc = V::fmadd(yc, z, V::broadcast(4.16666679084301e-2f));
+			}
+			else
+			{
+				ys = V::broadcast(-1.950061705429107e-4f);
+				ys = V::fmadd(ys, z, V::broadcast(8.332076482474804e-3f));
+				ys = V::fmadd(ys, z, V::broadcast(-1.6666653752326965e-1f));
+				yc = V::broadcast(2.4460481654386967e-5f);
+				yc = V::fmadd(yc, z, V::broadcast(-1.3887629611417651e-3f));
+				yc = V::fmadd(yc, z, V::broadcast(4.1666653007268906e-2f));
+			}
+			ys = V::mul(V::mul(ys, z), r);
+			yc = V::mul(V::mul(yc, z), z);
+			reg hz = V::mul(z, V::broadcast(0.5f));
+			if (p == precision::ULP1)
+			{
+				// sin(r + lo) ~ sin(r) + lo, cos(r + lo) ~ cos(r) - lo*r, w + ((1 - w) - hz) is exactly 1 - hz
+				ys = V::add(r, V::add(ys, lo));
+				reg w = V::sub(V::broadcast(1.0f), hz);
+				yc = V::add(w, V::add(V::sub(V::sub(V::broadcast(1.0f), w), hz), V::fnmadd(lo, r, yc)));
+			}
+			else
+			{
+				ys = V::add(r, ys);
+				yc = V::add(V::sub(V::broadcast(1.0f), hz), yc);
+			}
+
+			reg y = V::select_if_zero(V::iand(q, 1), ys, yc);
+			// quadrants 2 and 3 flip the sign
+			y = V::xor_(y, V::as_float(V::template shl<30>(V::iand(q, 2))));
+
+			if (slow)
+				y = FixupLanes<V>(x, y, slow, cosine ? cosf : sinf);
+			return y;
+		}
+	};
+
+	// every lane through libm
+	template <class V>
+	inline typename V::reg ExactLanes(typename V::reg x, float (*f)(float))
+	{
+		return FixupLanes<V>(x, x, (1u << V::WIDTH) - 1u, f);
+	}
+
+	// unary op of x under precision p
+	template <class V>
+	inline typename V::reg UnaryLane(opcode op, typename V::reg x, precision p)
+	{
+		switch (op)
+		{
+		case opcode::MINUS: return V::xor_(x, V::broadcast(-0.0f));
+		case opcode::SQRT:  return V::sqrt(x);
+		case opcode::TAN:
+			return p == precision::DEFAULT ? lane_math<V>::tan(x) : ExactLanes<V>(x, tanf);
+		case opcode::ARCSIN:
+			return p == precision::DEFAULT ? lane_math<V>::asin(x) : ExactLanes<V>(x, asinf);
+		case opcode::ARCCOS:
+			return p == precision::DEFAULT ? lane_math<V>::acos(x) : ExactLanes<V>(x, acosf);
+		case opcode::ARCTAN:
+			return p == precision::DEFAULT ? lane_math<V>::atan(x) : ExactLanes<V>(x, atanf);
+		default:
+			break;
+		}
+		switch (p)
+		{
+		case precision::DEFAULT:
+			return op == opcode::EXP ? lane_math<V>::exp(x) : (op == opcode::SIN ? lane_math<V>::sin(x) : lane_math<V>::cos(x));
+		case precision::EXACT:
+			return ExactLanes<V>(x, op == opcode::EXP ? expf : (op == opcode::SIN ? sinf : cosf));
+		default:
+			return op == opcode::EXP ? approx_math<V>::exp(x, p) : (op == opcode::SIN ? approx_math<V>::sin(x, p) : approx_math<V>::cos(x, p));
+		}
+	}
+
+	template <class V>
+	inline void RunBatchBlock(const instruction* ins, size_t n, const float* const* columns, size_t offset, size_t width, typename V::reg* reg, precision p)
+	{
+		for (size_t k = 0; k < n; k++)
+		{
+			const instruction& in = ins[k];
+			switch (in.op)
+			{
+			case opcode::LOAD_CONST: reg[in.dst] = V::broadcast(in.constant); break;
+			case opcode::LOAD_INPUT:
+				reg[in.dst] = (width == V::WIDTH) ? V::load(columns[in.a] + offset) : V::load_partial(columns[in.a] + offset, width);
+				break;
+			case opcode::ADD:  reg[in.dst] = V::add(reg[in.a], reg[in.b]);       break;
+			case opcode::SUB:  reg[in.dst] = V::sub(reg[in.a], reg[in.b]);       break;
+			case opcode::MULT: reg[in.dst] = V::mul(reg[in.a], reg[in.b]);       break;
+			case opcode::DIV:  reg[in.dst] = V::div(reg[in.a], reg[in.b]);       break;
+			case opcode::POW:  reg[in.dst] = BinaryLanes<V>(reg[in.a], reg[in.b], Power); break;
+			default:           reg[in.dst] = UnaryLane<V>(in.op, reg[in.a], p);  break;
+			}
+		}
+	}
+
+	template <class V>
+	inline void RunBatchKernel(const instruction* ins, size_t n, uint32_t result, const float* const* columns, float* output, size_t count, float* scratch, precision p)
+	{
+		typename V::reg* reg = reinterpret_cast<typename V::reg*>(scratch);
+		size_t i = 0;
+		for (; i + V::WIDTH <= count; i += V::WIDTH)
+		{
+			RunBatchBlock<V>(ins, n, columns, i, V::WIDTH, reg, p);
+			V::store(output + i, reg[result]);
+		}
+		// tail goes through zero padded lanes
+		if (i < count)
+		{
+			RunBatchBlock<V>(ins, n, columns, i, count - i, reg, p);
+			V::store_partial(output + i, reg[result], count - i);
+		}
+	}
+
+	template <class V>
+	inline void RunBatchMultiKernel(const instruction* ins, size_t n, const uint32_t* results, size_t number_of_results, const float* const* columns,
+		float* const* outputs, size_t count, float* scratch, precision p)
+	{
+		typename V::reg* reg = reinterpret_cast<typename V::reg*>(scratch);
+		size_t i = 0;
+		for (; i + V::WIDTH <= count; i += V::WIDTH)
+		{
+			RunBatchBlock<V>(ins, n, columns, i, V::WIDTH, reg, p);
+			for (size_t k = 0; k < number_of_results; k++)
+				V::store(outputs[k] + i, reg[results[k]]);
+		}
+		if (i < count)
+		{
+			RunBatchBlock<V>(ins, n, columns, i, count - i, reg, p);
+			for (size_t k = 0; k < number_of_results; k++)
+				V::store_partial(outputs[k] + i, reg[results[k]], count - i);
+		}
+	}
+
+	/*
+	 reverse mode gradient for one block of points (see autodiff.h), ins has to be an ssa program (dst == index)
+	 so RunBatchBlock leaves every intermediate in value, adjoint is another n registers
+	*/
+	template <class V>
+	inline void RunGradientBlock(const instruction* ins, size_t n, uint32_t result, const float* const* columns, float* output,
+		float* const* gradient, size_t number_of_slots, size_t offset, size_t width, typename V::reg* value, typename V::reg* adjoint, precision p)
+	{
+		using reg = typename V::reg;
+		RunBatchBlock<V>(ins, n, columns, offset, width, value, p);
+		for (size_t k = 0; k < n; k++)
+			adjoint[k] = V::broadcast(0.0f);
+		adjoint[result] = V::broadcast(1.0f);
+
+		bool full = width == V::WIDTH;
+		if (full)
+			V::store(output + offset, value[result]);
+		else
+			V::store_partial(output + offset, value[result], width);
+		for (size_t s = 0; s < number_of_slots; s++)
+		{
+			if (!gradient[s])
+				continue;
+			if (full)
+				V::store(gradient[s] + offset, V::broadcast(0.0f));
+			else
+				V::store_partial(gradient[s] + offset, V::broadcast(0.0f), width);
+		}
+
+		for (size_t k = n; k-- > 0;)
+		{
+			const instruction& in = ins[k];
+			reg g = adjoint[k];
+			switch (in.op)
+			{
+			case opcode::LOAD_CONST:
+				break;
+			case opcode::LOAD_INPUT:
+			{
+				float* out = gradient[in.a];
+				if (!out)
+					break;
+				if (full)
+					V::store(out + offset, V::add(V::load(out + offset), g));
+				else
+					V::store_partial(out + offset, V::add(V::load_partial(out + offset, width), g), width);
+				break;
+			}
+			case opcode::ADD:
+				adjoint[in.a] = V::add(adjoint[in.a], g);
+				adjoint[in.b] = V::add(adjoint[in.b], g);
+				break;
+			case opcode::SUB:
+				adjoint[in.a] = V::add(adjoint[in.a], g);
+				adjoint[in.b] = V::sub(adjoint[in.b], g);
+				break;
+			case opcode::MULT:
+				adjoint[in.a] = V::add(adjoint[in.a], V::mul(g, value[in.b]));
+				adjoint[in.b] = V::add(adjoint[in.b], V::mul(g, value[in.a]));
+				break;
+			case opcode::DIV:
+				adjoint[in.a] = V::add(adjoint[in.a], V::div(g, value[in.b]));
+				adjoint[in.b] = V::sub(adjoint[in.b], V::div(V::mul(g, value[k]), value[in.b]));
+				break;
+			case opcode::EXP:
+				adjoint[in.a] = V::add(adjoint[in.a], V::mul(g, value[k]));
+				break;
+			case opcode::SIN:
+				adjoint[in.a] = V::add(adjoint[in.a], V::mul(g, UnaryLane<V>(opcode::COS, value[in.a], p)));
+				break;
+			case opcode::COS:
+				adjoint[in.a] = V::sub(adjoint[in.a], V::mul(g, UnaryLane<V>(opcode::SIN, value[in.a], p)));
+				break;
+			case opcode::POW:
+			{
+				// the same per point partials as RunGradient
+				reg da = BinaryLanes<V>(value[in.a], value[in.b], [](float a, float b) { return b * Power(a, b - 1.0f); });
+				reg db = BinaryLanes<V>(value[k], value[in.a], [](float y, float a) { return y == 0.0f ? 0.0f : y * logf(a); });
+				adjoint[in.a] = V::add(adjoint[in.a], V::mul(g, da));
+				adjoint[in.b] = V::add(adjoint[in.b], V::mul(g, db));
+				break;
+			}
+			case opcode::TAN:
+				adjoint[in.a] = V::add(adjoint[in.a], V::mul(g, V::fmadd(value[k], value[k], V::broadcast(1.0f))));
+				break;
+			case opcode::ARCSIN:
+			case opcode::ARCCOS:
+			{
+				// +-1/sqrt(1 - x^2)
+				reg d = V::div(V::broadcast(1.0f), V::sqrt(V::fnmadd(value[in.a], value[in.a], V::broadcast(1.0f))));
+				adjoint[in.a] = in.op == opcode::ARCSIN ? V::add(adjoint[in.a], V::mul(g, d)) : V::sub(adjoint[in.a], V::mul(g, d));
+				break;
+			}
+			case opcode::ARCTAN:
+				adjoint[in.a] = V::add(adjoint[in.a], V::mul(g, V::div(V::broadcast(1.0f), V::fmadd(value[in.a], value[in.a], V::broadcast(1.0f)))));
+				break;
+			case opcode::MINUS:
+				adjoint[in.a] = V::sub(adjoint[in.a], g);
+				break;
+			case opcode::SQRT:
+				adjoint[in.a] = V::add(adjoint[in.a], V::mul(g, V::div(V::broadcast(0.5f), value[k])));
+				break;
+			default: break;
+			}
+		}
+	}
+
+	// scratch holds 2 * n registers
+	template <class V>
+	inline void RunGradientKernel(const instruction* ins, size_t n, uint32_t result, const float* const* columns, float* output,
+		float* const* gradient, size_t number_of_slots, size_t count, float* scratch, precision p)
+	{
+		typename V::reg* value = reinterpret_cast<typename V::reg*>(scratch);
+		typename V::reg* adjoint = value + n;
+		for (size_t i = 0; i < count; i += V::WIDTH)
+		{
+			size_t width = count - i < V::WIDTH ? count - i : V::WIDTH;
+			RunGradientBlock<V>(ins, n, result, columns, output, gradient, number_of_slots, i, width, value, adjoint, p);
+		}
+	}
+};
+
+#endif // BATCH_KERNEL_H
@@ -0,0 +1,144 @@
+#include "batch.h"
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#include <immintrin.h>
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("sse4.1"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("sse4.1")
+#endif
+
+#include "batch_kernel.h"
+
+namespace MathEval
+{
+	struct sse4_lane
+	{
+		using reg = __m128;
+		using ireg = __m128i;
+		static constexpr size_t WIDTH = 4;
+
+		static inline reg load(const float* p) { return _mm_loadu_ps(p); }
+		static inline void store(float* p, reg v) { _mm_storeu_ps(p, v); }
+		static inline reg load_partial(const float* p, size_t n)
+		{
+			alignas(16) float buf[WIDTH] = {};
+			memcpy(buf, p, n * sizeof(float));
+			return _mm_load_ps(buf);
+		}
+		static inline void store_partial(float* p, reg v, size_t n)
+		{
+			alignas(16) float buf[WIDTH];
+			_mm_store_ps(buf, v);
+			memcpy(p, buf, n * sizeof(float));
+		}
+		static inline reg broadcast(float f) { return _mm_set1_ps(f); }
+
+		static inline reg add(reg a, reg b) { return _mm_add_ps(a, b); }
+		static inline reg sub(reg a, reg b) { return _mm_sub_ps(a, b); }
+		static inline reg mul(reg a, reg b) { return _mm_mul_ps(a, b); }
+		static inline reg div(reg a, reg b) { return _mm_div_ps(a, b); }
+		// no fma at this level
+		static inline reg fmadd(reg a, reg b, reg c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+		static inline reg fnmadd(reg a, reg b, reg c) { return _mm_sub_ps(c, _mm_mul_ps(a, b)); }
+		static inline reg min(reg a, reg b) { return _mm_min_ps(a, b); }
+		static inline reg max(reg a, reg b) { return _mm_max_ps(a, b); }
+		static inline reg floor(reg a) { return _mm_floor_ps(a); }
+		static inline reg abs(reg a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+		static inline reg xor_(reg a, reg b) { return _mm_xor_ps(a, b); }
+		static inline reg sqrt(reg a) { return _mm_sqrt_ps(a); }
+
+		static inline ireg cvtt(reg a) { return _mm_cvttps_epi32(a); }
+		static inline reg to_float(ireg a) { return _mm_cvtepi32_ps(a); }
+		static inline ireg iadd(ireg a, int b) { return _mm_add_epi32(a, _mm_set1_epi32(b)); }
+		static inline ireg iand(ireg a, int b) { return _mm_and_si128(a, _mm_set1_epi32(b)); }
+		static inline ireg iandnot(ireg a, int b) { return _mm_andnot_si128(a, _mm_set1_epi32(b)); }
+		template <int N>
+		static inline ireg shl(ireg a) { return _mm_slli_epi32(a, N); }
+		static inline reg as_float(ireg a) { return _mm_castsi128_ps(a); }
+
+		static inline reg select_if_zero(ireg i, reg a, reg b)
+		{
+			__m128 zero = _mm_castsi128_ps(_mm_cmpeq_epi32(i, _mm_setzero_si128()));
+			return _mm_blendv_ps(b, a, zero);
+		}
+		static inline reg select_if_less(reg x, float limit, reg a, reg b)
+		{
+			return _mm_blendv_ps(b, a, _mm_cmplt_ps(x, _mm_set1_ps(limit)));
+		}
+		static inline unsigned outside(reg x, float lo, float hi)
+		{
+			__m128 inside = _mm_and_ps(_mm_cmpge_ps(x, _mm_set1_ps(lo)), _mm_cmple_ps(x, _mm_set1_ps(hi)));
+			return static_cast<unsigned>(~_mm_movemask_ps(inside)) & 0xFu;
+		}
+		static inline reg reduce(reg x, reg& k, reg& lo, double inverse, double c1, double c2, double c3)
+		{
+			__m128d k0, k1;
+			__m128d r0 = reduce_pd(_mm_cvtps_pd(x), k0, inverse, c1, c2, c3);
+			__m128d r1 = reduce_pd(_mm_cvtps_pd(_mm_movehl_ps(x, x)), k1, inverse, c1, c2, c3);
+			__m128 h0 = _mm_cvtpd_ps(r0), h1 = _mm_cvtpd_ps(r1);
+			k = _mm_movelh_ps(_mm_cvtpd_ps(k0), _mm_cvtpd_ps(k1));
+			lo = _mm_movelh_ps(_mm_cvtpd_ps(_mm_sub_pd(r0, _mm_cvtps_pd(h0))), _mm_cvtpd_ps(_mm_sub_pd(r1, _mm_cvtps_pd(h1))));
+			return _mm_movelh_ps(h0, h1);
+		}
+	private:
+		static inline __m128d reduce_pd(__m128d x, __m128d& k, double inverse, double c1, double c2, double c3)
+		{
+			k = _mm_floor_pd(_mm_add_pd(_mm_mul_pd(x, _mm_set1_pd(inverse)), _mm_set1_pd(0.5)));
+			__m128d r = _mm_sub_pd(x, _mm_mul_pd(k, _mm_set1_pd(c1)));
+			r = _mm_sub_pd(r, _mm_mul_pd(k, _mm_set1_pd(c2)));
+			return _mm_sub_pd(r, _mm_mul_pd(k, _mm_set1_pd(c3)));
+		}
+	};
+
+	void RunBatchSse4(const instruction* ins, size_t n, uint32_t result, const float* const* columns, float* output, size_t count, float* scratch, precision p)
+	{
+		RunBatchKernel<sse4_lane>(ins, n, result, columns, output, count, scratch, p);
+	}
+
+	void RunBatchMultiSse4(const instruction* ins, size_t n, const uint32_t* results, size_t number_of_results, const float* const* columns,
+		float* const* outputs, size_t count, float* scratch, precision p)
+	{
+		RunBatchMultiKernel<sse4_lane>(ins, n, results, number_of_results, columns, outputs, count, scratch, p);
+	}
+
+	void RunGradientSse4(const instruction* ins, size_t n, uint32_t result, const float* const* columns, float* output,
+		float* const* gradient, size_t number_of_slots, size_t count, float* scratch, precision p)
+	{
+		RunGradientKernel<sse4_lane>(ins, n, result, columns, output, gradient, number_of_slots, count, scratch, p);
+	}
+};
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+#else // not x86, never selected by GetSupportedIsa
+
+namespace MathEval
+{
+	void RunBatchSse4(const instruction* ins, size_t n, uint32_t result, const float* const* columns, float* output, size_t count, float* scratch, precision p)
+	{
+		RunBatchScalar(ins, n, result, columns, output, count, scratch, p);
+	}
+
+	void RunBatchMultiSse4(const instruction* ins, size_t n, const uint32_t* results, size_t number_of_results, const float* const* columns,
+		float* const* outputs, size_t count, float* scratch, precision p)
+	{
+		RunBatchMultiScalar(ins, n, results, number_of_results, columns, outputs, count, scratch, p);
+	}
+
+	void RunGradientSse4(const instruction* ins, size_t n, uint32_t result, const float* const* columns, float* output,
+		float* const* gradient, size_t number_of_slots, size_t count, float* scratch, precision p)
+	{
+		RunGradientScalar(ins, n, result, columns, output, gradient, number_of_slots, count, scratch, p);
+	}
+};
+
+#endif
@@ -0,0 +1,61 @@
+#include "bulk_compile.h"
+#include "lexer.h"
+#include <exception>
+#include <stdexcept>
+#include <string>
+
+namespace MathEval
+{
+
+	compile_result TryCompileExpression(std::string_view text, const std::unordered_map<std::string, size_t>& function_inputs,
+		size_t number_of_slots, const compile_options& options, expression_registry* registry)
+	{
+		compile_result result;
+		compile_error& error = result.error;
+		try
+		{
+			if (registry)
+				result.compiled = registry->Get(text, function_inputs, number_of_slots, options);
+			else
+				result.compiled = CompileExpression(text, function_inputs, number_of_slots, options);
+		}
+		catch (const Lexer::syntax_error& e)
+		{
+			error.type = compile_error::kind::SYNTAX;
+			error.message = e.what();
+			error.token = e.token;
+			error.expected = e.expected;
+			error.line = e.line;
+		}
+		catch (const std::out_of_range& e)
+		{
+			error.type = compile_error::kind::UNRESOLVED;
+			error.message = e.what();
+		}
+		catch (const std::length_error& e)
+		{
+			error.type = compile_error::kind::TOO_LONG;
+			error.message = e.what();
+		}
+		catch (const std::exception& e)
+		{
+			error.type = compile_error::kind::OTHER;
+			error.message = e.what();
+		}
+		return result;
+	}
+
+	std::vector<compile_result> CompileBulk(const std::vector<std::string>& texts, const std::unordered_map<std::string, size_t>& function_inputs,
+		size_t number_of_slots, const compile_options& options, thread_pool& pool, expression_registry* registry)
+	{
+		std::vector<compile_result> results(texts.size());
+		// expressions take anywhere from 1us to a few 100us, small chunks let the idle threads steal the long ones
+		static const size_t CHUNK = 16;
+		pool.ParallelFor(texts.size(), CHUNK, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+				results[i] = TryCompileExpression(texts[i], function_inputs, number_of_slots, options, registry);
+		});
+		return results;
+	}
+};
@@ -0,0 +1,55 @@
+#pragma once
+#ifndef BULK_COMPILE_H
+#define BULK_COMPILE_H
+
+#include "registry.h"
+#include "thread_pool.h"
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace MathEval
+{
+	// why an expression didn't compile
+	struct compile_error
+	{
+		enum class kind : char
+		{
+			SYNTAX = 0, // malformed or empty text, token/expected/line say where
+			UNRESOLVED, // a variable missing from function_inputs or mapped past number_of_slots
+			TOO_LONG, // text over 4GB, a token over 64K chars or nesting past Lexer::grammar::MAX_DEPTH
+			OTHER, // anything else, ie: out of memory
+		};
+		kind type = kind::OTHER;
+		std::string message;
+		// SYNTAX only, see Lexer::syntax_error
+		Lexer::Token token; // offset/length into the text
+		Lexer::TokenType expected = Lexer::TokenType::TOKEN_TYPE_ERROR;
+		int line = 0;
+	};
+
+	struct compile_result
+	{
+		std::shared_ptr<const compiled_expression> compiled; // nullptr when it failed, MathEvaluator<S>(compiled) runs it
+		compile_error error; // only filled in when it failed
+
+		inline bool Ok() const { return compiled != nullptr; }
+	};
+
+	// CompileExpression (or registry->Get) that hands back what went wrong instead of throwing
+	compile_result TryCompileExpression(std::string_view text, const std::unordered_map<std::string, size_t>& function_inputs,
+		size_t number_of_slots, const compile_options& options, expression_registry* registry = nullptr);
+
+	/*
+	 every text through TryCompileExpression, split over pool, results[i] belongs to texts[i] whatever thread ran it
+	 a bad expression only costs its own entry, nothing is thrown and the process never exits
+	 with a registry, texts that repeat (up to whitespace and variable names) compile once and share the result
+	*/
+	std::vector<compile_result> CompileBulk(const std::vector<std::string>& texts, const std::unordered_map<std::string, size_t>& function_inputs,
+		size_t number_of_slots, const compile_options& options, thread_pool& pool = thread_pool::GetDefault(), expression_registry* registry = nullptr);
+};
+
+#endif // BULK_COMPILE_H
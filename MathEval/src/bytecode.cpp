@@ -0,0 +1,366 @@
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include "bytecode.h"
+#include "fast_math.h"
+
+using std::cout;
+using std::endl;
+
+namespace MathEval
+{
+
+	program::program(const Lexer::syntax_tree& syntax, uint32_t root, bool reuse)
+		: program(syntax, std::vector<uint32_t>{ root }, reuse)
+	{}
+
+	program::program(const Lexer::syntax_tree& syntax, const std::vector<uint32_t>& roots, bool reuse)
+		: reuse_registers(reuse)
+	{
+		if (roots.empty())
+			throw std::out_of_range("program: empty expression");
+		for (uint32_t root : roots)
+		{
+			if (root == Lexer::NO_NODE)
+				throw std::out_of_range("program: empty expression");
+		}
+		tree = &syntax;
+		remaining_uses.assign(syntax.nodes.size(), 0);
+		node_register.assign(syntax.nodes.size(), NO_REGISTER);
+		for (uint32_t root : roots)
+			CountUses(root);
+		for (uint32_t root : roots)
+			result_registers.push_back(Emit(root));
+		result_register = result_registers[0];
+
+		// compile state isn't needed after lowering
+		tree = nullptr;
+		remaining_uses = std::vector<uint32_t>();
+		node_register = std::vector<uint32_t>();
+		free_registers.clear();
+	}
+
+	program::program(std::vector<instruction> code, uint32_t registers, std::vector<uint32_t> results, size_t number_of_slots, bool reuse)
+		: instructions(std::move(code)), number_of_registers(registers), result_registers(std::move(results)), reuse_registers(reuse)
+	{
+		if (instructions.empty() || result_registers.empty())
+			throw std::invalid_argument("program: empty expression");
+		if (number_of_registers > instructions.size() || (!reuse && number_of_registers != instructions.size()))
+			throw std::invalid_argument("program: " + std::to_string(number_of_registers) + " registers for "
+				+ std::to_string(instructions.size()) + " instructions");
+		// every register has to be written before anything reads it, so a damaged program can't read garbage either
+		std::vector<char> written(number_of_registers, 0);
+		auto check = [&](uint32_t reg)
+		{
+			if (reg >= number_of_registers || !written[reg])
+				throw std::invalid_argument("program: register " + std::to_string(reg) + " read before it's written");
+		};
+		for (size_t i = 0; i < instructions.size(); i++)
+		{
+			const instruction& ins = instructions[i];
+			if (ins.op > LAST_OPCODE)
+				throw std::invalid_argument("program: unknown opcode " + std::to_string(static_cast<int>(ins.op)));
+			if (ins.op == opcode::LOAD_INPUT && ins.a >= number_of_slots)
+				throw std::invalid_argument("program: input slot " + std::to_string(ins.a) + " past the last input");
+			if (ins.op >= opcode::ADD)
+				check(ins.a);
+			if (IsBinary(ins.op))
+				check(ins.b);
+			if (ins.dst >= number_of_registers || (!reuse && ins.dst != i))
+				throw std::invalid_argument("program: bad destination register " + std::to_string(ins.dst));
+			written[ins.dst] = 1;
+		}
+		for (uint32_t reg : result_registers)
+			check(reg);
+		result_register = result_registers[0];
+	}
+
+	// number of parents for every node, a node only gets emitted once even if it's shared
+	// a root has one more reader, whoever takes the result, that one never releases it
+	void program::CountUses(uint32_t root)
+	{
+		std::vector<uint32_t> stack;
+		if (remaining_uses[root]++ == 0)
+			stack.push_back(root);
+		while (!stack.empty())
+		{
+			const Lexer::tree_node& n = (*tree)[stack.back()];
+			stack.pop_back();
+
+			uint32_t children[2] = { Lexer::NO_NODE, Lexer::NO_NODE };
+			if (n.type == Lexer::node_type::BINARY_OP)
+			{
+				children[0] = n.lhs;
+				// a constant exponent that gets strength reduced is never read
+				children[1] = IsReducedPower(n) ? Lexer::NO_NODE : n.rhs;
+			}
+			else if (!n.IsLeaf())
+			{
+				children[0] = n.next;
+			}
+
+			for (uint32_t child : children)
+			{
+				if (child == Lexer::NO_NODE)
+					continue;
+				// first visit walks the subtree
+				if (remaining_uses[child]++ == 0)
+					stack.push_back(child);
+			}
+		}
+	}
+
+	uint32_t program::AllocateRegister()
+	{
+		if (free_registers.empty())
+			return number_of_registers++;
+		uint32_t reg = free_registers.back();
+		free_registers.pop_back();
+		return reg;
+	}
+
+	// operand was read by its parent, recycle its register when nobody else needs it
+	void program::ReleaseOperand(uint32_t operand)
+	{
+		if (--remaining_uses[operand] == 0 && reuse_registers)
+			free_registers.push_back(node_register[operand]);
+	}
+
+	// x^c with c a chain exponent or 0.5, lowered by EmitPower instead of a POW
+	bool program::IsReducedPower(const Lexer::tree_node& n) const
+	{
+		if (n.type != Lexer::node_type::BINARY_OP || n.op_type != Lexer::bin_op::POW_OP)
+			return false;
+		const Lexer::tree_node& exponent = (*tree)[n.rhs];
+		return exponent.type == Lexer::node_type::PREFIX_OP && exponent.op == Lexer::unary_op::NUM_OP
+			&& (IsPowerChain(exponent.constant) || exponent.constant == 0.5f);
+	}
+
+	uint32_t program::Append(opcode op, uint32_t a, uint32_t b)
+	{
+		instruction ins{};
+		ins.op = op;
+		ins.a = a;
+		ins.b = b;
+		ins.dst = AllocateRegister();
+		instructions.push_back(ins);
+		return ins.dst;
+	}
+
+	// the exact steps of Power (fast_math.h), so the program gives the same bits as every scalar path
+	// the chain's own registers are freed as soon as the next multiply has read them, base keeps its until the end
+	// base is lowered already
+	uint32_t program::EmitPower(uint32_t base, float exponent)
+	{
+		uint32_t x = node_register[base];
+		if (exponent == 0.5f)
+		{
+			ReleaseOperand(base);
+			return Append(opcode::SQRT, x, 0);
+		}
+
+		auto release = [this, x](uint32_t reg)
+		{
+			if (reuse_registers && reg != x)
+				free_registers.push_back(reg);
+		};
+		int n = static_cast<int>(exponent);
+		unsigned m = static_cast<unsigned>(n < 0 ? -n : n);
+		uint32_t square = x;
+		uint32_t result = NO_REGISTER;
+		for (;;)
+		{
+			bool last = (m >> 1) == 0;
+			if (m & 1)
+			{
+				if (result == NO_REGISTER)
+					result = square;
+				else
+				{
+					uint32_t previous = result;
+					release(previous);
+					if (last)
+						release(square);
+					result = Append(opcode::MULT, previous, square);
+				}
+			}
+			m >>= 1;
+			if (!m)
+				break;
+			uint32_t previous = square;
+			if (previous != result)
+				release(previous);
+			square = Append(opcode::MULT, previous, previous);
+		}
+		if (n < 0)
+		{
+			instruction one{};
+			one.op = opcode::LOAD_CONST;
+			one.constant = 1.0f;
+			one.dst = AllocateRegister();
+			instructions.push_back(one);
+			release(one.dst);
+			release(result);
+			result = Append(opcode::DIV, one.dst, result);
+		}
+		ReleaseOperand(base);
+		return result;
+	}
+
+	// post-order over an explicit stack, a recursion level per node would overflow on long expressions (a+a+...+a is
+	// as deep as it is long); children are lowered one at a time in the order a recursive walk takes them, so a shared
+	// child the lhs computed is already there for the rhs
+	uint32_t program::Emit(uint32_t root)
+	{
+		struct frame
+		{
+			uint32_t node;
+			uint32_t next_child; // children already lowered
+		};
+		std::vector<frame> stack;
+		stack.push_back({ root, 0 });
+		while (!stack.empty())
+		{
+			frame& top = stack.back();
+			uint32_t node = top.node;
+			const Lexer::tree_node& n = (*tree)[node];
+			uint32_t children[2];
+			uint32_t count = 0;
+			if (IsReducedPower(n))
+			{
+				// the exponent is a constant of the chain, never read
+				children[count++] = n.lhs;
+			}
+			else if (n.type == Lexer::node_type::BINARY_OP)
+			{
+				if (n.op_type == Lexer::bin_op::ERROR_BIN_OP)
+					throw std::out_of_range("program: unsupported binary operation");
+				children[count++] = n.lhs;
+				children[count++] = n.rhs;
+			}
+			else if (n.op == Lexer::unary_op::ID_OP)
+			{
+				if (n.slot == Lexer::NO_SLOT)
+					throw std::out_of_range("program: unresolved variable " + tree->names[n.name]);
+			}
+			else if (n.op != Lexer::unary_op::NUM_OP)
+			{
+				if (n.op == Lexer::unary_op::ERROR_UN_OP || n.next == Lexer::NO_NODE)
+					throw std::out_of_range("program: unsupported unary operation");
+				children[count++] = n.next;
+			}
+
+			// shared subtree that was already computed
+			if (top.next_child == 0 && node_register[node] != NO_REGISTER)
+			{
+				stack.pop_back();
+				continue;
+			}
+			if (top.next_child < count)
+			{
+				// top dangles once the stack grows
+				uint32_t child = children[top.next_child++];
+				stack.push_back({ child, 0 });
+				continue;
+			}
+			stack.pop_back();
+			EmitNode(node);
+		}
+		return node_register[root];
+	}
+
+	// every child of node has its register already
+	void program::EmitNode(uint32_t node)
+	{
+		const Lexer::tree_node& n = (*tree)[node];
+		if (IsReducedPower(n))
+		{
+			node_register[node] = EmitPower(n.lhs, (*tree)[n.rhs].constant);
+			source_nodes.resize(instructions.size(), node);
+			return;
+		}
+		instruction ins{};
+		if (n.type == Lexer::node_type::BINARY_OP)
+		{
+			ins.op = static_cast<opcode>(static_cast<int>(opcode::ADD) + static_cast<int>(n.op_type));
+			ins.a = node_register[n.lhs];
+			ins.b = node_register[n.rhs];
+			ReleaseOperand(n.lhs);
+			ReleaseOperand(n.rhs);
+		}
+		else if (n.op == Lexer::unary_op::NUM_OP)
+		{
+			ins.op = opcode::LOAD_CONST;
+			ins.constant = n.constant;
+		}
+		else if (n.op == Lexer::unary_op::ID_OP)
+		{
+			ins.op = opcode::LOAD_INPUT;
+			ins.a = n.slot;
+		}
+		else
+		{
+			ins.op = static_cast<opcode>(static_cast<int>(opcode::EXP) + static_cast<int>(n.op));
+			ins.a = node_register[n.next];
+			ReleaseOperand(n.next);
+		}
+
+		ins.dst = AllocateRegister();
+		node_register[node] = ins.dst;
+		instructions.push_back(ins);
+		// the children's instructions are already tagged, whatever is new is this node's
+		source_nodes.resize(instructions.size(), node);
+	}
+
+	const char* GetOpcodeName(opcode op)
+	{
+		switch (op)
+		{
+		case opcode::LOAD_CONST: return "LOAD_CONST";
+		case opcode::LOAD_INPUT: return "LOAD_INPUT";
+		case opcode::ADD:        return "ADD";
+		case opcode::SUB:        return "SUB";
+		case opcode::MULT:       return "MULT";
+		case opcode::DIV:        return "DIV";
+		case opcode::POW:        return "POW";
+		case opcode::EXP:        return "EXP";
+		case opcode::SIN:        return "SIN";
+		case opcode::COS:        return "COS";
+		case opcode::TAN:        return "TAN";
+		case opcode::ARCSIN:     return "ARCSIN";
+		case opcode::ARCCOS:     return "ARCCOS";
+		case opcode::ARCTAN:     return "ARCTAN";
+		case opcode::MINUS:      return "MINUS";
+		case opcode::SQRT:       return "SQRT";
+		default:                 return "UNKNOWN";
+		}
+	}
+
+	void program::Print() const
+	{
+		for (const instruction& ins : instructions)
+		{
+			cout << "r" << ins.dst << " = " << GetOpcodeName(ins.op);
+			if (ins.op == opcode::LOAD_CONST)
+				cout << " " << ins.constant;
+			else if (ins.op == opcode::LOAD_INPUT)
+				cout << " slot " << ins.a;
+			else if (IsUnary(ins.op))
+				cout << " r" << ins.a;
+			else
+				cout << " r" << ins.a << ", r" << ins.b;
+			cout << endl;
+		}
+		if (result_registers.size() > 1)
+		{
+			cout << "results:";
+			for (size_t k = 0; k < result_registers.size(); k++)
+				cout << (k ? ", r" : " r") << result_registers[k];
+			cout << " (" << number_of_registers << " registers)" << endl;
+		}
+		else
+			cout << "result: r" << result_register << " (" << number_of_registers << " registers)" << endl;
+	}
+
+};
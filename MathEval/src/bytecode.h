@@ -0,0 +1,106 @@
+#pragma once
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include "parser.h"
+#include <cstdint>
+#include <vector>
+
+namespace MathEval
+{
+	/*
+	 the tree from Lexer::parser gets lowered into a flat register program:
+	   r0 = LOAD_INPUT  slot 0
+	   r1 = LOAD_CONST  3.14
+	   r1 = SIN         r1
+	   r0 = MULT        r0, r1
+	 instructions are stored in post-order, so a single forward pass over the array
+	 evaluates the expression. registers are recycled once their value has no more readers
+	 x^n with a constant exponent never reaches POW: an integer n (IsPowerChain, fast_math.h) is lowered into
+	 MULTs by repeated squaring (and a DIV for a negative n), 0.5 into SQRT
+	*/
+	enum class opcode : uint8_t
+	{
+		LOAD_CONST = 0, LOAD_INPUT,
+		ADD, SUB, MULT, DIV, POW, // same order as Lexer::bin_op
+		EXP, SIN, COS, TAN, ARCSIN, ARCCOS, ARCTAN, MINUS, SQRT, // same order as Lexer::unary_op
+	};
+	static constexpr opcode LAST_OPCODE = opcode::SQRT;
+
+	inline bool IsBinary(opcode op) { return op >= opcode::ADD && op <= opcode::POW; }
+	inline bool IsUnary(opcode op) { return op >= opcode::EXP; }
+
+	// dst = op(a, b), unary ops ignore b
+	// LOAD_INPUT keeps the input slot in a, LOAD_CONST keeps the float inline
+	struct instruction
+	{
+		opcode op;
+		uint32_t dst;
+		uint32_t a;
+		union
+		{
+			uint32_t b;
+			float constant;
+		};
+	};
+
+	class program
+	{
+	public:
+		program() = default;
+		// identifiers have to be resolved to slots already, see syntax_tree::ResolveInputs
+		// without reuse_registers every instruction writes its own register (dst == its index), which
+		// keeps every intermediate value around for passes that walk the program backwards (autodiff.h)
+		program(const Lexer::syntax_tree& tree, uint32_t root, bool reuse_registers = true);
+		// several results out of one program (multi_expression.h), shared subtrees are computed once for all of them
+		// and no result register is recycled, GetResultRegisters()[k] holds roots[k] at the end
+		program(const Lexer::syntax_tree& tree, const std::vector<uint32_t>& roots, bool reuse_registers = true);
+		// a program lowered earlier (ie: read back from an archive, serialize.h), checked instruction by instruction
+		// throws std::invalid_argument for an unknown opcode, a register read before it's written or past
+		// number_of_registers, a slot past number_of_slots, or (without reuse_registers) a dst other than the index,
+		// and for more registers than instructions (exactly as many without reuse_registers), every register is
+		// some instruction's dst so a bigger count can only be damage, and it sizes the jit's stack frame
+		program(std::vector<instruction> instructions, uint32_t number_of_registers, std::vector<uint32_t> result_registers,
+			size_t number_of_slots, bool reuse_registers);
+
+		inline const instruction* GetInstructions() const { return instructions.data(); }
+		inline size_t GetNumOfInstructions() const { return instructions.size(); }
+		inline uint32_t GetNumOfRegisters() const { return number_of_registers; }
+		inline uint32_t GetResultRegister() const { return result_register; }
+		inline const std::vector<uint32_t>& GetResultRegisters() const { return result_registers; }
+		// tree node each instruction was lowered from (a power chain belongs to its POW node), for reports that map
+		// costs back onto the tree (profiler.h); empty for a program read back from an archive
+		inline const std::vector<uint32_t>& GetSourceNodes() const { return source_nodes; }
+
+		// extras
+		void Print() const;
+	private:
+		std::vector<instruction> instructions;
+		uint32_t number_of_registers = 0;
+		uint32_t result_register = 0;
+		std::vector<uint32_t> result_registers; // one per root, result_register is the first
+		std::vector<uint32_t> source_nodes; // per instruction
+
+		// compile state, only used while lowering
+		const Lexer::syntax_tree* tree = nullptr;
+		std::vector<uint32_t> remaining_uses; // per node index
+		std::vector<uint32_t> node_register; // per node index, NO_REGISTER until emitted
+		std::vector<uint32_t> free_registers;
+		bool reuse_registers = true;
+
+		static constexpr uint32_t NO_REGISTER = UINT32_MAX;
+
+		void CountUses(uint32_t root);
+		bool IsReducedPower(const Lexer::tree_node& n) const;
+		uint32_t Emit(uint32_t root);
+		void EmitNode(uint32_t node);
+		uint32_t EmitPower(uint32_t base, float exponent);
+		uint32_t Append(opcode op, uint32_t a, uint32_t b);
+		uint32_t AllocateRegister();
+		void ReleaseOperand(uint32_t operand);
+	};
+
+	const char* GetOpcodeName(opcode);
+};
+
+#endif // BYTECODE_H
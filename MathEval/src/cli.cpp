@@ -0,0 +1,713 @@
+// comment out the below definition if using elsewhere
+// uncomment out below definition to build the command line evaluator
+//#define MATH_EVAL_CLI_MAIN
+#ifdef MATH_EVAL_CLI_MAIN
+#include "../include/ExpressionEvaluation.h"
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MATH_EVAL_CLI_MMAP
+#endif
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+/*
+ streams rows through one expression from the shell:
+   matheval_cli [options] <expression> <var>=<column> ...
+   cat data.csv | matheval_cli "sin(x)*exp(y)" x=0 y=2 > out.csv
+   matheval_cli --input data.f32 --format f32 --columns 4 --output-format f32 "a*b+c" a=0 b=1 c=3 > out.f32
+ three threads joined by bounded ring buffers of batches: parse (reads stdin or walks a memory-mapped file and fills
+ columns), evaluate (RunBatch on the best simd kernel) and write (formats and writes the outputs), a fixed number of
+ batches circulate so memory stays the same whatever the input size; mapped pages are dropped once parsed
+ options
+   --input FILE          read FILE instead of stdin, memory mapped where the os allows (--no-mmap reads it instead)
+   --output FILE         write FILE instead of stdout
+   --format csv|f32      input: csv lines (default) or records of --columns little-endian float32 values
+   --columns N           floats per f32 record
+   --output-format csv|f32
+   --header              the first csv line names the columns, <var>=<name> may use those names
+   --delimiter C         csv field separator, ',' by default
+   --batch N             rows per batch (16384)
+   --buffers N           batches in flight (4)
+   --precision MODE      default, exact, ulp1, ulp2 or ulp4 (fast_math.h)
+   --quiet               no throughput report
+ columns count from 0, the report (rows/s, MB/s in and out, how busy each stage was) goes to stderr
+*/
+
+namespace
+{
+	enum class format : char { CSV, F32 };
+
+	struct settings
+	{
+		std::string expression;
+		std::vector<std::pair<std::string, std::string>> mapping; // variable, column index or header name
+		std::string input, output;
+		format input_format = format::CSV;
+		format output_format = format::CSV;
+		size_t record_columns = 0;
+		bool header = false;
+		char delimiter = ',';
+		size_t batch_rows = 16384;
+		size_t buffers = 4;
+		MathEval::precision precision = MathEval::precision::DEFAULT;
+		bool mmap = true;
+		bool quiet = false;
+	};
+
+	// fixed number of slots, Push waits while it's full and Pop while it's empty
+	// after Close, Push drops and Pop drains what's left, then returns false
+	template <class T>
+	class ring_buffer
+	{
+	public:
+		explicit ring_buffer(size_t capacity) : slots(capacity) {}
+
+		void Push(T value)
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			not_full.wait(guard, [&] { return count < slots.size() || closed; });
+			if (closed)
+				return;
+			slots[(head + count) % slots.size()] = value;
+			count++;
+			not_empty.notify_one();
+		}
+
+		bool Pop(T& value)
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			not_empty.wait(guard, [&] { return count > 0 || closed; });
+			if (count == 0)
+				return false;
+			value = slots[head];
+			head = (head + 1) % slots.size();
+			count--;
+			not_full.notify_one();
+			return true;
+		}
+
+		void Close()
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			closed = true;
+			not_empty.notify_all();
+			not_full.notify_all();
+		}
+	private:
+		std::mutex lock;
+		std::condition_variable not_empty, not_full;
+		std::vector<T> slots;
+		size_t head = 0, count = 0;
+		bool closed = false;
+	};
+
+	struct batch
+	{
+		std::vector<std::vector<float>> columns; // per input slot, batch_rows values
+		std::vector<float> output;
+		std::string text; // output formatted for writing
+		size_t rows = 0;
+	};
+
+	static bool IsLittleEndian()
+	{
+		const uint32_t one = 1;
+		unsigned char first;
+		std::memcpy(&first, &one, 1);
+		return first == 1;
+	}
+
+	static float SwapBytes(float x)
+	{
+		uint32_t bits;
+		std::memcpy(&bits, &x, sizeof(bits));
+		bits = (bits >> 24) | ((bits >> 8) & 0xff00u) | ((bits << 8) & 0xff0000u) | (bits << 24);
+		std::memcpy(&x, &bits, sizeof(bits));
+		return x;
+	}
+
+	class pipeline
+	{
+	public:
+		pipeline(const settings& config, std::shared_ptr<const MathEval::compiled_expression> compiled, FILE* in, FILE* out)
+			: config(config), compiled(std::move(compiled)), in(in), out(out), free_batches(config.buffers), parsed(config.buffers), evaluated(config.buffers)
+		{
+			batches.resize(config.buffers);
+			for (batch& b : batches)
+			{
+				b.columns.assign(config.mapping.size(), std::vector<float>(config.batch_rows));
+				b.output.resize(config.batch_rows);
+				free_batches.Push(&b);
+			}
+			swap = !IsLittleEndian();
+		}
+
+		void Run()
+		{
+			auto start = std::chrono::steady_clock::now();
+			std::thread parse_thread([this] { Stage([this] { Parse(); }); parsed.Close(); });
+			std::thread evaluate_thread([this] { Stage([this] { Evaluate(); }); evaluated.Close(); });
+			Stage([this] { Write(); });
+			parse_thread.join();
+			evaluate_thread.join();
+			seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			if (error)
+				std::rethrow_exception(error);
+		}
+
+		void Report() const
+		{
+			double rate = seconds > 0 ? rows / seconds : 0.0;
+			fprintf(stderr, "%zu rows in %.3f s: %.0f rows/s, %.1f MB/s in, %.1f MB/s out (%s, %s)\n", rows, seconds, rate,
+				seconds > 0 ? bytes_in / seconds / 1e6 : 0.0, seconds > 0 ? bytes_out / seconds / 1e6 : 0.0,
+				MathEval::GetIsaName(MathEval::GetSupportedIsa()), mapped ? "mapped" : "streamed");
+			// the stage closest to 100% is the bottleneck
+			fprintf(stderr, "busy: parse %.0f%%, evaluate %.0f%%, write %.0f%%\n", Busy(parse_seconds - parse_waiting), Busy(evaluate_seconds), Busy(write_seconds));
+		}
+	private:
+		const settings& config;
+		std::shared_ptr<const MathEval::compiled_expression> compiled;
+		FILE* in;
+		FILE* out;
+		std::vector<batch> batches;
+		ring_buffer<batch*> free_batches, parsed, evaluated;
+		bool swap = false; // big endian host, f32 data gets its bytes swapped
+
+		// parse state
+		std::vector<size_t> slot_column; // per slot, the column it reads
+		std::vector<char> column_read; // per column up to the last one read, 1 if a slot reads it
+		std::vector<float> fields; // one csv line, the columns that are read
+		size_t line = 0;
+		bool header_pending = false;
+		batch* current = nullptr;
+
+		std::mutex error_lock;
+		std::exception_ptr error;
+		std::atomic<bool> failed{ false };
+
+		// report
+		size_t rows = 0;
+		size_t bytes_in = 0, bytes_out = 0;
+		bool mapped = false;
+		double seconds = 0, parse_seconds = 0, evaluate_seconds = 0, write_seconds = 0;
+		double parse_waiting = 0; // parse_seconds covers the whole stage, this is the part spent on the ring buffers
+
+		double Busy(double stage) const { return seconds > 0 ? 100.0 * stage / seconds : 0.0; }
+
+		// runs a stage, the first failure is kept and every queue closed so the other stages stop too
+		template <class Body>
+		void Stage(Body body)
+		{
+			try
+			{
+				body();
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> guard(error_lock);
+				if (!error)
+					error = std::current_exception();
+				failed = true;
+				free_batches.Close();
+				parsed.Close();
+				evaluated.Close();
+			}
+		}
+
+		// adds the time until it goes out of scope to total
+		struct busy_timer
+		{
+			double& total;
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			~busy_timer() { total += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(); }
+		};
+
+		void ResolveColumns(const std::vector<std::string>& names)
+		{
+			slot_column.clear();
+			for (const auto& [variable, column] : config.mapping)
+			{
+				size_t index = 0;
+				auto [end, failure] = std::from_chars(column.data(), column.data() + column.size(), index);
+				if (failure != std::errc() || end != column.data() + column.size())
+				{
+					auto found = std::find(names.begin(), names.end(), column);
+					if (found == names.end())
+						throw std::runtime_error("no column named " + column + (config.header ? "" : " (names need --header)"));
+					index = static_cast<size_t>(found - names.begin());
+				}
+				if (config.input_format == format::F32 && index >= config.record_columns)
+					throw std::runtime_error("column " + column + " is past --columns");
+				slot_column.push_back(index);
+			}
+			size_t last = 0;
+			for (size_t column : slot_column)
+				last = std::max(last, column);
+			column_read.assign(slot_column.empty() ? 0 : last + 1, 0);
+			for (size_t column : slot_column)
+				column_read[column] = 1; // the value lands in fields, every slot reading the column copies it from there
+			fields.assign(column_read.size(), 0.0f);
+		}
+
+		static std::vector<std::string> SplitHeader(const char* begin, const char* end, char delimiter)
+		{
+			std::vector<std::string> names;
+			const char* field = begin;
+			for (const char* p = begin;; p++)
+			{
+				if (p == end || *p == delimiter)
+				{
+					const char* a = field;
+					const char* b = p;
+					while (a < b && (*a == ' ' || *a == '\t' || *a == '"'))
+						a++;
+					while (b > a && (b[-1] == ' ' || b[-1] == '\t' || b[-1] == '"'))
+						b--;
+					names.emplace_back(a, b);
+					if (p == end)
+						break;
+					field = p + 1;
+				}
+			}
+			return names;
+		}
+
+		void ParseLine(const char* begin, const char* end)
+		{
+			line++;
+			if (end > begin && end[-1] == '\r')
+				end--;
+			if (begin == end)
+				return;
+			if (header_pending)
+			{
+				ResolveColumns(SplitHeader(begin, end, config.delimiter));
+				header_pending = false;
+				return;
+			}
+
+			size_t column = 0;
+			const char* p = begin;
+			while (column < column_read.size())
+			{
+				const char* field_end = static_cast<const char*>(std::memchr(p, config.delimiter, end - p));
+				if (!field_end)
+					field_end = end;
+				if (column_read[column])
+				{
+					const char* a = p;
+					while (a < field_end && (*a == ' ' || *a == '\t'))
+						a++;
+					if (a < field_end && *a == '+')
+						a++;
+					auto [number_end, failure] = std::from_chars(a, field_end, fields[column]);
+					while (number_end < field_end && (*number_end == ' ' || *number_end == '\t'))
+						number_end++;
+					if (failure != std::errc() || number_end != field_end)
+					{
+						// out of range values still parse, to inf or 0 like strtof
+						if (failure == std::errc::result_out_of_range)
+							fields[column] = static_cast<float>(std::strtod(std::string(a, field_end).c_str(), nullptr));
+						else
+							throw std::runtime_error("line " + std::to_string(line) + ", column " + std::to_string(column) + ": not a number");
+					}
+				}
+				column++;
+				if (field_end == end)
+					break;
+				p = field_end + 1;
+			}
+			if (column < column_read.size())
+				throw std::runtime_error("line " + std::to_string(line) + ": " + std::to_string(column) + " columns, column "
+					+ std::to_string(column_read.size() - 1) + " is read");
+
+			for (size_t s = 0; s < slot_column.size(); s++)
+				current->columns[s][current->rows] = fields[slot_column[s]];
+			current->rows++;
+		}
+
+		// whole lines (or records) of data go into batches, the batch in progress stays in current
+		// returns the bytes used, the rest is an incomplete line unless final
+		size_t Consume(const char* data, size_t size, bool final)
+		{
+			size_t used = 0;
+			while (used < size && !failed)
+			{
+				if (!current)
+				{
+					busy_timer waiting{ parse_waiting };
+					if (!free_batches.Pop(current))
+						return used;
+					current->rows = 0;
+				}
+				if (config.input_format == format::CSV)
+				{
+					while (current->rows < config.batch_rows && used < size)
+					{
+						const char* begin = data + used;
+						const char* end = static_cast<const char*>(std::memchr(begin, '\n', size - used));
+						if (!end && !final)
+							return used;
+						size_t length = end ? static_cast<size_t>(end - begin) + 1 : size - used;
+						ParseLine(begin, end ? end : data + size);
+						used += length;
+					}
+				}
+				else
+				{
+					size_t record = config.record_columns * sizeof(float);
+					size_t records = std::min((size - used) / record, config.batch_rows - current->rows);
+					if (records == 0 && final)
+						throw std::runtime_error("input ends inside a record, " + std::to_string(size - used) + " bytes left");
+					for (size_t r = 0; r < records; r++)
+					{
+						const char* p = data + used + r * record;
+						for (size_t s = 0; s < slot_column.size(); s++)
+						{
+							float value;
+							std::memcpy(&value, p + slot_column[s] * sizeof(float), sizeof(float));
+							current->columns[s][current->rows + r] = swap ? SwapBytes(value) : value;
+						}
+					}
+					current->rows += records;
+					used += records * record;
+					if (records == 0)
+						return used;
+				}
+				if (current->rows == config.batch_rows)
+				{
+					busy_timer waiting{ parse_waiting };
+					parsed.Push(current);
+					current = nullptr;
+				}
+			}
+			return used;
+		}
+
+		void Parse()
+		{
+			header_pending = config.header && config.input_format == format::CSV;
+			if (!header_pending)
+				ResolveColumns({});
+#ifdef MATH_EVAL_CLI_MMAP
+			if (!config.input.empty() && config.mmap && ParseMapped())
+				return;
+#endif
+			busy_timer timer{ parse_seconds };
+			// a line longer than the buffer doubles it
+			std::vector<char> buffer(size_t(1) << 20);
+			size_t filled = 0;
+			while (!failed)
+			{
+				size_t got = fread(buffer.data() + filled, 1, buffer.size() - filled, in);
+				bytes_in += got;
+				filled += got;
+				bool final = got == 0;
+				size_t used = Consume(buffer.data(), filled, final);
+				if (final)
+					break;
+				std::memmove(buffer.data(), buffer.data() + used, filled - used);
+				filled -= used;
+				if (filled == buffer.size())
+					buffer.resize(buffer.size() * 2);
+			}
+			if (ferror(in))
+				throw std::runtime_error("read error");
+			Flush();
+		}
+
+#ifdef MATH_EVAL_CLI_MMAP
+		// false if the file can't be mapped (a pipe, /dev/stdin, ...), Parse reads it instead
+		bool ParseMapped()
+		{
+			int fd = fileno(in);
+			struct stat info;
+			if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size == 0)
+				return false;
+			size_t size = static_cast<size_t>(info.st_size);
+			void* map = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (map == MAP_FAILED)
+				return false;
+			mapped = true;
+			busy_timer timer{ parse_seconds };
+			const char* data = static_cast<const char*>(map);
+			madvise(map, size, MADV_SEQUENTIAL);
+
+			// windows keep the pages in use bounded, pages behind the parser are handed back
+			static const size_t WINDOW = size_t(1) << 24;
+			size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+			size_t offset = 0, window = WINDOW, released = 0;
+			try
+			{
+				while (offset < size && !failed)
+				{
+					size_t end = std::min(size, offset + window);
+					size_t used = Consume(data + offset, end - offset, end == size);
+					if (used == 0 && end != size)
+					{
+						window *= 2; // a line longer than the window
+						continue;
+					}
+					if (used == 0)
+						break;
+					offset += used;
+					bytes_in += used;
+					window = WINDOW;
+					size_t behind = offset / page * page;
+					if (behind - released >= WINDOW)
+					{
+						madvise(const_cast<char*>(data) + released, behind - released, MADV_DONTNEED);
+						released = behind;
+					}
+				}
+				Flush();
+			}
+			catch (...)
+			{
+				munmap(map, size);
+				throw;
+			}
+			munmap(map, size);
+			return true;
+		}
+#endif
+
+		// the last, partly filled batch
+		void Flush()
+		{
+			if (current && current->rows)
+				parsed.Push(current);
+			current = nullptr;
+		}
+
+		void Evaluate()
+		{
+			const MathEval::program& prog = compiled->prog;
+			MathEval::isa target = MathEval::GetSupportedIsa();
+			std::vector<const float*> columns(config.mapping.size());
+			batch* b;
+			while (parsed.Pop(b))
+			{
+				{
+					busy_timer timer{ evaluate_seconds };
+					for (size_t s = 0; s < columns.size(); s++)
+						columns[s] = b->columns[s].data();
+					MathEval::RunBatch(prog, columns.data(), b->output.data(), b->rows, target, compiled->precision);
+				}
+				evaluated.Push(b);
+			}
+		}
+
+		void Write()
+		{
+			batch* b;
+			while (evaluated.Pop(b))
+			{
+				busy_timer timer{ write_seconds };
+				size_t written;
+				if (config.output_format == format::CSV)
+				{
+					// shortest text that reads back to the same float
+					b->text.resize(b->rows * 16);
+					char* p = &b->text[0];
+					char* end = p + b->text.size();
+					for (size_t i = 0; i < b->rows; i++)
+					{
+						p = std::to_chars(p, end, b->output[i]).ptr;
+						*p++ = '\n';
+					}
+					size_t length = static_cast<size_t>(p - b->text.data());
+					written = fwrite(b->text.data(), 1, length, out);
+					if (written != length)
+						throw std::runtime_error("write error");
+				}
+				else
+				{
+					if (swap)
+					{
+						for (size_t i = 0; i < b->rows; i++)
+							b->output[i] = SwapBytes(b->output[i]);
+					}
+					written = fwrite(b->output.data(), sizeof(float), b->rows, out) * sizeof(float);
+					if (written != b->rows * sizeof(float))
+						throw std::runtime_error("write error");
+				}
+				bytes_out += written;
+				rows += b->rows;
+				free_batches.Push(b);
+			}
+			if (fflush(out) != 0)
+				throw std::runtime_error("write error");
+		}
+	};
+
+	static bool ParseFormat(const char* text, format& f)
+	{
+		if (!std::strcmp(text, "csv"))
+			f = format::CSV;
+		else if (!std::strcmp(text, "f32"))
+			f = format::F32;
+		else
+			return false;
+		return true;
+	}
+
+	static bool ParseCount(const char* text, size_t& value)
+	{
+		auto [end, failure] = std::from_chars(text, text + std::strlen(text), value);
+		return failure == std::errc() && *end == '\0' && value > 0;
+	}
+
+	static int Usage(const char* program)
+	{
+		std::cerr << "usage: " << program << " [--input file] [--output file] [--format csv|f32] [--columns n] [--output-format csv|f32]\n"
+			"       [--header] [--delimiter c] [--batch rows] [--buffers n] [--precision mode] [--no-mmap] [--quiet]\n"
+			"       <expression> <var>=<column> ...\n";
+		return 2;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	settings config;
+	for (int i = 1; i < argc; i++)
+	{
+		const char* arg = argv[i];
+		bool has_value = i + 1 < argc;
+		if (!std::strcmp(arg, "--input") && has_value)
+			config.input = argv[++i];
+		else if (!std::strcmp(arg, "--output") && has_value)
+			config.output = argv[++i];
+		else if (!std::strcmp(arg, "--format") && has_value)
+		{
+			if (!ParseFormat(argv[++i], config.input_format))
+				return Usage(argv[0]);
+		}
+		else if (!std::strcmp(arg, "--output-format") && has_value)
+		{
+			if (!ParseFormat(argv[++i], config.output_format))
+				return Usage(argv[0]);
+		}
+		else if (!std::strcmp(arg, "--columns") && has_value)
+		{
+			if (!ParseCount(argv[++i], config.record_columns))
+				return Usage(argv[0]);
+		}
+		else if (!std::strcmp(arg, "--batch") && has_value)
+		{
+			if (!ParseCount(argv[++i], config.batch_rows))
+				return Usage(argv[0]);
+		}
+		else if (!std::strcmp(arg, "--buffers") && has_value)
+		{
+			if (!ParseCount(argv[++i], config.buffers) || config.buffers < 2)
+				return Usage(argv[0]);
+		}
+		else if (!std::strcmp(arg, "--delimiter") && has_value)
+		{
+			const char* d = argv[++i];
+			if (std::strlen(d) != 1 && std::strcmp(d, "\\t"))
+				return Usage(argv[0]);
+			config.delimiter = std::strcmp(d, "\\t") ? d[0] : '\t';
+		}
+		else if (!std::strcmp(arg, "--precision") && has_value)
+		{
+			const char* mode = argv[++i];
+			bool found = false;
+			for (MathEval::precision p : { MathEval::precision::DEFAULT, MathEval::precision::EXACT,
+				MathEval::precision::ULP1, MathEval::precision::ULP2, MathEval::precision::ULP4 })
+			{
+				if (!std::strcmp(mode, MathEval::GetPrecisionName(p)))
+				{
+					config.precision = p;
+					found = true;
+				}
+			}
+			if (!found)
+				return Usage(argv[0]);
+		}
+		else if (!std::strcmp(arg, "--header"))
+			config.header = true;
+		else if (!std::strcmp(arg, "--no-mmap"))
+			config.mmap = false;
+		else if (!std::strcmp(arg, "--quiet"))
+			config.quiet = true;
+		else if (arg[0] == '-' && arg[1] == '-')
+			return Usage(argv[0]);
+		else if (config.expression.empty())
+			config.expression = arg;
+		else
+		{
+			const char* equals = std::strchr(arg, '=');
+			if (!equals || equals == arg || !equals[1])
+				return Usage(argv[0]);
+			config.mapping.emplace_back(std::string(arg, equals), std::string(equals + 1));
+		}
+	}
+	if (config.expression.empty() || (config.input_format == format::F32 && config.record_columns == 0))
+		return Usage(argv[0]);
+
+	try
+	{
+		std::unordered_map<std::string, size_t> definition;
+		for (size_t slot = 0; slot < config.mapping.size(); slot++)
+		{
+			if (!definition.emplace(config.mapping[slot].first, slot).second)
+				throw std::runtime_error("variable " + config.mapping[slot].first + " is mapped twice");
+		}
+		MathEval::compile_options options;
+		options.precision = config.precision;
+		auto compiled = MathEval::CompileExpression(config.expression, definition, config.mapping.size(), options);
+
+		FILE* in = stdin;
+		FILE* out = stdout;
+		if (!config.input.empty() && !(in = fopen(config.input.c_str(), "rb")))
+			throw std::runtime_error("can't read " + config.input);
+		if (!config.output.empty() && !(out = fopen(config.output.c_str(), "wb")))
+			throw std::runtime_error("can't write " + config.output);
+#ifdef _WIN32
+		// stdin/stdout default to text mode there, which would mangle f32 data
+		_setmode(_fileno(in), _O_BINARY);
+		_setmode(_fileno(out), _O_BINARY);
+#endif
+
+		pipeline run(config, compiled, in, out);
+		run.Run();
+		if (!config.quiet)
+			run.Report();
+		if (in != stdin)
+			fclose(in);
+		if (out != stdout && fclose(out) != 0)
+			throw std::runtime_error("can't write " + config.output);
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << argv[0] << ": " << e.what() << "\n";
+		return 1;
+	}
+	return 0;
+}
+
+#endif
@@ -0,0 +1,246 @@
+#pragma once
+#ifndef DECIMAL_H
+#define DECIMAL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string_view>
+
+namespace Lexer
+{
+	namespace decimal_detail
+	{
+		// fixed size unsigned integer, just the operations the conversion below needs
+		// 24 limbs is 768 bits, the largest value it ever holds is around 580 bits
+		struct big
+		{
+			static constexpr size_t LIMBS = 24;
+			uint32_t limb[LIMBS] = {};
+
+			constexpr void MulAdd(uint32_t m, uint32_t a)
+			{
+				uint64_t carry = a;
+				for (size_t i = 0; i < LIMBS; i++)
+				{
+					uint64_t v = static_cast<uint64_t>(limb[i]) * m + carry;
+					limb[i] = static_cast<uint32_t>(v);
+					carry = v >> 32;
+				}
+			}
+
+			constexpr void ShiftLeft(size_t bits)
+			{
+				size_t words = bits / 32;
+				size_t rest = bits % 32;
+				for (size_t i = LIMBS; i-- > 0;)
+				{
+					uint64_t v = 0;
+					if (i >= words)
+					{
+						v = static_cast<uint64_t>(limb[i - words]) << rest;
+						if (rest && i >= words + 1)
+							v |= limb[i - words - 1] >> (32 - rest);
+					}
+					limb[i] = static_cast<uint32_t>(v);
+				}
+			}
+
+			constexpr size_t BitLength() const
+			{
+				for (size_t i = LIMBS; i-- > 0;)
+				{
+					if (limb[i])
+					{
+						size_t bits = 0;
+						for (uint32_t v = limb[i]; v; v >>= 1)
+							bits++;
+						return i * 32 + bits;
+					}
+				}
+				return 0;
+			}
+
+			constexpr int Compare(const big& other) const
+			{
+				for (size_t i = LIMBS; i-- > 0;)
+				{
+					if (limb[i] != other.limb[i])
+						return limb[i] < other.limb[i] ? -1 : 1;
+				}
+				return 0;
+			}
+
+			constexpr void Subtract(const big& other)
+			{
+				uint64_t borrow = 0;
+				for (size_t i = 0; i < LIMBS; i++)
+				{
+					uint64_t v = static_cast<uint64_t>(limb[i]) - other.limb[i] - borrow;
+					limb[i] = static_cast<uint32_t>(v);
+					borrow = (v >> 32) & 1;
+				}
+			}
+		};
+
+		// floor(num * 2^shift / den) for a quotient below 2^26, num keeps the remainder
+		constexpr uint32_t Divide(big num, big den, int shift, big& remainder)
+		{
+			if (shift >= 0)
+				num.ShiftLeft(static_cast<size_t>(shift));
+			else
+				den.ShiftLeft(static_cast<size_t>(-shift));
+			uint32_t q = 0;
+			for (int j = 25; j >= 0; j--)
+			{
+				big step = den;
+				step.ShiftLeft(static_cast<size_t>(j));
+				if (num.Compare(step) >= 0)
+				{
+					num.Subtract(step);
+					q |= 1u << j;
+				}
+			}
+			remainder = num;
+			return q;
+		}
+
+		// q * 2^exponent, exact for anything a float can hold
+		constexpr float Scale(uint32_t q, int exponent)
+		{
+			double value = static_cast<double>(q);
+			for (; exponent > 0; exponent--)
+				value *= 2.0;
+			for (; exponent < 0; exponent++)
+				value *= 0.5;
+			return static_cast<float>(value);
+		}
+	}
+
+	/*
+	 decimal NUM lexeme (digits with an optional '.') to the nearest float, ties to even, like strtof
+	 parsing stops at a second '.', same as strtof does
+	 constexpr so compile time and runtime constants come out of the same code
+	*/
+	constexpr float ParseNumber(std::string_view lexeme)
+	{
+		using decimal_detail::big;
+		// 120 significant digits are enough to place any float rounding boundary exactly,
+		// later digits only matter as a sticky bit
+		constexpr size_t MAX_DIGITS = 120;
+
+		big num;
+		size_t digits = 0; // significant digits kept in num
+		int exponent10 = 0; // value = num * 10^exponent10
+		bool sticky = false;
+		bool dot = false;
+		for (char c : lexeme)
+		{
+			if (c == '.')
+			{
+				if (dot)
+					break;
+				dot = true;
+				continue;
+			}
+			if (c < '0' || c > '9')
+				break;
+			uint32_t d = static_cast<uint32_t>(c - '0');
+			if (digits == 0 && d == 0)
+			{
+				// leading zeros only move the decimal point
+				if (dot)
+					exponent10--;
+				continue;
+			}
+			if (digits < MAX_DIGITS)
+			{
+				num.MulAdd(10, d);
+				digits++;
+				if (dot)
+					exponent10--;
+			}
+			else
+			{
+				sticky |= d != 0;
+				if (!dot)
+					exponent10++;
+			}
+		}
+
+		if (digits == 0)
+			return 0.0f;
+		// fast path: the digits and the power of ten are both exact floats (10^10 = 2^10 * 5^10 and 5^10 < 2^24),
+		// so one correctly rounded multiply or divide is the answer, that covers nearly every literal people write
+		if (digits <= 7 && !sticky && exponent10 >= -10 && exponent10 <= 10)
+		{
+			float value = static_cast<float>(num.limb[0]);
+			float power = 1.0f;
+			for (int i = 0; i < (exponent10 < 0 ? -exponent10 : exponent10); i++)
+				power *= 10.0f;
+			return exponent10 < 0 ? value / power : value * power;
+		}
+		int leading = exponent10 + static_cast<int>(digits) - 1; // decimal exponent of the first digit
+		if (leading > 38)
+			return std::numeric_limits<float>::infinity(); // past FLT_MAX + half an ulp whatever the digits
+		if (leading < -46)
+			return 0.0f; // below half the smallest denormal
+
+		big den;
+		den.MulAdd(1, 1);
+		if (exponent10 > 0)
+		{
+			for (int i = 0; i < exponent10; i++)
+				num.MulAdd(10, 0);
+		}
+		else
+		{
+			for (int i = 0; i < -exponent10; i++)
+				den.MulAdd(10, 0);
+		}
+
+		// pick the shift that leaves 24 bits in the quotient
+		int shift = 23 - (static_cast<int>(num.BitLength()) - static_cast<int>(den.BitLength()));
+		big remainder;
+		uint32_t q = decimal_detail::Divide(num, den, shift, remainder);
+		while (q >= (1u << 24))
+		{
+			shift--;
+			q = decimal_detail::Divide(num, den, shift, remainder);
+		}
+		while (q < (1u << 23))
+		{
+			shift++;
+			q = decimal_detail::Divide(num, den, shift, remainder);
+		}
+		int exponent2 = -shift; // value = (q + rem) * 2^exponent2, q has 24 bits
+		if (exponent2 + 23 > 127)
+			return std::numeric_limits<float>::infinity();
+		if (exponent2 < -149)
+		{
+			// denormal, the last bit is worth 2^-149 so fewer than 24 bits are left
+			shift = 149;
+			exponent2 = -149;
+			q = decimal_detail::Divide(num, den, shift, remainder);
+		}
+
+		// round to nearest: twice the remainder against the divisor
+		big divisor = den;
+		if (shift < 0)
+			divisor.ShiftLeft(static_cast<size_t>(-shift));
+		remainder.ShiftLeft(1);
+		int half = remainder.Compare(divisor);
+		if (half > 0 || (half == 0 && (sticky || (q & 1))))
+			q++;
+		if (q == (1u << 24))
+		{
+			q >>= 1;
+			exponent2++;
+			if (exponent2 + 23 > 127)
+				return std::numeric_limits<float>::infinity();
+		}
+		return decimal_detail::Scale(q, exponent2);
+	}
+};
+
+#endif // DECIMAL_H
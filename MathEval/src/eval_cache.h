@@ -0,0 +1,370 @@
+#pragma once
+#ifndef EVAL_CACHE_H
+#define EVAL_CACHE_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace MathEval
+{
+	enum class cache_policy : char
+	{
+		LRU = 0, // evict the least recently used entry of the probe window
+		CLOCK, // second chance: skip entries hit since the hand last passed them
+		DIRECT_MAPPED, // one slot per key, a new key always replaces the old one
+	};
+
+	struct cache_stats
+	{
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+		uint64_t insertions = 0;
+		uint64_t evictions = 0;
+		uint64_t probes = 0; // slots looked at by lookups, probes / (hits + misses) is the average probe length
+		uint64_t max_probe = 0;
+	};
+
+	/*
+	 fixed capacity memo of inputs -> result, open addressing with linear probing, nothing is allocated after construction
+	 keys compare by their bits, so -0 and 0 are different inputs (1/x tells them apart)
+	 and a NaN input finds its own entry again instead of adding a new one every time
+	 a key lives within PROBE_WINDOW slots of its hash, the policy picks the victim inside that window
+	 not thread-safe, sharded_cache below wraps it in locks
+	*/
+	template <size_t S>
+	class eval_cache
+	{
+	public:
+		static constexpr size_t PROBE_WINDOW = 8;
+
+		// capacity rounds up to a power of two, 0 turns the cache off
+		explicit eval_cache(size_t capacity = 4096, cache_policy policy = cache_policy::CLOCK)
+			: policy(policy)
+		{
+			if (capacity == 0)
+				return;
+			size_t rounded = 1;
+			while (rounded < capacity)
+				rounded <<= 1;
+			slots.resize(rounded);
+			tags.resize(rounded, 0);
+			mask = rounded - 1;
+		}
+
+		// bit pattern hash of the inputs, the sharded cache picks a shard from it before calling in
+		static inline size_t HashOf(const std::array<float, S>& inputs) { return Hash(ToKey(inputs)); }
+
+		inline bool Find(const std::array<float, S>& inputs, float& value) { return Find(inputs, HashOf(inputs), value); }
+		inline void Insert(const std::array<float, S>& inputs, float value) { Insert(inputs, HashOf(inputs), value); }
+
+		bool Find(const std::array<float, S>& inputs, size_t hash, float& value)
+		{
+			if (slots.empty())
+				return false;
+			key_t key = ToKey(inputs);
+			uint8_t tag = ToTag(hash);
+			size_t window = GetWindow();
+			for (size_t i = 0; i < window; i++)
+			{
+				size_t index = (hash + i) & mask;
+				// nothing is ever erased, so an empty slot ends the chain
+				if (tags[index] == 0)
+				{
+					Probed(i + 1);
+					stats.misses++;
+					return false;
+				}
+				if (tags[index] == tag && slots[index].key == key)
+				{
+					Probed(i + 1);
+					stats.hits++;
+					Touch(index);
+					value = slots[index].value;
+					return true;
+				}
+			}
+			Probed(window);
+			stats.misses++;
+			return false;
+		}
+
+		void Insert(const std::array<float, S>& inputs, size_t hash, float value)
+		{
+			if (slots.empty())
+				return;
+			key_t key = ToKey(inputs);
+			uint8_t tag = ToTag(hash);
+			size_t window = GetWindow();
+			for (size_t i = 0; i < window; i++)
+			{
+				size_t index = (hash + i) & mask;
+				if (tags[index] == 0)
+				{
+					stats.insertions++;
+					size++;
+					Store(index, tag, key, value);
+					return;
+				}
+				if (tags[index] == tag && slots[index].key == key)
+				{
+					Store(index, tag, key, value);
+					return;
+				}
+			}
+			stats.insertions++;
+			stats.evictions++;
+			Store(Victim(hash), tag, key, value);
+		}
+
+		void Clear()
+		{
+			std::fill(tags.begin(), tags.end(), static_cast<uint8_t>(0));
+			size = 0;
+			tick = 0;
+		}
+
+		inline const cache_stats& GetStats() const { return stats; }
+		inline void ResetStats() { stats = cache_stats(); }
+		inline size_t GetCapacity() const { return slots.size(); }
+		inline size_t GetSize() const { return size; }
+		inline cache_policy GetPolicy() const { return policy; }
+	private:
+		typedef std::array<uint32_t, S> key_t;
+
+		struct slot
+		{
+			key_t key;
+			float value;
+			uint32_t stamp; // LRU: tick of the last use, CLOCK: reference bit
+		};
+
+		// tags[i] is 0 for an empty slot, otherwise 8 bits of the key's hash, so most
+		// probes are answered from this one dense array without touching the slots
+		std::vector<uint8_t> tags;
+		std::vector<slot> slots;
+		size_t mask = 0;
+		size_t size = 0;
+		uint32_t tick = 0; // wraps, ages are compared as tick - stamp
+		cache_policy policy;
+		cache_stats stats;
+
+		static key_t ToKey(const std::array<float, S>& inputs)
+		{
+			key_t key;
+			memcpy(key.data(), inputs.data(), sizeof(key));
+			return key;
+		}
+
+		static size_t Hash(const key_t& key)
+		{
+			uint64_t h = 0x243F6A8885A308D3ull;
+			for (uint32_t word : key)
+				h = (h ^ word) * 0x9E3779B97F4A7C15ull;
+			return static_cast<size_t>(h ^ (h >> 29));
+		}
+
+		// top bits, the slot index already uses the bottom ones
+		static inline uint8_t ToTag(size_t hash)
+		{
+			uint8_t tag = static_cast<uint8_t>(static_cast<uint64_t>(hash) >> 56);
+			return tag ? tag : 1;
+		}
+
+		inline size_t GetWindow() const
+		{
+			if (policy == cache_policy::DIRECT_MAPPED)
+				return 1;
+			return slots.size() < PROBE_WINDOW ? slots.size() : PROBE_WINDOW;
+		}
+
+		inline void Probed(size_t length)
+		{
+			stats.probes += length;
+			if (length > stats.max_probe)
+				stats.max_probe = length;
+		}
+
+		inline void Touch(size_t index)
+		{
+			if (policy == cache_policy::LRU)
+				slots[index].stamp = ++tick;
+			else if (policy == cache_policy::CLOCK)
+				slots[index].stamp = 1;
+		}
+
+		inline void Store(size_t index, uint8_t tag, const key_t& key, float value)
+		{
+			tags[index] = tag;
+			slots[index].key = key;
+			slots[index].value = value;
+			// a new CLOCK entry starts without its reference bit, it has to be hit to earn a second chance
+			slots[index].stamp = policy == cache_policy::LRU ? ++tick : 0;
+		}
+
+		// window is full, pick which slot to overwrite
+		size_t Victim(size_t hash)
+		{
+			size_t window = GetWindow(); // a power of two
+			if (policy == cache_policy::LRU)
+			{
+				size_t oldest = hash & mask;
+				for (size_t i = 1; i < window; i++)
+				{
+					size_t index = (hash + i) & mask;
+					if (tick - slots[index].stamp > tick - slots[oldest].stamp)
+						oldest = index;
+				}
+				return oldest;
+			}
+			if (policy == cache_policy::CLOCK)
+			{
+				// the hand sweeps the window clearing reference bits, at most one lap before something is free
+				size_t start = tick++;
+				for (size_t i = 0; i < 2 * window; i++)
+				{
+					size_t index = (hash + ((start + i) & (window - 1))) & mask;
+					if (slots[index].stamp == 0)
+						return index;
+					slots[index].stamp = 0;
+				}
+			}
+			return hash & mask;
+		}
+	};
+
+	/*
+	 eval_cache split into independently locked shards, for one evaluator shared by many threads
+	 a key always maps to the same shard (bits of its hash the shard doesn't use for slots or tags),
+	 so threads only contend when they hit the same shard at the same moment
+	 each shard sits on its own cache lines, its lock and counters don't bounce between unrelated threads
+	 Find still takes the shard's lock, LRU and CLOCK hits write recency bits
+	 nothing is allocated until the first Insert, an evaluator that never stores costs a few words for its cache
+	*/
+	template <size_t S>
+	class sharded_cache
+	{
+	public:
+		// shards rounds up to a power of two, 0 -> enough for the hardware threads, capacity is split between them
+		sharded_cache(size_t capacity, cache_policy policy, size_t shards = 0)
+			: capacity(capacity), requested_shards(shards), policy(policy)
+		{}
+
+		bool Find(const std::array<float, S>& inputs, float& value)
+		{
+			// nothing stored yet, skip the hash and the lock, a cache that's off doesn't count anything
+			if (!filled.load(std::memory_order_acquire))
+			{
+				if (capacity != 0)
+					empty_misses.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+			size_t hash = eval_cache<S>::HashOf(inputs);
+			shard& s = ShardOf(hash);
+			std::lock_guard<std::mutex> lock(s.lock);
+			return s.cache.Find(inputs, hash, value);
+		}
+
+		void Insert(const std::array<float, S>& inputs, float value)
+		{
+			if (capacity == 0)
+				return;
+			std::call_once(built, [this] { Build(); });
+			size_t hash = eval_cache<S>::HashOf(inputs);
+			shard& s = ShardOf(hash);
+			{
+				std::lock_guard<std::mutex> lock(s.lock);
+				s.cache.Insert(inputs, hash, value);
+			}
+			if (!filled.load(std::memory_order_relaxed))
+				filled.store(true, std::memory_order_release);
+		}
+
+		void Clear()
+		{
+			if (filled.load(std::memory_order_acquire))
+			{
+				for (auto& s : table)
+				{
+					std::lock_guard<std::mutex> lock(s->lock);
+					s->cache.Clear();
+					s->cache.ResetStats();
+				}
+			}
+			empty_misses.store(0, std::memory_order_relaxed);
+			filled.store(false, std::memory_order_release);
+		}
+
+		// counters summed over the shards
+		cache_stats GetStats() const
+		{
+			cache_stats total;
+			total.misses = empty_misses.load(std::memory_order_relaxed);
+			if (!filled.load(std::memory_order_acquire))
+				return total;
+			for (auto& s : table)
+			{
+				std::lock_guard<std::mutex> lock(s->lock);
+				const cache_stats& part = s->cache.GetStats();
+				total.hits += part.hits;
+				total.misses += part.misses;
+				total.insertions += part.insertions;
+				total.evictions += part.evictions;
+				total.probes += part.probes;
+				if (part.max_probe > total.max_probe)
+					total.max_probe = part.max_probe;
+			}
+			return total;
+		}
+
+		// 0 while nothing is stored
+		inline size_t GetNumOfShards() const { return filled.load(std::memory_order_acquire) ? table.size() : 0; }
+	private:
+		static constexpr size_t MAX_SHARDS = 256;
+		static constexpr size_t MIN_SHARD_CAPACITY = 64;
+
+		struct alignas(64) shard
+		{
+			shard(size_t capacity, cache_policy policy) : cache(capacity, policy) {}
+			mutable std::mutex lock;
+			eval_cache<S> cache;
+		};
+
+		size_t capacity;
+		size_t requested_shards;
+		cache_policy policy;
+		std::once_flag built;
+		std::vector<std::unique_ptr<shard>> table; // empty until built, only read once filled is set
+		size_t mask = 0;
+		std::atomic<bool> filled{ false };
+		std::atomic<uint64_t> empty_misses{ 0 }; // Find calls answered before anything was stored
+
+		void Build()
+		{
+			// asking the os for the thread count costs microseconds, once is enough
+			static const size_t hardware_threads = static_cast<size_t>(std::thread::hardware_concurrency());
+			size_t shards = requested_shards == 0 ? 4 * hardware_threads : requested_shards;
+			size_t rounded = 1;
+			while (rounded < shards && rounded < MAX_SHARDS)
+				rounded <<= 1;
+			// tiny caches stay in one shard rather than splitting into useless slivers
+			while (rounded > 1 && capacity / rounded < MIN_SHARD_CAPACITY)
+				rounded >>= 1;
+			for (size_t i = 0; i < rounded; i++)
+				table.emplace_back(new shard((capacity + rounded - 1) / rounded, policy));
+			mask = rounded - 1;
+		}
+
+		// slots use the low bits of the hash and tags the top 8, shards take the bits just below the tag
+		inline shard& ShardOf(size_t hash) { return *table[(static_cast<uint64_t>(hash) >> 48) & mask]; }
+	};
+};
+
+#endif // EVAL_CACHE_H
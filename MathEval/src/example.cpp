@@ -9,7 +9,7 @@
 #include <chrono>
 
 
-int main(int argc, char** argv)
+int main()
 {
 	std::unordered_map<std::string, size_t> definition;
 	definition["a"] = 0;
@@ -20,37 +20,29 @@ int main(int argc, char** argv)
 	std::array<float, 1> inputs{};
 	inputs[0] = 1.0f;
 
-	double avg_ns_noCache;
-	double avg_ns_cache = 0.0;
 	const size_t ITERATIONS = 1000000;
 
-	std::chrono::time_point< std::chrono::high_resolution_clock> time = std::chrono::high_resolution_clock::now();
+	// time the whole loop once, a clock read per call would cost about as much as the call
+	// see bench/benchmark.cpp for the full suite (warmup, statistics, json)
+	auto start = std::chrono::steady_clock::now();
+	float sum = 0.0f;
 	for (size_t i = 0; i < ITERATIONS; i++)
 	{
-		inputs[0] = (i % ITERATIONS);
-		//std::cout << compute.Evaluate(inputs) << std::endl
-		//inputs[0] = i;
-		compute.Evaluate(inputs);
-		auto currentTime = std::chrono::high_resolution_clock::now(); // current time
-		auto elapsed_time = std::chrono::duration_cast<std::chrono::nanoseconds>(currentTime - time); // time diff
-		time = currentTime; // update current time
-		avg_ns_noCache = elapsed_time.count(); // print time diff
+		inputs[0] = static_cast<float>(i);
+		sum += compute.Evaluate(inputs);
 	}
-	/*
-	time = std::chrono::high_resolution_clock::now();
+	double avg_ns_noCache = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / ITERATIONS;
+
+	// 1000 distinct inputs, so all but the first pass over them are cache hits
+	start = std::chrono::steady_clock::now();
 	for (size_t i = 0; i < ITERATIONS; i++)
 	{
-		inputs[0] = (i % ITERATIONS);
-		//inputs[0] = i;
-		//std::cout << compute.Evaluate(inputs, true) << std::endl;
-		compute.Evaluate(inputs, true);
-		auto currentTime = std::chrono::high_resolution_clock::now(); // current time
-		auto elapsed_time = std::chrono::duration_cast<std::chrono::nanoseconds>(currentTime - time); // time diff
-		time = currentTime; // update current time
-		avg_ns_cache = elapsed_time.count(); // print time diff
-	}*/
-
-	std::cout << "results (500 iterations)\n" << "avg cache: " << avg_ns_cache / ITERATIONS << "ns" << std::endl << "avg no cache : " << avg_ns_noCache / ITERATIONS << "ns" << std::endl;
+		inputs[0] = static_cast<float>(i % 1000);
+		sum += compute.Evaluate(inputs, true);
+	}
+	double avg_ns_cache = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / ITERATIONS;
+
+	std::cout << "results (" << ITERATIONS << " iterations, checksum " << sum << ")\n" << "avg cache: " << avg_ns_cache << "ns" << std::endl << "avg no cache : " << avg_ns_noCache << "ns" << std::endl;
 	std::cin.get();
 
 
@@ -0,0 +1,129 @@
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include "batch.h"
+#include "batch_kernel.h"
+
+namespace MathEval
+{
+	// one float at a time through the lane interface, so Evaluate runs the exact same polynomials as the simd kernels
+	struct scalar_lane
+	{
+		using reg = float;
+		using ireg = int32_t;
+		static constexpr size_t WIDTH = 1;
+
+		static inline reg load(const float* p) { return *p; }
+		static inline void store(float* p, reg v) { *p = v; }
+		static inline reg broadcast(float f) { return f; }
+
+		static inline reg add(reg a, reg b) { return a + b; }
+		static inline reg sub(reg a, reg b) { return a - b; }
+		static inline reg mul(reg a, reg b) { return a * b; }
+		static inline reg fmadd(reg a, reg b, reg c) { return a * b + c; }
+		static inline reg fnmadd(reg a, reg b, reg c) { return c - a * b; }
+		static inline reg floor(reg a) { return static_cast<reg>(Floor(a)); }
+		static inline reg xor_(reg a, reg b) { return as_float(as_int(a) ^ as_int(b)); }
+
+		// like cvttps, out of range and NaN give INT32_MIN instead of undefined behaviour
+		static inline ireg cvtt(reg a) { return a > -2147483648.0f && a < 2147483648.0f ? static_cast<ireg>(a) : INT32_MIN; }
+		// wrapping like the simd adds
+		static inline ireg iadd(ireg a, int b) { return static_cast<ireg>(static_cast<uint32_t>(a) + static_cast<uint32_t>(b)); }
+		static inline ireg iand(ireg a, int b) { return a & b; }
+		template <int N>
+		static inline ireg shl(ireg a) { return static_cast<ireg>(static_cast<uint32_t>(a) << N); }
+		static inline reg as_float(ireg a)
+		{
+			float f;
+			memcpy(&f, &a, sizeof(f));
+			return f;
+		}
+
+		static inline reg select_if_zero(ireg i, reg a, reg b) { return i == 0 ? a : b; }
+		static inline unsigned outside(reg x, float lo, float hi) { return x >= lo && x <= hi ? 0u : 1u; }
+		static inline reg reduce(reg x, reg& k, reg& lo, double inverse, double c1, double c2, double c3)
+		{
+			double dk = Floor(x * inverse + 0.5);
+			double r = x - dk * c1;
+			r = r - dk * c2;
+			r = r - dk * c3;
+			float hi = static_cast<float>(r);
+			k = static_cast<float>(dk);
+			lo = static_cast<float>(r - hi);
+			return hi;
+		}
+	private:
+		// floor/floorf are library calls without sse4.1, big values are integers already (or lanes libm redoes)
+		static inline double Floor(double a)
+		{
+			if (!(fabs(a) < 2147483647.0))
+				return a;
+			double t = static_cast<double>(static_cast<int32_t>(a));
+			return t > a ? t - 1.0 : t;
+		}
+		static inline ireg as_int(reg a)
+		{
+			ireg i;
+			memcpy(&i, &a, sizeof(i));
+			return i;
+		}
+	};
+
+	static float ExpUlp1(float x) { return approx_math<scalar_lane>::exp(x, precision::ULP1); }
+	static float ExpUlp2(float x) { return approx_math<scalar_lane>::exp(x, precision::ULP2); }
+	static float ExpUlp4(float x) { return approx_math<scalar_lane>::exp(x, precision::ULP4); }
+	static float SinUlp1(float x) { return approx_math<scalar_lane>::sin(x, precision::ULP1); }
+	static float SinUlp2(float x) { return approx_math<scalar_lane>::sin(x, precision::ULP2); }
+	static float CosUlp1(float x) { return approx_math<scalar_lane>::cos(x, precision::ULP1); }
+	static float CosUlp2(float x) { return approx_math<scalar_lane>::cos(x, precision::ULP2); }
+
+	// the plain libm names can be overloaded or macros, wrap them so they have one address
+	static float LibmExp(float x) { return expf(x); }
+	static float LibmSin(float x) { return sinf(x); }
+	static float LibmCos(float x) { return cosf(x); }
+	static float LibmTan(float x) { return tanf(x); }
+	static float LibmArcsin(float x) { return asinf(x); }
+	static float LibmArccos(float x) { return acosf(x); }
+	static float LibmArctan(float x) { return atanf(x); }
+	static float Minus(float x) { return -x; }
+	static float Sqrt(float x) { return sqrtf(x); }
+
+	const char* GetPrecisionName(precision p)
+	{
+		switch (p)
+		{
+		case precision::EXACT: return "exact";
+		case precision::ULP1:  return "ulp1";
+		case precision::ULP2:  return "ulp2";
+		case precision::ULP4:  return "ulp4";
+		default:               return "default";
+		}
+	}
+
+	unary_function GetUnaryFunction(opcode op, precision p)
+	{
+		// no precision knob for these
+		switch (op)
+		{
+		case opcode::TAN:    return LibmTan;
+		case opcode::ARCSIN: return LibmArcsin;
+		case opcode::ARCCOS: return LibmArccos;
+		case opcode::ARCTAN: return LibmArctan;
+		case opcode::MINUS:  return Minus;
+		case opcode::SQRT:   return Sqrt;
+		default:             break;
+		}
+		switch (p)
+		{
+		case precision::ULP1:
+			return op == opcode::EXP ? ExpUlp1 : (op == opcode::SIN ? SinUlp1 : CosUlp1);
+		case precision::ULP2:
+			return op == opcode::EXP ? ExpUlp2 : (op == opcode::SIN ? SinUlp2 : CosUlp2);
+		case precision::ULP4:
+			// sin/cos have nothing cheaper than the ULP2 kernel
+			return op == opcode::EXP ? ExpUlp4 : (op == opcode::SIN ? SinUlp2 : CosUlp2);
+		default:
+			return op == opcode::EXP ? LibmExp : (op == opcode::SIN ? LibmSin : LibmCos);
+		}
+	}
+};
@@ -0,0 +1,92 @@
+#pragma once
+#ifndef FAST_MATH_H
+#define FAST_MATH_H
+
+#include "bytecode.h"
+#include <cmath>
+
+namespace MathEval
+{
+	/*
+	 how exp/sin/cos are computed, picked per evaluator with MathEvaluatorOptions::precision
+	   DEFAULT    libm for Evaluate and the scalar jit, the cephes polynomials of batch_kernel.h for EvaluateBatch
+	              (those lose most near the zeros of sin/cos, measured worst cases in the table below)
+	   EXACT      libm everywhere, EvaluateBatch matches Evaluate bit for bit but runs the math one lane at a time
+	   ULP1/2/4   polynomials after range reduction (batch_kernel.h approx_math), the same code on every path,
+	              at most 1/2/4 ulp from the correctly rounded result
+	 the bounds hold for every float (bench/accuracy.cpp checks them), worst cases over every float with |x| <= 1e6
+	 (past that sin/cos go to libm):
+	              exp     sin     cos
+	   ULP1       0.70    0.92    0.91
+	   ULP2       1.28    1.58    1.59
+	   ULP4       3.22    1.58    1.59
+	   DEFAULT    1.27    47.7    44.1    EvaluateBatch on sse4.1
+	              1.23    18.7    41.1    EvaluateBatch on avx2/avx-512
+	 DEFAULT has no bound to hold, those are what bench/accuracy.cpp measures, Evaluate under it is libm (0.56 for all three)
+	 ULP2 and ULP4 share the sin/cos kernel, ULP4 only saves a term on exp
+	 speed (the precision cases of bench/benchmark.cpp): in batch ULP4/ULP2/ULP1 cost about 1.0/1.2/1.4x DEFAULT and EXACT 4-5x, one at a time
+	 libm is already quick and the ULP modes run 1.5x slower than it, pick them there to get the batch numbers
+	 Evaluate and EvaluateBatch can still differ in the last bit, the avx kernels fuse multiply-adds and the
+	 scalar code doesn't, both stay in bound
+	 gradients on the scalar path (EvaluateWithGradient, programs without a batch kernel) use what Evaluate does
+	 tan/arcsin/arccos/arctan only have the DEFAULT batch polynomials (cephes again, a few ulp, tan loses more next to
+	 its poles), every other mode runs libm for them on every path; minus and sqrt are exact everywhere
+	*/
+	enum class precision : char
+	{
+		DEFAULT = 0, EXACT, ULP1, ULP2, ULP4,
+	};
+
+	const char* GetPrecisionName(precision);
+
+	typedef float (*unary_function)(float);
+
+	// scalar version of the unary op for p, plain libm for DEFAULT and EXACT (and for every op but exp/sin/cos)
+	unary_function GetUnaryFunction(opcode op, precision p);
+
+	// integer exponents up to this size become multiply chains, 16 takes 4 multiplies
+	static constexpr int MAX_POWER_CHAIN = 16;
+
+	// true if x^y is computed as a multiply chain, an integer with 2 <= |y| <= MAX_POWER_CHAIN or -1
+	constexpr bool IsPowerChain(float y)
+	{
+		return y >= -MAX_POWER_CHAIN && y <= MAX_POWER_CHAIN && y != 0.0f && y != 1.0f && static_cast<float>(static_cast<int>(y)) == y;
+	}
+
+	/*
+	 x^y the way every path computes it (program lowers a constant exponent into the same steps):
+	   - IsPowerChain(y): square and multiply, x^8 = ((x*x)^2)^2, x^5 = x*x^4, a negative y takes 1/chain
+	     each multiply rounds, so it can be a few ulp from powf (and overflows where 1/powf wouldn't)
+	   - y = 0.5: sqrt, which also makes (-0)^0.5 -0 and (-inf)^0.5 NaN
+	   - anything else: powf
+	*/
+	inline float Power(float x, float y)
+	{
+		if (IsPowerChain(y))
+		{
+			int n = static_cast<int>(y);
+			unsigned m = static_cast<unsigned>(n < 0 ? -n : n);
+			float square = x;
+			float result = 0.0f;
+			bool first = true;
+			for (;;)
+			{
+				if (m & 1)
+				{
+					result = first ? square : result * square;
+					first = false;
+				}
+				m >>= 1;
+				if (!m)
+					break;
+				square = square * square;
+			}
+			return n < 0 ? 1.0f / result : result;
+		}
+		if (y == 0.5f)
+			return sqrtf(x);
+		return powf(x, y);
+	}
+};
+
+#endif // FAST_MATH_H
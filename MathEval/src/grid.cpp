@@ -0,0 +1,263 @@
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "grid.h"
+#include "autodiff.h"
+
+namespace MathEval
+{
+	size_t GetGridSize(const grid_axis* axes, size_t number_of_axes)
+	{
+		size_t size = 1;
+		for (size_t i = 0; i < number_of_axes; i++)
+			size *= axes[i].steps;
+		return size;
+	}
+
+	typedef void (*batch_function)(const instruction*, size_t, uint32_t, const float* const*, float*, size_t, float*, precision);
+
+	static batch_function GetBatchFunction(isa target)
+	{
+		switch (target)
+		{
+		case isa::AVX512: return RunBatchAvx512;
+		case isa::AVX2:   return RunBatchAvx2;
+		case isa::SSE4:   return RunBatchSse4;
+		default:          return RunBatchScalar;
+		}
+	}
+
+	namespace
+	{
+		struct grid_run
+		{
+			const instruction* ins = nullptr;
+			const grid_axis* axes = nullptr; // the axes that loop, more than one step each
+			size_t number_of_axes = 0;
+			uint32_t result = 0;
+			precision p = precision::DEFAULT;
+			unary_function exp_function = nullptr;
+			unary_function sin_function = nullptr;
+			unary_function cos_function = nullptr;
+
+			std::vector<std::vector<uint32_t>> levels; // instructions per level, the innermost level isn't here
+			std::vector<float> value; // one per instruction of ssa
+			std::vector<float> inputs; // per slot, the current step of its axis
+			std::vector<std::vector<float>> points; // per axis, the values it steps through
+			std::vector<size_t> stride; // per axis, output floats between two of its steps
+
+			// innermost level, renumbered so row register i is row instruction i
+			std::vector<instruction> row;
+			std::vector<std::pair<uint32_t, uint32_t>> patches; // row LOAD_CONST, ssa register it takes before each row
+			uint32_t row_result = 0;
+			bool row_hoisted = false; // the result doesn't depend on the innermost axis, a row is one value
+			batch_function kernel = nullptr;
+			float* scratch = nullptr;
+			std::vector<float> scratch_memory;
+
+			float Compute(const instruction& in, const float* reg, const float* slots) const
+			{
+				switch (in.op)
+				{
+				case opcode::LOAD_CONST: return in.constant;
+				case opcode::LOAD_INPUT: return slots[in.a];
+				case opcode::ADD:        return reg[in.a] + reg[in.b];
+				case opcode::SUB:        return reg[in.a] - reg[in.b];
+				case opcode::MULT:       return reg[in.a] * reg[in.b];
+				case opcode::DIV:        return reg[in.a] / reg[in.b];
+				case opcode::POW:        return Power(reg[in.a], reg[in.b]);
+				case opcode::EXP:        return exp_function(reg[in.a]);
+				case opcode::SIN:        return sin_function(reg[in.a]);
+				case opcode::COS:        return cos_function(reg[in.a]);
+				default:                 return UnaryValue(in.op, reg[in.a]);
+				}
+			}
+
+			void Run(const std::vector<uint32_t>& list)
+			{
+				for (uint32_t i : list)
+					value[i] = Compute(ins[i], value.data(), inputs.data());
+			}
+
+			void Row(float* out)
+			{
+				size_t count = axes[number_of_axes - 1].steps;
+				if (row_hoisted)
+				{
+					std::fill(out, out + count, value[result]);
+					return;
+				}
+				for (const std::pair<uint32_t, uint32_t>& patch : patches)
+					row[patch.first].constant = value[patch.second];
+				const float* column = points[number_of_axes - 1].data();
+				kernel(row.data(), row.size(), row_result, &column, out, count, scratch, p);
+			}
+
+			void Loop(size_t axis, float* out)
+			{
+				if (axis + 1 == number_of_axes)
+				{
+					Row(out);
+					return;
+				}
+				const grid_axis& g = axes[axis];
+				for (size_t i = 0; i < g.steps; i++)
+				{
+					inputs[g.slot] = points[axis][i];
+					Run(levels[axis + 1]);
+					Loop(axis + 1, out + i * stride[axis]);
+				}
+			}
+		};
+	}
+
+	void RunGrid(const program& ssa, const grid_axis* axes, size_t number_of_axes, float* output, isa target, precision p)
+	{
+		CheckGradientProgram(ssa);
+		const instruction* ins = ssa.GetInstructions();
+		size_t n = ssa.GetNumOfInstructions();
+		if (n == 0 || GetGridSize(axes, number_of_axes) == 0)
+			return;
+
+		// axis of every slot, then the level of every instruction
+		uint32_t slots = 0;
+		for (size_t i = 0; i < number_of_axes; i++)
+			slots = std::max(slots, axes[i].slot + 1);
+		for (size_t i = 0; i < n; i++)
+		{
+			if (ins[i].op == opcode::LOAD_INPUT)
+				slots = std::max(slots, ins[i].a + 1);
+		}
+		static constexpr size_t NO_AXIS = SIZE_MAX;
+		std::vector<size_t> axis_of_slot(slots, NO_AXIS);
+		for (size_t i = 0; i < number_of_axes; i++)
+		{
+			if (axis_of_slot[axes[i].slot] != NO_AXIS)
+				throw std::invalid_argument("RunGrid: two axes for input slot " + std::to_string(axes[i].slot));
+			axis_of_slot[axes[i].slot] = i;
+		}
+		// axes of one step are fixed inputs, they run with the constants and don't count as a loop
+		std::vector<grid_axis> loops;
+		std::vector<size_t> loop_of_slot(slots, NO_AXIS);
+		for (size_t i = 0; i < number_of_axes; i++)
+		{
+			if (axes[i].steps > 1)
+			{
+				loop_of_slot[axes[i].slot] = loops.size();
+				loops.push_back(axes[i]);
+			}
+		}
+		std::vector<size_t> level(n, 0);
+		for (size_t i = 0; i < n; i++)
+		{
+			const instruction& in = ins[i];
+			if (in.op == opcode::LOAD_INPUT)
+			{
+				if (axis_of_slot[in.a] == NO_AXIS)
+					throw std::invalid_argument("RunGrid: no axis for input slot " + std::to_string(in.a));
+				level[i] = loop_of_slot[in.a] == NO_AXIS ? 0 : loop_of_slot[in.a] + 1;
+			}
+			else if (IsBinary(in.op))
+				level[i] = std::max(level[in.a], level[in.b]);
+			else if (IsUnary(in.op))
+				level[i] = level[in.a];
+		}
+
+		grid_run run;
+		run.ins = ins;
+		run.axes = loops.data();
+		run.number_of_axes = loops.size();
+		run.result = ssa.GetResultRegister();
+		run.p = p;
+		run.exp_function = GetUnaryFunction(opcode::EXP, p);
+		run.sin_function = GetUnaryFunction(opcode::SIN, p);
+		run.cos_function = GetUnaryFunction(opcode::COS, p);
+		run.value.resize(n);
+		run.inputs.resize(slots);
+		for (size_t i = 0; i < number_of_axes; i++)
+			run.inputs[axes[i].slot] = axes[i].lo; // the loops overwrite theirs, the fixed ones keep it
+		run.levels.resize(std::max<size_t>(loops.size(), 1));
+		// the innermost level is left to the rows, without any loop everything is level 0 and runs once
+		for (size_t i = 0; i < n; i++)
+		{
+			if (level[i] < loops.size() || loops.empty())
+				run.levels[level[i]].push_back(static_cast<uint32_t>(i));
+		}
+		run.Run(run.levels[0]);
+		if (loops.empty())
+		{
+			output[0] = run.value[run.result];
+			return;
+		}
+
+		run.points.resize(loops.size());
+		run.stride.resize(loops.size());
+		size_t stride = 1;
+		for (size_t k = loops.size(); k-- > 0;)
+		{
+			const grid_axis& g = loops[k];
+			run.stride[k] = stride;
+			stride *= g.steps;
+			std::vector<float>& values = run.points[k];
+			values.resize(g.steps);
+			for (size_t i = 0; i < g.steps; i++)
+				values[i] = static_cast<float>(g.lo + (static_cast<double>(g.hi) - g.lo) * i / std::max<size_t>(g.steps - 1, 1));
+			if (g.steps > 1)
+				values.back() = g.hi;
+		}
+
+		// the innermost level, operands from the levels above become constants patched before every row
+		run.row_hoisted = level[run.result] < loops.size();
+		if (!run.row_hoisted)
+		{
+			static constexpr uint32_t NO_REGISTER = UINT32_MAX;
+			std::vector<uint32_t> row_register(n, NO_REGISTER);
+			auto operand = [&](uint32_t reg)
+			{
+				if (row_register[reg] == NO_REGISTER)
+				{
+					// only hoisted registers get here, a register of the innermost level is emitted before its readers
+					instruction load = {};
+					load.op = opcode::LOAD_CONST;
+					load.dst = static_cast<uint32_t>(run.row.size());
+					load.constant = 0.0f;
+					run.patches.push_back({ load.dst, reg });
+					row_register[reg] = load.dst;
+					run.row.push_back(load);
+				}
+				return row_register[reg];
+			};
+			for (size_t i = 0; i < n; i++)
+			{
+				if (level[i] != loops.size())
+					continue;
+				instruction in = ins[i];
+				if (in.op == opcode::LOAD_INPUT)
+					in.a = 0;
+				else if (IsBinary(in.op))
+				{
+					in.a = operand(in.a);
+					in.b = operand(in.b);
+				}
+				else if (IsUnary(in.op))
+					in.a = operand(in.a);
+				in.dst = static_cast<uint32_t>(run.row.size());
+				row_register[i] = in.dst;
+				run.row.push_back(in);
+			}
+			run.row_result = row_register[run.result];
+
+			if (target > GetSupportedIsa())
+				target = GetSupportedIsa();
+			size_t width = GetIsaWidth(target);
+			run.kernel = GetBatchFunction(target);
+			run.scratch_memory.resize(run.row.size() * width + 16);
+			uintptr_t address = reinterpret_cast<uintptr_t>(run.scratch_memory.data());
+			run.scratch = run.scratch_memory.data() + ((64 - (address & 63)) & 63) / sizeof(float);
+		}
+
+		run.Loop(0, output);
+	}
+};
@@ -0,0 +1,39 @@
+#pragma once
+#ifndef GRID_H
+#define GRID_H
+
+#include "bytecode.h"
+#include "batch.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace MathEval
+{
+	// one dimension of a grid: steps values from lo to hi inclusive, evenly spaced (steps 1 is just lo)
+	struct grid_axis
+	{
+		uint32_t slot = 0; // input slot this axis feeds
+		float lo = 0.0f;
+		float hi = 0.0f;
+		size_t steps = 1;
+	};
+
+	/*
+	 evaluates ssa over the cartesian product of the axes, axes[0] is the outermost loop and axes[number_of_axes - 1]
+	 the innermost, output is row-major in that order (the innermost axis is contiguous), product of the steps floats
+	 every instruction gets a level, the deepest axis its inputs depend on: level 0 runs once, level k once per step of
+	 axis k - 1 and only the innermost level runs per point, a whole row at a time on the simd kernels with the hoisted
+	 values patched in as constants. exp(b) in sin(a)*exp(b) with b outside a is computed once per row
+	 axes of one step are fixed inputs and cost nothing wherever they sit in the order
+	 ssa is a program built without register reuse (autodiff.h), every slot the program reads needs exactly one axis,
+	 throws std::invalid_argument otherwise
+	 the hoisted levels run the scalar math of Evaluate and the rows the kernels of EvaluateBatch, so under DEFAULT the
+	 last bits of exp/sin/cos can differ from both, EXACT matches Evaluate bit for bit
+	*/
+	void RunGrid(const program& ssa, const grid_axis* axes, size_t number_of_axes, float* output, isa target, precision p = precision::DEFAULT);
+
+	// number of points RunGrid writes
+	size_t GetGridSize(const grid_axis* axes, size_t number_of_axes);
+};
+
+#endif // GRID_H
@@ -0,0 +1,175 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include "incremental.h"
+#include "autodiff.h"
+
+namespace MathEval
+{
+	static inline uint32_t Bits(float x)
+	{
+		uint32_t bits;
+		std::memcpy(&bits, &x, sizeof(bits));
+		return bits;
+	}
+
+	incremental_evaluator::incremental_evaluator(std::shared_ptr<const compiled_expression> compiled_input, size_t number_of_slots)
+		: compiled(std::move(compiled_input))
+	{
+		const program& ssa = compiled->gradient_program;
+		CheckGradientProgram(ssa);
+		ins = ssa.GetInstructions();
+		size_t n = ssa.GetNumOfInstructions();
+		value.resize(n);
+		inputs.resize(number_of_slots);
+		dependents.resize(number_of_slots);
+
+		// which slots reach every instruction, one bit per slot
+		words = (number_of_slots + 63) / 64;
+		reach.assign(n * words, 0);
+		changed_mask.assign(words, 0);
+		for (size_t i = 0; i < n; i++)
+		{
+			const instruction& in = ins[i];
+			uint64_t* mask = reach.data() + i * words;
+			if (in.op == opcode::LOAD_INPUT)
+			{
+				if (in.a >= number_of_slots)
+					throw std::out_of_range("incremental_evaluator: input slot past number_of_slots");
+				mask[in.a / 64] |= uint64_t(1) << (in.a % 64);
+			}
+			else if (in.op != opcode::LOAD_CONST)
+			{
+				const uint64_t* a = reach.data() + in.a * words;
+				for (size_t w = 0; w < words; w++)
+					mask[w] |= a[w];
+				if (IsBinary(in.op))
+				{
+					const uint64_t* b = reach.data() + in.b * words;
+					for (size_t w = 0; w < words; w++)
+						mask[w] |= b[w];
+				}
+			}
+
+			bool reached = false;
+			for (size_t s = 0; s < number_of_slots; s++)
+			{
+				if (mask[s / 64] >> (s % 64) & 1)
+				{
+					dependents[s].push_back(static_cast<uint32_t>(i));
+					reached = true;
+				}
+			}
+			if (!reached)
+				constant.push_back(static_cast<uint32_t>(i));
+		}
+		Run(constant);
+	}
+
+	inline void incremental_evaluator::Step(uint32_t i)
+	{
+		float* reg = value.data();
+		const instruction& in = ins[i];
+		switch (in.op)
+		{
+		case opcode::LOAD_CONST: reg[i] = in.constant;                              break;
+		case opcode::LOAD_INPUT: reg[i] = inputs[in.a];                             break;
+		case opcode::ADD:        reg[i] = reg[in.a] + reg[in.b];                    break;
+		case opcode::SUB:        reg[i] = reg[in.a] - reg[in.b];                    break;
+		case opcode::MULT:       reg[i] = reg[in.a] * reg[in.b];                    break;
+		case opcode::DIV:        reg[i] = reg[in.a] / reg[in.b];                    break;
+		case opcode::POW:        reg[i] = Power(reg[in.a], reg[in.b]);              break;
+		case opcode::EXP:        reg[i] = compiled->exp_function(reg[in.a]);        break;
+		case opcode::SIN:        reg[i] = compiled->sin_function(reg[in.a]);        break;
+		case opcode::COS:        reg[i] = compiled->cos_function(reg[in.a]);        break;
+		default:                 reg[i] = UnaryValue(in.op, reg[in.a]);             break;
+		}
+	}
+
+	void incremental_evaluator::Run(const std::vector<uint32_t>& list)
+	{
+		for (uint32_t i : list)
+			Step(i);
+		last_recomputed = list.size();
+	}
+
+	void incremental_evaluator::RunMasked()
+	{
+		size_t count = 0;
+		for (uint32_t i = 0; i < value.size(); i++)
+		{
+			const uint64_t* mask = reach.data() + i * words;
+			uint64_t hit = 0;
+			for (size_t w = 0; w < words; w++)
+				hit |= mask[w] & changed_mask[w];
+			if (hit)
+			{
+				Step(i);
+				count++;
+			}
+		}
+		last_recomputed = count;
+	}
+
+	void incremental_evaluator::RunAll(const float* new_inputs)
+	{
+		std::copy(new_inputs, new_inputs + inputs.size(), inputs.begin());
+		std::fill(changed_mask.begin(), changed_mask.end(), ~uint64_t(0));
+		RunMasked();
+		valid = true;
+	}
+
+	float incremental_evaluator::Evaluate(const float* new_inputs)
+	{
+		uint32_t result = compiled->gradient_program.GetResultRegister();
+		if (!valid)
+		{
+			RunAll(new_inputs);
+			return value[result];
+		}
+
+		size_t changed = 0, first = 0;
+		std::fill(changed_mask.begin(), changed_mask.end(), 0);
+		for (size_t s = 0; s < inputs.size(); s++)
+		{
+			if (Bits(new_inputs[s]) == Bits(inputs[s]))
+				continue;
+			inputs[s] = new_inputs[s];
+			changed_mask[s / 64] |= uint64_t(1) << (s % 64);
+			if (changed++ == 0)
+				first = s;
+		}
+		if (changed == 0)
+			last_recomputed = 0;
+		else if (changed == 1)
+			Run(dependents[first]);
+		else
+			RunMasked();
+		return value[result];
+	}
+
+	float incremental_evaluator::Set(size_t slot, float new_value)
+	{
+		uint32_t result = compiled->gradient_program.GetResultRegister();
+		if (!valid)
+		{
+			std::vector<float> all = inputs;
+			all[slot] = new_value;
+			RunAll(all.data());
+			return value[result];
+		}
+		if (Bits(new_value) == Bits(inputs[slot]))
+		{
+			last_recomputed = 0;
+			return value[result];
+		}
+		inputs[slot] = new_value;
+		Run(dependents[slot]);
+		return value[result];
+	}
+
+	void incremental_evaluator::Invalidate()
+	{
+		valid = false;
+	}
+};
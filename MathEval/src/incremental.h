@@ -0,0 +1,60 @@
+#pragma once
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include "registry.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace MathEval
+{
+	/*
+	 re-evaluation for callers that change a few inputs between calls (simulation steps and the like)
+	 keeps the value of every instruction of the SSA program (compiled_expression::gradient_program) from the last call
+	 and, per input slot, the sorted list of instructions that depend on it; a call recomputes only the union of the
+	 lists of the slots whose value changed, so changing input k costs the paths from k to the root, not the whole program
+	 an input counts as changed when its bits differ, so NaN inputs and -0/+0 are handled like any other value
+	 results match MathEvaluator::Evaluate bit for bit (same ops, same exp/sin/cos)
+	 not thread-safe, one per caller; MathEvaluator::CreateIncremental hands them out
+	*/
+	class incremental_evaluator
+	{
+	public:
+		incremental_evaluator(std::shared_ptr<const compiled_expression> compiled, size_t number_of_slots);
+
+		// inputs holds number_of_slots floats, the first call computes everything
+		float Evaluate(const float* inputs);
+		// changes one input and returns the new result, Evaluate with that input changed (inputs start at 0 before any call)
+		float Set(size_t slot, float value);
+		// forget the saved values, the next Evaluate computes everything again
+		void Invalidate();
+
+		// instructions the last call ran, out of GetNumOfInstructions()
+		inline size_t GetLastRecomputed() const { return last_recomputed; }
+		inline size_t GetNumOfInstructions() const { return value.size(); }
+		// instructions that read slot directly or through other instructions
+		inline const std::vector<uint32_t>& GetDependents(size_t slot) const { return dependents[slot]; }
+	private:
+		std::shared_ptr<const compiled_expression> compiled;
+		const instruction* ins = nullptr;
+		std::vector<float> value; // one per instruction, register i is instruction i
+		std::vector<float> inputs; // as of the last call
+		std::vector<std::vector<uint32_t>> dependents; // per slot, sorted
+		std::vector<uint32_t> constant; // instructions no input reaches
+		size_t words = 0; // per mask
+		std::vector<uint64_t> reach; // per instruction, a bit for every slot that reaches it
+		std::vector<uint64_t> changed_mask; // slots changed by this call
+		size_t last_recomputed = 0;
+		bool valid = false;
+
+		inline void Step(uint32_t i);
+		void Run(const std::vector<uint32_t>& list);
+		// every instruction reached by a slot of changed_mask
+		void RunMasked();
+		void RunAll(const float* new_inputs);
+	};
+};
+
+#endif // INCREMENTAL_H
@@ -0,0 +1,358 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <stdexcept>
+#include "interval.h"
+
+namespace MathEval
+{
+
+	static inline interval Whole() { return { -INFINITY, INFINITY }; }
+
+	// a + b rounded towards -inf, two-sum gives the exact rounding error of the float sum
+	static float AddDown(float a, float b)
+	{
+		float s = a + b;
+		if (!std::isfinite(s))
+			return s > 0.0f && std::isfinite(a) && std::isfinite(b) ? FLT_MAX : s;
+		float bb = s - a;
+		float error = (a - (s - bb)) + (b - bb);
+		return error < 0.0f ? nextafterf(s, -INFINITY) : s;
+	}
+	static float AddUp(float a, float b) { return -AddDown(-a, -b); }
+
+	// a float product is exact in double
+	static float MulDown(float a, float b)
+	{
+		if (!std::isfinite(a) || !std::isfinite(b))
+			return a * b;
+		double p = static_cast<double>(a) * b;
+		float f = static_cast<float>(p);
+		return static_cast<double>(f) > p ? nextafterf(f, -INFINITY) : f;
+	}
+	static float MulUp(float a, float b) { return -MulDown(-a, b); }
+
+	// b != 0, q * b - a is exact in double up to its last rounding, which keeps the sign
+	static float DivDown(float a, float b)
+	{
+		float q = a / b;
+		if (!std::isfinite(a) || !std::isfinite(b))
+			return q;
+		if (std::isinf(q))
+			return q > 0.0f ? FLT_MAX : q;
+		double r = static_cast<double>(q) * b - a;
+		// q is above a/b when r has the sign of b
+		return r != 0.0 && (r > 0.0) == (b > 0.0) ? nextafterf(q, -INFINITY) : q;
+	}
+	static float DivUp(float a, float b) { return -DivDown(-a, b); }
+
+	// v rounded to float towards -inf / +inf, then ulps more floats out
+	static float Down(double v, int ulps)
+	{
+		float f = static_cast<float>(v);
+		if (static_cast<double>(f) > v)
+			f = nextafterf(f, -INFINITY);
+		for (int i = 0; i < ulps; i++)
+			f = nextafterf(f, -INFINITY);
+		return f;
+	}
+	static float Up(double v, int ulps) { return -Down(-v, ulps); }
+
+	// how far the float exp/sin/cos Evaluate calls can be from the double one, in ulps, rounded up
+	static int Slack(precision p)
+	{
+		switch (p)
+		{
+		case precision::ULP1: return 2;
+		case precision::ULP2: return 3;
+		case precision::ULP4: return 5;
+		default:              return 2; // libm, within an ulp
+		}
+	}
+
+	static interval Add(interval x, interval y)
+	{
+		interval r = { AddDown(x.lo, y.lo), AddUp(x.hi, y.hi) };
+		return std::isnan(r.lo) || std::isnan(r.hi) ? Whole() : r;
+	}
+
+	static interval Sub(interval x, interval y)
+	{
+		interval r = { AddDown(x.lo, -y.hi), AddUp(x.hi, -y.lo) };
+		return std::isnan(r.lo) || std::isnan(r.hi) ? Whole() : r;
+	}
+
+	static interval Mul(interval x, interval y)
+	{
+		const float a[4] = { x.lo, x.lo, x.hi, x.hi };
+		const float b[4] = { y.lo, y.hi, y.lo, y.hi };
+		interval r = { INFINITY, -INFINITY };
+		for (int i = 0; i < 4; i++)
+		{
+			float lo = MulDown(a[i], b[i]), hi = MulUp(a[i], b[i]);
+			if (std::isnan(lo) || std::isnan(hi))
+				return Whole();
+			r.lo = std::min(r.lo, lo);
+			r.hi = std::max(r.hi, hi);
+		}
+		return r;
+	}
+
+	// x*x where both operands are the same register, never negative
+	static interval Square(interval x)
+	{
+		if (x.lo >= 0.0f)
+			return { MulDown(x.lo, x.lo), MulUp(x.hi, x.hi) };
+		if (x.hi <= 0.0f)
+			return { MulDown(x.hi, x.hi), MulUp(x.lo, x.lo) };
+		return { 0.0f, std::max(MulUp(x.lo, x.lo), MulUp(x.hi, x.hi)) };
+	}
+
+	static interval Div(interval x, interval y)
+	{
+		if (y.lo <= 0.0f && y.hi >= 0.0f)
+			return Whole();
+		const float a[4] = { x.lo, x.lo, x.hi, x.hi };
+		const float b[4] = { y.lo, y.hi, y.lo, y.hi };
+		interval r = { INFINITY, -INFINITY };
+		for (int i = 0; i < 4; i++)
+		{
+			float lo = DivDown(a[i], b[i]), hi = DivUp(a[i], b[i]);
+			if (std::isnan(lo) || std::isnan(hi))
+				return Whole();
+			r.lo = std::min(r.lo, lo);
+			r.hi = std::max(r.hi, hi);
+		}
+		return r;
+	}
+
+	static interval Exp(interval x, int slack)
+	{
+		return { std::max(0.0f, Down(std::exp(static_cast<double>(x.lo)), slack)), Up(std::exp(static_cast<double>(x.hi)), slack) };
+	}
+
+	// true if [lo, hi] may hold phase + 2k*pi for some k, a near miss counts as a hit
+	static bool HasPeak(double lo, double hi, double phase)
+	{
+		static const double TWO_PI = 6.28318530717958647692;
+		double k = std::ceil((lo - phase) / TWO_PI);
+		double slop = 1e-9 * std::max(1.0, std::max(std::fabs(lo), std::fabs(hi)));
+		for (double t : { phase + (k - 1.0) * TWO_PI, phase + k * TWO_PI })
+		{
+			if (t >= lo - slop && t <= hi + slop)
+				return true;
+		}
+		return false;
+	}
+
+	// past this a float has so few neighbours per period that the peak search isn't worth its rounding worries
+	static const float PERIODIC_LIMIT = 1048576.0f;
+
+	static interval SinCos(interval x, bool cosine, int slack)
+	{
+		static const double PI = 3.14159265358979323846;
+		if (!std::isfinite(x.lo) || !std::isfinite(x.hi) || static_cast<double>(x.hi) - x.lo >= 2.0 * PI
+			|| (x.lo != x.hi && std::max(std::fabs(x.lo), std::fabs(x.hi)) > PERIODIC_LIMIT))
+			return { Down(-1.0, slack), Up(1.0, slack) };
+
+		double (*f)(double) = cosine ? static_cast<double (*)(double)>(std::cos) : static_cast<double (*)(double)>(std::sin);
+		double a = f(x.lo), b = f(x.hi);
+		double lo = std::min(a, b), hi = std::max(a, b);
+		if (x.lo != x.hi)
+		{
+			// sin peaks at pi/2 and bottoms out at -pi/2, cos at 0 and pi
+			if (HasPeak(x.lo, x.hi, cosine ? 0.0 : 0.5 * PI))
+				hi = 1.0;
+			if (HasPeak(x.lo, x.hi, cosine ? PI : -0.5 * PI))
+				lo = -1.0;
+		}
+		return { Down(lo, slack), Up(hi, slack) };
+	}
+
+	// only exp/sin/cos follow the precision modes, the rest is always libm
+	static const int LIBM_SLACK = 2;
+
+	static interval Tan(interval x)
+	{
+		static const double PI = 3.14159265358979323846;
+		if (!std::isfinite(x.lo) || !std::isfinite(x.hi) || static_cast<double>(x.hi) - x.lo >= PI
+			|| (x.lo != x.hi && std::max(std::fabs(x.lo), std::fabs(x.hi)) > PERIODIC_LIMIT))
+			return Whole();
+		// increasing between the poles at pi/2 + k*pi
+		if (x.lo != x.hi && (HasPeak(x.lo, x.hi, 0.5 * PI) || HasPeak(x.lo, x.hi, -0.5 * PI)))
+			return Whole();
+		return { Down(std::tan(static_cast<double>(x.lo)), LIBM_SLACK), Up(std::tan(static_cast<double>(x.hi)), LIBM_SLACK) };
+	}
+
+	// asin increasing and acos decreasing, NaN past [-1, 1]
+	static interval ArcSinCos(interval x, bool cosine)
+	{
+		if (!(x.lo >= -1.0f && x.hi <= 1.0f))
+			return Whole();
+		if (cosine)
+			return { Down(std::acos(static_cast<double>(x.hi)), LIBM_SLACK), Up(std::acos(static_cast<double>(x.lo)), LIBM_SLACK) };
+		return { Down(std::asin(static_cast<double>(x.lo)), LIBM_SLACK), Up(std::asin(static_cast<double>(x.hi)), LIBM_SLACK) };
+	}
+
+	static interval ArcTan(interval x)
+	{
+		return { Down(std::atan(static_cast<double>(x.lo)), LIBM_SLACK), Up(std::atan(static_cast<double>(x.hi)), LIBM_SLACK) };
+	}
+
+	// sqrtf is correctly rounded
+	static interval Sqrt(interval x)
+	{
+		if (x.lo < 0.0f)
+			return Whole();
+		return { std::max(0.0f, Down(std::sqrt(static_cast<double>(x.lo)), 1)), Up(std::sqrt(static_cast<double>(x.hi)), 1) };
+	}
+
+	/*
+	 only for a positive base, where x^y = exp(y*ln(x)) and y*ln(x) is bilinear so the corners hold the extremes
+	 Power's multiply chains lose up to an ulp a step, MAX_POWER_CHAIN ulps more covers the longest
+	*/
+	static interval Pow(interval x, interval y)
+	{
+		if (!(x.lo > 0.0f) || !std::isfinite(x.hi) || !std::isfinite(y.lo) || !std::isfinite(y.hi))
+			return Whole();
+		const float a[4] = { x.lo, x.lo, x.hi, x.hi };
+		const float b[4] = { y.lo, y.hi, y.lo, y.hi };
+		double lo = INFINITY, hi = -INFINITY;
+		for (int i = 0; i < 4; i++)
+		{
+			double v = std::pow(static_cast<double>(a[i]), static_cast<double>(b[i]));
+			lo = std::min(lo, v);
+			hi = std::max(hi, v);
+		}
+		int slack = LIBM_SLACK + MAX_POWER_CHAIN;
+		return { std::max(0.0f, Down(lo, slack)), Up(hi, slack) };
+	}
+
+	interval RunInterval(const program& prog, const interval* inputs, precision p)
+	{
+		static constexpr uint32_t MAX_STACK_REGISTERS = 64;
+		interval stack_registers[MAX_STACK_REGISTERS];
+		std::vector<interval> heap_registers;
+		interval* reg = stack_registers;
+		if (prog.GetNumOfRegisters() > MAX_STACK_REGISTERS)
+		{
+			heap_registers.resize(prog.GetNumOfRegisters());
+			reg = heap_registers.data();
+		}
+
+		int slack = Slack(p);
+		const instruction* ins = prog.GetInstructions();
+		for (size_t i = 0, n = prog.GetNumOfInstructions(); i < n; i++)
+		{
+			const instruction& in = ins[i];
+			switch (in.op)
+			{
+			case opcode::LOAD_CONST: reg[in.dst] = { in.constant, in.constant };                                    break;
+			case opcode::LOAD_INPUT: reg[in.dst] = inputs[in.a];                                                    break;
+			case opcode::ADD:        reg[in.dst] = Add(reg[in.a], reg[in.b]);                                       break;
+			case opcode::SUB:        reg[in.dst] = Sub(reg[in.a], reg[in.b]);                                       break;
+			case opcode::MULT:       reg[in.dst] = in.a == in.b ? Square(reg[in.a]) : Mul(reg[in.a], reg[in.b]);    break;
+			case opcode::DIV:        reg[in.dst] = Div(reg[in.a], reg[in.b]);                                       break;
+			case opcode::EXP:        reg[in.dst] = Exp(reg[in.a], slack);                                           break;
+			case opcode::SIN:        reg[in.dst] = SinCos(reg[in.a], false, slack);                                 break;
+			case opcode::COS:        reg[in.dst] = SinCos(reg[in.a], true, slack);                                  break;
+			case opcode::POW:        reg[in.dst] = Pow(reg[in.a], reg[in.b]);                                       break;
+			case opcode::TAN:        reg[in.dst] = Tan(reg[in.a]);                                                  break;
+			case opcode::ARCSIN:     reg[in.dst] = ArcSinCos(reg[in.a], false);                                     break;
+			case opcode::ARCCOS:     reg[in.dst] = ArcSinCos(reg[in.a], true);                                      break;
+			case opcode::ARCTAN:     reg[in.dst] = ArcTan(reg[in.a]);                                               break;
+			case opcode::MINUS:      reg[in.dst] = { -reg[in.a].hi, -reg[in.a].lo };                                break;
+			case opcode::SQRT:       reg[in.dst] = Sqrt(reg[in.a]);                                                 break;
+			default:
+				throw std::out_of_range("RunInterval: unsupported operation");
+			}
+		}
+		return reg[prog.GetResultRegister()];
+	}
+
+	namespace
+	{
+		struct box_search
+		{
+			const program& prog;
+			precision p;
+			size_t number_of_slots;
+			float threshold;
+			const box_search_options& options;
+			std::vector<interval>& leaves;
+			box_search_stats& stats;
+			std::vector<bool> used; // per slot, does the program read it
+			std::vector<interval> boxes; // one box per depth, the current path from the root
+
+			void Leaf(const interval* box)
+			{
+				leaves.insert(leaves.end(), box, box + number_of_slots);
+				stats.leaves++;
+			}
+
+			void Search(size_t depth)
+			{
+				interval* box = boxes.data() + depth * number_of_slots;
+				if (stats.boxes >= options.max_boxes)
+				{
+					stats.truncated = true;
+					Leaf(box);
+					return;
+				}
+				stats.boxes++;
+				interval y = RunInterval(prog, box, p);
+				if (y.lo > threshold || y.hi < threshold)
+				{
+					stats.pruned++;
+					return;
+				}
+
+				// split the widest side that can still be halved
+				size_t split = number_of_slots;
+				float widest = options.min_width;
+				float mid = 0.0f;
+				for (size_t s = 0; s < number_of_slots; s++)
+				{
+					float width = box[s].Width();
+					float m = 0.5f * box[s].lo + 0.5f * box[s].hi;
+					if (used[s] && std::isfinite(width) && width > widest && m > box[s].lo && m < box[s].hi)
+					{
+						split = s;
+						widest = width;
+						mid = m;
+					}
+				}
+				if (split == number_of_slots || depth == options.max_depth)
+				{
+					Leaf(box);
+					return;
+				}
+
+				interval* child = box + number_of_slots;
+				std::copy(box, box + number_of_slots, child);
+				child[split].hi = mid;
+				Search(depth + 1);
+				std::copy(box, box + number_of_slots, child);
+				child[split].lo = mid;
+				Search(depth + 1);
+			}
+		};
+	}
+
+	void SearchBoxes(const program& prog, precision p, const interval* box, size_t number_of_slots, float threshold,
+		const box_search_options& options, std::vector<interval>& leaves, box_search_stats& stats)
+	{
+		box_search search = { prog, p, number_of_slots, threshold, options, leaves, stats, {}, {} };
+		search.used.assign(number_of_slots, false);
+		const instruction* ins = prog.GetInstructions();
+		for (size_t i = 0; i < prog.GetNumOfInstructions(); i++)
+		{
+			if (ins[i].op == opcode::LOAD_INPUT && ins[i].a < number_of_slots)
+				search.used[ins[i].a] = true;
+		}
+		search.boxes.resize((options.max_depth + 1) * number_of_slots);
+		std::copy(box, box + number_of_slots, search.boxes.begin());
+		search.Search(0);
+	}
+
+};
@@ -0,0 +1,61 @@
+#pragma once
+#ifndef INTERVAL_H
+#define INTERVAL_H
+
+#include "bytecode.h"
+#include "fast_math.h"
+#include <cstddef>
+#include <vector>
+
+namespace MathEval
+{
+	// every float from lo to hi, lo = -inf / hi = inf for unbounded sides
+	struct interval
+	{
+		float lo = 0.0f;
+		float hi = 0.0f;
+
+		inline bool Contains(float x) const { return lo <= x && x <= hi; }
+		inline float Width() const { return hi - lo; }
+	};
+
+	/*
+	 interval arithmetic over a program: every input slot is a range and the result bounds the output over the whole box
+	 + - * / round their bounds outwards exactly (the rounding error is recovered in float/double and the bound moved one
+	 float out only if needed), the functions are worked out in double and widened by the error of the float one
+	 Evaluate runs under p (fast_math.h), so the result holds both the exact value of the program and what Evaluate
+	 (or the scalar jit) returns at any point of the box
+	 sin/cos find the peaks inside the range instead of giving up to [-1, 1], tan gives up only when a pole is inside
+	 x^y is bounded for a positive base only
+	 NaN isn't tracked: an op that can make one (0*inf, inf-inf, x/[..0..], sqrt/asin/acos off their domain, pow of a
+	 base that may be <= 0) returns [-inf, inf] and so does the rest
+	 throws std::out_of_range for ops without an interval version
+	*/
+	interval RunInterval(const program& prog, const interval* inputs, precision p = precision::DEFAULT);
+
+	struct box_search_options
+	{
+		size_t max_depth = 32; // splits from the first box to a leaf
+		float min_width = 0.0f; // boxes with every side this narrow or less aren't split again
+		size_t max_boxes = size_t(1) << 20; // enclosures computed in total, the boxes still open past it become leaves
+	};
+
+	struct box_search_stats
+	{
+		size_t boxes = 0; // enclosures computed
+		size_t pruned = 0; // boxes whose enclosure left out the threshold
+		size_t leaves = 0; // boxes handed back
+		bool truncated = false; // ran into max_boxes
+	};
+
+	/*
+	 finds where the output may cross threshold inside box (number_of_slots ranges): the box is split in half along its
+	 widest side, recursively, and a piece is dropped as soon as its enclosure is all above or all below threshold
+	 the pieces left at max_depth / min_width come back in leaves, number_of_slots ranges each, only those need points
+	 sampled; inputs the program never reads are never split
+	*/
+	void SearchBoxes(const program& prog, precision p, const interval* box, size_t number_of_slots, float threshold,
+		const box_search_options& options, std::vector<interval>& leaves, box_search_stats& stats);
+};
+
+#endif // INTERVAL_H
@@ -0,0 +1,810 @@
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "jit.h"
+#include "batch.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace MathEval
+{
+
+#if defined(__x86_64__) || defined(_M_X64)
+
+	enum gpr : uint8_t
+	{
+		RAX = 0, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+		R8, R9, R10, R11, R12, R13, R14, R15,
+	};
+
+#if defined(_WIN32)
+	// win64: xmm6-xmm15 are callee saved, 32 bytes of shadow space above every call
+	static const bool WIN64_ABI = true;
+	static const uint8_t ARG0 = RCX, ARG1 = RDX, ARG2 = R8;
+#else
+	static const bool WIN64_ABI = false;
+	static const uint8_t ARG0 = RDI, ARG1 = RSI, ARG2 = RDX;
+#endif
+
+	// [base + index + disp], or [rip + constant pool entry]
+	struct mem_operand
+	{
+		uint8_t base = RSP;
+		int index = -1;
+		int32_t disp = 0;
+		bool rip = false;
+		uint32_t constant = 0;
+	};
+
+	static mem_operand Mem(uint8_t base, int32_t disp)
+	{
+		mem_operand m;
+		m.base = base;
+		m.disp = disp;
+		return m;
+	}
+
+	static mem_operand MemIndex(uint8_t base, uint8_t index)
+	{
+		mem_operand m;
+		m.base = base;
+		m.index = index;
+		return m;
+	}
+
+	static mem_operand Constant(uint32_t idx)
+	{
+		mem_operand m;
+		m.rip = true;
+		m.constant = idx;
+		return m;
+	}
+
+	// just enough of an x86-64 assembler for the code jit_compiler generates
+	class x64_emitter
+	{
+	public:
+		std::vector<uint8_t> code;
+		std::vector<float> constants;
+
+		void Byte(uint8_t b) { code.push_back(b); }
+		void Dword(uint32_t d)
+		{
+			for (int i = 0; i < 4; i++)
+				Byte(static_cast<uint8_t>(d >> (8 * i)));
+		}
+		void Qword(uint64_t q)
+		{
+			for (int i = 0; i < 8; i++)
+				Byte(static_cast<uint8_t>(q >> (8 * i)));
+		}
+		void Align(size_t alignment)
+		{
+			while (code.size() % alignment)
+				Byte(0xCC); // int3
+		}
+
+		// one pool entry per bit pattern, -0 and 0 stay apart
+		uint32_t AddConstant(float value)
+		{
+			uint32_t bits;
+			memcpy(&bits, &value, sizeof(bits));
+			auto found = constant_index.emplace(bits, static_cast<uint32_t>(constants.size()));
+			if (found.second)
+				constants.push_back(value);
+			return found.first->second;
+		}
+
+		// legacy sse, [prefix] [rex] 0F op modrm
+		void Sse(uint8_t prefix, uint8_t op, uint8_t reg, const mem_operand& m)
+		{
+			if (prefix)
+				Byte(prefix);
+			Rex(false, reg, m);
+			Byte(0x0F);
+			Byte(op);
+			Modrm(reg, m);
+		}
+		void Sse(uint8_t prefix, uint8_t op, uint8_t reg, uint8_t rm)
+		{
+			if (prefix)
+				Byte(prefix);
+			if ((reg | rm) & 8)
+				Byte(0x40 | ((reg >> 3) << 2) | (rm >> 3));
+			Byte(0x0F);
+			Byte(op);
+			Byte(0xC0 | ((reg & 7) << 3) | (rm & 7));
+		}
+
+		// 3 byte vex, 256 bit. map 1 = 0F, 2 = 0F38. pp 0 = none, 1 = 66
+		void Vex(uint8_t pp, uint8_t map, uint8_t op, uint8_t reg, uint8_t vvvv, const mem_operand& m)
+		{
+			uint8_t x = (!m.rip && m.index >= 0) ? (m.index >> 3) : 0;
+			uint8_t b = m.rip ? 0 : (m.base >> 3);
+			VexPrefix(pp, map, reg >> 3, x, b, vvvv);
+			Byte(op);
+			Modrm(reg, m);
+		}
+		void Vex(uint8_t pp, uint8_t map, uint8_t op, uint8_t reg, uint8_t vvvv, uint8_t rm)
+		{
+			VexPrefix(pp, map, reg >> 3, 0, rm >> 3, vvvv);
+			Byte(op);
+			Byte(0xC0 | ((reg & 7) << 3) | (rm & 7));
+		}
+
+		void MovLoad64(uint8_t reg, const mem_operand& m) { Rex(true, reg, m); Byte(0x8B); Modrm(reg, m); }
+		void Lea(uint8_t reg, const mem_operand& m) { Rex(true, reg, m); Byte(0x8D); Modrm(reg, m); }
+		void MovRR64(uint8_t dst, uint8_t src)
+		{
+			Byte(0x48 | ((src >> 3) << 2) | (dst >> 3));
+			Byte(0x89);
+			Byte(0xC0 | ((src & 7) << 3) | (dst & 7));
+		}
+		void MovImm64(uint8_t reg, uint64_t imm)
+		{
+			Byte(0x48 | (reg >> 3));
+			Byte(0xB8 | (reg & 7));
+			Qword(imm);
+		}
+		void Xor32(uint8_t reg)
+		{
+			if (reg & 8)
+				Byte(0x45);
+			Byte(0x31);
+			Byte(0xC0 | ((reg & 7) << 3) | (reg & 7));
+		}
+		void Test64(uint8_t reg)
+		{
+			Byte(0x48 | ((reg >> 3) << 2) | (reg >> 3));
+			Byte(0x85);
+			Byte(0xC0 | ((reg & 7) << 3) | (reg & 7));
+		}
+		void AddImm32(uint8_t reg, int32_t imm) { Byte(0x48 | (reg >> 3)); Byte(0x81); Byte(0xC0 | (reg & 7)); Dword(static_cast<uint32_t>(imm)); }
+		void SubImm32(uint8_t reg, int32_t imm) { Byte(0x48 | (reg >> 3)); Byte(0x81); Byte(0xE8 | (reg & 7)); Dword(static_cast<uint32_t>(imm)); }
+		void Dec64(uint8_t reg) { Byte(0x48 | (reg >> 3)); Byte(0xFF); Byte(0xC8 | (reg & 7)); }
+		void Push(uint8_t reg) { if (reg & 8) Byte(0x41); Byte(0x50 | (reg & 7)); }
+		void Pop(uint8_t reg) { if (reg & 8) Byte(0x41); Byte(0x58 | (reg & 7)); }
+		void CallReg(uint8_t reg) { if (reg & 8) Byte(0x41); Byte(0xFF); Byte(0xD0 | (reg & 7)); }
+		void Ret() { Byte(0xC3); }
+		void Vzeroupper() { Byte(0xC5); Byte(0xF8); Byte(0x77); }
+
+		// jcc rel32, returns where the displacement goes
+		size_t Jcc(uint8_t cc)
+		{
+			Byte(0x0F);
+			Byte(0x80 | cc);
+			Dword(0);
+			return code.size() - 4;
+		}
+		void PatchRel32(size_t at, size_t target)
+		{
+			int32_t rel = static_cast<int32_t>(static_cast<int64_t>(target) - static_cast<int64_t>(at + 4));
+			memcpy(&code[at], &rel, sizeof(rel));
+		}
+
+		// lays the constant pool out after the code and resolves every rip relative operand
+		void Finalize()
+		{
+			Align(32);
+			size_t pool = code.size();
+			for (float c : constants)
+			{
+				uint32_t bits;
+				memcpy(&bits, &c, sizeof(bits));
+				Dword(bits);
+			}
+			// every rip operand we emit ends its instruction, so rip = displacement + 4
+			for (const std::pair<size_t, uint32_t>& fixup : rip_fixups)
+				PatchRel32(fixup.first, pool + fixup.second * sizeof(float));
+		}
+	private:
+		std::vector<std::pair<size_t, uint32_t>> rip_fixups;
+		std::unordered_map<uint32_t, uint32_t> constant_index; // bits -> index in constants
+
+		void Rex(bool w, uint8_t reg, const mem_operand& m)
+		{
+			uint8_t x = (!m.rip && m.index >= 0) ? (m.index >> 3) : 0;
+			uint8_t b = m.rip ? 0 : (m.base >> 3);
+			uint8_t rex = 0x40 | (w ? 8 : 0) | ((reg >> 3) << 2) | (x << 1) | b;
+			if (rex != 0x40)
+				Byte(rex);
+		}
+		void VexPrefix(uint8_t pp, uint8_t map, uint8_t r, uint8_t x, uint8_t b, uint8_t vvvv)
+		{
+			Byte(0xC4);
+			Byte(((~r & 1) << 7) | ((~x & 1) << 6) | ((~b & 1) << 5) | map);
+			Byte(((~vvvv & 15) << 3) | (1 << 2) | pp); // W0, L1
+		}
+		// always a 32 bit displacement, keeps the encoder simple
+		void Modrm(uint8_t reg, const mem_operand& m)
+		{
+			if (m.rip)
+			{
+				Byte(0x05 | ((reg & 7) << 3));
+				rip_fixups.push_back(std::make_pair(code.size(), m.constant));
+				Dword(0);
+			}
+			else if (m.index >= 0)
+			{
+				Byte(0x84 | ((reg & 7) << 3));
+				Byte(((m.index & 7) << 3) | (m.base & 7));
+				Dword(static_cast<uint32_t>(m.disp));
+			}
+			else if ((m.base & 7) == RSP) // rsp and r12 need a sib byte
+			{
+				Byte(0x84 | ((reg & 7) << 3));
+				Byte(0x24);
+				Dword(static_cast<uint32_t>(m.disp));
+			}
+			else
+			{
+				Byte(0x80 | ((reg & 7) << 3) | (m.base & 7));
+				Dword(static_cast<uint32_t>(m.disp));
+			}
+		}
+	};
+
+	// opcodes shared by the sse (F3 prefixed, scalar) and vex (packed) forms
+	enum : uint8_t
+	{
+		OP_LOAD = 0x10, OP_STORE = 0x11, OP_MOVAPS = 0x28,
+		OP_ADD = 0x58, OP_MUL = 0x59, OP_SUB = 0x5C, OP_DIV = 0x5E,
+		OP_SQRT = 0x51, OP_XOR = 0x57, // xorps has no F3 form, it's always packed
+		OP_BROADCAST = 0x18, // vex 66 0F38
+	};
+
+	/*
+	 bytecode register r lives in xmm(r+2) for r < MAPPED_REGISTERS, otherwise in a stack slot.
+	 xmm0/xmm1 are scratch. stack frame, from rsp up:
+	   [shadow space 32] [save slots for xmm2-15 around calls] [spilled registers] [helper buffer] [win64 xmm6-15]
+	 the frame is one sub of rsp with no stack probes, so it has to fit in a page (FitsFrame), anything moving rsp
+	 further could step over the guard page
+	*/
+	class jit_compiler
+	{
+	public:
+		jit_compiler(const program& p, bool packed, precision math)
+			: prog(p), batch(packed), math(math)
+		{
+			width = batch ? 32 : 4;
+			uint32_t spilled = prog.GetNumOfRegisters() > MAPPED_REGISTERS ? prog.GetNumOfRegisters() - MAPPED_REGISTERS : 0;
+			// in 64 bits, a program can have more registers than an int32 offset reaches
+			int64_t frame = 32 + (static_cast<int64_t>(MAPPED_REGISTERS) + spilled) * width + 32 + (WIN64_ABI ? 160 : 0);
+			frame_size = static_cast<int32_t>(frame > MAX_FRAME ? MAX_FRAME + 1 : (frame + 15) & ~15);
+			if (!FitsFrame())
+				return;
+			save_base = 32;
+			spill_base = save_base + MAPPED_REGISTERS * width;
+			buffer_base = spill_base + spilled * width;
+			callee_save_base = buffer_base + 32;
+			ComputeLiveness();
+		}
+
+		// false when the spilled registers make the frame larger than MAX_FRAME
+		bool FitsFrame() const { return frame_size + (batch ? 8 : 0) <= MAX_FRAME; }
+
+		static bool IsSupported(const program& p)
+		{
+			const instruction* ins = p.GetInstructions();
+			for (size_t i = 0; i < p.GetNumOfInstructions(); i++)
+			{
+				switch (ins[i].op)
+				{
+				case opcode::LOAD_CONST:
+				case opcode::LOAD_INPUT:
+				case opcode::ADD:
+				case opcode::SUB:
+				case opcode::MULT:
+				case opcode::DIV:
+				case opcode::EXP:
+				case opcode::SIN:
+				case opcode::COS:
+				case opcode::TAN:
+				case opcode::ARCSIN:
+				case opcode::ARCCOS:
+				case opcode::ARCTAN:
+				case opcode::MINUS:
+				case opcode::SQRT:
+					break;
+				default:
+					return false;
+				}
+			}
+			return true;
+		}
+
+		void EmitScalar(x64_emitter& e)
+		{
+			e.Push(RBX);
+			e.SubImm32(RSP, frame_size); // one push keeps rsp 16 byte aligned
+			e.MovRR64(RBX, ARG0);
+			SaveCalleeXmm(e);
+
+			EmitBody(e);
+			LoadTo(e, 0, prog.GetResultRegister());
+
+			RestoreCalleeXmm(e);
+			e.AddImm32(RSP, frame_size);
+			e.Pop(RBX);
+			e.Ret();
+		}
+
+		void EmitBatch(x64_emitter& e)
+		{
+			const uint8_t saved[] = { RBX, R12, R13, R14 };
+			for (uint8_t reg : saved)
+				e.Push(reg);
+			e.SubImm32(RSP, frame_size + 8); // 4 pushes leave rsp 8 off
+			SaveCalleeXmm(e);
+			e.MovRR64(RBX, ARG0); // columns
+			e.MovRR64(R12, ARG1); // output
+			e.MovRR64(R13, ARG2); // blocks left
+			e.Xor32(R14);         // byte offset of the current block
+
+			e.Test64(R13);
+			size_t skip = e.Jcc(0x4); // jz
+			size_t loop = e.code.size();
+
+			EmitBody(e);
+			uint32_t result = prog.GetResultRegister();
+			uint8_t out = InXmm(result) ? Xmm(result) : 0;
+			if (!InXmm(result))
+				LoadTo(e, 0, result);
+			e.Vex(0, 1, OP_STORE, out, 0, MemIndex(R12, R14));
+
+			e.AddImm32(R14, 32);
+			e.Dec64(R13);
+			size_t back = e.Jcc(0x5); // jnz
+			e.PatchRel32(back, loop);
+			e.PatchRel32(skip, e.code.size());
+
+			RestoreCalleeXmm(e);
+			e.Vzeroupper();
+			e.AddImm32(RSP, frame_size + 8);
+			for (int i = 3; i >= 0; i--)
+				e.Pop(saved[i]);
+			e.Ret();
+		}
+	private:
+		static const uint32_t MAPPED_REGISTERS = 14;
+		// a page, about a thousand spilled registers for scalar code and a hundred for batch code
+		static const int64_t MAX_FRAME = 4096;
+
+		const program& prog;
+		bool batch;
+		precision math;
+		int32_t width;
+		int32_t save_base, spill_base, buffer_base, callee_save_base, frame_size;
+		// registers still read after each call instruction
+		std::vector<std::vector<uint32_t>> live_after;
+
+		bool InXmm(uint32_t r) const { return r < MAPPED_REGISTERS; }
+		uint8_t Xmm(uint32_t r) const { return static_cast<uint8_t>(r + 2); }
+		mem_operand Slot(uint32_t r) const { return Mem(RSP, spill_base + static_cast<int32_t>(r - MAPPED_REGISTERS) * width); }
+		mem_operand SaveSlot(uint8_t xmm) const { return Mem(RSP, save_base + (xmm - 2) * width); }
+
+		// calls clobber every xmm on sysv and in batch mode (ymm upper halves), only xmm0-5 on win64
+		bool IsCallerSaved(uint8_t xmm) const { return batch || !WIN64_ABI || xmm < 6; }
+
+		void ComputeLiveness()
+		{
+			const instruction* ins = prog.GetInstructions();
+			size_t n = prog.GetNumOfInstructions();
+			live_after.resize(n);
+			std::vector<bool> live(prog.GetNumOfRegisters(), false);
+			if (n)
+				live[prog.GetResultRegister()] = true;
+			for (size_t k = n; k-- > 0;)
+			{
+				opcode op = ins[k].op;
+				bool call = op >= opcode::EXP && op <= opcode::ARCTAN;
+				live[ins[k].dst] = false;
+				if (call)
+				{
+					for (uint32_t r = 0; r < live.size(); r++)
+					{
+						if (live[r])
+							live_after[k].push_back(r);
+					}
+				}
+				if (op != opcode::LOAD_CONST && op != opcode::LOAD_INPUT)
+					live[ins[k].a] = true;
+				if (IsBinary(op))
+					live[ins[k].b] = true;
+			}
+		}
+
+		void MovReg(x64_emitter& e, uint8_t dst, uint8_t src)
+		{
+			if (dst == src)
+				return;
+			if (batch)
+				e.Vex(0, 1, OP_MOVAPS, dst, 0, src);
+			else
+				e.Sse(0, OP_MOVAPS, dst, src);
+		}
+		void Load(x64_emitter& e, uint8_t dst, const mem_operand& m)
+		{
+			if (batch)
+				e.Vex(0, 1, OP_LOAD, dst, 0, m);
+			else
+				e.Sse(0xF3, OP_LOAD, dst, m);
+		}
+		void Store(x64_emitter& e, const mem_operand& m, uint8_t src)
+		{
+			if (batch)
+				e.Vex(0, 1, OP_STORE, src, 0, m);
+			else
+				e.Sse(0xF3, OP_STORE, src, m);
+		}
+		void LoadTo(x64_emitter& e, uint8_t xmm, uint32_t r)
+		{
+			if (InXmm(r))
+				MovReg(e, xmm, Xmm(r));
+			else
+				Load(e, xmm, Slot(r));
+		}
+		void StoreFrom(x64_emitter& e, uint32_t r, uint8_t xmm)
+		{
+			if (InXmm(r))
+				MovReg(e, Xmm(r), xmm);
+			else
+				Store(e, Slot(r), xmm);
+		}
+
+		void SaveCalleeXmm(x64_emitter& e)
+		{
+			if (!WIN64_ABI)
+				return;
+			for (uint8_t x = 6; x < 16; x++)
+				e.Sse(0, OP_STORE, x, Mem(RSP, callee_save_base + (x - 6) * 16)); // movups
+		}
+		void RestoreCalleeXmm(x64_emitter& e)
+		{
+			if (!WIN64_ABI)
+				return;
+			for (uint8_t x = 6; x < 16; x++)
+				e.Sse(0, OP_LOAD, x, Mem(RSP, callee_save_base + (x - 6) * 16));
+		}
+
+		void EmitBinary(x64_emitter& e, uint8_t op, const instruction& in, bool commutative)
+		{
+			uint8_t d = InXmm(in.dst) ? Xmm(in.dst) : 0;
+			if (batch)
+			{
+				// three operand form, only the second source may be memory
+				uint8_t a = 1;
+				if (InXmm(in.a))
+					a = Xmm(in.a);
+				else
+					LoadTo(e, 1, in.a);
+				if (InXmm(in.b))
+					e.Vex(0, 1, op, d, a, Xmm(in.b));
+				else
+					e.Vex(0, 1, op, d, a, Slot(in.b));
+			}
+			else
+			{
+				uint32_t first = in.a, second = in.b;
+				// dst == b for a commutative op, just swap the operands
+				if (commutative && InXmm(in.dst) && in.dst == in.b)
+					std::swap(first, second);
+				if (!(InXmm(in.dst) && in.dst != second))
+					d = 0; // dst would be overwritten before it's read, go through scratch
+				LoadTo(e, d, first);
+				if (InXmm(second))
+					e.Sse(0xF3, op, d, Xmm(second));
+				else
+					e.Sse(0xF3, op, d, Slot(second));
+			}
+			StoreFrom(e, in.dst, d);
+		}
+
+		void EmitSqrt(x64_emitter& e, const instruction& in)
+		{
+			uint8_t d = InXmm(in.dst) ? Xmm(in.dst) : 0;
+			if (batch)
+			{
+				if (InXmm(in.a))
+					e.Vex(0, 1, OP_SQRT, d, 0, Xmm(in.a));
+				else
+					e.Vex(0, 1, OP_SQRT, d, 0, Slot(in.a));
+			}
+			else
+			{
+				if (InXmm(in.a))
+					e.Sse(0xF3, OP_SQRT, d, Xmm(in.a));
+				else
+					e.Sse(0xF3, OP_SQRT, d, Slot(in.a));
+			}
+			StoreFrom(e, in.dst, d);
+		}
+
+		// flips the sign bit, xmm1 holds -0
+		void EmitMinus(x64_emitter& e, const instruction& in)
+		{
+			uint8_t d = InXmm(in.dst) ? Xmm(in.dst) : 0;
+			mem_operand sign = Constant(e.AddConstant(-0.0f));
+			if (batch)
+			{
+				uint8_t a = 0;
+				if (InXmm(in.a))
+					a = Xmm(in.a);
+				else
+					LoadTo(e, 0, in.a);
+				e.Vex(1, 2, OP_BROADCAST, 1, 0, sign);
+				e.Vex(0, 1, OP_XOR, d, a, 1);
+			}
+			else
+			{
+				e.Sse(0xF3, OP_LOAD, 1, sign);
+				LoadTo(e, d, in.a);
+				e.Sse(0, OP_XOR, d, 1);
+			}
+			StoreFrom(e, in.dst, d);
+		}
+
+		void EmitCall(x64_emitter& e, size_t k, const instruction& in)
+		{
+			std::vector<uint8_t> spilled;
+			for (uint32_t r : live_after[k])
+			{
+				if (r != in.dst && InXmm(r) && IsCallerSaved(Xmm(r)))
+					spilled.push_back(Xmm(r));
+			}
+			for (uint8_t x : spilled)
+				Store(e, SaveSlot(x), x);
+
+			LoadTo(e, 0, in.a);
+			if (batch)
+			{
+				unary_block_function helper = GetUnaryAvx2(in.op, math);
+				Store(e, Mem(RSP, buffer_base), 0);
+				e.Lea(ARG0, Mem(RSP, buffer_base));
+				e.MovImm64(RAX, reinterpret_cast<uint64_t>(helper));
+				e.CallReg(RAX);
+				Load(e, 0, Mem(RSP, buffer_base));
+			}
+			else
+			{
+				// the same functions Evaluate calls
+				unary_function helper = GetUnaryFunction(in.op, math);
+				e.MovImm64(RAX, reinterpret_cast<uint64_t>(helper));
+				e.CallReg(RAX);
+			}
+
+			for (uint8_t x : spilled)
+				Load(e, x, SaveSlot(x));
+			StoreFrom(e, in.dst, 0);
+		}
+
+		void EmitBody(x64_emitter& e)
+		{
+			const instruction* ins = prog.GetInstructions();
+			for (size_t k = 0; k < prog.GetNumOfInstructions(); k++)
+			{
+				const instruction& in = ins[k];
+				uint8_t d = InXmm(in.dst) ? Xmm(in.dst) : 0;
+				switch (in.op)
+				{
+				case opcode::LOAD_CONST:
+					if (batch)
+						e.Vex(1, 2, OP_BROADCAST, d, 0, Constant(e.AddConstant(in.constant)));
+					else
+						e.Sse(0xF3, OP_LOAD, d, Constant(e.AddConstant(in.constant)));
+					StoreFrom(e, in.dst, d);
+					break;
+				case opcode::LOAD_INPUT:
+					if (batch)
+					{
+						e.MovLoad64(RAX, Mem(RBX, static_cast<int32_t>(in.a * sizeof(float*))));
+						e.Vex(0, 1, OP_LOAD, d, 0, MemIndex(RAX, R14));
+					}
+					else
+					{
+						e.Sse(0xF3, OP_LOAD, d, Mem(RBX, static_cast<int32_t>(in.a * sizeof(float))));
+					}
+					StoreFrom(e, in.dst, d);
+					break;
+				case opcode::ADD:  EmitBinary(e, OP_ADD, in, true);  break;
+				case opcode::SUB:  EmitBinary(e, OP_SUB, in, false); break;
+				case opcode::MULT: EmitBinary(e, OP_MUL, in, true);  break;
+				case opcode::DIV:  EmitBinary(e, OP_DIV, in, false); break;
+				case opcode::EXP:
+				case opcode::SIN:
+				case opcode::COS:
+				case opcode::TAN:
+				case opcode::ARCSIN:
+				case opcode::ARCCOS:
+				case opcode::ARCTAN:
+					EmitCall(e, k, in);
+					break;
+				case opcode::MINUS: EmitMinus(e, in); break;
+				case opcode::SQRT:  EmitSqrt(e, in);  break;
+				default:
+					break; // IsSupported rejects these
+				}
+			}
+		}
+	};
+
+	static void* AllocateExecutable(const std::vector<uint8_t>& bytes)
+	{
+#if defined(_WIN32)
+		void* memory = VirtualAlloc(nullptr, bytes.size(), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+		if (memory == nullptr)
+			return nullptr;
+		memcpy(memory, bytes.data(), bytes.size());
+		DWORD old_protection;
+		if (!VirtualProtect(memory, bytes.size(), PAGE_EXECUTE_READ, &old_protection))
+		{
+			VirtualFree(memory, 0, MEM_RELEASE);
+			return nullptr;
+		}
+		FlushInstructionCache(GetCurrentProcess(), memory, bytes.size());
+		return memory;
+#else
+		void* memory = mmap(nullptr, bytes.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (memory == MAP_FAILED)
+			return nullptr;
+		memcpy(memory, bytes.data(), bytes.size());
+		// never writable and executable at the same time
+		if (mprotect(memory, bytes.size(), PROT_READ | PROT_EXEC) != 0)
+		{
+			munmap(memory, bytes.size());
+			return nullptr;
+		}
+		return memory;
+#endif
+	}
+
+	static void FreeExecutable(void* memory, size_t size)
+	{
+#if defined(_WIN32)
+		(void)size;
+		VirtualFree(memory, 0, MEM_RELEASE);
+#else
+		munmap(memory, size);
+#endif
+	}
+
+	bool jit_program::Compile(const program& prog, precision p)
+	{
+		Release();
+		if (prog.GetNumOfInstructions() == 0 || !jit_compiler::IsSupported(prog))
+			return false;
+
+		// programs with too many live registers for the frame stay on the interpreter (batch code needs 8x the space)
+		jit_compiler scalar(prog, false, p);
+		if (!scalar.FitsFrame())
+			return false;
+		x64_emitter e;
+		scalar.EmitScalar(e);
+		size_t batch_offset = 0;
+		bool with_batch = GetSupportedIsa() >= isa::AVX2;
+		if (with_batch)
+		{
+			jit_compiler packed(prog, true, p);
+			with_batch = packed.FitsFrame();
+			if (with_batch)
+			{
+				e.Align(16);
+				batch_offset = e.code.size();
+				packed.EmitBatch(e);
+			}
+		}
+		e.Finalize();
+
+		code = AllocateExecutable(e.code);
+		if (code == nullptr)
+			return false;
+		code_size = e.code.size();
+
+		number_of_inputs = 0;
+		const instruction* ins = prog.GetInstructions();
+		for (size_t i = 0; i < prog.GetNumOfInstructions(); i++)
+		{
+			if (ins[i].op == opcode::LOAD_INPUT && ins[i].a + 1 > number_of_inputs)
+				number_of_inputs = ins[i].a + 1;
+		}
+
+		scalar_function = reinterpret_cast<scalar_function_t>(code);
+		if (with_batch)
+			batch_function = reinterpret_cast<batch_function_t>(static_cast<uint8_t*>(code) + batch_offset);
+		return true;
+	}
+
+	void jit_program::Release()
+	{
+		if (code)
+			FreeExecutable(code, code_size);
+		code = nullptr;
+		code_size = 0;
+		scalar_function = nullptr;
+		batch_function = nullptr;
+	}
+
+#else // no jit on this architecture
+
+	bool jit_program::Compile(const program&, precision) { return false; }
+	void jit_program::Release() {}
+
+#endif
+
+	jit_program::~jit_program()
+	{
+		Release();
+	}
+
+	jit_program::jit_program(jit_program&& other) noexcept
+	{
+		*this = std::move(other);
+	}
+
+	jit_program& jit_program::operator=(jit_program&& other) noexcept
+	{
+		if (this != &other)
+		{
+			Release();
+			std::swap(code, other.code);
+			std::swap(code_size, other.code_size);
+			std::swap(number_of_inputs, other.number_of_inputs);
+			std::swap(scalar_function, other.scalar_function);
+			std::swap(batch_function, other.batch_function);
+		}
+		return *this;
+	}
+
+	void jit_program::EvaluateBatch(const float* const* columns, float* output, size_t count) const
+	{
+		const size_t BLOCK = 8;
+		if (batch_function == nullptr)
+		{
+			float inputs[64];
+			std::vector<float> heap_inputs;
+			float* point = inputs;
+			if (number_of_inputs > 64)
+			{
+				heap_inputs.resize(number_of_inputs);
+				point = heap_inputs.data();
+			}
+			for (size_t i = 0; i < count; i++)
+			{
+				// a slot the program never loads may have no column (EvaluateParallel passes those on as nullptr)
+				for (uint32_t s = 0; s < number_of_inputs; s++)
+					point[s] = columns[s] ? columns[s][i] : 0.0f;
+				output[i] = scalar_function(point);
+			}
+			return;
+		}
+
+		size_t blocks = count / BLOCK;
+		if (blocks)
+			batch_function(columns, output, blocks);
+
+		// tail goes through zero padded copies of the columns
+		size_t done = blocks * BLOCK;
+		if (done < count)
+		{
+			size_t rest = count - done;
+			std::vector<float> padded(static_cast<size_t>(number_of_inputs) * BLOCK, 0.0f);
+			std::vector<const float*> padded_columns(number_of_inputs);
+			for (uint32_t s = 0; s < number_of_inputs; s++)
+			{
+				if (columns[s])
+					memcpy(&padded[s * BLOCK], columns[s] + done, rest * sizeof(float));
+				padded_columns[s] = &padded[s * BLOCK];
+			}
+			float out[BLOCK];
+			batch_function(padded_columns.data(), out, 1);
+			memcpy(output + done, out, rest * sizeof(float));
+		}
+	}
+
+};
@@ -0,0 +1,56 @@
+#pragma once
+#ifndef JIT_H
+#define JIT_H
+
+#include "bytecode.h"
+#include "fast_math.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace MathEval
+{
+	/*
+	 translates a program into x86-64 machine code in its own executable pages
+	   - scalar: bytecode registers live in xmm2-xmm15 (spilling to the stack past that), the functions call
+	     GetUnaryFunction(op, p), so results are bit-identical to MathEvaluator::Evaluate under the same precision
+	   - batch: same layout in ymm registers, 8 points per iteration, the functions call the avx2 batch kernels,
+	     so results are bit-identical to RunBatch(..., isa::AVX2, p)
+	 minus and sqrt are inline (xorps with -0, sqrtss/vsqrtps)
+	 Compile returns false (and the program stays empty) on anything but x86-64, when the program
+	 uses an op without a jit translation (POW, x^y with a runtime exponent), when it has so many registers that the
+	 spilled ones don't fit in a page of stack (about a thousand), or when the pages can't be made executable
+	 the batch half also needs avx2+fma and room for its registers in a page (about a hundred), IsBatchCompiled tells if it's there
+	*/
+	class jit_program
+	{
+	public:
+		jit_program() = default;
+		~jit_program();
+		jit_program(const jit_program&) = delete;
+		jit_program& operator=(const jit_program&) = delete;
+		jit_program(jit_program&&) noexcept;
+		jit_program& operator=(jit_program&&) noexcept;
+
+		bool Compile(const program& prog, precision p = precision::DEFAULT);
+		void Release();
+
+		inline bool IsCompiled() const { return scalar_function != nullptr; }
+		inline bool IsBatchCompiled() const { return batch_function != nullptr; }
+
+		inline float Evaluate(const float* inputs) const { return scalar_function(inputs); }
+		// like RunBatch (batch.h), the columns of slots the program never loads may be nullptr
+		void EvaluateBatch(const float* const* columns, float* output, size_t count) const;
+	private:
+		typedef float (*scalar_function_t)(const float* inputs);
+		// count is in blocks of 8 points
+		typedef void (*batch_function_t)(const float* const* columns, float* output, size_t blocks);
+
+		void* code = nullptr;
+		size_t code_size = 0;
+		uint32_t number_of_inputs = 0; // highest input slot + 1
+		scalar_function_t scalar_function = nullptr;
+		batch_function_t batch_function = nullptr;
+	};
+};
+
+#endif // JIT_H
@@ -1,7 +1,7 @@
 #include <iostream>
 #include <vector>
-#include <algorithm>
 #include <string>
+#include <stdexcept>
 #include <cstdio>
 #include "lexer.h"
 
@@ -15,86 +15,54 @@ using std::endl;
 namespace Lexer
 {
 
-	// these GetChar(char) func will get modified so probably all of the input 
-	// gets passed into vector as an std::stack (instead of a vector)
-	bool InputBuffer::EndOfInput()
+	void Token::Print(std::string_view source) const
 	{
-#ifdef DEBUG_LEXER
-		cout << "end of file: " << input_buffer.empty() << endl;
-#endif
-		return input_buffer.empty();
-	}
-
-	char InputBuffer::UngetChar(char c)
-	{
-		if (c != EOF)
-			input_buffer.push_back(c);
-		return c;
-	}
-
-	// get char from standard input, else get it from the buffer
-	void InputBuffer::GetChar(char& c)
-	{
-		if (input_buffer.empty())
-		{
-			//std::cin.get(&c, 0);
-#ifdef DEBUG_LEXER
-	//cout << "char inbuf (from stream): " << c << endl;
-	//cout << "num:" << int(c) << endl;
-#endif
-			c = EOF;
-
-#ifdef DEBUG_LEXER
-			cout << "custom 'c': " << int(c) << endl;
-#endif
-
-			return;
-		}
-		c = input_buffer.back();
-		input_buffer.pop_back();
-
-#ifdef DEBUG_LEXER
-		cout << "char inbuf (from vec): " << c << endl;
-#endif
-	}
-
-	string InputBuffer::UngetString(string s)
-	{
-		for (int i = 0; i < static_cast<int>(s.size()); i++)
-		{
-			input_buffer.push_back(s[s.size() - i - 1]);
-		}
-		return s;
+		cout << "{" << source.substr(this->offset, this->length) << " , "
+			<< static_cast<int>(this->token_type) << " , "
+			<< this->offset << "}\n";
 	}
 
-
-	void InputBuffer::PassInput(std::string input)
+	const char* GetTokenTypeName(TokenType t)
 	{
-
-		for (auto c : input)
-		{
-			input_buffer.push_back(c);
+		switch (t)
+		{
+		case TokenType::END_OF_FILE:      return "the end of the input";
+		case TokenType::EXP:              return "exp";
+		case TokenType::SIN:              return "sin";
+		case TokenType::COS:              return "cos";
+		case TokenType::TAN:              return "tan";
+		case TokenType::ARCSIN:           return "arcsin";
+		case TokenType::ARCCOS:           return "arccos";
+		case TokenType::ARCTAN:           return "arctan";
+		case TokenType::SQRT:             return "sqrt";
+		case TokenType::POW:              return "pow";
+		case TokenType::NUM:              return "a number";
+		case TokenType::ID:               return "a name";
+		case TokenType::VAR:              return "a variable";
+		case TokenType::EQUAL:            return "'='";
+		case TokenType::NOT_EQUAL:        return "'<>'";
+		case TokenType::PLUS:             return "'+'";
+		case TokenType::MINUS:            return "'-'";
+		case TokenType::MULT:             return "'*'";
+		case TokenType::DIV:              return "'/'";
+		case TokenType::CARET:            return "'^'";
+		case TokenType::COMMA:            return "','";
+		case TokenType::LPAREN:           return "'('";
+		case TokenType::RPAREN:           return "')'";
+		case TokenType::LBRAC:            return "'['";
+		case TokenType::RBRAC:            return "']'";
+		case TokenType::LESS:             return "'<'";
+		case TokenType::GREATER:          return "'>'";
+		default:                          return "an unknown character";
 		}
-		std::reverse(input_buffer.begin(), input_buffer.end());
 	}
 
-	void Token::Print()
+	LexicalAnalyzer::LexicalAnalyzer(std::string_view input)
+		: source(input)
 	{
-		cout << "{" << this->lexeme << " , "
-			<< static_cast<int>(this->token_type) << " , "
-			<< this->line_no << "}\n";
-	}
-
-	LexicalAnalyzer::LexicalAnalyzer(std::string input)
-	{
-		if (input != "")
-			this->PassInput(input);
-		this->line_no = 1;
-		tmp.lexeme = "";
-		tmp.line_no = 1;
-		tmp.token_type = TokenType::TOKEN_TYPE_ERROR;
+		if (input.size() > UINT32_MAX)
+			throw std::length_error("LexicalAnalyzer: input longer than 4GB");
 		Token tok = GetTokenMain();
-		index = 0;
 		while (tok.token_type != TokenType::END_OF_FILE)
 		{
 			tokenList.push_back(tok);
@@ -102,89 +70,30 @@ namespace Lexer
 		}
 		// END_OF_FILE doesn't get pushed into the list
 #ifdef DEBUG_LEXER
-		for (Token tok : tokenList)
-		{
-			cout << tok.lexeme << endl;
-		}
-		cout << "WE MADE ITTTTTT!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!" << endl;
-#endif
-	}
-
-	bool LexicalAnalyzer::PassInput(std::string inputString)
-	{
-		if (inputString == "")
-			return false;
-
-		input.PassInput(inputString);
-
-		return true;
-	}
-
-	bool LexicalAnalyzer::SkipSpace()
-	{
-		char c;
-		input.GetChar(c);
-		bool space_encountered = false;
-		while (!input.EndOfInput() && isspace(c))
+		for (const Token& t : tokenList)
 		{
-			space_encountered = true;
-			input.GetChar(c);
+			t.Print(source);
 		}
-		if (!input.EndOfInput() || c != EOF)
-		{
-#ifdef DEBUG_LEXER
-			cout << "skipspace: unget\n";
 #endif
-			input.UngetChar(c);
-		}
-		return space_encountered;
 	}
 
-	Token LexicalAnalyzer::ScanNumber()
+	int LexicalAnalyzer::GetLineNo(const Token& tok) const
 	{
-		char c;
-
-		input.GetChar(c);
-		if (isdigit(c))
+		int line = 1;
+		for (size_t i = 0; i < tok.offset && i < source.size(); i++)
 		{
-			if (c == '0')
-				tmp.lexeme = "0";
-			else
-			{
-				tmp.lexeme = "";
-				while (!input.EndOfInput() && (isdigit(c) || c == '.'))
-				{
-					tmp.lexeme += c;
-					input.GetChar(c);
-#ifdef DEBUG_LEXER
-					cout << "ScanNumber() digit candidiate: " << c << endl;
-#endif
-				}
-				if (!input.EndOfInput())
-					input.UngetChar(c);
-			}
-			tmp.token_type = TokenType::NUM;
-			tmp.line_no = line_no;
-			return tmp;
-		}
-		else
-		{
-			if (!input.EndOfInput())
-				input.UngetChar(c);
-			tmp.lexeme = "";
-			tmp.token_type = TokenType::TOKEN_TYPE_ERROR;
-			tmp.line_no = line_no;
-			return tmp;
+			if (source[i] == '\n')
+				line++;
 		}
+		return line;
 	}
 
 	Token LexicalAnalyzer::GetToken()
 	{
 		Token tok;
-		if (index >= static_cast<int>(tokenList.size()))
+		if (index >= tokenList.size())
 		{
-			tok.lexeme = "";
-			tok.line_no = line_no;
+			tok.offset = static_cast<uint32_t>(source.size());
 			tok.token_type = TokenType::END_OF_FILE;
 		}
 		else
@@ -195,73 +104,17 @@ namespace Lexer
 		return tok;
 	}
 
-	// scan ID or keyword (this was rewritten to handle keywords ie. trig/exp functions)
-	Token LexicalAnalyzer::ScanId()
-	{
-#ifdef DEBUG_LEXER
-		cout << "ScanID()" << endl;
-#endif
-		char c;
-		input.GetChar(c);
-		if (isalpha(c))
-		{
-			tmp.lexeme = "";
-			while ((c != EOF) && isalnum(c))
-			{
-				tmp.lexeme += c;
-				input.GetChar(c);
-			}
-			if (!input.EndOfInput())
-				input.UngetChar(c);
-			tmp.line_no = line_no;
-			int keywordIndex = FindKeywordIndex(tmp.lexeme);
-			if (keywordIndex != -1)
-				tmp.token_type = (TokenType)keywordIndex;
-			else
-				tmp.token_type = TokenType::ID;
-		}
-		else
-		{
-			if (!input.EndOfInput())
-				input.UngetChar(c);
-			tmp.lexeme = "";
-			tmp.token_type = TokenType::TOKEN_TYPE_ERROR;
-		}
-#ifdef DEBUG_LEXER
-		cout << "ScanID() tok.lexeme: " << tmp.lexeme << endl;
-#endif
-		return tmp;
-	}
-
-	int LexicalAnalyzer::FindKeywordIndex(string s)
-	{
-#ifdef DEBUG_LEXER
-		cout << "keyword string: " << s << endl;
-#endif
-		string keyword[] = { "exp", "sin", "cos", "tan", "arcsin", "arccos", "arctan" };
-		for (int i = 0; i < KEYWORDS_COUNT; i++) {
-			if (s == keyword[i]) {
-				return i + 1;
-			}
-		}
-		return -1;
-	}
-
 	// hf --> how far
 	Token LexicalAnalyzer::peek(int hf)
 	{
 		if (hf <= 0)
-		{
-			cout << "TOKEN_TYPE_ERROR: peeking with <= argument)\n";
-			exit(1);
-		}
+			throw std::invalid_argument("LexicalAnalyzer: peek needs a distance of 1 or more");
 
-		int peekIndex = index + hf - 1;
-		if (peekIndex >= static_cast<int>(tokenList.size()))
+		size_t peekIndex = index + static_cast<size_t>(hf) - 1;
+		if (peekIndex >= tokenList.size())
 		{
 			Token tok;
-			tok.lexeme = "";
-			tok.line_no = line_no;
+			tok.offset = static_cast<uint32_t>(source.size());
 			tok.token_type = TokenType::END_OF_FILE;
 			return tok;
 		}
@@ -271,82 +124,11 @@ namespace Lexer
 
 	Token LexicalAnalyzer::GetTokenMain()
 	{
-		char c;
-
-		SkipSpace();
-		// default eof
-		tmp.lexeme = "";
-		tmp.line_no = line_no;
-		tmp.token_type = TokenType::END_OF_FILE;
-		if (!input.EndOfInput())
-			input.GetChar(c);
-		else
-			return tmp;
-#ifdef DEBUG_LEXER
-		cout << "GetTokenMain() char: " << c << endl;
-#endif
-		switch (c)
-		{
-		case '+':   tmp.token_type = TokenType::PLUS;
+		Token tok = ScanToken(source, position);
 #ifdef DEBUG_LEXER
-			cout << "LEXER:= [+]\n";
+		if (tok.token_type == TokenType::TOKEN_TYPE_ERROR)
+			cout << "Not a character: " << int(source[tok.offset]) << endl;
 #endif
-			return tmp;
-		case '-':   tmp.token_type = TokenType::MINUS;     return tmp;
-		case '/':   tmp.token_type = TokenType::DIV;       return tmp;
-		case '*':   tmp.token_type = TokenType::MULT;      return tmp;
-		case '=':   tmp.token_type = TokenType::EQUAL;     return tmp;
-		case ',':   tmp.token_type = TokenType::COMMA;     return tmp;
-		case '[':   tmp.token_type = TokenType::LBRAC;     return tmp;
-		case ']':   tmp.token_type = TokenType::RBRAC;     return tmp;
-		case '(':   tmp.token_type = TokenType::LPAREN;
-#ifdef DEBUG_LEXER
-			cout << "LEXER:= [(]\n";
-#endif
-			return tmp;
-		case ')':   tmp.token_type = TokenType::RPAREN;    return tmp;
-		case '>':   tmp.token_type = TokenType::GREATER;   return tmp;
-		case '<':
-			input.GetChar(c);
-			if (c == '>')
-			{
-				tmp.token_type = TokenType::NOT_EQUAL;
-			}
-			else
-			{
-				if (!input.EndOfInput())
-				{
-					input.UngetChar(c);
-				}
-				tmp.token_type = TokenType::LESS;
-			}
-			return tmp;
-		default:
-			if (isdigit(c))
-			{
-#ifdef DEBUG_LEXER
-				cout << c << " is digit\n";
-#endif
-
-				input.UngetChar(c);
-				return ScanNumber();
-			}
-			else if (isalpha(c))
-			{
-#ifdef DEBUG_LEXER
-				cout << "UngetChar(): " << c << endl;
-#endif
-				input.UngetChar(c);
-				return ScanId();
-			}
-			else if (input.EndOfInput())
-				tmp.token_type = TokenType::END_OF_FILE;
-			else
-				tmp.token_type = TokenType::TOKEN_TYPE_ERROR;
-#ifdef DEBUG_LEXER
-			cout << "Not a character, EOF" << endl;
-#endif
-			return tmp;
-		}
+		return tok;
 	}
-};
\ No newline at end of file
+};
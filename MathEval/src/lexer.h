@@ -2,67 +2,195 @@
 #ifndef LEXER_H
 #define LEXER_H
 
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
 #include <vector>
 #include <string>
+#include <string_view>
 
 namespace Lexer
 {
 
 	
 
-#define KEYWORDS_COUNT 7
+#define KEYWORDS_COUNT 9
 	enum class TokenType : unsigned char
 	{
 		END_OF_FILE = 0,
-		EXP, SIN, COS, TAN, ARCSIN, ARCCOS, ARCTAN, // append more keywords HERE and don't forget to update KEYWORD_COUNT
+		EXP, SIN, COS, TAN, ARCSIN, ARCCOS, ARCTAN, SQRT, POW, // append more keywords HERE and don't forget to update KEYWORD_COUNT
 		NUM, ID, VAR, EQUAL, NOT_EQUAL, PLUS, MINUS,
-		MULT, DIV, COMMA, LPAREN, RPAREN, LBRAC, RBRAC, LESS, GREATER,
+		MULT, DIV, CARET, COMMA, LPAREN, RPAREN, LBRAC, RBRAC, LESS, GREATER,
 		TOKEN_TYPE_ERROR
 	};
 
-	class InputBuffer
+	// 8 bytes, the text stays in the input: LexicalAnalyzer::GetLexeme gives it back as a view
+	class Token
 	{
 	public:
-		void GetChar(char&);
-		char UngetChar(char);
-		std::string UngetString(std::string);
-		bool EndOfInput();
-		void PassInput(std::string);
-	private:
-		std::vector<char> input_buffer;
+		void Print(std::string_view source) const; // print tok info to stdout
+		uint32_t offset = 0; // first char in the input
+		uint16_t length = 0;
+		TokenType token_type = TokenType::END_OF_FILE;
 	};
 
-	class Token
+	// how a token type reads in messages, ie: "')'", "a number", "the end of the input"
+	const char* GetTokenTypeName(TokenType);
+
+	/*
+	 what parser throws for input it can't read instead of ending the process
+	 expected is the token that would have fit where token is: the exact one when only one can (RPAREN, EQUAL, ...),
+	 ID for any operand (a number, variable, function or '('), END_OF_FILE after a complete expression with more
+	 input behind it, MULT between two operands ("2(x)", products need the *)
+	*/
+	class syntax_error : public std::invalid_argument
 	{
 	public:
-		void Print(); // print tok info to stdout
-		std::string lexeme;
-		TokenType token_type; // HERE (should be TokenType)
-		int line_no; // number in the input		
+		syntax_error(const std::string& message, const Token& token, TokenType expected, int line)
+			: std::invalid_argument(message), token(token), expected(expected), line(line) {}
+
+		Token token; // offset and length point into the parsed text, TOKEN_TYPE_ERROR for a char no token starts with
+		TokenType expected;
+		int line; // 1 based
+	};
+
+	// character classes, a table instead of <cctype> so there is no locale lookup per char
+	// (and no undefined behaviour for chars above 127)
+	enum char_class : unsigned char
+	{
+		CHAR_OTHER = 0, CHAR_SPACE = 1, CHAR_DIGIT = 2, CHAR_ALPHA = 4,
+	};
+
+	struct char_table
+	{
+		unsigned char classes[256] = {};
+		TokenType single[256] = {}; // token of a one char operator, TOKEN_TYPE_ERROR for anything else
+		constexpr char_table()
+		{
+			const char spaces[] = { ' ', '\t', '\n', '\v', '\f', '\r' };
+			for (char c : spaces)
+				classes[static_cast<unsigned char>(c)] = CHAR_SPACE;
+			for (int c = '0'; c <= '9'; c++)
+				classes[c] = CHAR_DIGIT;
+			for (int c = 'a'; c <= 'z'; c++)
+				classes[c] = CHAR_ALPHA;
+			for (int c = 'A'; c <= 'Z'; c++)
+				classes[c] = CHAR_ALPHA;
+			for (int c = 0; c < 256; c++)
+				single[c] = TokenType::TOKEN_TYPE_ERROR;
+			single['+'] = TokenType::PLUS;
+			single['-'] = TokenType::MINUS;
+			single['/'] = TokenType::DIV;
+			single['*'] = TokenType::MULT;
+			single['^'] = TokenType::CARET;
+			single['='] = TokenType::EQUAL;
+			single[','] = TokenType::COMMA;
+			single['['] = TokenType::LBRAC;
+			single[']'] = TokenType::RBRAC;
+			single['('] = TokenType::LPAREN;
+			single[')'] = TokenType::RPAREN;
+			single['>'] = TokenType::GREATER;
+			single['<'] = TokenType::LESS; // or NOT_EQUAL, ScanToken looks one further
+		}
 	};
+	inline constexpr char_table s_char_table;
+	// same order as the keywords in TokenType
+	inline constexpr std::string_view s_keywords[KEYWORDS_COUNT] = { "exp", "sin", "cos", "tan", "arcsin", "arccos", "arctan", "sqrt", "pow" };
+
+	constexpr bool IsSpace(char c) { return s_char_table.classes[static_cast<unsigned char>(c)] == CHAR_SPACE; }
+	constexpr bool IsDigit(char c) { return s_char_table.classes[static_cast<unsigned char>(c)] == CHAR_DIGIT; }
+	constexpr bool IsAlpha(char c) { return s_char_table.classes[static_cast<unsigned char>(c)] == CHAR_ALPHA; }
+	constexpr bool IsAlnum(char c) { return (s_char_table.classes[static_cast<unsigned char>(c)] & (CHAR_DIGIT | CHAR_ALPHA)) != 0; }
+
+	// keyword token for s, ID when it isn't one
+	constexpr TokenType FindKeyword(std::string_view s)
+	{
+		// keywords are 3, 4 or 6 chars, anything else is an ID without comparing
+		if (s.size() < 3 || s.size() > 6 || s.size() == 5)
+			return TokenType::ID;
+		for (int i = 0; i < KEYWORDS_COUNT; i++)
+		{
+			if (s == s_keywords[i])
+				return static_cast<TokenType>(i + 1);
+		}
+		return TokenType::ID;
+	}
+
+	constexpr uint16_t TokenLength(size_t begin, size_t end)
+	{
+		if (end - begin > UINT16_MAX)
+			throw std::length_error("LexicalAnalyzer: token longer than 64K chars");
+		return static_cast<uint16_t>(end - begin);
+	}
+
+	/*
+	 next token of source starting at position, position moves past it, END_OF_FILE once only whitespace is left
+	 constexpr so the compile time front end (static_parser.h) lexes exactly like LexicalAnalyzer
+	*/
+	constexpr Token ScanToken(std::string_view source, size_t& position)
+	{
+		while (position < source.size() && IsSpace(source[position]))
+			position++;
+		Token tok;
+		tok.offset = static_cast<uint32_t>(position);
+		tok.token_type = TokenType::END_OF_FILE;
+		if (position >= source.size())
+			return tok;
+
+		char c = source[position];
+		if (IsDigit(c))
+		{
+			while (position < source.size() && (IsDigit(source[position]) || source[position] == '.'))
+				position++;
+			tok.length = TokenLength(tok.offset, position);
+			tok.token_type = TokenType::NUM;
+			return tok;
+		}
+		if (IsAlpha(c))
+		{
+			while (position < source.size() && IsAlnum(source[position]))
+				position++;
+			tok.length = TokenLength(tok.offset, position);
+			tok.token_type = FindKeyword(source.substr(tok.offset, tok.length));
+			return tok;
+		}
+
+		// operators come from the table rather than a switch, one less unpredictable jump per token
+		tok.length = 1;
+		tok.token_type = s_char_table.single[static_cast<unsigned char>(c)];
+		if (c == '<' && position + 1 < source.size() && source[position + 1] == '>')
+		{
+			tok.token_type = TokenType::NOT_EQUAL;
+			tok.length = 2;
+		}
+		position += tok.length;
+		return tok;
+	}
 
+	/*
+	 scans the input in place, nothing is copied out of it
+	 the only allocation is the token list, so the input has to outlive the analyzer
+	 inputs are limited to 4GB (offsets are 32 bit) and single tokens to 64K chars, past that it throws std::length_error
+	*/
 	class LexicalAnalyzer
 	{
 	public:
 		Token GetToken();
 		Token peek(int);
-		LexicalAnalyzer(std::string input = "");
+		LexicalAnalyzer(std::string_view input = std::string_view());
 		inline size_t GetNumOfToks() { return tokenList.size(); }
+		inline std::string_view GetLexeme(const Token& tok) const { return source.substr(tok.offset, tok.length); }
+		inline std::string_view GetSource() const { return source; }
+		// 1 based line of a token, counted on demand since only errors need it
+		int GetLineNo(const Token& tok) const;
 	private:
-		bool PassInput(std::string); // returns true upon success
+		std::string_view source;
+		size_t position = 0; // scan position in source
 		std::vector<Token> tokenList;
+		size_t index = 0; // next token GetToken hands out
 		Token GetTokenMain();
-		int line_no;
-		int index;
-		Token tmp;
-		InputBuffer input;
-
-		bool SkipSpace(); // remove whitespace
-		int FindKeywordIndex(std::string);
-		Token ScanId();
-		Token ScanNumber(); // is it ID or number
 	};
 
 }
 
-#endif // LEXER_H
\ No newline at end of file
+#endif // LEXER_H
@@ -0,0 +1,102 @@
+#include <stdexcept>
+#include "multi_expression.h"
+#include "autodiff.h"
+
+namespace MathEval
+{
+
+	// copies source below the nodes already in tree, children and names are renumbered, returns the new root
+	static uint32_t Append(Lexer::syntax_tree& tree, const Lexer::syntax_tree& source, uint32_t root)
+	{
+		uint32_t offset = static_cast<uint32_t>(tree.nodes.size());
+		for (const Lexer::tree_node& node : source.nodes)
+		{
+			Lexer::tree_node copy = node;
+			if (copy.type == Lexer::node_type::BINARY_OP)
+			{
+				copy.lhs += offset;
+				copy.rhs += offset;
+			}
+			else if (copy.op == Lexer::unary_op::ID_OP)
+				copy.name = tree.AddName(source.names[copy.name]);
+			else if (copy.op != Lexer::unary_op::NUM_OP && copy.next != Lexer::NO_NODE)
+				copy.next += offset;
+			tree.Add(copy);
+		}
+		return root + offset;
+	}
+
+	std::shared_ptr<const compiled_multi_expression> CompileExpressions(const std::vector<std::string>& texts,
+		const std::unordered_map<std::string, size_t>& function_inputs, size_t number_of_slots, const compile_options& options)
+	{
+		auto compiled = std::make_shared<compiled_multi_expression>();
+		for (const std::string& text : texts)
+		{
+			Lexer::parser parser(text);
+			uint32_t root = parser.parse();
+			if (root == Lexer::NO_NODE)
+				throw std::out_of_range("program: empty expression");
+			compiled->roots.push_back(Append(compiled->tree, parser.GetTree(), root));
+		}
+		compiled->tree.ResolveInputs(function_inputs, number_of_slots);
+
+		Lexer::optimizer opt(compiled->tree, Lexer::NO_NODE, options.relaxed_fp, options.precision);
+		if (options.fold_constants)
+			opt.FoldConstants(compiled->roots);
+		// what one evaluator per expression would run: each expression deduplicated on its own
+		for (uint32_t root : compiled->roots)
+		{
+			std::vector<uint32_t> alone = { root };
+			compiled->separate_nodes += options.eliminate_common_subexpressions ?
+				Lexer::optimizer::CountUniqueNodes(compiled->tree, alone) : Lexer::optimizer::CountNodes(compiled->tree, root);
+		}
+		if (options.eliminate_common_subexpressions)
+			opt.EliminateCommonSubexpressions(compiled->roots);
+		compiled->shared_nodes = Lexer::optimizer::CountUniqueNodes(compiled->tree, compiled->roots);
+		compiled->optimize_stats = opt.GetStats();
+
+		compiled->prog = program(compiled->tree, compiled->roots);
+		compiled->precision = options.precision;
+		compiled->exp_function = GetUnaryFunction(opcode::EXP, options.precision);
+		compiled->sin_function = GetUnaryFunction(opcode::SIN, options.precision);
+		compiled->cos_function = GetUnaryFunction(opcode::COS, options.precision);
+		return compiled;
+	}
+
+	void RunMulti(const compiled_multi_expression& compiled, const float* inputs, float* outputs)
+	{
+		static constexpr uint32_t MAX_STACK_REGISTERS = 64;
+		float stack_registers[MAX_STACK_REGISTERS];
+		std::vector<float> heap_registers;
+		float* reg = stack_registers;
+		const program& prog = compiled.prog;
+		if (prog.GetNumOfRegisters() > MAX_STACK_REGISTERS)
+		{
+			heap_registers.resize(prog.GetNumOfRegisters());
+			reg = heap_registers.data();
+		}
+
+		const instruction* ip = prog.GetInstructions();
+		const instruction* end = ip + prog.GetNumOfInstructions();
+		for (; ip != end; ++ip)
+		{
+			switch (ip->op)
+			{
+			case opcode::LOAD_CONST: reg[ip->dst] = ip->constant;                        break;
+			case opcode::LOAD_INPUT: reg[ip->dst] = inputs[ip->a];                       break;
+			case opcode::ADD:        reg[ip->dst] = reg[ip->a] + reg[ip->b];             break;
+			case opcode::SUB:        reg[ip->dst] = reg[ip->a] - reg[ip->b];             break;
+			case opcode::MULT:       reg[ip->dst] = reg[ip->a] * reg[ip->b];             break;
+			case opcode::DIV:        reg[ip->dst] = reg[ip->a] / reg[ip->b];             break;
+			case opcode::POW:        reg[ip->dst] = Power(reg[ip->a], reg[ip->b]);       break;
+			case opcode::EXP:        reg[ip->dst] = compiled.exp_function(reg[ip->a]);   break;
+			case opcode::SIN:        reg[ip->dst] = compiled.sin_function(reg[ip->a]);   break;
+			case opcode::COS:        reg[ip->dst] = compiled.cos_function(reg[ip->a]);   break;
+			default:                 reg[ip->dst] = UnaryValue(ip->op, reg[ip->a]);      break;
+			}
+		}
+		const std::vector<uint32_t>& results = prog.GetResultRegisters();
+		for (size_t k = 0; k < results.size(); k++)
+			outputs[k] = reg[results[k]];
+	}
+};
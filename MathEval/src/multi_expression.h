@@ -0,0 +1,43 @@
+#pragma once
+#ifndef MULTI_EXPRESSION_H
+#define MULTI_EXPRESSION_H
+
+#include "registry.h"
+#include "batch.h"
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace MathEval
+{
+	/*
+	 a set of expressions over the same inputs compiled into one program: every expression is parsed into one shared
+	 tree, folded on its own, then hash-consed together so a subtree that shows up in several expressions (sin(a*b),
+	 a/(1+c*c), ...) is one node, and lowered with one result register per expression. one pass over the program
+	 computes every output, so the cost per record is the union of the distinct nodes instead of their sum
+	*/
+	struct compiled_multi_expression
+	{
+		Lexer::syntax_tree tree;
+		std::vector<uint32_t> roots; // one per expression, in the order given
+		program prog; // GetResultRegisters()[k] is expression k
+		Lexer::optimize_stats optimize_stats;
+		size_t separate_nodes = 0; // nodes of the expressions optimized one by one, what separate evaluators run
+		size_t shared_nodes = 0; // distinct nodes of the combined program
+		MathEval::precision precision = MathEval::precision::DEFAULT;
+		unary_function exp_function = nullptr;
+		unary_function sin_function = nullptr;
+		unary_function cos_function = nullptr;
+	};
+
+	// throws what CompileExpression throws for any one of the expressions, compile_options::jit is ignored
+	std::shared_ptr<const compiled_multi_expression> CompileExpressions(const std::vector<std::string>& texts,
+		const std::unordered_map<std::string, size_t>& function_inputs, size_t number_of_slots, const compile_options& options);
+
+	// every output for one point, outputs gets one float per expression, same results as Evaluate on each of them
+	void RunMulti(const compiled_multi_expression& compiled, const float* inputs, float* outputs);
+};
+
+#endif // MULTI_EXPRESSION_H
@@ -0,0 +1,365 @@
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <vector>
+#include "optimizer.h"
+#include "fast_math.h"
+
+namespace Lexer
+{
+
+	optimizer::optimizer(syntax_tree& tree, uint32_t node, bool relaxed, MathEval::precision p)
+		: tree(tree), root(node), relaxed_fp(relaxed), precision(p)
+	{}
+
+	uint32_t optimizer::GetRoot() { return root; }
+
+	size_t optimizer::CountNodes(const syntax_tree& tree, uint32_t node)
+	{
+		size_t count = 0;
+		std::vector<uint32_t> stack;
+		stack.push_back(node);
+		while (!stack.empty())
+		{
+			uint32_t n = stack.back();
+			stack.pop_back();
+			if (n == NO_NODE)
+				continue;
+			count++;
+			const tree_node& current = tree[n];
+			if (current.type == node_type::BINARY_OP)
+			{
+				stack.push_back(current.lhs);
+				stack.push_back(current.rhs);
+			}
+			else if (!current.IsLeaf())
+			{
+				stack.push_back(current.next);
+			}
+		}
+		return count;
+	}
+
+	size_t optimizer::CountUniqueNodes(const syntax_tree& tree, uint32_t node)
+	{
+		return CountUniqueNodes(tree, std::vector<uint32_t>{ node });
+	}
+
+	size_t optimizer::CountUniqueNodes(const syntax_tree& tree, const std::vector<uint32_t>& roots)
+	{
+		std::vector<bool> visited(tree.nodes.size(), false);
+		size_t count = 0;
+		std::vector<uint32_t> stack(roots.rbegin(), roots.rend());
+		while (!stack.empty())
+		{
+			uint32_t n = stack.back();
+			stack.pop_back();
+			if (n == NO_NODE || visited[n])
+				continue;
+			visited[n] = true;
+			count++;
+			const tree_node& current = tree[n];
+			if (current.type == node_type::BINARY_OP)
+			{
+				stack.push_back(current.lhs);
+				stack.push_back(current.rhs);
+			}
+			else if (!current.IsLeaf())
+			{
+				stack.push_back(current.next);
+			}
+		}
+		return count;
+	}
+
+	uint32_t optimizer::FoldConstants()
+	{
+		if (root == NO_NODE)
+			return root;
+		size_t before = CountNodes(tree, root);
+		root = Simplify(root);
+		stats.removed_nodes += before - CountNodes(tree, root);
+		return root;
+	}
+
+	void optimizer::FoldConstants(std::vector<uint32_t>& roots)
+	{
+		for (uint32_t& node : roots)
+		{
+			root = node;
+			node = FoldConstants();
+		}
+		root = NO_NODE;
+	}
+
+	bool optimizer::IsConstant(uint32_t node, float& value)
+	{
+		const tree_node& n = tree[node];
+		if (n.type != node_type::PREFIX_OP || n.op != unary_op::NUM_OP)
+			return false;
+		value = n.constant;
+		return true;
+	}
+
+	// exact comparison, so 0 and -0 are told apart
+	bool optimizer::IsExactly(uint32_t node, float expected)
+	{
+		float value;
+		return IsConstant(node, value) && value == expected && std::signbit(value) == std::signbit(expected);
+	}
+
+	// turn node into a NUM leaf
+	void optimizer::MakeConstant(uint32_t node, float value)
+	{
+		tree[node] = tree_node::MakeNumber(value);
+	}
+
+	// post-order walk over an explicit stack, a recursion level per node would overflow on long expressions
+	// (a+a+...+a is as deep as it is long); visit(node, children) gets what it returned for node's children,
+	// lhs first, and returns what node's parent gets
+	template <typename Visit>
+	static uint32_t PostOrder(const syntax_tree& tree, uint32_t root, Visit visit)
+	{
+		struct frame
+		{
+			uint32_t node;
+			int children; // -1 until they're pushed
+		};
+		std::vector<frame> stack;
+		std::vector<uint32_t> results;
+		stack.push_back({ root, -1 });
+		while (!stack.empty())
+		{
+			frame& top = stack.back();
+			if (top.children < 0)
+			{
+				// top dangles once the stack grows, so it's set first
+				const tree_node& n = tree[top.node];
+				top.children = 0;
+				if (n.type == node_type::BINARY_OP)
+				{
+					top.children = 2;
+					stack.push_back({ n.rhs, -1 });
+					stack.push_back({ n.lhs, -1 });
+				}
+				else if (!n.IsLeaf() && n.next != NO_NODE)
+				{
+					top.children = 1;
+					stack.push_back({ n.next, -1 });
+				}
+				continue;
+			}
+			frame done = top;
+			stack.pop_back();
+			size_t first = results.size() - done.children;
+			uint32_t result = visit(done.node, results.data() + first);
+			results.resize(first);
+			results.push_back(result);
+		}
+		return results.back();
+	}
+
+	uint32_t optimizer::Simplify(uint32_t node)
+	{
+		return PostOrder(tree, node, [this](uint32_t n, const uint32_t* children) { return SimplifyNode(n, children); });
+	}
+
+	// children are simplified already
+	uint32_t optimizer::SimplifyNode(uint32_t node, const uint32_t* children)
+	{
+		// copies, not references: the node gets overwritten by MakeConstant below
+		tree_node n = tree[node];
+		if (n.type == node_type::BINARY_OP)
+		{
+			uint32_t lhs = children[0];
+			uint32_t rhs = children[1];
+			tree[node].lhs = lhs;
+			tree[node].rhs = rhs;
+			bin_op op = n.op_type;
+
+			float L, R;
+			if (IsConstant(lhs, L) && IsConstant(rhs, R))
+			{
+				switch (op)
+				{
+				case bin_op::ADD_OP:  MakeConstant(node, L + R); return node;
+				case bin_op::SUB_OP:  MakeConstant(node, L - R); return node;
+				case bin_op::MULT_OP: MakeConstant(node, L * R); return node;
+				case bin_op::DIV_OP:  MakeConstant(node, L / R); return node;
+				case bin_op::POW_OP:  MakeConstant(node, MathEval::Power(L, R)); return node;
+				default: return node;
+				}
+			}
+
+			switch (op)
+			{
+			case bin_op::ADD_OP:
+				// x + -0 is x for every x, x + 0 turns -0 into 0
+				if (IsExactly(rhs, -0.0f) || (relaxed_fp && IsExactly(rhs, 0.0f)))
+					return lhs;
+				if (IsExactly(lhs, -0.0f) || (relaxed_fp && IsExactly(lhs, 0.0f)))
+					return rhs;
+				break;
+			case bin_op::SUB_OP:
+				if (IsExactly(rhs, 0.0f) || (relaxed_fp && IsExactly(rhs, -0.0f)))
+					return lhs;
+				break;
+			case bin_op::MULT_OP:
+				if (IsExactly(rhs, 1.0f))
+					return lhs;
+				if (IsExactly(lhs, 1.0f))
+					return rhs;
+				// NaN*0 and inf*0 are NaN, so only when relaxed
+				if (relaxed_fp && (IsExactly(rhs, 0.0f) || IsExactly(rhs, -0.0f)))
+					return rhs;
+				if (relaxed_fp && (IsExactly(lhs, 0.0f) || IsExactly(lhs, -0.0f)))
+					return lhs;
+				break;
+			case bin_op::DIV_OP:
+				if (IsExactly(rhs, 1.0f))
+					return lhs;
+				break;
+			case bin_op::POW_OP:
+				// exact for every x, NaN^0 is 1 too
+				if (IsExactly(rhs, 1.0f))
+					return lhs;
+				if (IsExactly(rhs, 0.0f) || IsExactly(rhs, -0.0f))
+				{
+					MakeConstant(node, 1.0f);
+					return node;
+				}
+				break;
+			default:
+				break;
+			}
+			return node;
+		}
+
+		// leaves
+		if (n.IsLeaf() || n.next == NO_NODE)
+			return node;
+
+		uint32_t child = children[0];
+		tree[node].next = child;
+		unary_op op = n.op;
+
+		// -(-x) -> x
+		const tree_node& c = tree[child];
+		if (op == unary_op::MINUS_OP && c.type == node_type::PREFIX_OP && c.op == unary_op::MINUS_OP)
+			return c.next;
+
+		float C;
+		if (IsConstant(child, C) && op >= unary_op::EXP_OP && op <= unary_op::SQRT_OP)
+		{
+			// the scalar function Evaluate calls for this precision, so folding doesn't change what Evaluate returns
+			// EvaluateBatch under DEFAULT runs polynomials where this is libm, see fast_math.h
+			MathEval::opcode code = static_cast<MathEval::opcode>(static_cast<int>(MathEval::opcode::EXP) + static_cast<int>(op));
+			MakeConstant(node, MathEval::GetUnaryFunction(code, precision)(C));
+		}
+		return node;
+	}
+
+	bool optimizer::node_key::operator==(const node_key& other) const
+	{
+		return type == other.type && op == other.op && lhs == other.lhs && rhs == other.rhs
+			&& bits == other.bits;
+	}
+
+	size_t optimizer::node_key_hash::operator()(const node_key& key) const
+	{
+		size_t seed = 0;
+		const uint32_t fields[] = { static_cast<uint32_t>(key.type), static_cast<uint32_t>(key.op), key.lhs, key.rhs, key.bits };
+		for (uint32_t field : fields)
+			seed ^= std::hash<uint32_t>{}(field) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+		return seed;
+	}
+
+	uint32_t optimizer::EliminateCommonSubexpressions()
+	{
+		if (root == NO_NODE)
+			return root;
+		size_t before = CountNodes(tree, root);
+		canonical_id.assign(tree.nodes.size(), NO_NODE);
+		root = HashCons(root);
+		stats.deduplicated_nodes += before - CountUniqueNodes(tree, root);
+		canonical_nodes.clear();
+		canonical_id.clear();
+		return root;
+	}
+
+	void optimizer::EliminateCommonSubexpressions(std::vector<uint32_t>& roots)
+	{
+		size_t before = 0;
+		for (uint32_t node : roots)
+		{
+			if (node != NO_NODE)
+				before += CountNodes(tree, node);
+		}
+		canonical_id.assign(tree.nodes.size(), NO_NODE);
+		for (uint32_t& node : roots)
+		{
+			if (node != NO_NODE)
+				node = HashCons(node);
+		}
+		stats.deduplicated_nodes += before - CountUniqueNodes(tree, roots);
+		canonical_nodes.clear();
+		canonical_id.clear();
+	}
+
+	// post-order: children are canonical before their parent gets looked up
+	uint32_t optimizer::HashCons(uint32_t node)
+	{
+		return PostOrder(tree, node, [this](uint32_t n, const uint32_t* children) { return HashConsNode(n, children); });
+	}
+
+	// children are the canonical nodes of node's children
+	uint32_t optimizer::HashConsNode(uint32_t node, const uint32_t* children)
+	{
+		node_key key{};
+		tree_node n = tree[node];
+		key.type = n.type;
+		if (n.type == node_type::BINARY_OP)
+		{
+			uint32_t lhs = children[0];
+			uint32_t rhs = children[1];
+			tree[node].lhs = lhs;
+			tree[node].rhs = rhs;
+			key.op = static_cast<char>(n.op_type);
+			key.lhs = canonical_id[lhs];
+			key.rhs = canonical_id[rhs];
+			// add and mult are commutative in ieee arithmetic too
+			bin_op op = n.op_type;
+			if ((op == bin_op::ADD_OP || op == bin_op::MULT_OP) && key.rhs < key.lhs)
+				std::swap(key.lhs, key.rhs);
+		}
+		else
+		{
+			key.op = static_cast<char>(n.op);
+			if (n.op == unary_op::NUM_OP)
+			{
+				// by value, so 2 and 2.0 are the same constant
+				memcpy(&key.bits, &n.constant, sizeof(float));
+			}
+			else if (n.op == unary_op::ID_OP)
+			{
+				key.bits = n.name; // names are interned, same name same index
+			}
+			else if (n.next != NO_NODE)
+			{
+				uint32_t next = children[0];
+				tree[node].next = next;
+				key.lhs = canonical_id[next];
+			}
+		}
+
+		auto found = canonical_nodes.find(key);
+		if (found != canonical_nodes.end())
+			return found->second;
+
+		uint32_t id = static_cast<uint32_t>(canonical_nodes.size());
+		canonical_id[node] = id;
+		canonical_nodes.emplace(key, node);
+		return node;
+	}
+
+};
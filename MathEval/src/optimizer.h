@@ -0,0 +1,87 @@
+#pragma once
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include "fast_math.h"
+#include "parser.h"
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace Lexer
+{
+	struct optimize_stats
+	{
+		size_t removed_nodes = 0; // nodes no longer reachable after folding/simplifying
+		size_t deduplicated_nodes = 0; // nodes replaced by an identical subtree elsewhere in the expression
+	};
+
+	/*
+	 rewrites the tree parser::parse() produced, in place
+	   - constant subtrees fold into a single NUM node: sin(3.14) -> 0.00159255, exp/sin/cos with the scalar function
+	     of the precision (GetUnaryFunction), the one Evaluate would have called
+	   - x*1, 1*x, x/1, x-0, x^1 -> x
+	   - x^0 -> 1
+	   - -(-x) -> x
+	 with relaxed_fp (these can change NaN, inf or the sign of zero)
+	   - x+0, 0+x -> x
+	   - x*0, 0*x -> 0
+	 EliminateCommonSubexpressions hash-conses the tree into a DAG, identical subtrees become one
+	 shared node: sin(a*b)*x + sin(a*b)*y computes sin(a*b) once (a+b and b+a count as identical)
+	 nodes stay in the parser's syntax_tree and are rewritten in place, nothing is appended to it
+*/
+	class optimizer
+	{
+	public:
+		optimizer() = delete;
+		optimizer(syntax_tree& tree, uint32_t root, bool relaxed_fp = false, MathEval::precision p = MathEval::precision::DEFAULT);
+		uint32_t FoldConstants(); // returns the new root
+		uint32_t EliminateCommonSubexpressions(); // returns the new root
+		uint32_t GetRoot();
+		const optimize_stats& GetStats() const { return stats; }
+
+		// several expressions in one tree (multi_expression.h), built with root NO_NODE: each root is folded on its own,
+		// then all of them are hash-consed against one table so identical subtrees are shared across roots too
+		// roots get their new nodes written back
+		void FoldConstants(std::vector<uint32_t>& roots);
+		void EliminateCommonSubexpressions(std::vector<uint32_t>& roots);
+
+		static size_t CountNodes(const syntax_tree& tree, uint32_t root); // shared nodes count once per parent
+		static size_t CountUniqueNodes(const syntax_tree& tree, uint32_t root);
+		static size_t CountUniqueNodes(const syntax_tree& tree, const std::vector<uint32_t>& roots); // shared across roots count once
+	private:
+		syntax_tree& tree;
+		uint32_t root = NO_NODE;
+		bool relaxed_fp = false;
+		MathEval::precision precision = MathEval::precision::DEFAULT;
+		optimize_stats stats;
+
+		// structural key of a node, children are referred to by their canonical id
+		struct node_key
+		{
+			node_type type;
+			char op;
+			uint32_t lhs;
+			uint32_t rhs;
+			uint32_t bits; // NUM value or ID name index
+			bool operator==(const node_key& other) const;
+		};
+		struct node_key_hash
+		{
+			size_t operator()(const node_key& key) const;
+		};
+		std::unordered_map<node_key, uint32_t, node_key_hash> canonical_nodes;
+		std::vector<uint32_t> canonical_id; // per node index, NO_NODE until the node is canonical
+
+		uint32_t Simplify(uint32_t node);
+		uint32_t SimplifyNode(uint32_t node, const uint32_t* children);
+		bool IsConstant(uint32_t node, float& value);
+		bool IsExactly(uint32_t node, float value);
+		void MakeConstant(uint32_t node, float value);
+		uint32_t HashCons(uint32_t node);
+		uint32_t HashConsNode(uint32_t node, const uint32_t* children);
+	};
+};
+
+#endif // OPTIMIZER_H
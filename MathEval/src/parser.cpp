@@ -1,4 +1,5 @@
 #include <iostream>
+#include <stdexcept>
 #include "parser.h"
 #include "lexer.h"
 
@@ -8,371 +9,172 @@ using std::endl;
 namespace Lexer
 {
 
-	void parser::syntax_error()
+	void parser::SyntaxError(const Token& found, TokenType expected)
 	{
-		cout << "syntax TOKEN_TYPE_ERROR\n";
-		exit(1);
+		int line = lex->GetLineNo(found);
+		string message = "syntax error at offset " + std::to_string(found.offset) + " (line " + std::to_string(line) + "): expected ";
+		message += expected == TokenType::ID ? "an operand" : GetTokenTypeName(expected);
+		if (found.token_type == TokenType::END_OF_FILE)
+			message += ", found the end of the input";
+		else
+			message += ", found '" + string(lex->GetLexeme(found)) + "'";
+		throw syntax_error(message, found, expected, line);
 	}
 
-	Token parser::expect(TokenType tt)
+	// constants are converted and names interned once here, leaves never keep a string
+	uint32_t parser::AddLeaf(const Token& tok)
 	{
-		Token t1 = lex->GetToken();
-		if (t1.token_type != tt)
-		{
-#ifdef DEBUG_PARSER
-			cout << "expected " << tt << ", but got " << t1.token_type << endl;
-#endif
-			syntax_error(); // add calls here
-			return { 0 };
-		}
-		return t1;
+		if (tok.token_type == TokenType::NUM)
+			return tree.Add(tree_node::MakeNumber(ParseNumber(lex->GetLexeme(tok))));
+		return tree.Add(tree_node::MakeId(tree.AddName(lex->GetLexeme(tok))));
 	}
 
 	int parser::GetLineNo() { return this->line_no; }
 
-	tree_node* parser::GetRoot() { return this->root_node; }
-
-	parser::~parser()
-	{
-		if (lex)
-			delete lex;
-		if (tree_node_memory)
-			delete[] tree_node_memory;
-	}
-
-	parser::parser(std::string input)
-	{
-		lex = new LexicalAnalyzer(input);
-
-		number_of_tree_nodes = lex->GetNumOfToks();
-		tree_node_memory = new tree_node[number_of_tree_nodes];
+	uint32_t parser::GetRoot() { return this->root_node; }
 
-		infix_precedence[TokenType::END_OF_FILE] = -1;
-		infix_precedence[TokenType::VAR] = 0;
-		infix_precedence[TokenType::NUM] = 0;
-		infix_precedence[TokenType::PLUS] = 2;
-		infix_precedence[TokenType::MINUS] = 2;
-		infix_precedence[TokenType::MULT] = 4;
-		infix_precedence[TokenType::DIV] = 4;
-		infix_precedence[TokenType::EXP] = 5;
-		infix_precedence[TokenType::LPAREN] = 6;
-		infix_precedence[TokenType::RPAREN] = 0;
-		infix_precedence[TokenType::LBRAC] = 6;
-		infix_precedence[TokenType::RBRAC] = 0;
-		infix_precedence[TokenType::SIN] = 0;
-		infix_precedence[TokenType::COS] = 0;
-		infix_precedence[TokenType::TAN] = 0;
-		infix_precedence[TokenType::ARCSIN] = 0;
-		infix_precedence[TokenType::ARCCOS] = 0;
-		infix_precedence[TokenType::ARCTAN] = 0;
-		// END_OF_FILE = 0, 
-		// EXP, SIN, COS, TAN, ARCSIN, ARCCOS, ARCTAN, 
-		// NUM, ID, VAR, EQUAL, NOT_EQUAL, PLUS, MINUS, 
-		// MULT, DIV, COMMA, LPAREN, RPAREN, LBRAC, RBRAC, LESS, GREATER, 
-		// TOKEN_TYPE_ERROR
-		prefix_precedence[TokenType::END_OF_FILE] = -1;
-		prefix_precedence[TokenType::VAR] = 0;
-		prefix_precedence[TokenType::NUM] = 0;
-		prefix_precedence[TokenType::PLUS] = 2;
-		prefix_precedence[TokenType::MINUS] = 2;
-		prefix_precedence[TokenType::MULT] = 4;
-		prefix_precedence[TokenType::DIV] = 4;
-		prefix_precedence[TokenType::EXP] = 5;
-		prefix_precedence[TokenType::LPAREN] = prefix_precedence.at(TokenType::MULT);
-		prefix_precedence[TokenType::RPAREN] = 0;
-		prefix_precedence[TokenType::LBRAC] = prefix_precedence.at(TokenType::MULT);
-		prefix_precedence[TokenType::RBRAC] = 0;
-		prefix_precedence[TokenType::SIN] = 0;
-		prefix_precedence[TokenType::COS] = 0;
-		prefix_precedence[TokenType::TAN] = 0;
-		prefix_precedence[TokenType::ARCSIN] = 0;
-		prefix_precedence[TokenType::ARCCOS] = 0;
-		prefix_precedence[TokenType::ARCTAN] = 0;
-	}
-
-	void parser::PrintTokens()
+	tree_node tree_node::MakeBinary(bin_op op_type, uint32_t lhs, uint32_t rhs)
 	{
-		Token t;
-		t = lex->GetToken();
-		while (t.token_type != TokenType::END_OF_FILE)
-		{
-			t.Print();
-			t = lex->GetToken();
-		}
+		tree_node node;
+		node.type = node_type::BINARY_OP;
+		node.op_type = op_type;
+		node.lhs = lhs;
+		node.rhs = rhs;
+		return node;
 	}
 
-	int8_t parser::getInfixPrecedence(TokenType t)
+	tree_node tree_node::MakePrefix(unary_op op, uint32_t next)
 	{
-		if (infix_precedence.find(t) != infix_precedence.end())
-			return  infix_precedence.at(t);
-		return -1;
+		tree_node node;
+		node.type = node_type::PREFIX_OP;
+		node.op = op;
+		node.next = next;
+		node.rhs = NO_NODE;
+		return node;
 	}
 
-	int8_t parser::getPrefixPrecedence(TokenType t)
+	tree_node tree_node::MakeNumber(float constant)
 	{
-		if (prefix_precedence.find(t) != prefix_precedence.end())
-			return  prefix_precedence.at(t);
-		return -1;
+		tree_node node;
+		node.type = node_type::PREFIX_OP;
+		node.op = unary_op::NUM_OP;
+		node.next = NO_NODE;
+		node.constant = constant;
+		return node;
 	}
 
-	unary_op parser::GetUnaryOp(TokenType t)
+	tree_node tree_node::MakeId(uint32_t name)
 	{
-		switch (t)
-		{
-		case TokenType::EXP:
-			return unary_op::EXP_OP;
-		case TokenType::SIN:
-			return unary_op::SIN_OP;
-		case TokenType::COS:
-			return unary_op::COS_OP;
-		case TokenType::TAN:
-			return unary_op::TAN_OP;
-		case TokenType::ARCSIN:
-			return unary_op::ARCSIN_OP;
-		case TokenType::ARCCOS:
-			return unary_op::ARCCOS_OP;
-		case TokenType::ARCTAN:
-			return unary_op::ARCTAN_OP;
-		default:
-			return unary_op::ERROR_UN_OP;
-		}
+		tree_node node;
+		node.type = node_type::PREFIX_OP;
+		node.op = unary_op::ID_OP;
+		node.name = name;
+		node.slot = NO_SLOT;
+		return node;
 	}
 
-	bool parser::is_identifier(TokenType t)
+	uint32_t syntax_tree::AddName(std::string_view name)
 	{
-		switch (t)
-		{
-			//case EXP:
-			//case SIN:
-			//case COS:
-			//case TAN:
-			//case ARCSIN:
-			//case ARCCOS:
-			//case ARCTAN:
-		case TokenType::NUM:
-		case TokenType::ID:
-			return true;
-		default:
-			return false;
-		}
+		auto found = name_index.find(string(name));
+		if (found != name_index.end())
+			return found->second;
+		uint32_t index = static_cast<uint32_t>(names.size());
+		names.emplace_back(name);
+		name_index.emplace(names.back(), index);
+		return index;
 	}
 
-	unary_op parser::GetPrefixOp(TokenType t)
+	void syntax_tree::ResolveInputs(const std::unordered_map<string, size_t>& function_inputs, size_t number_of_slots)
 	{
-		switch (t)
+		// one lookup per distinct name, not per leaf
+		std::vector<uint32_t> name_slot(names.size());
+		for (size_t i = 0; i < names.size(); i++)
 		{
-		case TokenType::EXP:
-			return unary_op::EXP_OP;
-		case TokenType::SIN:
-			return unary_op::SIN_OP;
-		case TokenType::COS:
-			return unary_op::COS_OP;
-		case TokenType::TAN:
-			return unary_op::TAN_OP;
-		case TokenType::ARCSIN:
-			return unary_op::ARCSIN_OP;
-		case TokenType::ARCCOS:
-			return unary_op::ARCCOS_OP;
-		case TokenType::ARCTAN:
-			return unary_op::ARCTAN_OP;
-		case TokenType::MINUS:
-			return unary_op::MINUS_OP;
-		case TokenType::NUM:
-			return unary_op::NUM_OP;
-		case TokenType::ID:
-			return unary_op::ID_OP;
-		default:
-			return unary_op::ERROR_UN_OP;
+			auto found = function_inputs.find(names[i]);
+			if (found == function_inputs.end())
+				throw std::out_of_range("unknown variable: " + names[i]);
+			if (found->second >= number_of_slots)
+				throw std::out_of_range("variable " + names[i] + " maps to slot " + std::to_string(found->second) + ", past the last input");
+			name_slot[i] = static_cast<uint32_t>(found->second);
 		}
-	}
-
-	bin_op parser::GetBinOp(TokenType t)
-	{
-		switch (t)
+		for (tree_node& node : nodes)
 		{
-		case TokenType::PLUS:
-			return bin_op::ADD_OP;
-		case TokenType::MINUS:
-			return bin_op::SUB_OP;
-		case TokenType::MULT:
-			return bin_op::MULT_OP;
-		case TokenType::DIV:
-			return bin_op::DIV_OP;
-		default:
-			return bin_op::ERROR_BIN_OP;
+			if (node.type == node_type::PREFIX_OP && node.op == unary_op::ID_OP)
+				node.slot = name_slot[node.name];
 		}
 	}
 
-	tree_node* parser::parse()
-	{
-		root_node = parse_block();
-		return root_node;
-	}
-
-	tree_node* parser::parse_block()
+	parser::~parser()
 	{
-		TokenType t1 = lex->peek(1).token_type; // ID
-		TokenType t2 = lex->peek(2).token_type; // LPAREN
-		TokenType t3 = lex->peek(3).token_type; // VAR
-		TokenType t4 = lex->peek(4).token_type; // COMMA (or) EQUAL 
-		TokenType t5 = lex->peek(5).token_type;
-		if (t1 == TokenType::ID && t2 == TokenType::LPAREN && t3 == TokenType::ID)
-		{
-			if (t4 == TokenType::COMMA || (t4 == TokenType::RPAREN && t5 == TokenType::EQUAL))
-			{
-				parse_decl();
-				expect(TokenType::EQUAL);
-			}
-		}
-		return parse_expr(0);
+		if (lex)
+			delete lex;
 	}
 
-	// function declaration section
-	tree_node* parser::parse_decl()
+	parser::parser(std::string_view input)
 	{
-		function_name.push_back(expect(TokenType::ID).lexeme); // function name
-		expect(TokenType::LPAREN);
-		parse_varList();
-		expect(TokenType::RPAREN);
-		return nullptr;
-	}
+		lex = new LexicalAnalyzer(input);
 
-	tree_node* parser::parse_varList()
-	{
-		function_name.push_back(expect(TokenType::ID).lexeme);
-		if (lex->peek(1).token_type == TokenType::COMMA)
-			parse_varList();
-		return nullptr;
+		// at most one node per token, so the array never moves while parsing
+		tree.nodes.reserve(lex->GetNumOfToks());
 	}
 
-	// pratt parsing
-	// first call should terminate on EOF
-	tree_node* parser::parse_expr(int8_t precedence)
+	void parser::PrintTokens()
 	{
-		tree_node* left = parse_prefix(); // becomes possible LHS
-		tree_node* temp;
-		Token op;
-#ifdef DEBUG_PARSER
-		cout << "parse expr: " << lex->peek(1).lexeme << endl;
-#endif
-		while (getInfixPrecedence(lex->peek(1).token_type) > precedence)
+		Token t;
+		t = lex->GetToken();
+		while (t.token_type != TokenType::END_OF_FILE)
 		{
-#ifdef DEBUG_PARSER
-			cout << "higher precedence, recursively call expr" << endl;
-#endif
-			op = lex->GetToken();
-			temp = left;
-			left = &(tree_node_memory[tree_node_idx++]); // new tree_node{}; //{ BINARY_OP, left, parse_expr( getInfixPrecedence(op.token_type) ), GetBinOp(op.token_type) }; // lhs, rhs, op
-			left->type = node_type::BINARY_OP;
-			left->binary_op.lhs = temp; // previous left
-			left->binary_op.rhs = parse_expr(getInfixPrecedence(op.token_type));
-			left->binary_op.op_type = GetBinOp(op.token_type);
+			t.Print(lex->GetSource());
+			t = lex->GetToken();
 		}
-		return left;
 	}
 
-	tree_node* parser::parse_prefix()
+	uint32_t parser::parse()
 	{
-		Token t1 = lex->GetToken();
-#ifdef DEBUG_PARSER
-		cout << "parse prefix: " << t1.lexeme << " " << t1.token_type << endl;
-#endif
-		if (t1.token_type == TokenType::END_OF_FILE) return nullptr;
-		if (is_identifier(t1.token_type))
-		{
-#ifdef DEBUG_PARSER
-			cout << "is identifier\n";
-#endif
-			tree_node* node = &(tree_node_memory[tree_node_idx++]); //new tree_node{};// { PREFIX_OP, nullptr, nullptr, static_cast<bin_op>(0)}; // union cheese jazz club
-			node->type = node_type::PREFIX_OP;
-			node->prefix_op.lexeme = new std::string(); // static initialization (added line)
-			*(node->prefix_op.lexeme) = t1.lexeme;
-			node->prefix_op.op = GetPrefixOp(t1.token_type);
-			node->prefix_op.next = nullptr;
-#ifdef DEBUG_PARSER
-			cout << "next token type: " << lex->peek(1).token_type << "\n";
-#endif
-			return node;
-		}
-		else
-		{
-#ifdef DEBUG_PARSER
-			cout << "is NOT identifier\n";
-#endif
-			int8_t precedence = getPrefixPrecedence(t1.token_type);
-			if (precedence != -1)
-			{
-				if (t1.token_type == TokenType::LPAREN || t1.token_type == TokenType::RPAREN)
-					return parse_expr(0); // reset precedence
-				else
-				{
-					tree_node* temp_tn = &(tree_node_memory[tree_node_idx++]); //new tree_node{}; // {PREFIX_OP, nullptr, nullptr, static_cast<bin_op>(0)};
-					temp_tn->type = node_type::PREFIX_OP;
-					temp_tn->prefix_op.op = GetUnaryOp(t1.token_type);
-					temp_tn->prefix_op.next = parse_expr(0);
-					return temp_tn;
-				}
-			}
-			else
-			{
-#ifdef DEBUG_PARSER
-				cout << "parse_prefix syntax TOKEN_TYPE_ERROR\n" << t1.token_type << endl << (int)precedence << endl;
-#endif
-				syntax_error();
-			}
-		}
-		return nullptr; // program never reaches here, it just stops the compiler warning
+		root_node = grammar<parser>::Block(*this);
+		return root_node;
 	}
 
 #ifdef DEBUG_PARSER
-	void parser::PrintBFS(tree_node* node)
+	void parser::PrintBFS(uint32_t node)
 	{
-		std::queue<tree_node*> q;
+		std::queue<uint32_t> q;
 		q.push(node);
-		tree_node* n = nullptr;
 
 		cout << "printbfs\n";
 
-
-		while (q.front() != nullptr)
+		while (!q.empty() && q.front() != NO_NODE)
 		{
 			// print top of queue
-			n = q.front();
-			if (n->type == node_type::BINARY_OP)
-				cout << n->binary_op.op_type << endl;
-			else
-				cout << *(n->prefix_op.lexeme) << " " << n->prefix_op.op << endl;
+			const tree_node& n = tree[q.front()];
 			q.pop();
+			if (n.type == node_type::BINARY_OP)
+				cout << n.op_type << endl;
+			else if (n.op == unary_op::NUM_OP)
+				cout << n.constant << " " << n.op << endl;
+			else if (n.op == unary_op::ID_OP)
+				cout << tree.names[n.name] << " " << n.op << endl;
+			else
+				cout << n.op << endl;
 
 			// recursive call
-			if (n->type == node_type::BINARY_OP)
+			if (n.type == node_type::BINARY_OP)
 			{
-				q.push(n->binary_op.lhs);
-				q.push(n->binary_op.rhs);
+				q.push(n.lhs);
+				q.push(n.rhs);
 			}
-			else if (n->prefix_op.next != nullptr)
+			else if (!n.IsLeaf())
 			{
-				q.push(n->prefix_op.next);
+				q.push(n.next);
 			}
 		}
-
-		/*
-			while(!q.empty())
-			{
-				if(q.front()->type == BINARY_OP)
-					cout << q.front()->binary_op.op_type << endl;
-				else
-					cout << *(q.front()->prefix_op.lexeme) << " " << q.front()->prefix_op.op << endl;
-				q.pop();
-			}*/
 	}
 #endif /*DEBUG_PARSER*/
 
 	// make this std::optional
+	// empty without a f(a, b) = header
 	const std::vector<string>& parser::GetFunctionName()
 	{
-		if (function_name.empty())
-			return std::vector<string>();
 		return function_name;
 	}
 
@@ -394,7 +196,7 @@ namespace Lexer
 #endif /* MAIN_H */
 
 	// type checking class
-	type_check::type_check(tree_node* node)
+	type_check::type_check(uint32_t node)
 		: root(node)
 	{}
 
@@ -2,6 +2,8 @@
 #define PARSER_H
 
 #include "lexer.h"
+#include "decimal.h"
+#include <cstdint>
 #include <unordered_map>
 #include <string>
 #include <queue>
@@ -23,12 +25,15 @@ namespace Lexer
 	 expr -> expr MINUS expr
 	 expr -> expr MULT expr
 	 expr -> expr DIV expr
+	 expr -> expr CARET expr   right associative, binds tighter than * and unary minus: -x^2 is -(x^2)
+	 expr -> pow LPAREN expr COMMA expr RPAREN
 	 expr -> sin LPAREN expr RPAREN
 	 expr -> cos LPAREN expr RPAREN
 	 expr -> tan LPAREN expr RPAREN
 	 expr -> arcsin LPAREN expr RPAREN
 	 expr -> arccos LPAREN expr RPAREN
 	 expr -> arctan LPAREN expr RPAREN
+	 expr -> sqrt LPAREN expr RPAREN
 	 expr -> exp LPAREN expr RPAREN
 	 expr -> exp LPAREN expr COMMA expr RPAREN
 	 expr -> ...all trig and exp
@@ -39,13 +44,13 @@ namespace Lexer
 
 	enum class bin_op : char
 	{
-		ERROR_BIN_OP = -1, ADD_OP, SUB_OP, MULT_OP, DIV_OP,
+		ERROR_BIN_OP = -1, ADD_OP, SUB_OP, MULT_OP, DIV_OP, POW_OP,
 	};
 
 	enum class unary_op : char
 	{
 		ERROR_UN_OP = -1, EXP_OP, SIN_OP, COS_OP, TAN_OP,
-		ARCSIN_OP, ARCCOS_OP, ARCTAN_OP, MINUS_OP,
+		ARCSIN_OP, ARCCOS_OP, ARCTAN_OP, MINUS_OP, SQRT_OP,
 		NUM_OP, ID_OP,
 	};
 
@@ -54,51 +59,278 @@ namespace Lexer
 		BINARY_OP = 0, PREFIX_OP,
 	};
 
-	/*
-	typedef struct tag_tree_node tree_node;
+	static constexpr uint32_t NO_NODE = UINT32_MAX;
+	static constexpr uint32_t NO_SLOT = UINT32_MAX;
 
-	struct binary_op // ie: a+b
+	// binding power of t after an operand, -1 can't continue an expression
+	constexpr int8_t InfixPrecedence(TokenType t)
 	{
-		tree_node* lhs = nullptr;
-		tree_node* rhs = nullptr;
-		bin_op op_type = NO_OP;
-	};
+		switch (t)
+		{
+		case TokenType::VAR:
+		case TokenType::NUM:
+		case TokenType::RPAREN:
+		case TokenType::RBRAC:
+		case TokenType::SIN:
+		case TokenType::COS:
+		case TokenType::TAN:
+		case TokenType::ARCSIN:
+		case TokenType::ARCCOS:
+		case TokenType::ARCTAN:
+		case TokenType::SQRT:
+		case TokenType::POW:
+			return 0;
+		case TokenType::PLUS:
+		case TokenType::MINUS:
+			return 2;
+		case TokenType::MULT:
+		case TokenType::DIV:
+			return 4;
+		case TokenType::EXP:
+		case TokenType::CARET:
+			return 5;
+		case TokenType::LPAREN:
+		case TokenType::LBRAC:
+			return 6;
+		default:
+			return -1;
+		}
+	}
 
-	struct prefix_op // ie: exp(5)
+	// binding power of t starting an operand, -1 can't start one
+	constexpr int8_t PrefixPrecedence(TokenType t)
 	{
-		string lexeme;
-		unary_op op;
-	};
+		switch (t)
+		{
+		case TokenType::LPAREN:
+		case TokenType::LBRAC:
+			return PrefixPrecedence(TokenType::MULT);
+		case TokenType::EXP:
+			return 5;
+		default:
+			return InfixPrecedence(t);
+		}
+	}
+
+	constexpr bool IsIdentifier(TokenType t) { return t == TokenType::NUM || t == TokenType::ID; }
 
-	typedef union node_data
+	constexpr bin_op ToBinOp(TokenType t)
+	{
+		switch (t)
 		{
-			struct binary_op; // ie: a+b
-			struct prefix_op; // ie: exp(5)
-		} node_data;
-	*/
+		case TokenType::PLUS:  return bin_op::ADD_OP;
+		case TokenType::MINUS: return bin_op::SUB_OP;
+		case TokenType::MULT:  return bin_op::MULT_OP;
+		case TokenType::DIV:   return bin_op::DIV_OP;
+		case TokenType::CARET: return bin_op::POW_OP;
+		default:               return bin_op::ERROR_BIN_OP;
+		}
+	}
 
-	typedef struct tag_tree_node
+	constexpr unary_op ToUnaryOp(TokenType t)
 	{
-		node_type type;
-		union
+		switch (t)
 		{
-			struct // ie: a+b
+		case TokenType::EXP:    return unary_op::EXP_OP;
+		case TokenType::SIN:    return unary_op::SIN_OP;
+		case TokenType::COS:    return unary_op::COS_OP;
+		case TokenType::TAN:    return unary_op::TAN_OP;
+		case TokenType::ARCSIN: return unary_op::ARCSIN_OP;
+		case TokenType::ARCCOS: return unary_op::ARCCOS_OP;
+		case TokenType::ARCTAN: return unary_op::ARCTAN_OP;
+		case TokenType::MINUS:  return unary_op::MINUS_OP;
+		case TokenType::SQRT:   return unary_op::SQRT_OP;
+		default:                return unary_op::ERROR_UN_OP;
+		}
+	}
+
+	/*
+	 the pratt parser, written once for both front ends: parser below at runtime and
+	 static_parser (static_parser.h) at compile time, so they can't disagree on what an expression means
+	 P provides
+	   Token Next(), Token Peek(int how_far)
+	   uint32_t AddBinary(bin_op, lhs, rhs), AddPrefix(unary_op, next), AddLeaf(NUM or ID token)
+	   void Declare(ID token) for the names in a f(a, b) = ... header
+	   void SyntaxError(found token, expected token type), doesn't return (see syntax_error in lexer.h for expected)
+	 every token has to be used: an empty input gives NO_NODE, anything else that doesn't read as one whole
+	 expression is a SyntaxError, so no malformed input ever reaches AddBinary/AddPrefix
+	 each '(', function, unary minus or exponent is one level of recursion, past MAX_DEPTH levels it throws
+	 std::length_error instead of running out of stack
+	*/
+	template <class P>
+	struct grammar
+	{
+		// a variable inside 999 parentheses still parses, that's a few 100KB of stack at most even unoptimized
+		static constexpr uint32_t MAX_DEPTH = 1000;
+
+		// block -> expr | decl EQUAL expr
+		static constexpr uint32_t Block(P& p)
+		{
+			if (p.Peek(1).token_type == TokenType::END_OF_FILE)
+				return NO_NODE;
+			TokenType t1 = p.Peek(1).token_type; // ID
+			TokenType t2 = p.Peek(2).token_type; // LPAREN
+			TokenType t3 = p.Peek(3).token_type; // VAR
+			TokenType t4 = p.Peek(4).token_type; // COMMA (or) RPAREN
+			TokenType t5 = p.Peek(5).token_type;
+			if (t1 == TokenType::ID && t2 == TokenType::LPAREN && t3 == TokenType::ID)
+			{
+				if (t4 == TokenType::COMMA || (t4 == TokenType::RPAREN && t5 == TokenType::EQUAL))
+				{
+					Decl(p);
+					Expect(p, TokenType::EQUAL);
+				}
+			}
+			uint32_t root = Expr(p, 0, 0);
+			Expect(p, TokenType::END_OF_FILE); // ie: the b in "a b", or the ) in "a)"
+			return root;
+		}
+
+		// decl -> ID LPAREN var-list RPAREN, var-list -> VAR | VAR COMMA var-list
+		static constexpr void Decl(P& p)
+		{
+			p.Declare(Expect(p, TokenType::ID)); // function name
+			Expect(p, TokenType::LPAREN);
+			p.Declare(Expect(p, TokenType::ID));
+			while (p.Peek(1).token_type == TokenType::COMMA)
+			{
+				p.Next();
+				p.Declare(Expect(p, TokenType::ID));
+			}
+			Expect(p, TokenType::RPAREN);
+		}
+
+		// stops at the first token that can't continue it, Block checks that one is the end
+		// depth is how many levels of Prefix/Exponent are already on the stack
+		static constexpr uint32_t Expr(P& p, int8_t precedence, uint32_t depth)
+		{
+			uint32_t left = Prefix(p, depth); // becomes possible LHS
+			while (InfixPrecedence(p.Peek(1).token_type) > precedence)
+			{
+				Token op = p.Next();
+				bin_op op_type = ToBinOp(op.token_type);
+				if (op_type == bin_op::ERROR_BIN_OP)
+				{
+					p.SyntaxError(op, TokenType::MULT); // ie: the ( in 2(x)
+					return NO_NODE;
+				}
+				uint32_t rhs = op_type == bin_op::POW_OP ? Exponent(p, depth) : Expr(p, InfixPrecedence(op.token_type), depth);
+				left = p.AddBinary(op_type, left, rhs); // previous left becomes lhs
+			}
+			return left;
+		}
+
+		// right hand side of ^, right associative (a^b^c is a^(b^c)) and a minus in front of it only
+		// negates the exponent: 2^-x*y is (2^(-x))*y
+		static constexpr uint32_t Exponent(P& p, uint32_t depth)
+		{
+			depth = Deeper(depth);
+			if (p.Peek(1).token_type == TokenType::MINUS)
 			{
-				tag_tree_node* lhs = nullptr;
-				tag_tree_node* rhs = nullptr;
-				bin_op op_type = bin_op::ERROR_BIN_OP;
-			} binary_op;
+				p.Next();
+				uint32_t next = Exponent(p, depth);
+				return p.AddPrefix(unary_op::MINUS_OP, next);
+			}
+			return Expr(p, InfixPrecedence(TokenType::CARET) - 1, depth);
+		}
 
-			struct // ie: exp(5)
+		static constexpr uint32_t Prefix(P& p, uint32_t depth)
+		{
+			depth = Deeper(depth);
+			Token t1 = p.Next();
+			if (IsIdentifier(t1.token_type))
+				return p.AddLeaf(t1);
+			if (t1.token_type == TokenType::LPAREN)
 			{
-				tag_tree_node* next = nullptr;
-				string* lexeme;
-				unary_op op;
-			} prefix_op;
+				uint32_t group = Expr(p, 0, depth); // reset precedence
+				Expect(p, TokenType::RPAREN);
+				return group;
+			}
+			// pow(a, b) is a^b
+			if (t1.token_type == TokenType::POW)
+			{
+				Expect(p, TokenType::LPAREN);
+				uint32_t base = Expr(p, 0, depth);
+				Expect(p, TokenType::COMMA);
+				uint32_t exponent = Expr(p, 0, depth);
+				Expect(p, TokenType::RPAREN);
+				return p.AddBinary(bin_op::POW_OP, base, exponent);
+			}
+			unary_op op = ToUnaryOp(t1.token_type);
+			if (op == unary_op::ERROR_UN_OP)
+			{
+				p.SyntaxError(t1, TokenType::ID); // no operand starts with it, ie: the ) in "a+)" or the end in "a+"
+				return NO_NODE;
+			}
+			// functions bind tighter than any infix operator, ie: sin(x)+1 is (sin(x))+1
+			// unary minus takes everything above its own precedence, ie: -a*b is -(a*b)
+			uint32_t next = op == unary_op::MINUS_OP ? Expr(p, PrefixPrecedence(t1.token_type), depth) : Prefix(p, depth);
+			return p.AddPrefix(op, next);
+		}
+
+		static constexpr uint32_t Deeper(uint32_t depth)
+		{
+			if (depth == MAX_DEPTH)
+				throw std::length_error("parser: expression nested more than 1000 levels deep");
+			return depth + 1;
+		}
+
+		static constexpr Token Expect(P& p, TokenType t)
+		{
+			Token t1 = p.Next();
+			if (t1.token_type != t)
+				p.SyntaxError(t1, t);
+			return t1;
+		}
+	};
+
+	// 12 bytes, nodes sit in one array (syntax_tree::nodes) and point at each other by index
+	// leaves carry what evaluation needs inline: the float for NUM, the input slot for ID
+	struct tree_node
+	{
+		node_type type = node_type::BINARY_OP;
+		bin_op op_type = bin_op::ERROR_BIN_OP; // BINARY_OP
+		unary_op op = unary_op::ERROR_UN_OP; // PREFIX_OP
+		union
+		{
+			uint32_t lhs; // BINARY_OP, ie: a in a+b
+			uint32_t next; // PREFIX_OP other than NUM/ID, ie: 5 in exp(5)
+			uint32_t name; // ID leaf, index into syntax_tree::names
+		};
+		union
+		{
+			uint32_t rhs; // BINARY_OP
+			float constant; // NUM leaf
+			uint32_t slot; // ID leaf, input slot once syntax_tree::ResolveInputs ran, NO_SLOT before
 		};
-		tag_tree_node() {}
-		~tag_tree_node() { if (type == node_type::PREFIX_OP && this->prefix_op.lexeme) delete this->prefix_op.lexeme; }
-	} tree_node;
+
+		inline bool IsLeaf() const { return type == node_type::PREFIX_OP && (op == unary_op::NUM_OP || op == unary_op::ID_OP); }
+
+		static tree_node MakeBinary(bin_op op_type, uint32_t lhs, uint32_t rhs);
+		static tree_node MakePrefix(unary_op op, uint32_t next);
+		static tree_node MakeNumber(float constant);
+		static tree_node MakeId(uint32_t name);
+	};
+
+	// all nodes of one parsed expression, the optimizer rewrites them in place so some can end up unreachable
+	class syntax_tree
+	{
+	public:
+		std::vector<tree_node> nodes;
+		std::vector<string> names; // distinct identifiers
+
+		inline tree_node& operator[](uint32_t index) { return nodes[index]; }
+		inline const tree_node& operator[](uint32_t index) const { return nodes[index]; }
+		inline uint32_t Add(const tree_node& node) { nodes.push_back(node); return static_cast<uint32_t>(nodes.size() - 1); }
+		// index of name in names, added on first use
+		uint32_t AddName(std::string_view name);
+
+		// fills in slot on every ID leaf, done once so evaluation never looks a name up
+		// throws std::out_of_range for a name missing from function_inputs or a slot >= number_of_slots
+		void ResolveInputs(const std::unordered_map<string, size_t>& function_inputs, size_t number_of_slots = SIZE_MAX);
+	private:
+		std::unordered_map<string, uint32_t> name_index;
+	};
 
 
 	class parser
@@ -106,53 +338,42 @@ namespace Lexer
 	public:
 		parser() = delete;
 		~parser();
-		parser(std::string);
-		tree_node* parse();
+		parser(std::string_view); // the input has to stay alive until parse() returns
+		// index of the root in GetTree(), NO_NODE for an empty input, throws syntax_error (lexer.h) for malformed input
+		uint32_t parse();
 		int GetLineNo();
-		tree_node* GetRoot();
+		uint32_t GetRoot();
+		inline syntax_tree& GetTree() { return tree; }
 
 		// extras
 		void PrintTokens();
-		void PrintBFS(tree_node*);
+		void PrintBFS(uint32_t);
 		const std::vector<string>& GetFunctionName();
 	private:
-		std::unordered_map<TokenType, int8_t> infix_precedence; // consider making these two variables static
-		std::unordered_map<TokenType, int8_t> prefix_precedence;
+		friend struct grammar<parser>;
 		LexicalAnalyzer* lex;
-		tree_node* root_node = nullptr;
+		syntax_tree tree;
+		uint32_t root_node = NO_NODE;
 		int line_no = 1;
 		std::vector<string> function_name;
 
-		//
-		tree_node* tree_node_memory = nullptr;
-		size_t number_of_tree_nodes = 0;
-		size_t tree_node_idx = 0;
-
-		// parsing handlers
-		Token expect(TokenType);
-		void syntax_error();
-		// utilities
-		int8_t getInfixPrecedence(TokenType);
-		int8_t getPrefixPrecedence(TokenType);
-		bool is_identifier(TokenType);
-		unary_op GetPrefixOp(TokenType);
-		bin_op GetBinOp(TokenType);
-		unary_op GetUnaryOp(TokenType);
-		// rest of grammar for rec desc goes here...
-		tree_node* parse_block();
-		tree_node* parse_decl();
-		tree_node* parse_varList();
-		tree_node* parse_expr(int8_t prePrecedence);
-		tree_node* parse_prefix();
+		// hooks for grammar<parser>
+		inline Token Next() { return lex->GetToken(); }
+		inline Token Peek(int how_far) { return lex->peek(how_far); }
+		inline uint32_t AddBinary(bin_op op_type, uint32_t lhs, uint32_t rhs) { return tree.Add(tree_node::MakeBinary(op_type, lhs, rhs)); }
+		inline uint32_t AddPrefix(unary_op op, uint32_t next) { return tree.Add(tree_node::MakePrefix(op, next)); }
+		uint32_t AddLeaf(const Token& tok);
+		inline void Declare(const Token& tok) { function_name.push_back(string(lex->GetLexeme(tok))); }
+		[[noreturn]] void SyntaxError(const Token& found, TokenType expected);
 	};
 
 	class type_check
 	{
 	public:
 		type_check() = delete;
-		type_check(tree_node* node);
+		type_check(uint32_t node);
 	private:
-		tree_node* root = nullptr;
+		uint32_t root = NO_NODE;
 		std::pair<bool, string> function = { false, "" };
 
 	private:
@@ -0,0 +1,368 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "profiler.h"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace MathEval
+{
+
+	static inline uint64_t Ticks()
+	{
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+		return __rdtsc();
+#else
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+	}
+
+	// ticks per ns, measured once against steady_clock (comes out near 1 where Ticks is the clock already)
+	static double TicksPerNs()
+	{
+		static const double ratio = []
+		{
+			auto start = std::chrono::steady_clock::now();
+			uint64_t first = Ticks();
+			std::chrono::steady_clock::time_point now;
+			do
+				now = std::chrono::steady_clock::now();
+			while (now - start < std::chrono::milliseconds(2));
+			uint64_t last = Ticks();
+			double ns = std::chrono::duration<double, std::nano>(now - start).count();
+			return last > first ? static_cast<double>(last - first) / ns : 1.0;
+		}();
+		return ratio;
+	}
+
+	// what two back-to-back reads cost, the quickest of many so an interrupt can't inflate it
+	static uint64_t ReadCost()
+	{
+		static const uint64_t cost = []
+		{
+			uint64_t best = UINT64_MAX;
+			for (int i = 0; i < 1000; i++)
+			{
+				uint64_t start = Ticks();
+				uint64_t end = Ticks();
+				best = std::min(best, end - start);
+			}
+			return best;
+		}();
+		return cost;
+	}
+
+	// one instruction, the same functions Evaluate_program calls
+	static inline float Step(const instruction& in, const float* reg, const float* inputs, const unary_function* unary)
+	{
+		switch (in.op)
+		{
+		case opcode::LOAD_CONST: return in.constant;
+		case opcode::LOAD_INPUT: return inputs[in.a];
+		case opcode::ADD:        return reg[in.a] + reg[in.b];
+		case opcode::SUB:        return reg[in.a] - reg[in.b];
+		case opcode::MULT:       return reg[in.a] * reg[in.b];
+		case opcode::DIV:        return reg[in.a] / reg[in.b];
+		case opcode::POW:        return Power(reg[in.a], reg[in.b]);
+		default:                 return unary[static_cast<size_t>(in.op)](reg[in.a]);
+		}
+	}
+
+	expression_profiler::expression_profiler(std::shared_ptr<const compiled_expression> c, uint32_t period)
+		: compiled(std::move(c)), sample_period(period ? period : 1)
+	{
+		if (!compiled)
+			throw std::invalid_argument("expression_profiler: no compiled expression");
+		prog = compiled->prog.GetSourceNodes().empty() ? program(compiled->tree, compiled->root) : compiled->prog;
+		for (size_t op = static_cast<size_t>(opcode::EXP); op <= static_cast<size_t>(LAST_OPCODE); op++)
+			unary[op] = GetUnaryFunction(static_cast<opcode>(op), compiled->precision);
+		ticks.reset(new std::atomic<uint64_t>[prog.GetNumOfInstructions()]);
+		Reset();
+		// calibrate here rather than in the first timed evaluation
+		TicksPerNs();
+		ReadCost();
+	}
+
+	float expression_profiler::Evaluate(const float* inputs)
+	{
+		static constexpr uint32_t MAX_STACK_REGISTERS = 64;
+		float stack_registers[MAX_STACK_REGISTERS];
+		std::vector<float> heap_registers;
+		float* reg = stack_registers;
+		if (prog.GetNumOfRegisters() > MAX_STACK_REGISTERS)
+		{
+			heap_registers.resize(prog.GetNumOfRegisters());
+			reg = heap_registers.data();
+		}
+
+		const instruction* ins = prog.GetInstructions();
+		size_t n = prog.GetNumOfInstructions();
+		if (evaluations.fetch_add(1, std::memory_order_relaxed) % sample_period != 0)
+		{
+			for (size_t i = 0; i < n; i++)
+				reg[ins[i].dst] = Step(ins[i], reg, inputs, unary);
+		}
+		else
+		{
+			for (size_t i = 0; i < n; i++)
+			{
+				uint64_t start = Ticks();
+				reg[ins[i].dst] = Step(ins[i], reg, inputs, unary);
+				uint64_t end = Ticks();
+				ticks[i].fetch_add(end - start, std::memory_order_relaxed);
+			}
+			samples.fetch_add(1, std::memory_order_relaxed);
+		}
+		return reg[prog.GetResultRegister()];
+	}
+
+	void expression_profiler::Reset()
+	{
+		for (size_t i = 0; i < prog.GetNumOfInstructions(); i++)
+			ticks[i].store(0, std::memory_order_relaxed);
+		evaluations.store(0, std::memory_order_relaxed);
+		samples.store(0, std::memory_order_relaxed);
+	}
+
+	std::vector<double> expression_profiler::InstructionCosts() const
+	{
+		std::vector<double> cost(prog.GetNumOfInstructions(), 0.0);
+		uint64_t sampled = GetNumOfSamples();
+		if (sampled == 0)
+			return cost;
+		double read = static_cast<double>(ReadCost());
+		for (size_t i = 0; i < cost.size(); i++)
+		{
+			double per_sample = static_cast<double>(ticks[i].load(std::memory_order_relaxed)) / sampled;
+			cost[i] = std::max(0.0, per_sample - read) / TicksPerNs();
+		}
+		return cost;
+	}
+
+	namespace
+	{
+		// costs mapped back onto the tree, shared by both report formats
+		struct explain_data
+		{
+			const Lexer::syntax_tree& tree;
+			std::vector<double> self; // ns per evaluation, per node
+			std::vector<double> total; // self plus the subtrees, a shared node counts under its first parent only
+			std::vector<uint32_t> instructions; // per node
+			std::vector<double> opcode_cost;
+			std::vector<uint32_t> opcode_instructions;
+			double evaluation = 0.0; // every instruction together
+
+			explain_data(const Lexer::syntax_tree& t, uint32_t root, const program& prog, const std::vector<double>& cost)
+				: tree(t), self(t.nodes.size(), 0.0), total(t.nodes.size(), 0.0), instructions(t.nodes.size(), 0),
+				opcode_cost(static_cast<size_t>(LAST_OPCODE) + 1, 0.0), opcode_instructions(static_cast<size_t>(LAST_OPCODE) + 1, 0)
+			{
+				const std::vector<uint32_t>& source = prog.GetSourceNodes();
+				const instruction* ins = prog.GetInstructions();
+				for (size_t i = 0; i < prog.GetNumOfInstructions(); i++)
+				{
+					self[source[i]] += cost[i];
+					instructions[source[i]]++;
+					opcode_cost[static_cast<size_t>(ins[i].op)] += cost[i];
+					opcode_instructions[static_cast<size_t>(ins[i].op)]++;
+					evaluation += cost[i];
+				}
+				std::vector<bool> seen(t.nodes.size(), false);
+				Total(root, seen);
+			}
+
+			double Total(uint32_t node, std::vector<bool>& seen)
+			{
+				seen[node] = true;
+				double sum = self[node];
+				std::pair<uint32_t, uint32_t> children = Children(node);
+				for (uint32_t child : { children.first, children.second })
+				{
+					if (child != Lexer::NO_NODE && !seen[child])
+						sum += Total(child, seen);
+				}
+				total[node] = sum;
+				return sum;
+			}
+
+			std::pair<uint32_t, uint32_t> Children(uint32_t node) const
+			{
+				const Lexer::tree_node& n = tree[node];
+				if (n.type == Lexer::node_type::BINARY_OP)
+					return { n.lhs, n.rhs };
+				return { n.IsLeaf() ? Lexer::NO_NODE : n.next, Lexer::NO_NODE };
+			}
+
+			opcode Op(uint32_t node) const
+			{
+				const Lexer::tree_node& n = tree[node];
+				if (n.type == Lexer::node_type::BINARY_OP)
+					return static_cast<opcode>(static_cast<int>(opcode::ADD) + static_cast<int>(n.op_type));
+				if (n.op == Lexer::unary_op::NUM_OP)
+					return opcode::LOAD_CONST;
+				if (n.op == Lexer::unary_op::ID_OP)
+					return opcode::LOAD_INPUT;
+				return static_cast<opcode>(static_cast<int>(opcode::EXP) + static_cast<int>(n.op));
+			}
+
+			// ADD, 3.14, x (slot 0)
+			std::string Label(uint32_t node) const
+			{
+				const Lexer::tree_node& n = tree[node];
+				opcode op = Op(node);
+				if (op == opcode::LOAD_CONST)
+				{
+					std::ostringstream out;
+					out.precision(9);
+					out << n.constant;
+					return out.str();
+				}
+				if (op == opcode::LOAD_INPUT)
+					return tree.names[n.name] + " (slot " + std::to_string(n.slot) + ")";
+				return GetOpcodeName(op);
+			}
+
+			double Share(double ns) const { return evaluation > 0.0 ? 100.0 * ns / evaluation : 0.0; }
+		};
+
+		void ExplainNode(const explain_data& data, uint32_t node, int depth, std::vector<bool>& seen, std::string& out)
+		{
+			char line[128];
+			std::string indent(2 * depth, ' ');
+			if (seen[node])
+			{
+				std::snprintf(line, sizeof(line), "%34s  ", "");
+				out += line + indent + "#" + std::to_string(node) + " " + data.Label(node) + " (shared, above)\n";
+				return;
+			}
+			seen[node] = true;
+			std::snprintf(line, sizeof(line), "%7.1f %7.1f %10.2f %7u  ", data.Share(data.total[node]), data.Share(data.self[node]),
+				data.self[node], data.instructions[node]);
+			out += line + indent + "#" + std::to_string(node) + " " + data.Label(node) + "\n";
+			std::pair<uint32_t, uint32_t> children = data.Children(node);
+			for (uint32_t child : { children.first, children.second })
+			{
+				if (child != Lexer::NO_NODE)
+					ExplainNode(data, child, depth + 1, seen, out);
+			}
+		}
+
+		void ExplainNodeJson(const explain_data& data, uint32_t node, uint64_t evaluations, std::vector<bool>& seen, std::ostringstream& out)
+		{
+			out << "{\"node\": " << node << ", \"op\": \"" << GetOpcodeName(data.Op(node)) << "\"";
+			const Lexer::tree_node& n = data.tree[node];
+			if (data.Op(node) == opcode::LOAD_INPUT)
+				out << ", \"name\": \"" << data.tree.names[n.name] << "\", \"slot\": " << n.slot;
+			else if (data.Op(node) == opcode::LOAD_CONST)
+				out << ", \"value\": " << (std::isfinite(n.constant) ? data.Label(node) : "null");
+			if (seen[node])
+			{
+				out << ", \"shared\": true}";
+				return;
+			}
+			seen[node] = true;
+			out << ", \"instructions\": " << data.instructions[node] << ", \"executions\": " << data.instructions[node] * evaluations
+				<< ", \"self_ns\": " << data.self[node] << ", \"total_ns\": " << data.total[node]
+				<< ", \"self_share\": " << data.Share(data.self[node]) << ", \"total_share\": " << data.Share(data.total[node]);
+			std::pair<uint32_t, uint32_t> children = data.Children(node);
+			if (children.first != Lexer::NO_NODE)
+			{
+				out << ", \"children\": [";
+				ExplainNodeJson(data, children.first, evaluations, seen, out);
+				if (children.second != Lexer::NO_NODE)
+				{
+					out << ", ";
+					ExplainNodeJson(data, children.second, evaluations, seen, out);
+				}
+				out << "]";
+			}
+			out << "}";
+		}
+
+		double HitRate(const cache_stats& cache)
+		{
+			uint64_t lookups = cache.hits + cache.misses;
+			return lookups ? 100.0 * static_cast<double>(cache.hits) / lookups : 0.0;
+		}
+	}
+
+	std::string expression_profiler::Explain(const cache_stats* cache) const
+	{
+		explain_data data(compiled->tree, compiled->root, prog, InstructionCosts());
+		uint64_t runs = GetNumOfEvaluations();
+		char line[192];
+		std::string out;
+		std::snprintf(line, sizeof(line), "profile: %llu evaluations, %llu timed (1 in %u), %.2f ns per evaluation\n",
+			static_cast<unsigned long long>(runs), static_cast<unsigned long long>(GetNumOfSamples()), sample_period, data.evaluation);
+		out += line;
+		if (cache)
+		{
+			std::snprintf(line, sizeof(line), "cache: %llu hits, %llu misses, %.1f%% hit rate, %llu evictions\n",
+				static_cast<unsigned long long>(cache->hits), static_cast<unsigned long long>(cache->misses), HitRate(*cache),
+				static_cast<unsigned long long>(cache->evictions));
+			out += line;
+		}
+		std::snprintf(line, sizeof(line), "%7s %7s %10s %7s  %s\n", "total%", "self%", "self ns", "instrs", "node");
+		out += line;
+		std::vector<bool> seen(compiled->tree.nodes.size(), false);
+		ExplainNode(data, compiled->root, 0, seen, out);
+
+		out += "by opcode:\n";
+		std::snprintf(line, sizeof(line), "%7s %10s %7s %12s  %s\n", "share%", "ns", "instrs", "executions", "op");
+		out += line;
+		std::vector<size_t> order;
+		for (size_t op = 0; op < data.opcode_cost.size(); op++)
+		{
+			if (data.opcode_instructions[op])
+				order.push_back(op);
+		}
+		std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return data.opcode_cost[a] > data.opcode_cost[b]; });
+		for (size_t op : order)
+		{
+			std::snprintf(line, sizeof(line), "%7.1f %10.2f %7u %12llu  %s\n", data.Share(data.opcode_cost[op]), data.opcode_cost[op],
+				data.opcode_instructions[op], static_cast<unsigned long long>(data.opcode_instructions[op] * runs), GetOpcodeName(static_cast<opcode>(op)));
+			out += line;
+		}
+		return out;
+	}
+
+	std::string expression_profiler::ExplainJson(const cache_stats* cache) const
+	{
+		explain_data data(compiled->tree, compiled->root, prog, InstructionCosts());
+		uint64_t runs = GetNumOfEvaluations();
+		std::ostringstream out;
+		out.precision(6);
+		out << "{\"evaluations\": " << runs << ", \"samples\": " << GetNumOfSamples() << ", \"sample_period\": " << sample_period
+			<< ", \"ns_per_evaluation\": " << data.evaluation;
+		if (cache)
+		{
+			out << ", \"cache\": {\"hits\": " << cache->hits << ", \"misses\": " << cache->misses << ", \"hit_rate\": " << HitRate(*cache) / 100.0
+				<< ", \"evictions\": " << cache->evictions << "}";
+		}
+		out << ", \"tree\": ";
+		std::vector<bool> seen(compiled->tree.nodes.size(), false);
+		ExplainNodeJson(data, compiled->root, runs, seen, out);
+		out << ", \"opcodes\": [";
+		bool first = true;
+		for (size_t op = 0; op < data.opcode_cost.size(); op++)
+		{
+			if (!data.opcode_instructions[op])
+				continue;
+			out << (first ? "" : ", ") << "{\"op\": \"" << GetOpcodeName(static_cast<opcode>(op)) << "\", \"instructions\": " << data.opcode_instructions[op]
+				<< ", \"executions\": " << data.opcode_instructions[op] * runs << ", \"ns\": " << data.opcode_cost[op]
+				<< ", \"share\": " << data.Share(data.opcode_cost[op]) << "}";
+			first = false;
+		}
+		out << "]}";
+		return out.str();
+	}
+
+};
@@ -0,0 +1,65 @@
+#pragma once
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "bytecode.h"
+#include "eval_cache.h"
+#include "fast_math.h"
+#include "registry.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace MathEval
+{
+	/*
+	 where an expression spends its time, per tree node and per opcode, for EXPLAIN style reports
+	 a program is straight-line, every evaluation runs every instruction once, so execution counts come from
+	 counting evaluations and only time has to be measured: one evaluation in sample_period reads the time stamp
+	 counter (rdtsc, steady_clock off x86) around each instruction, what an empty read costs is taken off again
+	 rdtsc doesn't wait for the instruction before it, an add or a multiply reads as about 0 while calls and
+	 divides stand out, which is what the report is for
+	 MathEvaluator only has its hooks (StartProfiling/Explain) with MATH_EVAL_PROFILE defined, for every file that
+	 includes ExpressionEvaluation.h since it changes the class (cmake -DMATHEVAL_PROFILE=ON), without it nothing
+	 here is reachable from Evaluate
+	 Evaluate is safe from several threads, the counters are relaxed atomics
+	*/
+	class expression_profiler
+	{
+	public:
+		explicit expression_profiler(std::shared_ptr<const compiled_expression> compiled, uint32_t sample_period = DEFAULT_SAMPLE_PERIOD);
+		expression_profiler(const expression_profiler&) = delete;
+		expression_profiler& operator=(const expression_profiler&) = delete;
+
+		// the interpreter's result, same bits as MathEvaluator::Evaluate without jit
+		float Evaluate(const float* inputs);
+		void Reset();
+
+		inline uint64_t GetNumOfEvaluations() const { return evaluations.load(std::memory_order_relaxed); }
+		inline uint64_t GetNumOfSamples() const { return samples.load(std::memory_order_relaxed); }
+
+		// the tree with a line per node (children indented under their parent, a shared node is expanded once),
+		// then the totals per opcode; cache is what the evaluator's cache did over the same time, nullptr leaves it out
+		std::string Explain(const cache_stats* cache = nullptr) const;
+		// the same as a json object
+		std::string ExplainJson(const cache_stats* cache = nullptr) const;
+
+		static constexpr uint32_t DEFAULT_SAMPLE_PERIOD = 64;
+	private:
+		std::shared_ptr<const compiled_expression> compiled;
+		program prog; // compiled->prog, lowered again if it came from an archive without source nodes
+		uint32_t sample_period;
+		unary_function unary[static_cast<size_t>(LAST_OPCODE) + 1] = {};
+		std::atomic<uint64_t> evaluations{ 0 };
+		std::atomic<uint64_t> samples{ 0 };
+		std::unique_ptr<std::atomic<uint64_t>[]> ticks; // per instruction, over every sample, read cost included
+
+		// ns per evaluation of every instruction, empty reads taken off
+		std::vector<double> InstructionCosts() const;
+	};
+};
+
+#endif // PROFILER_H
@@ -0,0 +1,210 @@
+#include "registry.h"
+#include "lexer.h"
+
+namespace MathEval
+{
+
+	std::shared_ptr<const compiled_expression> CompileExpression(std::string_view text, const std::unordered_map<std::string, size_t>& function_inputs,
+		size_t number_of_slots, const compile_options& options)
+	{
+		auto compiled = std::make_shared<compiled_expression>();
+		uint32_t root;
+		{
+			// the parser (and its token list) only lives for the parse, the tree moves out of it
+			Lexer::parser parser(text);
+			root = parser.parse();
+			compiled->tree = std::move(parser.GetTree());
+		}
+		// the parser takes an empty text as no expression, there's nothing to evaluate so here it's a syntax error
+		if (root == Lexer::NO_NODE)
+		{
+			Lexer::Token end;
+			end.offset = static_cast<uint32_t>(text.size());
+			int line = 1;
+			for (char c : text)
+				line += c == '\n';
+			throw Lexer::syntax_error("syntax error at offset " + std::to_string(end.offset) + " (line " + std::to_string(line)
+				+ "): expected an operand, found the end of the input", end, Lexer::TokenType::ID, line);
+		}
+		// every identifier gets its input slot here, the tree never looks a name up again
+		compiled->tree.ResolveInputs(function_inputs, number_of_slots);
+		Lexer::optimizer opt(compiled->tree, root, options.relaxed_fp, options.precision);
+		if (options.fold_constants)
+			opt.FoldConstants();
+		if (options.eliminate_common_subexpressions)
+			opt.EliminateCommonSubexpressions();
+		compiled->root = opt.GetRoot();
+		compiled->number_of_slots = number_of_slots;
+		compiled->optimize_stats = opt.GetStats();
+		compiled->prog = program(compiled->tree, compiled->root);
+		compiled->gradient_program = program(compiled->tree, compiled->root, false);
+		compiled->precision = options.precision;
+		compiled->exp_function = GetUnaryFunction(opcode::EXP, options.precision);
+		compiled->sin_function = GetUnaryFunction(opcode::SIN, options.precision);
+		compiled->cos_function = GetUnaryFunction(opcode::COS, options.precision);
+		if (options.jit)
+			compiled->jit.Compile(compiled->prog, options.precision);
+		return compiled;
+	}
+
+	static void AppendNumber(std::string& key, size_t value)
+	{
+		char digits[20];
+		size_t count = 0;
+		do
+		{
+			digits[count++] = static_cast<char>('0' + value % 10);
+			value /= 10;
+		} while (value);
+		while (count)
+			key += digits[--count];
+	}
+
+	std::string CanonicalKey(std::string_view text, const std::unordered_map<std::string, size_t>& function_inputs,
+		size_t number_of_slots, const compile_options& options)
+	{
+		std::string key;
+		key.reserve(text.size() + 8);
+		key += options.fold_constants ? 'f' : '-';
+		key += options.relaxed_fp ? 'r' : '-';
+		key += options.eliminate_common_subexpressions ? 'c' : '-';
+		key += options.jit ? 'j' : '-';
+		key += static_cast<char>('0' + static_cast<int>(options.precision));
+		// the compiled copy records how many inputs it was built for, S of the evaluator that compiled it
+		key += '/';
+		AppendNumber(key, number_of_slots);
+
+		size_t position = 0;
+		Lexer::Token tok = Lexer::ScanToken(text, position);
+		std::string name;
+		while (tok.token_type != Lexer::TokenType::END_OF_FILE)
+		{
+			std::string_view lexeme = text.substr(tok.offset, tok.length);
+			// a separator keeps adjacent tokens apart, ie: "sin x" is two tokens but "sinx" is one
+			key += ' ';
+			if (tok.token_type == Lexer::TokenType::NUM)
+			{
+				// 1, 1.0 and 01 are the same constant; trimming the text is enough for that, two spellings
+				// that only meet after rounding just don't share
+				size_t dot = lexeme.find('.');
+				std::string_view whole = lexeme.substr(0, dot);
+				std::string_view fraction = dot == std::string_view::npos ? std::string_view() : lexeme.substr(dot + 1);
+				while (whole.size() > 1 && whole.front() == '0')
+					whole.remove_prefix(1);
+				while (!fraction.empty() && fraction.back() == '0')
+					fraction.remove_suffix(1);
+				key += whole.empty() ? std::string_view("0") : whole;
+				if (!fraction.empty())
+				{
+					key += '.';
+					key += fraction;
+				}
+			}
+			else if (tok.token_type == Lexer::TokenType::ID)
+			{
+				name.assign(lexeme);
+				auto found = function_inputs.find(name);
+				if (found == function_inputs.end())
+				{
+					// not an input: a name in a f(x) = header, or a mistake the compile will report
+					key += '@';
+					key += lexeme;
+				}
+				else
+				{
+					if (found->second >= number_of_slots)
+						throw std::out_of_range("variable " + name + " maps to slot " + std::to_string(found->second) + ", past the last input");
+					key += '$';
+					AppendNumber(key, found->second);
+				}
+			}
+			else
+				key += lexeme;
+			tok = Lexer::ScanToken(text, position);
+		}
+		return key;
+	}
+
+	expression_registry::expression_registry(size_t capacity)
+		: capacity(capacity)
+	{
+	}
+
+	std::shared_ptr<const compiled_expression> expression_registry::Get(std::string_view text, const std::unordered_map<std::string, size_t>& function_inputs,
+		size_t number_of_slots, const compile_options& options)
+	{
+		std::string key = CanonicalKey(text, function_inputs, number_of_slots, options);
+		std::promise<std::shared_ptr<const compiled_expression>> promise;
+		uint64_t id;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			auto found = entries.find(key);
+			if (found != entries.end())
+			{
+				stats.hits++;
+				recent.splice(recent.begin(), recent, found->second.lru);
+				pending compiled = found->second.compiled;
+				guard.unlock();
+				return compiled.get(); // waits if another thread is still compiling it
+			}
+			stats.misses++;
+			id = next_id++;
+			auto inserted = entries.emplace(std::move(key), entry{ promise.get_future().share(), recent.end(), id }).first;
+			recent.push_front(&inserted->first);
+			inserted->second.lru = recent.begin();
+			key = inserted->first;
+			if (capacity != 0 && entries.size() > capacity)
+			{
+				// waiters on an evicted key hold their own copy of the future, so it can go even mid-compile
+				const std::string* oldest = recent.back();
+				recent.pop_back();
+				entries.erase(*oldest);
+				stats.evictions++;
+			}
+			stats.size = entries.size();
+		}
+
+		try
+		{
+			std::shared_ptr<const compiled_expression> compiled = CompileExpression(text, function_inputs, number_of_slots, options);
+			promise.set_value(compiled);
+			return compiled;
+		}
+		catch (...)
+		{
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				auto found = entries.find(key);
+				if (found != entries.end() && found->second.id == id)
+				{
+					recent.erase(found->second.lru);
+					entries.erase(found);
+					stats.size = entries.size();
+				}
+			}
+			promise.set_exception(std::current_exception());
+			throw;
+		}
+	}
+
+	registry_stats expression_registry::GetStats() const
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		return stats;
+	}
+
+	void expression_registry::Clear()
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		entries.clear();
+		recent.clear();
+		stats.size = 0;
+	}
+
+	expression_registry& expression_registry::GetDefault()
+	{
+		static expression_registry registry;
+		return registry;
+	}
+
+};
@@ -0,0 +1,117 @@
+#pragma once
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#include "parser.h"
+#include "optimizer.h"
+#include "bytecode.h"
+#include "jit.h"
+#include "fast_math.h"
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace MathEval
+{
+	// the construction knobs of MathEvaluatorOptions that change what gets compiled
+	struct compile_options
+	{
+		bool fold_constants = true;
+		bool relaxed_fp = false;
+		bool eliminate_common_subexpressions = true;
+		bool jit = false;
+		MathEval::precision precision = MathEval::precision::DEFAULT;
+	};
+
+	/*
+	 everything construction makes out of an expression, never modified once built so any number of
+	 evaluators (on any threads) can share one through a shared_ptr
+	 the tree keeps the names of whoever compiled it first, evaluation only reads slots
+	*/
+	struct compiled_expression
+	{
+		Lexer::syntax_tree tree;
+		uint32_t root = Lexer::NO_NODE;
+		size_t number_of_slots = 0; // inputs it was compiled for, an evaluator needs at least this many
+		program prog;
+		program gradient_program; // without register reuse, see autodiff.h
+		Lexer::optimize_stats optimize_stats;
+		jit_program jit;
+		// exp/sin/cos as Evaluate runs them, GetUnaryFunction for precision
+		MathEval::precision precision = MathEval::precision::DEFAULT;
+		unary_function exp_function = nullptr;
+		unary_function sin_function = nullptr;
+		unary_function cos_function = nullptr;
+	};
+
+	// parse, resolve, optimize and lower text, throws the same errors as MathEvaluator's constructor
+	std::shared_ptr<const compiled_expression> CompileExpression(std::string_view text, const std::unordered_map<std::string, size_t>& function_inputs,
+		size_t number_of_slots, const compile_options& options);
+
+	/*
+	 what the registry keys on: the token stream with whitespace gone, numbers without leading/trailing zeros
+	 and every variable replaced by its input slot, so "x*y + 1" with {x:0, y:1} and "a * b+1.0" with {a:0, b:1}
+	 give the same key, plus the compile options and number_of_slots
+	 throws std::out_of_range for a variable past number_of_slots, same as syntax_tree::ResolveInputs
+	*/
+	std::string CanonicalKey(std::string_view text, const std::unordered_map<std::string, size_t>& function_inputs,
+		size_t number_of_slots, const compile_options& options);
+
+	struct registry_stats
+	{
+		uint64_t hits = 0;
+		uint64_t misses = 0; // compiles
+		uint64_t evictions = 0;
+		size_t size = 0;
+	};
+
+	/*
+	 process-wide table of compiled expressions keyed by CanonicalKey, so repeated expressions are parsed and
+	 optimized once and every evaluator built from them points at the same compiled_expression
+	 thread-safe: the first thread to ask for a key compiles it outside the lock, the others asking meanwhile wait for
+	 that one compile instead of starting their own; a compile that throws is forgotten and rethrown to every waiter
+	 with a capacity the least recently used key is dropped past it, evaluators holding its expression keep it alive
+	*/
+	class expression_registry
+	{
+	public:
+		explicit expression_registry(size_t capacity = DEFAULT_CAPACITY); // 0 never evicts
+		expression_registry(const expression_registry&) = delete;
+		expression_registry& operator=(const expression_registry&) = delete;
+
+		std::shared_ptr<const compiled_expression> Get(std::string_view text, const std::unordered_map<std::string, size_t>& function_inputs,
+			size_t number_of_slots, const compile_options& options);
+
+		registry_stats GetStats() const;
+		// drops every key, expressions still in use stay alive with their evaluators
+		void Clear();
+
+		// the one MathEvaluatorOptions points at unless told otherwise
+		static expression_registry& GetDefault();
+
+		static constexpr size_t DEFAULT_CAPACITY = 1024;
+	private:
+		typedef std::shared_future<std::shared_ptr<const compiled_expression>> pending;
+		struct entry
+		{
+			pending compiled;
+			std::list<const std::string*>::iterator lru; // position in recent, front is the newest
+			uint64_t id; // tells a failed compile which entry is its own
+		};
+
+		mutable std::mutex lock;
+		std::unordered_map<std::string, entry> entries;
+		std::list<const std::string*> recent; // points at the keys inside entries
+		size_t capacity;
+		uint64_t next_id = 0;
+		registry_stats stats;
+	};
+};
+
+#endif // REGISTRY_H
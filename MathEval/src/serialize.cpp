@@ -0,0 +1,447 @@
+#include "serialize.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+#include <utility>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MATH_EVAL_ARCHIVE_MMAP
+#endif
+
+namespace MathEval
+{
+	static const char MAGIC[8] = { 'M', 'E', 'V', 'A', 'L', 'A', 'R', 'C' };
+	static const size_t HEADER_SIZE = 32;
+	static const size_t INDEX_ENTRY_SIZE = 24;
+	static const size_t NODE_SIZE = 12;
+	static const size_t INSTRUCTION_SIZE = 16;
+
+	// little-endian byte by byte, so the file reads the same on any host and from any alignment
+	static void PutU32(std::string& out, uint32_t value)
+	{
+		char bytes[4] = { char(value), char(value >> 8), char(value >> 16), char(value >> 24) };
+		out.append(bytes, 4);
+	}
+
+	static void PutU64(std::string& out, uint64_t value)
+	{
+		PutU32(out, static_cast<uint32_t>(value));
+		PutU32(out, static_cast<uint32_t>(value >> 32));
+	}
+
+	static uint32_t GetU32(const char* p)
+	{
+		const unsigned char* b = reinterpret_cast<const unsigned char*>(p);
+		return uint32_t(b[0]) | (uint32_t(b[1]) << 8) | (uint32_t(b[2]) << 16) | (uint32_t(b[3]) << 24);
+	}
+
+	static uint64_t GetU64(const char* p)
+	{
+		return uint64_t(GetU32(p)) | (uint64_t(GetU32(p + 4)) << 32);
+	}
+
+	static uint32_t ToU32(size_t value)
+	{
+		if (value > UINT32_MAX)
+			throw std::length_error("archive: more than 4G of something in one record");
+		return static_cast<uint32_t>(value);
+	}
+
+	// walks a record, every read checks there's enough of it left
+	struct record_reader
+	{
+		const char* p;
+		const char* end;
+
+		const char* Take(uint64_t bytes)
+		{
+			if (bytes > static_cast<uint64_t>(end - p))
+				throw std::runtime_error("archive: record cut short");
+			const char* at = p;
+			p += bytes;
+			return at;
+		}
+		uint32_t U32() { return GetU32(Take(4)); }
+		uint64_t U64() { return GetU64(Take(8)); }
+	};
+
+	static void WriteProgram(std::string& out, const program& prog)
+	{
+		const instruction* ins = prog.GetInstructions();
+		for (size_t i = 0; i < prog.GetNumOfInstructions(); i++)
+		{
+			PutU32(out, static_cast<uint32_t>(ins[i].op));
+			PutU32(out, ins[i].dst);
+			PutU32(out, ins[i].a);
+			PutU32(out, ins[i].b); // the bits of constant for LOAD_CONST
+		}
+		for (uint32_t reg : prog.GetResultRegisters())
+			PutU32(out, reg);
+	}
+
+	static program ReadProgram(record_reader& in, uint32_t count, uint32_t registers, uint32_t results, size_t number_of_slots, bool reuse)
+	{
+		const char* p = in.Take(uint64_t(count) * INSTRUCTION_SIZE);
+		std::vector<instruction> code(count);
+		for (instruction& ins : code)
+		{
+			uint32_t op = GetU32(p);
+			if (op > static_cast<uint32_t>(LAST_OPCODE))
+				throw std::runtime_error("archive: unknown opcode " + std::to_string(op));
+			ins.op = static_cast<opcode>(op);
+			ins.dst = GetU32(p + 4);
+			ins.a = GetU32(p + 8);
+			ins.b = GetU32(p + 12);
+			p += INSTRUCTION_SIZE;
+		}
+		p = in.Take(uint64_t(results) * 4);
+		std::vector<uint32_t> result_registers(results);
+		for (uint32_t& reg : result_registers)
+		{
+			reg = GetU32(p);
+			p += 4;
+		}
+		try
+		{
+			return program(std::move(code), registers, std::move(result_registers), number_of_slots, reuse);
+		}
+		catch (const std::invalid_argument& e)
+		{
+			throw std::runtime_error(std::string("archive: ") + e.what());
+		}
+	}
+
+	void SerializeExpression(const compiled_expression& compiled, std::string& out)
+	{
+		const Lexer::syntax_tree& tree = compiled.tree;
+		size_t name_bytes = 0;
+		for (const std::string& name : tree.names)
+			name_bytes += name.size();
+
+		PutU32(out, ToU32(compiled.number_of_slots));
+		PutU32(out, static_cast<uint32_t>(compiled.precision));
+		PutU32(out, compiled.jit.IsCompiled() ? 1u : 0u);
+		PutU32(out, compiled.root);
+		PutU32(out, ToU32(tree.nodes.size()));
+		PutU32(out, ToU32(tree.names.size()));
+		PutU32(out, ToU32(name_bytes));
+		for (const program* prog : { &compiled.prog, &compiled.gradient_program })
+		{
+			PutU32(out, ToU32(prog->GetNumOfInstructions()));
+			PutU32(out, prog->GetNumOfRegisters());
+			PutU32(out, ToU32(prog->GetResultRegisters().size()));
+		}
+		PutU32(out, 0);
+		PutU64(out, compiled.optimize_stats.removed_nodes);
+		PutU64(out, compiled.optimize_stats.deduplicated_nodes);
+
+		for (const Lexer::tree_node& node : tree.nodes)
+		{
+			char kind[4] = { static_cast<char>(node.type), static_cast<char>(node.op_type), static_cast<char>(node.op), 0 };
+			out.append(kind, 4);
+			PutU32(out, node.lhs);
+			PutU32(out, node.rhs); // the bits of constant for NUM, the slot for ID
+		}
+		for (const std::string& name : tree.names)
+			PutU32(out, ToU32(name.size()));
+		for (const std::string& name : tree.names)
+			out += name;
+		WriteProgram(out, compiled.prog);
+		WriteProgram(out, compiled.gradient_program);
+	}
+
+	std::shared_ptr<const compiled_expression> DeserializeExpression(const char* data, size_t size)
+	{
+		record_reader in{ data, data + size };
+		auto compiled = std::make_shared<compiled_expression>();
+		compiled->number_of_slots = in.U32();
+		uint32_t precision_value = in.U32();
+		uint32_t flags = in.U32();
+		compiled->root = in.U32();
+		uint32_t node_count = in.U32();
+		uint32_t name_count = in.U32();
+		uint32_t name_bytes = in.U32();
+		uint32_t prog_sizes[2][3];
+		for (auto& sizes : prog_sizes)
+		{
+			for (uint32_t& value : sizes)
+				value = in.U32();
+		}
+		in.U32();
+		compiled->optimize_stats.removed_nodes = static_cast<size_t>(in.U64());
+		compiled->optimize_stats.deduplicated_nodes = static_cast<size_t>(in.U64());
+		if (precision_value > static_cast<uint32_t>(precision::ULP4))
+			throw std::runtime_error("archive: unknown precision " + std::to_string(precision_value));
+		compiled->precision = static_cast<precision>(precision_value);
+		if (compiled->root >= node_count)
+			throw std::runtime_error("archive: root past the last node");
+
+		// children always come before their parents (the parser appends in post-order and the optimizer only
+		// points at nodes it already visited), checking that also rules out cycles
+		Lexer::syntax_tree& tree = compiled->tree;
+		const char* p = in.Take(uint64_t(node_count) * NODE_SIZE);
+		tree.nodes.resize(node_count);
+		for (uint32_t i = 0; i < node_count; i++, p += NODE_SIZE)
+		{
+			Lexer::tree_node& node = tree.nodes[i];
+			node.type = static_cast<Lexer::node_type>(p[0]);
+			node.op_type = static_cast<Lexer::bin_op>(p[1]);
+			node.op = static_cast<Lexer::unary_op>(p[2]);
+			node.lhs = GetU32(p + 4);
+			node.rhs = GetU32(p + 8);
+			bool good;
+			if (node.type == Lexer::node_type::BINARY_OP)
+				good = node.op_type >= Lexer::bin_op::ADD_OP && node.op_type <= Lexer::bin_op::POW_OP && node.lhs < i && node.rhs < i;
+			else if (node.type != Lexer::node_type::PREFIX_OP || node.op < Lexer::unary_op::EXP_OP || node.op > Lexer::unary_op::ID_OP)
+				good = false;
+			else if (node.op == Lexer::unary_op::ID_OP)
+				good = node.name < name_count && node.slot < compiled->number_of_slots;
+			else
+				good = node.op == Lexer::unary_op::NUM_OP || node.next < i;
+			if (!good)
+				throw std::runtime_error("archive: bad tree node " + std::to_string(i));
+		}
+		p = in.Take(uint64_t(name_count) * 4);
+		const char* text = in.Take(name_bytes);
+		const char* text_end = text + name_bytes;
+		for (uint32_t i = 0; i < name_count; i++, p += 4)
+		{
+			uint32_t length = GetU32(p);
+			if (length > static_cast<size_t>(text_end - text))
+				throw std::runtime_error("archive: names cut short");
+			if (tree.AddName(std::string_view(text, length)) != i)
+				throw std::runtime_error("archive: name stored twice");
+			text += length;
+		}
+
+		compiled->prog = ReadProgram(in, prog_sizes[0][0], prog_sizes[0][1], prog_sizes[0][2], compiled->number_of_slots, true);
+		compiled->gradient_program = ReadProgram(in, prog_sizes[1][0], prog_sizes[1][1], prog_sizes[1][2], compiled->number_of_slots, false);
+		compiled->exp_function = GetUnaryFunction(opcode::EXP, compiled->precision);
+		compiled->sin_function = GetUnaryFunction(opcode::SIN, compiled->precision);
+		compiled->cos_function = GetUnaryFunction(opcode::COS, compiled->precision);
+		if (flags & 1u)
+			compiled->jit.Compile(compiled->prog, compiled->precision);
+		return compiled;
+	}
+
+	void archive_writer::Add(std::string_view key, const compiled_expression& compiled)
+	{
+		if (!keys.emplace(key).second)
+			throw std::invalid_argument("archive_writer: key " + std::string(key) + " added twice");
+		size_t offset = records.size();
+		SerializeExpression(compiled, records);
+		entries.push_back({ std::string(key), offset, records.size() - offset });
+		records.resize((records.size() + 7) & ~size_t(7), '\0');
+	}
+
+	std::string archive_writer::Finish() const
+	{
+		std::vector<size_t> order(entries.size());
+		std::iota(order.begin(), order.end(), size_t(0));
+		std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return entries[a].key < entries[b].key; });
+
+		size_t index_offset = HEADER_SIZE + records.size();
+		size_t key_bytes = 0;
+		for (const entry& e : entries)
+			key_bytes += e.key.size();
+		size_t file_size = index_offset + entries.size() * INDEX_ENTRY_SIZE + key_bytes;
+
+		std::string out;
+		out.reserve(file_size);
+		out.append(MAGIC, sizeof(MAGIC));
+		PutU32(out, ARCHIVE_VERSION);
+		PutU32(out, ToU32(entries.size()));
+		PutU64(out, index_offset);
+		PutU64(out, file_size);
+		out += records;
+		size_t key_offset = 0;
+		for (size_t i : order)
+		{
+			PutU64(out, HEADER_SIZE + entries[i].offset);
+			PutU32(out, ToU32(entries[i].size));
+			PutU32(out, ToU32(key_offset));
+			PutU32(out, ToU32(entries[i].key.size()));
+			PutU32(out, 0);
+			key_offset += entries[i].key.size();
+		}
+		for (size_t i : order)
+			out += entries[i].key;
+		return out;
+	}
+
+	void archive_writer::Save(const std::string& path) const
+	{
+		std::string file = Finish();
+		FILE* out = fopen(path.c_str(), "wb");
+		if (!out)
+			throw std::runtime_error("archive_writer: can't write " + path);
+		bool written = fwrite(file.data(), 1, file.size(), out) == file.size();
+		if (fclose(out) != 0 || !written)
+			throw std::runtime_error("archive_writer: can't write " + path);
+	}
+
+	expression_archive::expression_archive(const std::string& path)
+	{
+		FILE* in = fopen(path.c_str(), "rb");
+		if (!in)
+			throw std::runtime_error("expression_archive: can't read " + path);
+#ifdef MATH_EVAL_ARCHIVE_MMAP
+		struct stat info;
+		int fd = fileno(in);
+		if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0)
+		{
+			void* map = ::mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+			if (map != MAP_FAILED)
+			{
+				mapping = map;
+				data = static_cast<const char*>(map);
+				size = static_cast<size_t>(info.st_size);
+			}
+		}
+#endif
+		if (!mapping)
+		{
+			char chunk[1 << 16];
+			size_t got;
+			while ((got = fread(chunk, 1, sizeof(chunk), in)) != 0)
+				buffer.insert(buffer.end(), chunk, chunk + got);
+			data = buffer.data();
+			size = buffer.size();
+		}
+		bool failed = ferror(in) != 0;
+		fclose(in);
+		try
+		{
+			if (failed)
+				throw std::runtime_error("expression_archive: can't read " + path);
+			Check();
+		}
+		catch (...)
+		{
+			Release();
+			throw;
+		}
+	}
+
+	expression_archive::expression_archive(const void* memory, size_t bytes)
+		: data(static_cast<const char*>(memory)), size(bytes)
+	{
+		Check();
+	}
+
+	expression_archive::~expression_archive()
+	{
+		Release();
+	}
+
+	expression_archive::expression_archive(expression_archive&& other) noexcept
+	{
+		*this = std::move(other);
+	}
+
+	expression_archive& expression_archive::operator=(expression_archive&& other) noexcept
+	{
+		if (this == &other)
+			return *this;
+		Release();
+		// a vector's storage survives the move, so pointers into buffer stay good
+		data = other.data;
+		size = other.size;
+		entries = other.entries;
+		index = other.index;
+		keys = other.keys;
+		mapping = other.mapping;
+		buffer = std::move(other.buffer);
+		other.data = other.index = other.keys = nullptr;
+		other.size = other.entries = 0;
+		other.mapping = nullptr;
+		return *this;
+	}
+
+	void expression_archive::Release()
+	{
+#ifdef MATH_EVAL_ARCHIVE_MMAP
+		if (mapping)
+			munmap(mapping, size);
+#endif
+		mapping = nullptr;
+		buffer = std::vector<char>();
+		data = index = keys = nullptr;
+		size = entries = 0;
+	}
+
+	// the header and every index entry, so GetKey/Find/Load never step outside the file
+	void expression_archive::Check()
+	{
+		if (size < HEADER_SIZE || std::memcmp(data, MAGIC, sizeof(MAGIC)) != 0)
+			throw std::runtime_error("expression_archive: not an archive");
+		uint32_t version = GetU32(data + 8);
+		if (version != ARCHIVE_VERSION)
+			throw std::runtime_error("expression_archive: version " + std::to_string(version) + ", this build reads "
+				+ std::to_string(ARCHIVE_VERSION));
+		uint64_t count = GetU32(data + 12);
+		uint64_t index_offset = GetU64(data + 16);
+		if (GetU64(data + 24) != size || index_offset < HEADER_SIZE || index_offset > size
+			|| count * INDEX_ENTRY_SIZE > size - index_offset)
+			throw std::runtime_error("expression_archive: truncated or damaged file");
+		entries = static_cast<size_t>(count);
+		index = data + index_offset;
+		keys = index + entries * INDEX_ENTRY_SIZE;
+		uint64_t key_bytes = static_cast<uint64_t>(data + size - keys);
+		for (size_t i = 0; i < entries; i++)
+		{
+			const char* e = index + i * INDEX_ENTRY_SIZE;
+			uint64_t offset = GetU64(e);
+			uint64_t record_size = GetU32(e + 8);
+			uint64_t key_offset = GetU32(e + 12);
+			uint64_t key_size = GetU32(e + 16);
+			if (offset < HEADER_SIZE || offset > index_offset || record_size > index_offset - offset
+				|| key_offset > key_bytes || key_size > key_bytes - key_offset)
+				throw std::runtime_error("expression_archive: bad index entry " + std::to_string(i));
+		}
+	}
+
+	std::string_view expression_archive::GetKey(size_t i) const
+	{
+		if (i >= entries)
+			throw std::out_of_range("expression_archive: no entry " + std::to_string(i));
+		const char* e = index + i * INDEX_ENTRY_SIZE;
+		return std::string_view(keys + GetU32(e + 12), GetU32(e + 16));
+	}
+
+	size_t expression_archive::Find(std::string_view key) const
+	{
+		size_t lo = 0, hi = entries;
+		while (lo < hi)
+		{
+			size_t mid = lo + (hi - lo) / 2;
+			int order = GetKey(mid).compare(key);
+			if (order == 0)
+				return mid;
+			if (order < 0)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		return NOT_FOUND;
+	}
+
+	std::shared_ptr<const compiled_expression> expression_archive::Load(size_t i) const
+	{
+		if (i >= entries)
+			throw std::out_of_range("expression_archive: no entry " + std::to_string(i));
+		const char* e = index + i * INDEX_ENTRY_SIZE;
+		return DeserializeExpression(data + GetU64(e), GetU32(e + 8));
+	}
+
+	std::shared_ptr<const compiled_expression> expression_archive::Load(std::string_view key) const
+	{
+		size_t i = Find(key);
+		return i == NOT_FOUND ? nullptr : Load(i);
+	}
+};
@@ -0,0 +1,104 @@
+#pragma once
+#ifndef SERIALIZE_H
+#define SERIALIZE_H
+
+#include "registry.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+namespace MathEval
+{
+	/*
+	 compiled expressions on disk, so a process that builds thousands of evaluators at startup can skip the lexer,
+	 parser and optimizer: a record holds what CompileExpression made (optimized tree with resolved slots, both
+	 programs, precision, optimize stats), loading one copies its arrays out and checks every index, nothing is parsed
+	 layout, every integer little-endian whatever the host, offsets relative to the start of the file so it works
+	 wherever it's mapped:
+	   header   "MEVALARC", u32 version, u32 entries, u64 index offset, u64 file size
+	   records  one per entry, 8-byte aligned
+	   index    24 bytes per entry: u64 record offset, u32 record size, u32 key offset, u32 key size, u32 0, sorted by key
+	   keys     the key bytes
+	 jit code isn't stored, a record compiled with jit gets compiled again on Load
+	 bump ARCHIVE_VERSION whenever the record layout or the meaning of an opcode changes, older files are refused
+	*/
+	// 2: POW and SQRT, which renumbered the opcodes and the unary ops after them
+	static constexpr uint32_t ARCHIVE_VERSION = 2;
+
+	// appends one record to out
+	void SerializeExpression(const compiled_expression& compiled, std::string& out);
+	// a record from SerializeExpression, throws std::runtime_error if it's damaged or from another version
+	std::shared_ptr<const compiled_expression> DeserializeExpression(const char* data, size_t size);
+
+	// builds an archive in memory, any string works as a key, CanonicalKey (registry.h) gives the registry's
+	class archive_writer
+	{
+	public:
+		// throws std::invalid_argument for a key that's already in
+		void Add(std::string_view key, const compiled_expression& compiled);
+		inline size_t GetNumOfEntries() const { return entries.size(); }
+
+		// the whole file
+		std::string Finish() const;
+		// throws std::runtime_error if path can't be written
+		void Save(const std::string& path) const;
+	private:
+		struct entry
+		{
+			std::string key;
+			size_t offset; // into records
+			size_t size;
+		};
+		std::vector<entry> entries;
+		std::unordered_set<std::string> keys;
+		std::string records;
+	};
+
+	/*
+	 read side, the file is memory mapped where the os allows (read into memory elsewhere) so opening costs the
+	 header and index check, and an entry's pages come in when it's loaded
+	 Load is safe from several threads, every call builds its own compiled_expression
+	*/
+	class expression_archive
+	{
+	public:
+		expression_archive() = default;
+		// throws std::runtime_error if path can't be read or isn't an archive of this version
+		explicit expression_archive(const std::string& path);
+		// an archive already in memory (ie: Finish()), data has to outlive this
+		expression_archive(const void* data, size_t size);
+		~expression_archive();
+		expression_archive(const expression_archive&) = delete;
+		expression_archive& operator=(const expression_archive&) = delete;
+		expression_archive(expression_archive&&) noexcept;
+		expression_archive& operator=(expression_archive&&) noexcept;
+
+		inline size_t GetNumOfEntries() const { return entries; }
+		std::string_view GetKey(size_t index) const;
+		// binary search over the sorted index, NOT_FOUND if it isn't there
+		size_t Find(std::string_view key) const;
+		// throws std::runtime_error for a damaged record
+		std::shared_ptr<const compiled_expression> Load(size_t index) const;
+		// nullptr if key isn't there
+		std::shared_ptr<const compiled_expression> Load(std::string_view key) const;
+
+		static constexpr size_t NOT_FOUND = SIZE_MAX;
+	private:
+		const char* data = nullptr;
+		size_t size = 0;
+		size_t entries = 0;
+		const char* index = nullptr;
+		const char* keys = nullptr;
+		void* mapping = nullptr; // what to munmap, nullptr when the file was read or the memory is the caller's
+		std::vector<char> buffer; // the file, where it couldn't be mapped
+
+		void Check();
+		void Release();
+	};
+};
+
+#endif // SERIALIZE_H
@@ -0,0 +1,162 @@
+#pragma once
+#ifndef STATIC_PARSER_H
+#define STATIC_PARSER_H
+
+#include "parser.h"
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+
+namespace Lexer
+{
+	// tree_node without the unions, c++17 constant evaluation can't switch a union's active member
+	struct static_node
+	{
+		node_type type = node_type::BINARY_OP;
+		bin_op op_type = bin_op::ERROR_BIN_OP;
+		unary_op op = unary_op::ERROR_UN_OP;
+		uint32_t lhs = NO_NODE; // BINARY_OP lhs, PREFIX_OP next
+		uint32_t rhs = NO_NODE;
+		float constant = 0.0f; // NUM leaf
+		uint32_t slot = NO_SLOT; // ID leaf
+	};
+
+	// N is the node capacity, one more than the length of the text always fits
+	template <size_t N>
+	struct static_tree
+	{
+		static_node nodes[N] = {};
+		uint32_t count = 0;
+		uint32_t root = NO_NODE;
+	};
+
+	/*
+	 compile time front end, the same lexer (ScanToken) and grammar (grammar<P>) as parser
+	 identifiers resolve straight to their position in vars, so the tree needs no names
+	 errors throw, which inside a constant expression means the build fails right here
+	*/
+	template <size_t N>
+	class static_parser
+	{
+	public:
+		constexpr static_parser(std::string_view source, const std::string_view* vars, size_t number_of_vars)
+			: source(source), vars(vars), number_of_vars(number_of_vars)
+		{
+			size_t position = 0;
+			Token tok = ScanToken(source, position);
+			while (tok.token_type != TokenType::END_OF_FILE)
+			{
+				if (number_of_tokens == N)
+					throw std::length_error("static_parser: more tokens than capacity");
+				tokens[number_of_tokens++] = tok;
+				tok = ScanToken(source, position);
+			}
+		}
+
+		constexpr static_tree<N> Parse()
+		{
+			tree.root = grammar<static_parser>::Block(*this);
+			if (tree.root == NO_NODE)
+				throw std::invalid_argument("static_parser: empty expression");
+			return tree;
+		}
+	private:
+		friend struct grammar<static_parser>;
+		std::string_view source;
+		const std::string_view* vars;
+		size_t number_of_vars;
+		Token tokens[N] = {};
+		size_t number_of_tokens = 0;
+		size_t index = 0;
+		static_tree<N> tree;
+
+		// hooks for grammar<static_parser>
+		constexpr Token Next()
+		{
+			Token tok = Peek(1);
+			if (index < number_of_tokens)
+				index++;
+			return tok;
+		}
+
+		constexpr Token Peek(int how_far) const
+		{
+			size_t at = index + static_cast<size_t>(how_far) - 1;
+			if (at < number_of_tokens)
+				return tokens[at];
+			Token eof;
+			eof.offset = static_cast<uint32_t>(source.size());
+			eof.token_type = TokenType::END_OF_FILE;
+			return eof;
+		}
+
+		constexpr uint32_t Add(const static_node& node)
+		{
+			if (tree.count == N)
+				throw std::length_error("static_parser: more nodes than capacity");
+			tree.nodes[tree.count] = node;
+			return tree.count++;
+		}
+
+		constexpr uint32_t AddBinary(bin_op op_type, uint32_t lhs, uint32_t rhs)
+		{
+			// the runtime builds these and fails when lowering, here the build stops at the parse
+			if (op_type == bin_op::ERROR_BIN_OP || lhs == NO_NODE || rhs == NO_NODE)
+				throw std::invalid_argument("static_parser: missing operand or operator");
+			static_node node;
+			node.type = node_type::BINARY_OP;
+			node.op_type = op_type;
+			node.lhs = lhs;
+			node.rhs = rhs;
+			return Add(node);
+		}
+
+		constexpr uint32_t AddPrefix(unary_op op, uint32_t next)
+		{
+			if (op == unary_op::ERROR_UN_OP || next == NO_NODE)
+				throw std::invalid_argument("static_parser: missing operand or operator");
+			static_node node;
+			node.type = node_type::PREFIX_OP;
+			node.op = op;
+			node.lhs = next;
+			return Add(node);
+		}
+
+		constexpr uint32_t AddLeaf(const Token& tok)
+		{
+			std::string_view lexeme = source.substr(tok.offset, tok.length);
+			static_node node;
+			node.type = node_type::PREFIX_OP;
+			if (tok.token_type == TokenType::NUM)
+			{
+				node.op = unary_op::NUM_OP;
+				node.constant = ParseNumber(lexeme);
+				return Add(node);
+			}
+			node.op = unary_op::ID_OP;
+			for (size_t i = 0; i < number_of_vars; i++)
+			{
+				if (vars[i] == lexeme)
+				{
+					node.slot = static_cast<uint32_t>(i);
+					return Add(node);
+				}
+			}
+			throw std::out_of_range("static_parser: unknown variable");
+		}
+
+		constexpr void Declare(const Token&) {}
+
+		constexpr void SyntaxError(const Token&, TokenType) { throw std::invalid_argument("static_parser: syntax error"); }
+	};
+
+	// tree for source with vars[i] in input slot i, use it to initialise a constexpr variable
+	template <size_t N>
+	constexpr static_tree<N> ParseStatic(std::string_view source, const std::string_view* vars, size_t number_of_vars)
+	{
+		return static_parser<N>(source, vars, number_of_vars).Parse();
+	}
+};
+
+#endif // STATIC_PARSER_H
@@ -0,0 +1,217 @@
+#include "thread_pool.h"
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace MathEval
+{
+	// set while a thread runs chunks, nested ParallelFor calls run inline instead of waiting on themselves
+	static thread_local bool t_inside_job = false;
+
+	thread_pool::thread_pool(const thread_pool_options& options)
+	{
+		size_t threads = options.threads;
+		if (threads == 0)
+			threads = std::thread::hardware_concurrency();
+		if (threads == 0)
+			threads = 1;
+
+		for (size_t i = 0; i < threads; i++)
+			queues.emplace_back(new work_queue());
+		// the caller is thread 0, workers are 1..threads-1
+		for (size_t id = 1; id < threads; id++)
+		{
+			workers.emplace_back(&thread_pool::WorkerLoop, this, id);
+			if (options.pin_threads)
+				PinToCore(workers.back(), options.first_core + id);
+		}
+	}
+
+	thread_pool::~thread_pool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(state_lock);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (std::thread& worker : workers)
+			worker.join();
+	}
+
+	thread_pool& thread_pool::GetDefault()
+	{
+		static thread_pool pool;
+		return pool;
+	}
+
+	void thread_pool::ParallelFor(size_t count, size_t chunk, const range_function& fn)
+	{
+		if (count == 0)
+			return;
+		size_t threads = queues.size();
+		if (chunk == 0)
+			chunk = (count + threads - 1) / threads;
+
+		if (t_inside_job || threads == 1 || count <= chunk)
+		{
+			for (size_t begin = 0; begin < count; begin += chunk)
+				fn(begin, begin + chunk < count ? begin + chunk : count);
+			return;
+		}
+
+		std::lock_guard<std::mutex> run(run_lock);
+
+		// thread t gets chunks [t * chunks / threads, (t + 1) * chunks / threads), neighbours stay on one core
+		size_t chunks = (count + chunk - 1) / chunk;
+		for (size_t t = 0; t < threads; t++)
+		{
+			std::lock_guard<std::mutex> lock(queues[t]->lock);
+			queues[t]->ranges.clear();
+			for (size_t c = t * chunks / threads; c < (t + 1) * chunks / threads; c++)
+			{
+				size_t begin = c * chunk;
+				queues[t]->ranges.push_back({ begin, begin + chunk < count ? begin + chunk : count });
+			}
+		}
+
+		failed.store(false, std::memory_order_relaxed);
+		error = nullptr;
+		{
+			std::lock_guard<std::mutex> lock(state_lock);
+			job = &fn;
+			busy_workers = workers.size();
+			generation++;
+		}
+		wake.notify_all();
+
+		RunChunks(0, fn);
+
+		{
+			std::unique_lock<std::mutex> lock(state_lock);
+			finished.wait(lock, [this] { return busy_workers == 0; });
+			job = nullptr;
+		}
+		if (error)
+		{
+			std::exception_ptr first = error;
+			error = nullptr;
+			std::rethrow_exception(first);
+		}
+	}
+
+	void thread_pool::WorkerLoop(size_t id)
+	{
+		uint64_t seen = 0;
+		for (;;)
+		{
+			const range_function* fn;
+			{
+				std::unique_lock<std::mutex> lock(state_lock);
+				wake.wait(lock, [&] { return stopping || generation != seen; });
+				if (stopping)
+					return;
+				seen = generation;
+				fn = job;
+			}
+
+			RunChunks(id, *fn);
+
+			{
+				std::lock_guard<std::mutex> lock(state_lock);
+				if (--busy_workers == 0)
+					finished.notify_one();
+			}
+		}
+	}
+
+	void thread_pool::RunChunks(size_t id, const range_function& fn)
+	{
+		t_inside_job = true;
+		range r;
+		while (NextRange(id, r))
+		{
+			// after a failure the remaining chunks are only drained
+			if (failed.load(std::memory_order_relaxed))
+				continue;
+			try
+			{
+				fn(r.begin, r.end);
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(state_lock);
+				if (!error)
+					error = std::current_exception();
+				failed.store(true, std::memory_order_relaxed);
+			}
+		}
+		t_inside_job = false;
+	}
+
+	bool thread_pool::NextRange(size_t id, range& out)
+	{
+		{
+			work_queue& own = *queues[id];
+			std::lock_guard<std::mutex> lock(own.lock);
+			if (!own.ranges.empty())
+			{
+				out = own.ranges.front();
+				own.ranges.pop_front();
+				return true;
+			}
+		}
+		// steal from the far end, away from where the owner is working
+		size_t threads = queues.size();
+		for (size_t k = 1; k < threads; k++)
+		{
+			work_queue& victim = *queues[(id + k) % threads];
+			std::lock_guard<std::mutex> lock(victim.lock);
+			if (!victim.ranges.empty())
+			{
+				out = victim.ranges.back();
+				victim.ranges.pop_back();
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void thread_pool::PinToCore(std::thread& thread, size_t core)
+	{
+		size_t cores = std::thread::hardware_concurrency();
+		if (cores != 0)
+			core %= cores;
+#if defined(_WIN32)
+		if (core < 64)
+			SetThreadAffinityMask(static_cast<HANDLE>(thread.native_handle()), static_cast<DWORD_PTR>(1) << core);
+#elif defined(__linux__)
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(core, &set);
+		pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#else
+		(void)thread;
+		(void)core;
+#endif
+	}
+
+	size_t AutoChunkSize(double ns_per_point, size_t count, size_t threads, double target_ns)
+	{
+		const size_t GRAIN = 64;
+		size_t chunk = count;
+		if (ns_per_point > 0.0 && target_ns / ns_per_point < static_cast<double>(count))
+			chunk = static_cast<size_t>(target_ns / ns_per_point);
+		// a few chunks per thread so stealing has something to even out
+		size_t balanced = count / ((threads ? threads : 1) * 4);
+		if (balanced < chunk)
+			chunk = balanced;
+		chunk = (chunk + GRAIN - 1) / GRAIN * GRAIN;
+		return chunk < GRAIN ? GRAIN : chunk;
+	}
+
+};
@@ -0,0 +1,90 @@
+#pragma once
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace MathEval
+{
+	struct thread_pool_options
+	{
+		size_t threads = 0; // 0 -> one per hardware thread, the calling thread counts as one of them
+		bool pin_threads = false; // bind worker i (1..threads-1) to core first_core + i, the calling thread is left alone (linux and windows only)
+		size_t first_core = 0;
+	};
+
+	/*
+	 reusable pool for splitting an index range across cores
+	 ParallelFor cuts [0, count) into chunks and deals them out in contiguous runs, one run per thread,
+	 each thread works through its own run front to back and steals from the back of other runs once it's out
+	 the caller works too and only returns once every chunk ran, the first exception a chunk throws is rethrown there
+	 which thread runs a chunk is not deterministic, callers keep results deterministic by writing each index to its own slot
+	*/
+	class thread_pool
+	{
+	public:
+		typedef std::function<void(size_t begin, size_t end)> range_function;
+
+		explicit thread_pool(const thread_pool_options& options = thread_pool_options());
+		~thread_pool();
+		thread_pool(const thread_pool&) = delete;
+		thread_pool& operator=(const thread_pool&) = delete;
+
+		// workers + the calling thread
+		inline size_t GetNumOfThreads() const { return queues.size(); }
+
+		// fn(begin, end) for every chunk of [0, count), chunk 0 is taken as count / threads
+		// one job runs at a time, other callers wait for it; a ParallelFor from inside a chunk, on a pool of one
+		// thread or with a single chunk just runs inline on the calling thread and never waits
+		void ParallelFor(size_t count, size_t chunk, const range_function& fn);
+
+		// shared pool with the default options, made on first use
+		static thread_pool& GetDefault();
+	private:
+		struct range
+		{
+			size_t begin;
+			size_t end;
+		};
+		struct alignas(64) work_queue // own cache line, the lock bounces between thieves otherwise
+		{
+			std::mutex lock;
+			std::deque<range> ranges;
+		};
+
+		std::vector<std::thread> workers;
+		std::vector<std::unique_ptr<work_queue>> queues; // queues[0] belongs to the calling thread
+
+		std::mutex run_lock; // one ParallelFor at a time
+		std::mutex state_lock;
+		std::condition_variable wake;
+		std::condition_variable finished;
+		const range_function* job = nullptr;
+		uint64_t generation = 0;
+		size_t busy_workers = 0;
+		bool stopping = false;
+		std::atomic<bool> failed{ false };
+		std::exception_ptr error;
+
+		void WorkerLoop(size_t id);
+		void RunChunks(size_t id, const range_function& fn);
+		bool NextRange(size_t id, range& out);
+		static void PinToCore(std::thread& thread, size_t core);
+	};
+
+	// chunk size so one chunk takes roughly target_ns and every thread still gets a few chunks to balance with
+	// always a multiple of 64 points, so chunks line up with simd blocks and cache lines of the output
+	size_t AutoChunkSize(double ns_per_point, size_t count, size_t threads, double target_ns = 50000.0);
+};
+
+#endif // THREAD_POOL_H
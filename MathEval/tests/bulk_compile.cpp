@@ -0,0 +1,326 @@
+// comment out the below definition if using elsewhere
+// uncomment out below definition to run the bulk compile test
+//#define MATH_EVAL_BULK_COMPILE_TEST_MAIN
+#ifdef MATH_EVAL_BULK_COMPILE_TEST_MAIN
+#include "../include/ExpressionEvaluation.h"
+#include "test_util.h"
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+ TryCompileExpression and CompileBulk (bulk_compile.h)
+   syntax errors, the token, offset, line, expected token and message of Lexer::syntax_error, thrown by
+   MathEvaluator and copied into compile_error
+   every compile_error kind, OTHER by making one allocation fail
+   bulk, results[i] belongs to texts[i] with good and bad texts mixed, with and without a registry
+   nesting, parentheses, functions, unary minus and ^ a few 100000 levels deep each come back as their own TOO_LONG
+   instead of running the parser out of stack, one level under Lexer::grammar::MAX_DEPTH still compiles
+*/
+
+// the allocation this many allocations from now on this thread throws std::bad_alloc, 0 never
+static thread_local size_t t_fail_allocation = 0;
+
+#if defined(__GNUC__) && !defined(__clang__)
+// new below is malloc and delete is free, gcc only sees a free of something that came from new
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(size_t size)
+{
+	if (t_fail_allocation != 0 && --t_fail_allocation == 0)
+		throw std::bad_alloc();
+	if (void* p = std::malloc(size ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	std::free(p);
+}
+
+namespace
+{
+	using namespace MathEvalTest;
+
+	typedef Lexer::grammar<Lexer::parser> grammar;
+
+	std::string Repeat(const std::string& text, size_t times)
+	{
+		std::string result;
+		result.reserve(text.size() * times);
+		for (size_t i = 0; i < times; i++)
+			result += text;
+		return result;
+	}
+
+	std::string Parenthesized(size_t depth) { return Repeat("(", depth) + "a" + Repeat(")", depth); }
+
+	std::string KindName(MathEval::compile_error::kind kind)
+	{
+		switch (kind)
+		{
+		case MathEval::compile_error::kind::SYNTAX:     return "SYNTAX";
+		case MathEval::compile_error::kind::UNRESOLVED: return "UNRESOLVED";
+		case MathEval::compile_error::kind::TOO_LONG:   return "TOO_LONG";
+		default:                                        return "OTHER";
+		}
+	}
+
+	void CheckFailed(const std::string& name, const MathEval::compile_result& result, MathEval::compile_error::kind kind)
+	{
+		if (result.Ok())
+			Fail(name + ": compiled");
+		else if (result.error.type != kind)
+			Fail(name + ": " + KindName(result.error.type) + " instead of " + KindName(kind) + ", " + result.error.message);
+		else if (result.error.message.empty())
+			Fail(name + ": no message");
+	}
+
+	void CheckOk(const std::string& name, const MathEval::compile_result& result)
+	{
+		if (!result.Ok())
+			Fail(name + ": " + KindName(result.error.type) + ", " + result.error.message);
+	}
+
+	struct syntax_case
+	{
+		const char* text;
+		uint32_t offset; // of the offending token
+		Lexer::TokenType found;
+		Lexer::TokenType expected;
+		int line;
+		const char* message;
+	};
+
+	const syntax_case SYNTAX_CASES[] = {
+		{ "a+)", 2, Lexer::TokenType::RPAREN, Lexer::TokenType::ID, 1,
+			"syntax error at offset 2 (line 1): expected an operand, found ')'" },
+		{ "a +\n(b\n * 2", 11, Lexer::TokenType::END_OF_FILE, Lexer::TokenType::RPAREN, 3,
+			"syntax error at offset 11 (line 3): expected ')', found the end of the input" },
+		{ "2(a)", 1, Lexer::TokenType::LPAREN, Lexer::TokenType::MULT, 1,
+			"syntax error at offset 1 (line 1): expected '*', found '('" },
+		{ "a b", 2, Lexer::TokenType::ID, Lexer::TokenType::END_OF_FILE, 1,
+			"syntax error at offset 2 (line 1): expected the end of the input, found 'b'" },
+		{ "a\n\n$ b", 3, Lexer::TokenType::TOKEN_TYPE_ERROR, Lexer::TokenType::END_OF_FILE, 3,
+			"syntax error at offset 3 (line 3): expected the end of the input, found '$'" },
+		{ "pow(a b)", 6, Lexer::TokenType::ID, Lexer::TokenType::COMMA, 1,
+			"syntax error at offset 6 (line 1): expected ',', found 'b'" },
+		{ "f(a, b) a+b", 8, Lexer::TokenType::ID, Lexer::TokenType::EQUAL, 1,
+			"syntax error at offset 8 (line 1): expected '=', found 'a'" },
+		{ "sin()", 4, Lexer::TokenType::RPAREN, Lexer::TokenType::ID, 1,
+			"syntax error at offset 4 (line 1): expected an operand, found ')'" },
+		// empty, the parser takes it as no expression, compiling doesn't
+		{ "", 0, Lexer::TokenType::END_OF_FILE, Lexer::TokenType::ID, 1,
+			"syntax error at offset 0 (line 1): expected an operand, found the end of the input" },
+		{ "  \n\t ", 5, Lexer::TokenType::END_OF_FILE, Lexer::TokenType::ID, 2,
+			"syntax error at offset 5 (line 2): expected an operand, found the end of the input" },
+	};
+
+	void CheckSyntax(const syntax_case& c, const std::string& how, const Lexer::Token& token, Lexer::TokenType expected, int line,
+		const std::string& message)
+	{
+		std::string name = how + " \"" + c.text + "\"";
+		if (token.offset != c.offset || token.token_type != c.found)
+			Fail(name + ": token at " + std::to_string(token.offset) + " of type " + Lexer::GetTokenTypeName(token.token_type));
+		if (expected != c.expected)
+			Fail(name + ": expected " + Lexer::GetTokenTypeName(expected));
+		if (line != c.line)
+			Fail(name + ": line " + std::to_string(line));
+		if (message != c.message)
+			Fail(name + ": message \"" + message + "\"");
+	}
+
+	void SyntaxErrors(std::unordered_map<std::string, size_t>& definition, const MathEval::compile_options& options)
+	{
+		for (const syntax_case& c : SYNTAX_CASES)
+		{
+			MathEval::compile_result result = MathEval::TryCompileExpression(c.text, definition, 2, options);
+			CheckFailed(std::string("\"") + c.text + "\"", result, MathEval::compile_error::kind::SYNTAX);
+			if (!result.Ok())
+				CheckSyntax(c, "TryCompileExpression", result.error.token, result.error.expected, result.error.line, result.error.message);
+
+			MathEvaluatorOptions evaluator_options;
+			evaluator_options.registry = nullptr;
+			try
+			{
+				MathEvaluator<2> evaluator(c.text, definition, evaluator_options);
+				Fail(std::string("MathEvaluator \"") + c.text + "\": no exception");
+			}
+			catch (const Lexer::syntax_error& e)
+			{
+				CheckSyntax(c, "MathEvaluator", e.token, e.expected, e.line, e.what());
+			}
+			catch (const std::exception& e)
+			{
+				Fail(std::string("MathEvaluator \"") + c.text + "\": " + e.what());
+			}
+		}
+	}
+
+	void Kinds(const std::unordered_map<std::string, size_t>& definition, const MathEval::compile_options& options)
+	{
+		CheckOk("a*b", MathEval::TryCompileExpression("a*b", definition, 2, options));
+		CheckFailed("unknown variable", MathEval::TryCompileExpression("a + z", definition, 2, options), MathEval::compile_error::kind::UNRESOLVED);
+		// c is in the map but maps to slot 2
+		std::unordered_map<std::string, size_t> wider = definition;
+		wider["c"] = 2;
+		CheckFailed("slot past the last input", MathEval::TryCompileExpression("a + c", wider, 2, options), MathEval::compile_error::kind::UNRESOLVED);
+		CheckOk("slot inside the inputs", MathEval::TryCompileExpression("a + c", wider, 3, options));
+		CheckFailed("64K name", MathEval::TryCompileExpression("a + " + std::string(70000, 'x'), definition, 2, options),
+			MathEval::compile_error::kind::TOO_LONG);
+		CheckFailed("nesting", MathEval::TryCompileExpression(Parenthesized(grammar::MAX_DEPTH), definition, 2, options),
+			MathEval::compile_error::kind::TOO_LONG);
+		// out of memory somewhere in the middle of compiling, the next allocation after it fails works again
+		for (size_t at : { 1, 5, 20 })
+		{
+			t_fail_allocation = at;
+			MathEval::compile_result result = MathEval::TryCompileExpression("sin(a)*b + a/b - 2^a", definition, 2, options);
+			bool failed = t_fail_allocation == 0;
+			t_fail_allocation = 0;
+			if (!failed)
+				Fail("allocation " + std::to_string(at) + " never happened");
+			else
+				CheckFailed("out of memory at allocation " + std::to_string(at), result, MathEval::compile_error::kind::OTHER);
+		}
+	}
+
+	// the text of entry i, every third one is bad in one of three ways
+	std::string BulkText(size_t i)
+	{
+		switch (i % 6)
+		{
+		case 1:  return "a + " + std::to_string(i) + ")";
+		case 3:  return "a * z" + std::to_string(i);
+		case 5:  return Parenthesized(grammar::MAX_DEPTH + i % 7);
+		default: return "a*" + std::to_string(i) + " + b";
+		}
+	}
+
+	void Bulk(const std::unordered_map<std::string, size_t>& definition, const MathEval::compile_options& options)
+	{
+		const size_t COUNT = 1000; // a few chunks for every worker
+		std::vector<std::string> texts;
+		for (size_t i = 0; i < COUNT; i++)
+			texts.push_back(BulkText(i));
+		// twice, a registry compiles it once
+		texts.push_back("a*0 + b");
+		texts.push_back("a*0 + b");
+
+		MathEval::thread_pool pool(MathEval::thread_pool_options{ 4 });
+		MathEval::expression_registry registry;
+		for (MathEval::expression_registry* with : { static_cast<MathEval::expression_registry*>(nullptr), &registry })
+		{
+			std::string how = with ? "CompileBulk with a registry" : "CompileBulk";
+			std::vector<MathEval::compile_result> results = MathEval::CompileBulk(texts, definition, 2, options, pool, with);
+			if (results.size() != texts.size())
+			{
+				Fail(how + ": " + std::to_string(results.size()) + " results for " + std::to_string(texts.size()) + " texts");
+				continue;
+			}
+			for (size_t i = 0; i < texts.size(); i++)
+			{
+				// the same answer as compiling it alone, and for the good ones the expression of that text
+				MathEval::compile_result alone = MathEval::TryCompileExpression(texts[i], definition, 2, options);
+				std::string name = how + " [" + std::to_string(i) + "]";
+				if (alone.Ok())
+				{
+					CheckOk(name, results[i]);
+					if (!results[i].Ok())
+						continue;
+					MathEvaluator<2> evaluator(results[i].compiled);
+					std::array<float, 2> point = { 1.0f, 0.5f };
+					float expected = (i < COUNT ? static_cast<float>(i) : 0.0f) + 0.5f;
+					if (evaluator.Evaluate(point) != expected)
+						Fail(name + ": " + std::to_string(evaluator.Evaluate(point)) + " instead of " + std::to_string(expected));
+					continue;
+				}
+				CheckFailed(name, results[i], alone.error.type);
+				if (!results[i].Ok() && (results[i].error.message != alone.error.message || results[i].error.token.offset != alone.error.token.offset))
+					Fail(name + ": \"" + results[i].error.message + "\" instead of \"" + alone.error.message + "\"");
+			}
+			// a repeated text compiles once through a registry
+			if (with && results[COUNT].Ok() && results[COUNT].compiled != results[COUNT + 1].compiled)
+				Fail(how + ": a repeated text compiled twice");
+		}
+	}
+
+	void Nesting(const std::unordered_map<std::string, size_t>& definition, const MathEval::compile_options& options)
+	{
+		struct deep_case
+		{
+			const char* name;
+			std::string text;
+		};
+		const size_t DEEP = 200000;
+		std::vector<deep_case> deep = {
+			{ "parentheses", Parenthesized(DEEP) },
+			{ "a+(", Repeat("a+(", 20000) + "a" + Repeat(")", 20000) },
+			{ "sin(", Repeat("sin(", DEEP) + "a" + Repeat(")", DEEP) },
+			{ "pow(", Repeat("pow(a,", DEEP) + "a" + Repeat(")", DEEP) },
+			{ "sqrt sqrt", Repeat("sqrt ", DEEP) + "a" },
+			{ "unary minus", Repeat("-", DEEP) + "a" },
+			{ "a^a^", Repeat("a^", DEEP) + "a" },
+			{ "a^-", "a^" + Repeat("-", DEEP) + "a" },
+			{ "unclosed", Repeat("(", DEEP) }, // would be a syntax error at the end, the depth gives out first
+		};
+
+		// one call at a time
+		for (const deep_case& c : deep)
+			CheckFailed(c.name, MathEval::TryCompileExpression(c.text, definition, 2, options), MathEval::compile_error::kind::TOO_LONG);
+
+		// the depth is counted per level, not per token: MAX_DEPTH - 1 parentheses is still fine however long the text
+		CheckOk("MAX_DEPTH - 1 parentheses", MathEval::TryCompileExpression(Parenthesized(grammar::MAX_DEPTH - 1), definition, 2, options));
+		CheckFailed("MAX_DEPTH parentheses", MathEval::TryCompileExpression(Parenthesized(grammar::MAX_DEPTH), definition, 2, options),
+			MathEval::compile_error::kind::TOO_LONG);
+		std::string wide = Repeat(Parenthesized(grammar::MAX_DEPTH - 1) + "+", 100) + "b";
+		CheckOk("100 sums of MAX_DEPTH - 1 parentheses", MathEval::TryCompileExpression(wide, definition, 2, options));
+
+		// the same texts in bulk, between good ones, on the pool's worker threads as well as the caller
+		std::vector<std::string> texts;
+		for (const deep_case& c : deep)
+		{
+			texts.push_back("a*b");
+			texts.push_back(c.text);
+		}
+		texts.push_back(wide);
+		MathEval::thread_pool pool;
+		std::vector<MathEval::compile_result> results = MathEval::CompileBulk(texts, definition, 2, options, pool);
+		if (results.size() != texts.size())
+		{
+			Fail("CompileBulk: " + std::to_string(results.size()) + " results for " + std::to_string(texts.size()) + " texts");
+			return;
+		}
+		for (size_t i = 0; i < deep.size(); i++)
+		{
+			CheckOk("CompileBulk a*b before " + std::string(deep[i].name), results[2 * i]);
+			CheckFailed("CompileBulk " + std::string(deep[i].name), results[2 * i + 1], MathEval::compile_error::kind::TOO_LONG);
+		}
+		CheckOk("CompileBulk sums of MAX_DEPTH - 1 parentheses", results.back());
+	}
+}
+
+int main()
+{
+	std::unordered_map<std::string, size_t> definition = { { "a", 0 }, { "b", 1 } };
+	MathEval::compile_options options;
+
+	SyntaxErrors(definition, options);
+	Kinds(definition, options);
+	Bulk(definition, options);
+	Nesting(definition, options);
+
+	std::printf("bulk compile: %zu failures\n", failures);
+	return failures ? 1 : 0;
+}
+#endif
@@ -0,0 +1,393 @@
+// comment out the below definition if using elsewhere
+// uncomment out below definition to run the cache test
+//#define MATH_EVAL_CACHE_TEST_MAIN
+#ifdef MATH_EVAL_CACHE_TEST_MAIN
+#include "../include/ExpressionEvaluation.h"
+#include "../src/eval_cache.h"
+#include "test_util.h"
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/*
+ eval_cache and sharded_cache on their own, with keys picked so who gets evicted is known:
+   - a cache of 8 slots is one probe window, every key can go anywhere in it
+     LRU evicts the entry used longest ago, a hit counts as a use
+     CLOCK evicts an entry that wasn't hit since the hand passed it, one that was hit gets a second chance
+     DIRECT_MAPPED has one slot per key, a key on the same slot replaces the one there
+   - keys compare by bits: -0 misses the entry of 0, a NaN finds the entry it was stored under
+   - hits, misses, insertions, evictions and probes counted exactly, storing a key again only updates its value
+   - sharded_cache: Find before the first Insert is a miss it counts without building anything, Clear empties the
+     shards and zeroes the counters, capacity 0 stores and counts nothing
+   - MathEvaluator's cache: Evaluate(inputs, true) is found again, ClearCache forgets it
+ sharded_cache from several threads, each round on a fresh cache so the first Inserts race to build the shards:
+   - every hit gives the value stored for its key, with and without another thread calling Clear all the while
+   - without Clear the counters add up: hits are the Finds that found something, hits and misses every Find,
+     what's held (insertions - evictions) fits the capacity, and GetStats read in the middle never goes backwards
+*/
+
+namespace
+{
+	using namespace MathEvalTest;
+
+	typedef MathEval::eval_cache<2> cache;
+	typedef std::array<float, 2> key;
+
+	std::string Name(MathEval::cache_policy policy)
+	{
+		switch (policy)
+		{
+		case MathEval::cache_policy::LRU:   return "LRU";
+		case MathEval::cache_policy::CLOCK: return "CLOCK";
+		default:                            return "DIRECT_MAPPED";
+		}
+	}
+
+	// the value stored for a key, so a hit can be checked against it
+	float ValueOf(const key& k)
+	{
+		return k[0] * 3.0f + k[1];
+	}
+
+	key Key(size_t i)
+	{
+		return { static_cast<float>(i), 0.5f };
+	}
+
+	void ExpectHit(const std::string& what, cache& c, const key& k)
+	{
+		float value = NAN;
+		if (!c.Find(k, value))
+			Fail(what + ": " + std::to_string(k[0]) + " missed");
+		else if (!Same(value, ValueOf(k)))
+			Fail(what + ": " + std::to_string(k[0]) + " found " + std::to_string(value) + " instead of " + std::to_string(ValueOf(k)));
+	}
+
+	void ExpectMiss(const std::string& what, cache& c, const key& k)
+	{
+		float value;
+		if (c.Find(k, value))
+			Fail(what + ": " + std::to_string(k[0]) + " still there");
+	}
+
+	void ExpectStats(const std::string& what, const MathEval::cache_stats& stats, uint64_t hits, uint64_t misses, uint64_t insertions,
+		uint64_t evictions)
+	{
+		if (stats.hits != hits || stats.misses != misses || stats.insertions != insertions || stats.evictions != evictions)
+			Fail(what + ": " + std::to_string(stats.hits) + " hits, " + std::to_string(stats.misses) + " misses, " + std::to_string(stats.insertions)
+				+ " insertions, " + std::to_string(stats.evictions) + " evictions instead of " + std::to_string(hits) + ", " + std::to_string(misses)
+				+ ", " + std::to_string(insertions) + ", " + std::to_string(evictions));
+	}
+
+	// a full cache of one probe window holding Key(0)..Key(7)
+	cache Full(MathEval::cache_policy policy)
+	{
+		cache c(cache::PROBE_WINDOW, policy);
+		for (size_t i = 0; i < cache::PROBE_WINDOW; i++)
+			c.Insert(Key(i), ValueOf(Key(i)));
+		return c;
+	}
+
+	void Lru()
+	{
+		cache c = Full(MathEval::cache_policy::LRU);
+		ExpectHit("LRU", c, Key(0)); // Key(1) is the oldest now
+		c.Insert(Key(8), ValueOf(Key(8)));
+		ExpectStats("LRU after 9 inserts", c.GetStats(), 1, 0, 9, 1);
+		ExpectMiss("LRU, least recently used", c, Key(1));
+		for (size_t i : { 0, 2, 3, 4, 5, 6, 7, 8 })
+			ExpectHit("LRU", c, Key(i));
+		// Key(0) was used before the rest just now, it goes next
+		c.Insert(Key(9), ValueOf(Key(9)));
+		ExpectMiss("LRU, least recently used after another round", c, Key(0));
+		ExpectHit("LRU", c, Key(9));
+	}
+
+	void Clock()
+	{
+		// every entry hit but one, that one is the only candidate
+		for (size_t unused = 0; unused < cache::PROBE_WINDOW; unused++)
+		{
+			cache c = Full(MathEval::cache_policy::CLOCK);
+			for (size_t i = 0; i < cache::PROBE_WINDOW; i++)
+				if (i != unused)
+					ExpectHit("CLOCK", c, Key(i));
+			c.Insert(Key(8), ValueOf(Key(8)));
+			std::string what = "CLOCK, all hit but " + std::to_string(unused);
+			ExpectMiss(what, c, Key(unused));
+			for (size_t i = 0; i <= cache::PROBE_WINDOW; i++)
+				if (i != unused)
+					ExpectHit(what, c, Key(i));
+		}
+		// one entry hit, wherever the hand starts it survives the next eviction
+		for (size_t hit = 0; hit < cache::PROBE_WINDOW; hit++)
+		{
+			cache c = Full(MathEval::cache_policy::CLOCK);
+			ExpectHit("CLOCK", c, Key(hit));
+			c.Insert(Key(100), ValueOf(Key(100)));
+			ExpectHit("CLOCK, second chance for " + std::to_string(hit), c, Key(hit));
+			ExpectHit("CLOCK", c, Key(100));
+			ExpectStats("CLOCK", c.GetStats(), 3, 0, 9, 1);
+		}
+	}
+
+	void DirectMapped()
+	{
+		// two keys on the same slot of 8
+		cache c(8, MathEval::cache_policy::DIRECT_MAPPED);
+		size_t first = 0, second = 1;
+		while ((cache::HashOf(Key(second)) & 7) != (cache::HashOf(Key(first)) & 7))
+			second++;
+		size_t other = 1;
+		while ((cache::HashOf(Key(other)) & 7) == (cache::HashOf(Key(first)) & 7))
+			other++;
+		c.Insert(Key(first), ValueOf(Key(first)));
+		c.Insert(Key(other), ValueOf(Key(other)));
+		c.Insert(Key(second), ValueOf(Key(second)));
+		ExpectMiss("DIRECT_MAPPED, overwritten", c, Key(first));
+		ExpectHit("DIRECT_MAPPED", c, Key(second));
+		ExpectHit("DIRECT_MAPPED, another slot", c, Key(other));
+		ExpectStats("DIRECT_MAPPED", c.GetStats(), 2, 1, 3, 1);
+		// a miss never looks past its own slot
+		if (c.GetStats().max_probe != 1)
+			Fail("DIRECT_MAPPED: probed " + std::to_string(c.GetStats().max_probe) + " slots");
+	}
+
+	void Keys()
+	{
+		for (MathEval::cache_policy policy : { MathEval::cache_policy::LRU, MathEval::cache_policy::CLOCK, MathEval::cache_policy::DIRECT_MAPPED })
+		{
+			std::string what = Name(policy);
+			cache c(64, policy);
+			float value;
+			c.Insert({ 0.0f, 1.0f }, 1.0f);
+			if (c.Find({ -0.0f, 1.0f }, value))
+				Fail(what + ": -0 found the entry of 0");
+			if (!c.Find({ 0.0f, 1.0f }, value) || value != 1.0f)
+				Fail(what + ": 0 lost its entry");
+			c.Insert({ NAN, 1.0f }, 5.0f);
+			if (!c.Find({ NAN, 1.0f }, value) || value != 5.0f)
+				Fail(what + ": NaN didn't find its own entry");
+			// the same key again replaces the value, it isn't a new entry
+			c.Insert({ NAN, 1.0f }, 6.0f);
+			if (!c.Find({ NAN, 1.0f }, value) || value != 6.0f)
+				Fail(what + ": storing NaN again didn't update it");
+			ExpectStats(what + " keys", c.GetStats(), 3, 1, 2, 0);
+		}
+	}
+
+	void Stats()
+	{
+		// a lone key sits on its own slot, both lookups look at exactly one slot
+		cache c(100, MathEval::cache_policy::CLOCK);
+		if (c.GetCapacity() != 128)
+			Fail("capacity 100 rounded to " + std::to_string(c.GetCapacity()));
+		ExpectMiss("stats", c, Key(1));
+		c.Insert(Key(1), ValueOf(Key(1)));
+		ExpectHit("stats", c, Key(1));
+		ExpectStats("one key", c.GetStats(), 1, 1, 1, 0);
+		if (c.GetStats().probes != 2 || c.GetStats().max_probe != 1 || c.GetSize() != 1)
+			Fail("one key: " + std::to_string(c.GetStats().probes) + " probes, longest " + std::to_string(c.GetStats().max_probe));
+
+		// a miss on a full window looks at all of it
+		cache full = Full(MathEval::cache_policy::LRU);
+		ExpectMiss("full window", full, Key(50));
+		if (full.GetStats().max_probe != cache::PROBE_WINDOW)
+			Fail("miss on a full window: longest probe " + std::to_string(full.GetStats().max_probe));
+
+		c.Clear();
+		ExpectMiss("after Clear", c, Key(1));
+		if (c.GetSize() != 0)
+			Fail("Clear left " + std::to_string(c.GetSize()) + " entries");
+		c.ResetStats();
+		ExpectStats("after ResetStats", c.GetStats(), 0, 0, 0, 0);
+
+		cache off(0);
+		off.Insert(Key(1), 1.0f);
+		ExpectMiss("capacity 0", off, Key(1));
+		ExpectStats("capacity 0", off.GetStats(), 0, 0, 0, 0);
+	}
+
+	void Sharded()
+	{
+		MathEval::sharded_cache<2> c(4096, MathEval::cache_policy::CLOCK, 4);
+		float value;
+		for (size_t i = 0; i < 5; i++)
+			c.Find(Key(i), value);
+		ExpectStats("sharded, before the first Insert", c.GetStats(), 0, 5, 0, 0);
+		if (c.GetNumOfShards() != 0)
+			Fail("sharded: shards built before the first Insert");
+		for (size_t i = 0; i < 100; i++)
+			c.Insert(Key(i), ValueOf(Key(i)));
+		for (size_t i = 0; i < 200; i++)
+		{
+			bool found = c.Find(Key(i), value);
+			if (found != (i < 100) || (found && value != ValueOf(Key(i))))
+				Fail("sharded: " + std::to_string(i) + (found ? " found " + std::to_string(value) : " missed"));
+		}
+		ExpectStats("sharded", c.GetStats(), 100, 105, 100, 0);
+		if (c.GetNumOfShards() != 4)
+			Fail("sharded: " + std::to_string(c.GetNumOfShards()) + " shards instead of 4");
+
+		c.Clear();
+		ExpectStats("sharded after Clear", c.GetStats(), 0, 0, 0, 0);
+		for (size_t i = 0; i < 100; i++)
+			if (c.Find(Key(i), value))
+				Fail("sharded: " + std::to_string(i) + " found after Clear");
+		ExpectStats("sharded after Clear", c.GetStats(), 0, 100, 0, 0);
+		c.Insert(Key(7), ValueOf(Key(7)));
+		if (!c.Find(Key(7), value) || value != ValueOf(Key(7)) || c.Find(Key(8), value))
+			Fail("sharded: wrong answers after Clear and Insert");
+		ExpectStats("sharded after Clear and Insert", c.GetStats(), 1, 101, 1, 0);
+
+		MathEval::sharded_cache<2> off(0, MathEval::cache_policy::CLOCK);
+		off.Insert(Key(1), 1.0f);
+		if (off.Find(Key(1), value))
+			Fail("sharded capacity 0: found something");
+		ExpectStats("sharded capacity 0", off.GetStats(), 0, 0, 0, 0);
+		if (off.GetNumOfShards() != 0)
+			Fail("sharded capacity 0: built shards");
+	}
+
+	struct worker_counts
+	{
+		uint64_t finds = 0, hits = 0, inserts = 0, wrong = 0;
+	};
+
+	// Find and Insert on keys from a pool small enough to hit often and big enough to evict
+	void Work(MathEval::sharded_cache<2>& c, size_t seed, size_t calls, const std::atomic<bool>& go, worker_counts& counts)
+	{
+		const uint32_t KEYS = 3000;
+		uint32_t state = 2463534242u + static_cast<uint32_t>(seed) * 0x9E3779B9u;
+		while (!go.load(std::memory_order_acquire))
+			std::this_thread::yield();
+		for (size_t i = 0; i < calls; i++)
+		{
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			key k = Key(state % KEYS);
+			float value;
+			counts.finds++;
+			if (c.Find(k, value))
+			{
+				counts.hits++;
+				if (!Same(value, ValueOf(k)))
+					counts.wrong++;
+			}
+			else
+			{
+				counts.inserts++;
+				c.Insert(k, ValueOf(k));
+			}
+		}
+	}
+
+	void Concurrent(MathEval::cache_policy policy, size_t shards, bool clearing)
+	{
+		const size_t THREADS = 6, CALLS = 5000, CAPACITY = 1024;
+		std::string what = "concurrent " + Name(policy) + ", " + std::to_string(shards) + " shards" + (clearing ? ", Clear racing" : "");
+		for (size_t round = 0; round < 20; round++)
+		{
+			MathEval::sharded_cache<2> c(CAPACITY, policy, shards);
+			std::atomic<bool> go{ false }, done{ false };
+			std::vector<worker_counts> counts(THREADS);
+			std::vector<std::thread> threads;
+			for (size_t t = 0; t < THREADS; t++)
+				threads.emplace_back([&, t] { Work(c, round * THREADS + t, CALLS, go, counts[t]); });
+			// Clear over and over, or GetStats checking the counters only grow
+			uint64_t backwards = 0;
+			std::thread other([&]
+			{
+				uint64_t last = 0;
+				while (!done.load(std::memory_order_acquire))
+				{
+					if (clearing)
+						c.Clear();
+					else
+					{
+						MathEval::cache_stats stats = c.GetStats();
+						if (stats.hits + stats.misses < last)
+							backwards++;
+						last = stats.hits + stats.misses;
+					}
+					std::this_thread::yield();
+				}
+			});
+			go.store(true, std::memory_order_release);
+			for (std::thread& thread : threads)
+				thread.join();
+			done.store(true, std::memory_order_release);
+			other.join();
+
+			worker_counts total;
+			for (const worker_counts& w : counts)
+			{
+				total.finds += w.finds;
+				total.hits += w.hits;
+				total.inserts += w.inserts;
+				total.wrong += w.wrong;
+			}
+			if (total.wrong)
+				Fail(what + ": " + std::to_string(total.wrong) + " hits gave another key's value");
+			if (backwards)
+				Fail(what + ": hits + misses went down " + std::to_string(backwards) + " times");
+			if (clearing)
+			{
+				c.Clear();
+				ExpectStats(what + ", after the last Clear", c.GetStats(), 0, 0, 0, 0);
+				continue;
+			}
+			MathEval::cache_stats stats = c.GetStats();
+			if (stats.hits != total.hits || stats.hits + stats.misses != total.finds || stats.insertions > total.inserts
+				|| stats.insertions - stats.evictions > CAPACITY || total.hits == 0)
+				Fail(what + ": " + std::to_string(stats.hits) + " hits, " + std::to_string(stats.misses) + " misses, "
+					+ std::to_string(stats.insertions) + " insertions, " + std::to_string(stats.evictions) + " evictions, the threads saw "
+					+ std::to_string(total.hits) + " hits in " + std::to_string(total.finds) + " finds and made " + std::to_string(total.inserts)
+					+ " inserts");
+		}
+	}
+
+	void Evaluator()
+	{
+		std::unordered_map<std::string, size_t> definition = { { "a", 0 }, { "b", 1 } };
+		MathEvaluatorOptions options = Options(true, false);
+		options.cache_capacity = 256;
+		MathEvaluator<2> evaluator("a*b + 1", definition, options);
+		evaluator.Evaluate({ 2.0f, 3.0f }, true);
+		evaluator.Evaluate({ 2.0f, 3.0f }, true);
+		ExpectStats("MathEvaluator", evaluator.GetCacheStats(), 1, 1, 1, 0);
+		evaluator.ClearCache();
+		if (evaluator.Evaluate({ 2.0f, 3.0f }) != 7.0f)
+			Fail("MathEvaluator: wrong value after ClearCache");
+		ExpectStats("MathEvaluator after ClearCache", evaluator.GetCacheStats(), 0, 1, 0, 0);
+	}
+}
+
+int main()
+{
+	Lru();
+	Clock();
+	DirectMapped();
+	Keys();
+	Stats();
+	Sharded();
+	Evaluator();
+	for (MathEval::cache_policy policy : { MathEval::cache_policy::LRU, MathEval::cache_policy::CLOCK, MathEval::cache_policy::DIRECT_MAPPED })
+	{
+		for (size_t shards : { 0, 1, 4 })
+		{
+			Concurrent(policy, shards, false);
+			Concurrent(policy, shards, true);
+		}
+	}
+	std::printf("cache: %zu failures\n", failures);
+	return failures ? 1 : 0;
+}
+#endif
@@ -0,0 +1,302 @@
+// comment out the below definition if using elsewhere
+// uncomment out below definition to run the command line tool test
+//#define MATH_EVAL_CLI_TEST_MAIN
+#ifdef MATH_EVAL_CLI_TEST_MAIN
+#include "../include/ExpressionEvaluation.h"
+#include "test_util.h"
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+/*
+ runs the built matheval_cli (its path is the one argument, cmake passes it) on files written here:
+   - csv in, csv out: every row against MathEvaluator::Evaluate under --precision exact, bit for bit, read from stdin,
+     from a mapped file and with --no-mmap, in batches small enough that the rows take many trips round the buffers
+   - the default precision against EvaluateBatch, which runs the same kernels
+   - --header with columns picked by name, a ';' delimiter, CRLF, blank lines, spaces and '+' signs, unread columns
+   - f32 records in and out, and either one against csv
+   - bad input: a field that isn't a number, a short row, an unknown column name, a truncated record, a column past
+     --columns, a syntax error, a variable mapped twice, a missing file, each exits 1 with its own message on stderr,
+     unknown options exit 2 with the usage
+ the files go in the temp directory with the pid in their names, so runs at the same time (ctest -j, two build trees)
+ keep to their own, and are removed at the end
+*/
+
+namespace
+{
+	using namespace MathEvalTest;
+
+	std::string cli;
+	std::string input_file, output_file, error_file;
+	size_t rows_checked = 0;
+
+	// temp directory/matheval_cli_test.<pid>.<suffix>
+	std::string TempName(const char* suffix)
+	{
+#ifdef _WIN32
+		int pid = _getpid();
+#else
+		int pid = static_cast<int>(getpid());
+#endif
+		std::string name = "matheval_cli_test." + std::to_string(pid) + "." + suffix;
+		return (std::filesystem::temp_directory_path() / name).string();
+	}
+
+	std::string Quoted(const std::string& path)
+	{
+		return "\"" + path + "\"";
+	}
+
+	void WriteFile(const std::string& name, const std::string& data)
+	{
+		std::ofstream file(name, std::ios::binary);
+		file.write(data.data(), static_cast<std::streamsize>(data.size()));
+	}
+
+	std::string ReadFile(const std::string& name)
+	{
+		std::ifstream file(name, std::ios::binary);
+		std::stringstream data;
+		data << file.rdbuf();
+		return data.str();
+	}
+
+	struct result
+	{
+		int code = -1;
+		std::string out, err;
+	};
+
+	// arguments as the shell sees them, stdin from input_file when redirect is set
+	result Run(const std::string& arguments, bool redirect)
+	{
+		std::string command = "\"" + cli + "\" --quiet " + arguments + (redirect ? " < " + Quoted(input_file) : "")
+			+ " > " + Quoted(output_file) + " 2> " + Quoted(error_file);
+#ifdef _WIN32
+		command = "\"" + command + "\""; // cmd strips one pair of quotes around the whole line
+#endif
+		result r;
+		int status = std::system(command.c_str());
+#ifdef _WIN32
+		r.code = status;
+#else
+		r.code = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+#endif
+		r.out = ReadFile(output_file);
+		r.err = ReadFile(error_file);
+		return r;
+	}
+
+	std::string ToText(float value)
+	{
+		char text[32];
+		return std::string(text, std::to_chars(text, text + sizeof(text), value).ptr);
+	}
+
+	std::string F32(const std::vector<float>& values)
+	{
+		std::string data(values.size() * sizeof(float), '\0');
+		std::memcpy(&data[0], values.data(), data.size());
+		return data;
+	}
+
+	std::vector<float> ParseCsvOutput(const std::string& text)
+	{
+		std::vector<float> values;
+		size_t begin = 0;
+		while (begin < text.size())
+		{
+			size_t end = text.find('\n', begin);
+			if (end == std::string::npos)
+				end = text.size();
+			float value = NAN;
+			std::from_chars(text.data() + begin, text.data() + end, value);
+			values.push_back(value);
+			begin = end + 1;
+		}
+		return values;
+	}
+
+	std::vector<float> ParseF32Output(const std::string& data)
+	{
+		std::vector<float> values(data.size() / sizeof(float));
+		if (!values.empty())
+			std::memcpy(values.data(), data.data(), values.size() * sizeof(float));
+		return values;
+	}
+
+	void Compare(const std::string& what, const result& r, const std::vector<float>& got, const std::vector<float>& expected)
+	{
+		if (r.code != 0)
+		{
+			Fail(what + ": exit code " + std::to_string(r.code) + ", " + r.err);
+			return;
+		}
+		if (got.size() != expected.size())
+		{
+			Fail(what + ": " + std::to_string(got.size()) + " rows out for " + std::to_string(expected.size()) + " in");
+			return;
+		}
+		for (size_t i = 0; i < got.size(); i++)
+		{
+			rows_checked++;
+			if (!Same(got[i], expected[i]))
+			{
+				Fail(what + ": row " + std::to_string(i) + " is " + ToText(got[i]) + ", the evaluator gives " + ToText(expected[i]));
+				return;
+			}
+		}
+	}
+
+	void Diagnostic(const std::string& what, const std::string& data, const std::string& arguments, int code, const std::string& message)
+	{
+		WriteFile(input_file, data);
+		result r = Run(arguments, true);
+		if (r.code != code || r.err.find(message) == std::string::npos)
+			Fail(what + ": exit code " + std::to_string(r.code) + " and \"" + r.err + "\", expected " + std::to_string(code) + " and \"" + message + "\"");
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc != 2)
+	{
+		std::printf("usage: %s <path of matheval_cli>\n", argv[0]);
+		return 1;
+	}
+	cli = argv[1];
+	input_file = TempName("in");
+	output_file = TempName("out");
+	error_file = TempName("err");
+
+	// rows of x, y, z, with the specials to_chars and from_chars have to get across
+	const size_t ROWS = 2503;
+	std::vector<std::array<float, 3>> rows(ROWS);
+	uint32_t state = 7;
+	for (size_t i = 0; i < ROWS; i++)
+	{
+		for (float& v : rows[i])
+		{
+			state = state * 1664525u + 1013904223u;
+			v = (static_cast<float>(state >> 8) / 16777216.0f - 0.5f) * 20.0f;
+		}
+	}
+	rows[3] = { 0.0f, -0.0f, 1e-40f };
+	rows[4] = { INFINITY, -INFINITY, NAN };
+	rows[5] = { 3e38f, -1e-30f, 1.0f };
+
+	const std::string text = "sin(x)*exp(y/4) - z^2 + x/y";
+	std::unordered_map<std::string, size_t> definition = { { "x", 0 }, { "y", 1 }, { "z", 2 } };
+	MathEvaluator<3> exact(text, definition, Options(true, false, MathEval::precision::EXACT));
+	MathEvaluator<3> fast(text, definition, Options(true, false, MathEval::precision::DEFAULT));
+	std::vector<float> expected(ROWS), expected_fast(ROWS);
+	std::vector<float> columns[3];
+	for (size_t s = 0; s < 3; s++)
+		for (size_t i = 0; i < ROWS; i++)
+			columns[s].push_back(rows[i][s]);
+	for (size_t i = 0; i < ROWS; i++)
+		expected[i] = exact.Evaluate(rows[i]);
+	fast.EvaluateBatch({ columns[0].data(), columns[1].data(), columns[2].data() }, expected_fast.data(), ROWS);
+
+	std::string csv;
+	for (const auto& row : rows)
+		csv += ToText(row[0]) + "," + ToText(row[1]) + "," + ToText(row[2]) + "\n";
+	const std::string mapping = " \"" + text + "\" x=0 y=1 z=2";
+
+	// csv round trip, every way of reading the input
+	WriteFile(input_file, csv);
+	result r = Run("--precision exact --batch 100 --buffers 2" + mapping, true);
+	Compare("csv from stdin", r, ParseCsvOutput(r.out), expected);
+	r = Run("--input " + Quoted(input_file) + " --precision exact --batch 64" + mapping, false);
+	Compare("csv from a mapped file", r, ParseCsvOutput(r.out), expected);
+	r = Run("--input " + Quoted(input_file) + " --no-mmap --precision exact --batch 1000" + mapping, false);
+	Compare("csv read with --no-mmap", r, ParseCsvOutput(r.out), expected);
+	r = Run(mapping, true);
+	Compare("csv under the default precision", r, ParseCsvOutput(r.out), expected_fast);
+	r = Run("--precision exact --output-format f32" + mapping, true);
+	Compare("csv in, f32 out", r, ParseF32Output(r.out), expected);
+
+	// the last line without its newline
+	WriteFile(input_file, csv.substr(0, csv.size() - 1));
+	r = Run("--precision exact" + mapping, true);
+	Compare("csv without a final newline", r, ParseCsvOutput(r.out), expected);
+
+	// header, names in another order, ';', CRLF, blank lines, padding and '+', a column nobody reads
+	std::string named = "\"z\" ; unused ; x ; y\r\n\r\n";
+	for (size_t i = 0; i < ROWS; i++)
+	{
+		named += "  " + ToText(rows[i][2]) + " ;7; " + (std::signbit(rows[i][0]) ? "" : "+") + ToText(rows[i][0]) + "\t; " + ToText(rows[i][1]) + "\r\n";
+		if (i % 500 == 0)
+			named += "\n";
+	}
+	WriteFile(input_file, named);
+	r = Run("--header --delimiter \";\" --precision exact \"" + text + "\" x=x y=y z=z", true);
+	Compare("csv with a header", r, ParseCsvOutput(r.out), expected);
+
+	// f32 records of 4 floats, slots read columns 0, 3 and 1
+	std::vector<float> records;
+	for (const auto& row : rows)
+	{
+		records.push_back(row[0]);
+		records.push_back(row[2]);
+		records.push_back(-1.0f);
+		records.push_back(row[1]);
+	}
+	WriteFile(input_file, F32(records));
+	const std::string record_mapping = " --format f32 --columns 4 --precision exact \"" + text + "\" x=0 y=3 z=1";
+	r = Run("--output-format f32 --batch 333" + record_mapping, true);
+	Compare("f32 in, f32 out", r, ParseF32Output(r.out), expected);
+	r = Run("--input " + Quoted(input_file) + record_mapping, false);
+	Compare("f32 from a mapped file, csv out", r, ParseCsvOutput(r.out), expected);
+	r = Run("--input " + Quoted(input_file) + " --output " + Quoted(output_file + ".f32") + " --output-format f32" + record_mapping, false);
+	r.out = ReadFile(output_file + ".f32");
+	std::remove((output_file + ".f32").c_str());
+	Compare("f32 to --output", r, ParseF32Output(r.out), expected);
+
+	// values past float range still parse, to inf like strtof
+	WriteFile(input_file, "1e60,1,1\n");
+	r = Run("\"x\" x=0", true);
+	if (r.code != 0 || r.out != "inf\n")
+		Fail("1e60: \"" + r.out + "\", exit code " + std::to_string(r.code));
+
+	// diagnostics
+	Diagnostic("not a number", "1,2,3\n4,abc,6\n", mapping, 1, "line 2, column 1: not a number");
+	Diagnostic("short row", "1,2,3\n\n4,5\n", mapping, 1, "line 3: 2 columns, column 2 is read");
+	Diagnostic("unknown name", "x,y\n1,2\n", "--header \"x+w\" x=x w=w", 1, "no column named w");
+	Diagnostic("name without a header", "1,2\n", "\"x\" x=first", 1, "no column named first (names need --header)");
+	Diagnostic("truncated record", F32({ 1.0f, 2.0f, 3.0f }).substr(0, 10), "--format f32 --columns 2 \"x\" x=0", 1,
+		"input ends inside a record, 2 bytes left");
+	Diagnostic("column past the record", F32({ 1.0f, 2.0f }), "--format f32 --columns 2 \"x\" x=5", 1, "column 5 is past --columns");
+	Diagnostic("syntax error", "1\n", "\"x+\" x=0", 1, "syntax error at offset 2");
+	Diagnostic("mapped twice", "1,2\n", "\"x\" x=0 x=1", 1, "variable x is mapped twice");
+	Diagnostic("unknown variable", "1\n", "\"x*q\" x=0", 1, "unknown variable: q");
+	Diagnostic("unknown format", "1\n", "--format xml \"x\" x=0", 2, "usage:");
+	Diagnostic("f32 without --columns", "1\n", "--format f32 \"x\" x=0", 2, "usage:");
+	Diagnostic("one buffer", "1\n", "--buffers 1 \"x\" x=0", 2, "usage:");
+	r = Run("--input matheval_cli_test.missing \"x\" x=0", false);
+	if (r.code != 1 || r.err.find("can't read matheval_cli_test.missing") == std::string::npos)
+		Fail("missing input: exit code " + std::to_string(r.code) + ", \"" + r.err + "\"");
+
+	std::remove(input_file.c_str());
+	std::remove(output_file.c_str());
+	std::remove(error_file.c_str());
+	std::printf("cli: %zu rows checked, %zu failures\n", rows_checked, failures);
+	return failures ? 1 : 0;
+}
+#endif
@@ -0,0 +1,238 @@
+// comment out the below definition if using elsewhere
+// uncomment out below definition to run the differential test
+//#define MATH_EVAL_DIFFERENTIAL_TEST_MAIN
+#ifdef MATH_EVAL_DIFFERENTIAL_TEST_MAIN
+#include "../include/ExpressionEvaluation.h"
+#include "test_util.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+ every evaluation path against EvaluateTree on the unoptimized tree, which is the reference the compiled program,
+ the optimizer, the jit and the batch kernels all have to agree with bit for bit:
+   Evaluate (interpreter and jit) under DEFAULT
+   EvaluateBatch and EvaluateParallel (interpreter and jit kernels) under EXACT
+ inputs are a fixed set of awkward values (+-0, +-inf, NaN, denormals, huge) in every slot
+ under ULP1/2/4 Evaluate with folding is checked against Evaluate without it, EvaluateTree stays on libm there
+ the jit against the interpreter under DEFAULT and ULP1/2/4, scalar against Evaluate, batch against the avx2 kernel
+ the value of EvaluateWithGradient and RunGradient against Evaluate, in every precision
+ the batch paths also get nullptr for the columns of slots an expression never reads, with counts off the block size
+ a NaN result only has to be a NaN, its sign and payload are whatever the hardware made of it
+ exits 1 on the first few mismatches, printing them
+*/
+
+namespace
+{
+	using namespace MathEvalTest;
+
+	static const size_t SLOTS = 4;
+
+	std::unordered_map<std::string, size_t> Definition()
+	{
+		return { { "a", 0 }, { "b", 1 }, { "c", 2 }, { "d", 3 } };
+	}
+
+	std::vector<std::string> Corpus()
+	{
+		std::vector<std::string> corpus = {
+			"a+b",
+			"a * sin(3.14) - cos(2)",
+			"sin(a)*cos(b) + exp(a/10) - a*b/(1+a*a)",
+			"sin(a*b)*c + sin(a*b)*d + exp(c/(1+d*d)) - a/b",
+			"a^4 - 3*b^3 + c^-2 + d^0.5",
+			"a*a*a*a - 3*b*b*b + 1/(c*c) + sqrt(d)",
+			"tan(a)*arctan(b) + sqrt(c*c + d*d) - arcsin(a/4) + -arccos(b/4)",
+			// identities the strict optimizer has to leave alone or get exactly right
+			"a*1 + 0*b - (c-0) + d/1",
+			"a+0",
+			"0-a",
+			"a*0",
+			"a-a",
+			"a/a",
+			"-(-a) + --b",
+			"(a+b)*(a+b) - (a+b)",
+			"2*3*a + 4/8 - exp(0) + sin(0)*b",
+			"a^b + b^0 + c^1 + d^2",
+			"1/a + 1/b",
+			"sqrt(a) * arcsin(b) + arccos(c) - tan(d)",
+			"exp(a*a) - exp(-b*b)",
+		};
+		// long and flat
+		std::string flat;
+		for (int i = 0; i < 64; i++)
+		{
+			if (i)
+				flat += i % 3 ? " + " : " - ";
+			flat += std::string(1, static_cast<char>('a' + i % 4)) + "*" + std::to_string(i + 1);
+		}
+		corpus.push_back(flat);
+		// deep
+		std::string deep = "a";
+		for (int i = 0; i < 32; i++)
+			deep = (i % 2 ? "cos(" : "sin(") + deep + "+b)";
+		corpus.push_back(deep);
+		return corpus;
+	}
+
+	std::vector<float> Values()
+	{
+		return { 0.0f, -0.0f, 1.0f, -1.0f, 0.5f, -2.5f, 3.0f, 100.0f, 1e-40f, -1e-40f, 1e30f, -1e30f,
+			INFINITY, -INFINITY, NAN };
+	}
+
+	void Check(const std::string& text, const char* path, const std::array<float, SLOTS>& inputs, float expected, float got)
+	{
+		if (Same(expected, got))
+			return;
+		char at[192];
+		std::snprintf(at, sizeof(at), " at (%g, %g, %g, %g) gives %.9g, the reference gives %.9g", inputs[0], inputs[1], inputs[2], inputs[3],
+			got, expected);
+		Fail(text + ": " + path + at);
+	}
+}
+
+int main()
+{
+	MathEvaluator<SLOTS>::Setup();
+	std::unordered_map<std::string, size_t> definition = Definition();
+	std::vector<float> values = Values();
+
+	// every combination of values over the 4 slots, as columns for the batch paths
+	size_t count = 1;
+	for (size_t s = 0; s < SLOTS; s++)
+		count *= values.size();
+	std::vector<std::array<float, SLOTS>> points(count);
+	std::vector<float> columns[SLOTS];
+	for (size_t s = 0; s < SLOTS; s++)
+		columns[s].resize(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		size_t rest = i;
+		for (size_t s = 0; s < SLOTS; s++)
+		{
+			points[i][s] = columns[s][i] = values[rest % values.size()];
+			rest /= values.size();
+		}
+	}
+	std::array<const float*, SLOTS> column_pointers;
+	for (size_t s = 0; s < SLOTS; s++)
+		column_pointers[s] = columns[s].data();
+
+	MathEval::thread_pool_options pool_options;
+	pool_options.threads = 4;
+	MathEval::thread_pool pool(pool_options);
+	std::vector<float> expected(count), output(count);
+	for (const std::string& text : Corpus())
+	{
+		MathEvaluator<SLOTS> reference(text, definition, Options(false, false, MathEval::precision::DEFAULT));
+		for (size_t i = 0; i < count; i++)
+			expected[i] = reference.EvaluateTree(points[i]);
+
+		for (bool jit : { false, true })
+		{
+			const char* scalar_path = jit ? "jit Evaluate" : "Evaluate";
+			MathEvaluator<SLOTS> scalar(text, definition, Options(true, jit, MathEval::precision::DEFAULT));
+			for (size_t i = 0; i < count; i++)
+				Check(text, scalar_path, points[i], expected[i], scalar.Evaluate(points[i]));
+
+			MathEvaluator<SLOTS> exact(text, definition, Options(true, jit, MathEval::precision::EXACT));
+			exact.EvaluateBatch(column_pointers, output.data(), count);
+			for (size_t i = 0; i < count; i++)
+				Check(text, jit ? "jit EvaluateBatch" : "EvaluateBatch", points[i], expected[i], output[i]);
+			std::fill(output.begin(), output.end(), 0.0f);
+			exact.EvaluateParallel(column_pointers, output.data(), count, pool, 97);
+			for (size_t i = 0; i < count; i++)
+				Check(text, jit ? "jit EvaluateParallel" : "EvaluateParallel", points[i], expected[i], output[i]);
+		}
+	}
+
+	// folding has to give what Evaluate gets for the same function at run time, in every precision
+	for (MathEval::precision precision : { MathEval::precision::ULP1, MathEval::precision::ULP2, MathEval::precision::ULP4 })
+	{
+		for (const char* text : { "sin(1)*a + cos(2) - exp(0.5)*b", "exp(sin(0.25) + cos(3))*c" })
+		{
+			for (bool jit : { false, true })
+			{
+				MathEvaluator<SLOTS> unfolded(text, definition, Options(false, jit, precision));
+				MathEvaluator<SLOTS> folded(text, definition, Options(true, jit, precision));
+				for (size_t i = 0; i < count; i += 7)
+					Check(text, MathEval::GetPrecisionName(precision), points[i], unfolded.Evaluate(points[i]), folded.Evaluate(points[i]));
+			}
+		}
+	}
+
+	// the jit against the interpreter in the precisions with polynomials, scalar against Evaluate and batch against
+	// the avx2 kernel it copies (jit.h)
+	std::vector<float> kernel(count);
+	for (MathEval::precision precision : { MathEval::precision::DEFAULT, MathEval::precision::ULP1, MathEval::precision::ULP2,
+		MathEval::precision::ULP4 })
+	{
+		for (const std::string& text : Corpus())
+		{
+			MathEvaluator<SLOTS> interpreter(text, definition, Options(true, false, precision));
+			MathEvaluator<SLOTS> jit(text, definition, Options(true, true, precision));
+			for (size_t i = 0; i < count; i += 3)
+				Check(text, "jit Evaluate against the interpreter", points[i], interpreter.Evaluate(points[i]), jit.Evaluate(points[i]));
+			if (!jit.IsJitCompiled() || MathEval::GetSupportedIsa() < MathEval::isa::AVX2)
+				continue;
+			jit.EvaluateBatch(column_pointers, output.data(), count);
+			MathEval::RunBatch(interpreter.GetCompiled()->prog, column_pointers.data(), kernel.data(), count, MathEval::isa::AVX2, precision);
+			for (size_t i = 0; i < count; i++)
+				Check(text, "jit EvaluateBatch against RunBatch avx2", points[i], kernel[i], output[i]);
+		}
+	}
+
+	// the value EvaluateWithGradient returns is Evaluate's, forward mode (S = 4) and reverse mode alike
+	for (MathEval::precision precision : { MathEval::precision::DEFAULT, MathEval::precision::EXACT, MathEval::precision::ULP1,
+		MathEval::precision::ULP2, MathEval::precision::ULP4 })
+	{
+		for (const char* text : { "sin(a)*cos(b) + exp(a/10) - a*b/(1+a*a)", "exp(sin(c) + cos(d))*a", "sin(a*b)*c + sin(a*b)*d + exp(c/(1+d*d))" })
+		{
+			for (bool jit : { false, true })
+			{
+				MathEvaluator<SLOTS> evaluator(text, definition, Options(true, jit, precision));
+				std::array<float, SLOTS> gradient;
+				for (size_t i = 0; i < count; i += 7)
+				{
+					float value = evaluator.Evaluate(points[i]);
+					Check(text, "EvaluateWithGradient", points[i], value, evaluator.EvaluateWithGradient(points[i], gradient));
+					Check(text, "RunGradient", points[i], value,
+						MathEval::RunGradient(evaluator.GetCompiled()->gradient_program, points[i].data(), gradient.data(), SLOTS, precision));
+				}
+			}
+		}
+	}
+
+	// only b is read, the other columns are nullptr as EvaluateParallel passes them on
+	for (const char* text : { "b*2+sin(b)", "b", "3" })
+	{
+		MathEvaluator<SLOTS> reference(text, definition, Options(false, false, MathEval::precision::DEFAULT));
+		std::array<const float*, SLOTS> sparse = { nullptr, column_pointers[1], nullptr, nullptr };
+		for (bool jit : { false, true })
+		{
+			MathEvaluator<SLOTS> exact(text, definition, Options(true, jit, MathEval::precision::EXACT));
+			for (size_t sparse_count : { size_t(1), size_t(7), size_t(100), size_t(5000) + 3 })
+			{
+				exact.EvaluateBatch(sparse, output.data(), sparse_count);
+				for (size_t i = 0; i < sparse_count; i++)
+					Check(text, jit ? "jit EvaluateBatch, nullptr columns" : "EvaluateBatch, nullptr columns", points[i],
+						reference.EvaluateTree(points[i]), output[i]);
+				exact.EvaluateParallel(sparse, output.data(), sparse_count, pool, 13);
+				for (size_t i = 0; i < sparse_count; i++)
+					Check(text, jit ? "jit EvaluateParallel, nullptr columns" : "EvaluateParallel, nullptr columns", points[i],
+						reference.EvaluateTree(points[i]), output[i]);
+			}
+		}
+	}
+
+	std::printf("differential: %zu expressions over %zu points, %zu mismatches\n", Corpus().size(), count, failures);
+	return failures ? 1 : 0;
+}
+#endif
@@ -0,0 +1,220 @@
+// comment out the below definition if using elsewhere
+// uncomment out below definition to run the gradient test
+//#define MATH_EVAL_GRADIENT_TEST_MAIN
+#ifdef MATH_EVAL_GRADIENT_TEST_MAIN
+#include "../include/ExpressionEvaluation.h"
+#include "test_util.h"
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+ partial derivatives against central differences of the same function written out in double (h = 1e-6, good to
+ about 1e-9), at random points of a domain that keeps clear of poles and of the edges of arcsin/sqrt:
+   - EvaluateWithGradient in forward mode (S <= 4) and reverse mode (S > 4), the same expressions at S = 4 and 5
+     so both sides of the switch-over get the same inputs, and the two modes have to agree with each other
+   - EvaluateBatchWithGradient, over a count that isn't a whole number of blocks and with nullptr for a slot
+ the value that comes with the gradient is Evaluate's (EvaluateBatch's for the batch) bit for bit,
+ partials of slots an expression never reads are exactly 0
+ a partial may be off by 2e-4 of the largest term it's made of, float rounding of the terms rather than of the result
+*/
+
+namespace
+{
+	using namespace MathEvalTest;
+
+	static const size_t MAX_SLOTS = 6;
+	static const char* const NAMES[MAX_SLOTS] = { "a", "b", "c", "d", "e", "f" };
+
+	typedef double (*function)(const double* x);
+
+	struct gradient_case
+	{
+		const char* text;
+		function f;
+		size_t slots; // reads a.. up to this many
+		double lo, hi;
+		double scale; // size of the largest term of a partial over the domain
+	};
+
+	std::vector<gradient_case> Cases()
+	{
+		return {
+			{ "sin(a)*cos(b) + exp(a/10) - a*b/(1+a*a)",
+				[](const double* x) { return std::sin(x[0]) * std::cos(x[1]) + std::exp(x[0] / 10) - x[0] * x[1] / (1 + x[0] * x[0]); },
+				2, -3.0, 3.0, 4.0 },
+			{ "a^3 - 2*b^-2 + sqrt(a*a + b*b) + a^0.5*b",
+				[](const double* x) { return std::pow(x[0], 3) - 2 * std::pow(x[1], -2) + std::sqrt(x[0] * x[0] + x[1] * x[1]) + std::sqrt(x[0]) * x[1]; },
+				2, 0.5, 2.5, 40.0 },
+			{ "tan(a/2)*arctan(b) + arcsin(a/3) - arccos(b/3)",
+				[](const double* x) { return std::tan(x[0] / 2) * std::atan(x[1]) + std::asin(x[0] / 3) - std::acos(x[1] / 3); },
+				2, -2.0, 2.0, 4.0 },
+			{ "a^b + pow(b, 2.5) - -a",
+				[](const double* x) { return std::pow(x[0], x[1]) + std::pow(x[1], 2.5) + x[0]; },
+				2, 0.5, 2.0, 8.0 },
+			// shared subtrees get the adjoints of all their parents
+			{ "sin(a*b)*c + sin(a*b)*d + exp(c/(1+d*d))",
+				[](const double* x) { return std::sin(x[0] * x[1]) * x[2] + std::sin(x[0] * x[1]) * x[3] + std::exp(x[2] / (1 + x[3] * x[3])); },
+				4, -1.5, 1.5, 20.0 },
+			{ "(a-b)*(a-b)*(c+d) / (1 + (c+d)*(c+d))",
+				[](const double* x) { return (x[0] - x[1]) * (x[0] - x[1]) * (x[2] + x[3]) / (1 + (x[2] + x[3]) * (x[2] + x[3])); },
+				4, -2.0, 2.0, 20.0 },
+			{ "a*b*c*d*e*f + sin(e-f) + exp(-e*e)/(1+f*f) + cos(a+c)*sqrt(b*b+1)",
+				[](const double* x) { return x[0] * x[1] * x[2] * x[3] * x[4] * x[5] + std::sin(x[4] - x[5]) + std::exp(-x[4] * x[4]) / (1 + x[5] * x[5])
+					+ std::cos(x[0] + x[2]) * std::sqrt(x[1] * x[1] + 1); },
+				6, -1.5, 1.5, 10.0 },
+		};
+	}
+
+	size_t checked = 0;
+
+	uint32_t state = 12345;
+	double Random(double lo, double hi)
+	{
+		state = state * 1664525u + 1013904223u;
+		return lo + (hi - lo) * static_cast<double>(state >> 8) / 16777216.0;
+	}
+
+	// central difference in double, at the float point the evaluator sees
+	double Partial(function f, const std::array<float, MAX_SLOTS>& point, size_t slot)
+	{
+		double x[MAX_SLOTS];
+		for (size_t s = 0; s < MAX_SLOTS; s++)
+			x[s] = point[s];
+		double h = 1e-6 * (1.0 + std::fabs(x[slot]));
+		x[slot] = point[slot] + h;
+		double up = f(x);
+		x[slot] = point[slot] - h;
+		double down = f(x);
+		return (up - down) / (2.0 * h);
+	}
+
+	void CheckPartial(const std::string& what, const gradient_case& c, const std::array<float, MAX_SLOTS>& point, size_t slot, float got)
+	{
+		checked++;
+		if (slot >= c.slots)
+		{
+			if (got != 0.0f)
+				Fail(what + ": d/d" + NAMES[slot] + " of " + c.text + " is " + std::to_string(got) + ", it never reads the slot");
+			return;
+		}
+		double expected = Partial(c.f, point, slot);
+		if (std::fabs(static_cast<double>(got) - expected) > 2e-4 * (c.scale + std::fabs(expected)))
+		{
+			char message[512];
+			std::snprintf(message, sizeof(message), "%s: d/d%s of %s at (%g, %g, %g, %g, %g, %g) is %.9g, central differences give %.9g",
+				what.c_str(), NAMES[slot], c.text, point[0], point[1], point[2], point[3], point[4], point[5], got, expected);
+			Fail(message);
+		}
+	}
+
+	template <size_t S>
+	MathEvaluator<S> Make(const gradient_case& c)
+	{
+		std::unordered_map<std::string, size_t> definition;
+		for (size_t s = 0; s < S; s++)
+			definition[NAMES[s]] = s;
+		return MathEvaluator<S>(c.text, definition, Options(true, false));
+	}
+
+	// EvaluateWithGradient and EvaluateBatchWithGradient at S slots, the first S coordinates of points
+	template <size_t S>
+	void Run(const gradient_case& c, const std::vector<std::array<float, MAX_SLOTS>>& points, std::vector<std::array<float, MAX_SLOTS>>& partials)
+	{
+		std::string mode = std::string(S <= 4 ? "forward" : "reverse") + " mode S = " + std::to_string(S);
+		MathEvaluator<S> evaluator = Make<S>(c);
+		partials.resize(points.size());
+		for (size_t i = 0; i < points.size(); i++)
+		{
+			std::array<float, S> inputs, gradient;
+			for (size_t s = 0; s < S; s++)
+				inputs[s] = points[i][s];
+			float value = evaluator.EvaluateWithGradient(inputs, gradient);
+			if (!Same(value, evaluator.Evaluate(inputs)))
+				Fail(mode + ": " + c.text + " value " + std::to_string(value) + " isn't Evaluate's");
+			partials[i].fill(0.0f);
+			for (size_t s = 0; s < S; s++)
+			{
+				CheckPartial(mode, c, points[i], s, gradient[s]);
+				partials[i][s] = gradient[s];
+			}
+		}
+
+		// the batch, slot 0 is skipped the second time round
+		size_t count = points.size();
+		std::vector<std::vector<float>> columns(S, std::vector<float>(count)), gradient(S, std::vector<float>(count));
+		std::vector<float> output(count), expected(count);
+		std::array<const float*, S> column_pointers;
+		for (size_t s = 0; s < S; s++)
+		{
+			for (size_t i = 0; i < count; i++)
+				columns[s][i] = points[i][s];
+			column_pointers[s] = columns[s].data();
+		}
+		evaluator.EvaluateBatch(column_pointers, expected.data(), count);
+		for (bool skip_first : { false, true })
+		{
+			std::array<float*, S> gradient_pointers;
+			for (size_t s = 0; s < S; s++)
+			{
+				std::fill(gradient[s].begin(), gradient[s].end(), NAN);
+				gradient_pointers[s] = skip_first && s == 0 ? nullptr : gradient[s].data();
+			}
+			evaluator.EvaluateBatchWithGradient(column_pointers, output.data(), gradient_pointers, count);
+			std::string batch = "batch " + mode + (skip_first ? ", d/da skipped" : "");
+			for (size_t i = 0; i < count; i++)
+			{
+				if (!Same(output[i], expected[i]))
+					Fail(batch + ": " + c.text + " value " + std::to_string(output[i]) + " isn't EvaluateBatch's " + std::to_string(expected[i]));
+				for (size_t s = skip_first ? 1 : 0; s < S; s++)
+					CheckPartial(batch, c, points[i], s, gradient[s][i]);
+			}
+			if (skip_first && !std::isnan(gradient[0][0]))
+				Fail(batch + ": " + c.text + " wrote the skipped column");
+		}
+	}
+}
+
+int main()
+{
+	const size_t POINTS = 203; // not a whole number of simd blocks
+	size_t expressions = 0;
+	for (const gradient_case& c : Cases())
+	{
+		std::vector<std::array<float, MAX_SLOTS>> points(POINTS);
+		for (auto& point : points)
+			for (float& x : point)
+				x = static_cast<float>(Random(c.lo, c.hi));
+
+		std::vector<std::array<float, MAX_SLOTS>> forward, reverse;
+		if (c.slots <= 2)
+			Run<2>(c, points, forward);
+		if (c.slots <= 4)
+		{
+			// both sides of the switch-over on the same points
+			Run<4>(c, points, forward);
+			Run<5>(c, points, reverse);
+			for (size_t i = 0; i < POINTS; i++)
+			{
+				for (size_t s = 0; s < c.slots; s++)
+				{
+					float f = forward[i][s], r = reverse[i][s];
+					if (std::fabs(f - r) > 1e-5f * (1.0f + std::fabs(f)))
+						Fail(std::string(c.text) + ": forward mode gives " + std::to_string(f) + " for d/d" + NAMES[s] + ", reverse mode "
+							+ std::to_string(r));
+				}
+			}
+		}
+		Run<6>(c, points, reverse);
+		expressions++;
+	}
+
+	std::printf("gradient: %zu expressions, %zu partials, %zu failures\n", expressions, checked, failures);
+	return failures ? 1 : 0;
+}
+#endif
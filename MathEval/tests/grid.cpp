@@ -0,0 +1,153 @@
+// comment out the below definition if using elsewhere
+// uncomment out below definition to run the grid test
+//#define MATH_EVAL_GRID_TEST_MAIN
+#ifdef MATH_EVAL_GRID_TEST_MAIN
+#include "../include/ExpressionEvaluation.h"
+#include "test_util.h"
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+ EvaluateGrid against Evaluate at every point of the grid, axes in every order with step counts that don't fill a
+ simd block, axes of one step wherever they sit, expressions with parts that hoist out of the rows and parts that don't
+   - EXACT: bit for bit, on every isa the cpu has (RunGrid directly)
+   - DEFAULT: the rows run the batch polynomials, within 1e-5 of the value (relative, absolute below 1)
+ an axis steps through lo + (hi - lo) * i / (steps - 1) worked out in double, that's what each point gets here too
+ a slot without an axis or with two throws std::invalid_argument
+*/
+
+namespace
+{
+	using namespace MathEvalTest;
+
+	static const size_t SLOTS = 3;
+
+	size_t points_checked = 0;
+
+	float Step(const MathEval::grid_axis& axis, size_t i)
+	{
+		size_t last = axis.steps > 1 ? axis.steps - 1 : 1;
+		return static_cast<float>(axis.lo + (static_cast<double>(axis.hi) - axis.lo) * i / last);
+	}
+
+	std::string Describe(const char* text, const std::array<MathEval::grid_axis, SLOTS>& axes)
+	{
+		std::string name = text;
+		for (const MathEval::grid_axis& axis : axes)
+			name += std::string(axis.slot == 0 ? " a" : axis.slot == 1 ? " b" : " c") + "x" + std::to_string(axis.steps);
+		return name;
+	}
+
+	// the point of every output index, axes[0] outermost
+	void Compare(const std::string& name, MathEvaluator<SLOTS>& evaluator, const std::array<MathEval::grid_axis, SLOTS>& axes,
+		const std::vector<float>& output, bool exact)
+	{
+		size_t size = output.size();
+		for (size_t index = 0; index < size; index++)
+		{
+			std::array<float, SLOTS> point;
+			size_t rest = index;
+			for (size_t k = SLOTS; k-- > 0;)
+			{
+				point[axes[k].slot] = Step(axes[k], rest % axes[k].steps);
+				rest /= axes[k].steps;
+			}
+			float expected = evaluator.Evaluate(point);
+			float got = output[index];
+			points_checked++;
+			bool ok = exact ? Same(expected, got)
+				: Same(expected, got) || std::fabs(got - expected) <= 1e-5f * std::fmax(1.0f, std::fabs(expected));
+			if (!ok)
+			{
+				char message[256];
+				std::snprintf(message, sizeof(message), "%s: %s at (%.9g, %.9g, %.9g) is %.9g, Evaluate gives %.9g", name.c_str(),
+					exact ? "EXACT" : "DEFAULT", point[0], point[1], point[2], got, expected);
+				Fail(message);
+				return;
+			}
+		}
+	}
+}
+
+int main()
+{
+	std::unordered_map<std::string, size_t> definition = { { "a", 0 }, { "b", 1 }, { "c", 2 } };
+	const std::vector<const char*> corpus = {
+		"sin(a)*exp(b)",
+		"a*b + c",
+		"exp(c)*cos(a+b) - sqrt(b*b + 1)",
+		"sin(a*b)*c + sin(a*b)*c*c",
+		"b^2 + a^-1 + tan(c/4) - arctan(a*c)",
+		"arcsin(c/9) * a^b",
+		"a",
+		"2*c + exp(1)",
+	};
+
+	// slot order per axis position and steps per axis, 1 step axes in front, middle and back
+	const std::array<std::array<uint32_t, SLOTS>, 6> orders = { { { 0, 1, 2 }, { 0, 2, 1 }, { 1, 0, 2 }, { 1, 2, 0 }, { 2, 0, 1 }, { 2, 1, 0 } } };
+	const std::array<std::array<size_t, SLOTS>, 5> shapes = { { { 5, 7, 19 }, { 1, 9, 33 }, { 4, 1, 11 }, { 6, 3, 1 }, { 1, 1, 1 } } };
+	const float LO[SLOTS] = { 0.25f, -1.5f, -3.0f }, HI[SLOTS] = { 2.5f, 1.75f, 4.0f };
+
+	std::vector<MathEval::isa> targets;
+	for (MathEval::isa target : { MathEval::isa::SCALAR, MathEval::isa::SSE4, MathEval::isa::AVX2, MathEval::isa::AVX512 })
+		if (target <= MathEval::GetSupportedIsa())
+			targets.push_back(target);
+
+	std::vector<float> output;
+	for (const char* text : corpus)
+	{
+		MathEvaluator<SLOTS> exact(text, definition, Options(true, false, MathEval::precision::EXACT));
+		MathEvaluator<SLOTS> fast(text, definition, Options(true, false, MathEval::precision::DEFAULT));
+		for (const auto& order : orders)
+		{
+			for (const auto& shape : shapes)
+			{
+				std::array<MathEval::grid_axis, SLOTS> axes;
+				for (size_t k = 0; k < SLOTS; k++)
+					axes[k] = { order[k], LO[order[k]], HI[order[k]], shape[k] };
+				std::string name = Describe(text, axes);
+				output.assign(MathEval::GetGridSize(axes.data(), SLOTS), NAN);
+
+				fast.EvaluateGrid(axes, output.data());
+				Compare(name, fast, axes, output, false);
+				for (MathEval::isa target : targets)
+				{
+					std::fill(output.begin(), output.end(), NAN);
+					MathEval::RunGrid(exact.GetGradientProgram(), axes.data(), SLOTS, output.data(), target, MathEval::precision::EXACT);
+					Compare(name + " on " + MathEval::GetIsaName(target), exact, axes, output, true);
+				}
+			}
+		}
+	}
+
+	// slots without an axis or with two
+	{
+		MathEvaluator<SLOTS> evaluator("a+b+c", definition, Options(true, false, MathEval::precision::DEFAULT));
+		std::array<MathEval::grid_axis, SLOTS> twice = { { { 0, 0.0f, 1.0f, 3 }, { 1, 0.0f, 1.0f, 3 }, { 0, 0.0f, 1.0f, 3 } } };
+		std::vector<float> out(27);
+		for (int attempt = 0; attempt < 2; attempt++)
+		{
+			try
+			{
+				if (attempt == 0)
+					evaluator.EvaluateGrid(twice, out.data());
+				else
+					MathEval::RunGrid(evaluator.GetGradientProgram(), twice.data(), 2, out.data(), MathEval::GetSupportedIsa());
+				Fail(attempt == 0 ? "two axes for a: nothing thrown" : "no axis for c: nothing thrown");
+			}
+			catch (const std::invalid_argument&)
+			{
+			}
+		}
+	}
+
+	std::printf("grid: %zu expressions, %zu points, %zu failures\n", corpus.size(), points_checked, failures);
+	return failures ? 1 : 0;
+}
+#endif
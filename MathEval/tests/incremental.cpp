@@ -0,0 +1,156 @@
+// comment out the below definition if using elsewhere
+// uncomment out below definition to run the incremental evaluator test
+//#define MATH_EVAL_INCREMENTAL_TEST_MAIN
+#ifdef MATH_EVAL_INCREMENTAL_TEST_MAIN
+#include "../include/ExpressionEvaluation.h"
+#include "test_util.h"
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+ incremental_evaluator (incremental.h) against MathEvaluator::Evaluate bit for bit, in every precision
+ random walks over the inputs: one slot changed through Set or Evaluate, a few at once, all of them, none,
+ +0 to -0 and NaN to NaN, with an Invalidate now and then; 12 slots, and 70 so the slot masks take two words
+ a call that changes nothing must not recompute anything
+*/
+
+namespace
+{
+	using namespace MathEvalTest;
+
+	const float AWKWARD[] = { 0.0f, -0.0f, 1.0f, -1.0f, 0.5f, -2.5f, 3.0f, 100.0f, 1e-40f, 1e30f, -1e30f, INFINITY, -INFINITY, NAN };
+
+	uint32_t state = 2463534242u;
+	uint32_t Next() { state ^= state << 13; state ^= state >> 17; state ^= state << 5; return state; }
+
+	float RandomValue()
+	{
+		if (Next() % 4 == 0)
+			return AWKWARD[Next() % (sizeof(AWKWARD) / sizeof(AWKWARD[0]))];
+		return (static_cast<float>(Next() % 20001) - 10000.0f) / 1000.0f;
+	}
+
+	void Mismatch(const std::string& text, const char* what, size_t step, float expected, float got)
+	{
+		char message[128];
+		std::snprintf(message, sizeof(message), " at step %zu gives %.9g, Evaluate %.9g", step, got, expected);
+		Fail(text + ": " + what + message);
+	}
+
+	template <size_t S>
+	void Walk(const std::string& text, std::unordered_map<std::string, size_t>& definition, MathEval::precision precision)
+	{
+		MathEvaluator<S> evaluator(text, definition, Options(true, false, precision));
+		MathEval::incremental_evaluator incremental = evaluator.CreateIncremental();
+
+		// Set before any Evaluate, the other inputs are 0
+		{
+			MathEval::incremental_evaluator fresh = evaluator.CreateIncremental();
+			std::array<float, S> zeros = {};
+			zeros[S - 1] = 0.75f;
+			float got = fresh.Set(S - 1, 0.75f);
+			if (!Same(evaluator.Evaluate(zeros), got))
+				Mismatch(text, "Set on a fresh evaluator", 0, evaluator.Evaluate(zeros), got);
+		}
+
+		std::array<float, S> inputs;
+		for (size_t s = 0; s < S; s++)
+			inputs[s] = RandomValue();
+		// Set on a fresh evaluator would start from zeros instead
+		incremental.Evaluate(inputs.data());
+		for (size_t step = 0; step < 3000; step++)
+		{
+			uint32_t kind = Next() % 8;
+			if (kind == 0)
+			{
+				// one slot through Set
+				size_t slot = Next() % S;
+				inputs[slot] = RandomValue();
+				float got = incremental.Set(slot, inputs[slot]);
+				float expected = evaluator.Evaluate(inputs);
+				if (!Same(expected, got))
+					Mismatch(text, "Set", step, expected, got);
+				continue;
+			}
+			if (kind == 1)
+			{
+				// nothing changes, a NaN input stays the same NaN
+				incremental.Evaluate(inputs.data());
+				float got = incremental.Evaluate(inputs.data());
+				if (incremental.GetLastRecomputed() != 0)
+					Mismatch(text, "unchanged inputs recomputed", step, 0.0f, static_cast<float>(incremental.GetLastRecomputed()));
+				if (!Same(evaluator.Evaluate(inputs), got))
+					Mismatch(text, "Evaluate, nothing changed", step, evaluator.Evaluate(inputs), got);
+				continue;
+			}
+			if (kind == 2)
+			{
+				// the sign of a zero is a change
+				size_t slot = Next() % S;
+				inputs[slot] = std::signbit(inputs[slot]) ? 0.0f : -0.0f;
+			}
+			else if (kind == 3)
+			{
+				for (size_t s = 0; s < S; s++)
+					inputs[s] = RandomValue();
+			}
+			else if (kind == 4 && Next() % 16 == 0)
+				incremental.Invalidate(); // Evaluate below starts over from inputs
+			else
+			{
+				// one to three slots, possibly the same one twice
+				for (uint32_t k = 0, changes = 1 + Next() % 3; k < changes; k++)
+					inputs[Next() % S] = RandomValue();
+			}
+			float got = incremental.Evaluate(inputs.data());
+			float expected = evaluator.Evaluate(inputs);
+			if (!Same(expected, got))
+				Mismatch(text, "Evaluate", step, expected, got);
+			if (incremental.GetLastRecomputed() > incremental.GetNumOfInstructions())
+				Mismatch(text, "recomputed more than the program", step, static_cast<float>(incremental.GetNumOfInstructions()),
+					static_cast<float>(incremental.GetLastRecomputed()));
+		}
+	}
+}
+
+int main()
+{
+	MathEvaluator<12>::Setup();
+	std::unordered_map<std::string, size_t> twelve;
+	for (size_t s = 0; s < 12; s++)
+		twelve[std::string(1, static_cast<char>('a' + s))] = s;
+	std::unordered_map<std::string, size_t> seventy;
+	for (size_t s = 0; s < 70; s++)
+		seventy["x" + std::to_string(s)] = s;
+
+	std::vector<std::string> corpus = {
+		"a+b",
+		"sin(a)*cos(b) + exp(c/10) - d*e/(1+f*f) + g^h - sqrt(i) + tan(j)*arctan(k) - arcsin(l/4)",
+		"sin(a*b)*c + sin(a*b)*d + exp(c/(1+d*d)) - a/b + (e+f)*(e+f) - (g+h)*(i+j) + k^2 + l^0.5",
+		"a*1 + 0*b - (c-0) + d/1 + -(-e) + f-f + g/g + h*0",
+		"exp(sin(a) + cos(b)) * exp(sin(a) - cos(b)) + 2*3 - exp(1)",
+		"3",
+	};
+	size_t walks = 0;
+	for (MathEval::precision precision : { MathEval::precision::DEFAULT, MathEval::precision::EXACT, MathEval::precision::ULP1,
+		MathEval::precision::ULP2, MathEval::precision::ULP4 })
+	{
+		for (const std::string& text : corpus)
+		{
+			Walk<12>(text, twelve, precision);
+			walks++;
+		}
+		Walk<70>("x0*x1 + sin(x63) - x64*cos(x65) + exp(x69/100) - x3", seventy, precision);
+		walks++;
+	}
+
+	std::printf("incremental: %zu walks of 3000 steps, %zu failures\n", walks, failures);
+	return failures ? 1 : 0;
+}
+#endif
@@ -0,0 +1,249 @@
+// comment out the below definition if using elsewhere
+// uncomment out below definition to run the interval test
+//#define MATH_EVAL_INTERVAL_TEST_MAIN
+#ifdef MATH_EVAL_INTERVAL_TEST_MAIN
+#include "../include/ExpressionEvaluation.h"
+#include "test_util.h"
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+ EvaluateInterval has to hold what Evaluate returns anywhere in the box: random boxes of every width from a single
+ point to thousands, sampled at the corners, the middle and random points inside, every precision, interpreter and jit
+ a NaN out of Evaluate is only allowed where the enclosure gave up to [-inf, inf]
+ a few enclosures that must stay tight: a point box around + - * /, sin/cos between their peaks, tan away from a pole
+ FindCrossings: wherever the output goes from below the threshold to above it between two neighbouring floats, one of
+ the two is inside a leaf, a point right on the threshold always is, and slots the expression never reads aren't split
+*/
+
+namespace
+{
+	using namespace MathEvalTest;
+
+	static const size_t SLOTS = 3;
+
+	size_t samples = 0;
+
+	uint32_t state = 2463534242u;
+	float Random(float lo, float hi)
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return lo + (hi - lo) * static_cast<float>(state >> 8) / 16777216.0f;
+	}
+
+	std::string ToString(const std::array<float, SLOTS>& point)
+	{
+		char text[96];
+		std::snprintf(text, sizeof(text), "(%.9g, %.9g, %.9g)", point[0], point[1], point[2]);
+		return text;
+	}
+
+	std::string ToString(const MathEval::interval& range)
+	{
+		char text[64];
+		std::snprintf(text, sizeof(text), "[%.9g, %.9g]", range.lo, range.hi);
+		return text;
+	}
+
+	void Contained(const std::string& what, const std::array<float, SLOTS>& point, const MathEval::interval& range, float value)
+	{
+		samples++;
+		bool gave_up = range.lo == -INFINITY && range.hi == INFINITY;
+		if (std::isnan(value) ? gave_up : range.Contains(value))
+			return;
+		Fail(what + " at " + ToString(point) + " gives " + std::to_string(value) + " outside " + ToString(range));
+	}
+
+	// corners, middle and random points of box
+	std::vector<std::array<float, SLOTS>> Sample(const std::array<MathEval::interval, SLOTS>& box, size_t random)
+	{
+		std::vector<std::array<float, SLOTS>> points;
+		for (size_t corner = 0; corner < (size_t(1) << SLOTS); corner++)
+		{
+			std::array<float, SLOTS> point;
+			for (size_t s = 0; s < SLOTS; s++)
+				point[s] = corner & (size_t(1) << s) ? box[s].hi : box[s].lo;
+			points.push_back(point);
+		}
+		std::array<float, SLOTS> middle;
+		for (size_t s = 0; s < SLOTS; s++)
+			middle[s] = box[s].lo + (box[s].hi - box[s].lo) * 0.5f;
+		points.push_back(middle);
+		for (size_t i = 0; i < random; i++)
+		{
+			std::array<float, SLOTS> point;
+			for (size_t s = 0; s < SLOTS; s++)
+			{
+				point[s] = Random(box[s].lo, box[s].hi);
+				// float rounding of lo + (hi - lo) * t can land a hair outside
+				point[s] = point[s] < box[s].lo ? box[s].lo : point[s] > box[s].hi ? box[s].hi : point[s];
+			}
+			points.push_back(point);
+		}
+		return points;
+	}
+
+	bool InLeaf(const std::vector<std::array<MathEval::interval, SLOTS>>& leaves, const std::array<float, SLOTS>& point)
+	{
+		for (const auto& leaf : leaves)
+		{
+			bool inside = true;
+			for (size_t s = 0; s < SLOTS && inside; s++)
+				inside = leaf[s].Contains(point[s]);
+			if (inside)
+				return true;
+		}
+		return false;
+	}
+
+	int Side(float value, float threshold)
+	{
+		return value < threshold ? -1 : value > threshold ? 1 : 0;
+	}
+}
+
+int main()
+{
+	std::unordered_map<std::string, size_t> definition = { { "a", 0 }, { "b", 1 }, { "c", 2 } };
+	const std::vector<const char*> corpus = {
+		"a+b*c",
+		"a*a - 2*a*b + b*b",
+		"(a-b)/(1+c*c)",
+		"a/b",
+		"sin(a)*cos(b) + c",
+		"sin(a*b) - cos(a+c)",
+		"exp(a/4)*exp(-b) - exp(c)",
+		"tan(a/3) + arctan(b*c)",
+		"arcsin(a/8) + arccos(c/8)",
+		"sqrt(a*a + b*b) - sqrt(c)",
+		"a^2 + b^3 - c^-2",
+		"a^0.5 * b^-1",
+		"(a*a+1)^c",
+		"-(a - -b) * --c",
+		"sin(a)*sin(a) + cos(a)*cos(a)",
+	};
+
+	// widths from a point to most of the range the functions are tame on, some boxes straddle 0
+	std::vector<std::array<MathEval::interval, SLOTS>> boxes;
+	for (float width : { 0.0f, 1e-6f, 1e-3f, 0.1f, 1.0f, 3.0f, 10.0f, 1000.0f })
+	{
+		for (size_t k = 0; k < 40; k++)
+		{
+			std::array<MathEval::interval, SLOTS> box;
+			for (size_t s = 0; s < SLOTS; s++)
+			{
+				float lo = Random(-8.0f, 8.0f);
+				box[s] = { lo, lo + width * Random(0.25f, 1.0f) };
+			}
+			boxes.push_back(box);
+		}
+	}
+
+	for (const char* text : corpus)
+	{
+		for (MathEval::precision precision : { MathEval::precision::DEFAULT, MathEval::precision::EXACT, MathEval::precision::ULP1,
+			MathEval::precision::ULP4 })
+		{
+			for (bool jit : { false, true })
+			{
+				MathEvaluator<SLOTS> evaluator(text, definition, Options(true, jit, precision));
+				std::string what = std::string(text) + " under " + MathEval::GetPrecisionName(precision) + (jit ? ", jit" : "");
+				for (const auto& box : boxes)
+				{
+					MathEval::interval range = evaluator.EvaluateInterval(box);
+					if (!(range.lo <= range.hi))
+						Fail(what + ": empty enclosure " + ToString(range));
+					for (const auto& point : Sample(box, 24))
+						Contained(what, point, range, evaluator.Evaluate(point));
+				}
+			}
+		}
+	}
+
+	// enclosures that mustn't give up or blow up
+	struct tight_case
+	{
+		const char* text;
+		std::array<MathEval::interval, SLOTS> box;
+		float max_width;
+	};
+	for (const tight_case& c : std::vector<tight_case>{
+		{ "a+b*c - a/b", { { { 1.5f, 1.5f }, { 2.0f, 2.0f }, { -3.0f, -3.0f } } }, 2e-6f },
+		{ "sin(a)", { { { 0.1f, 1.4f }, { 0.0f, 0.0f }, { 0.0f, 0.0f } } }, 0.9f },
+		{ "cos(a)*2", { { { 0.5f, 0.6f }, { 0.0f, 0.0f }, { 0.0f, 0.0f } } }, 0.2f },
+		{ "tan(a)", { { { -1.0f, 1.0f }, { 0.0f, 0.0f }, { 0.0f, 0.0f } } }, 3.2f },
+		{ "a^4", { { { 1.0f, 2.0f }, { 0.0f, 0.0f }, { 0.0f, 0.0f } } }, 15.01f },
+		{ "exp(a) + sqrt(b)", { { { 0.0f, 1.0f }, { 4.0f, 9.0f }, { 0.0f, 0.0f } } }, 2.72f },
+	})
+	{
+		MathEvaluator<SLOTS> evaluator(c.text, definition, Options(true, false));
+		MathEval::interval range = evaluator.EvaluateInterval(c.box);
+		if (!(range.Width() <= c.max_width))
+			Fail(std::string(c.text) + ": enclosure " + ToString(range) + " wider than " + std::to_string(c.max_width));
+	}
+
+	// crossings, c is never read
+	struct crossing_case
+	{
+		const char* text;
+		float threshold;
+	};
+	std::array<MathEval::interval, SLOTS> box = { { { -2.0f, 2.0f }, { -2.0f, 2.0f }, { -5.0f, 5.0f } } };
+	size_t crossings = 0;
+	for (const crossing_case& c : std::vector<crossing_case>{ { "a*a + b*b", 1.0f }, { "sin(3*a)*cos(2*b)", 0.3f }, { "a - b^3", 0.0f } })
+	{
+		MathEvaluator<SLOTS> evaluator(c.text, definition, Options(true, false));
+		MathEval::box_search_options options;
+		options.max_depth = 16;
+		MathEval::box_search_stats stats;
+		std::vector<std::array<MathEval::interval, SLOTS>> leaves = evaluator.FindCrossings(box, c.threshold, options, &stats);
+		if (leaves.empty() || stats.pruned == 0 || stats.leaves != leaves.size())
+			Fail(std::string(c.text) + ": " + std::to_string(leaves.size()) + " leaves, " + std::to_string(stats.pruned) + " pruned");
+		for (const auto& leaf : leaves)
+			if (leaf[2].lo != box[2].lo || leaf[2].hi != box[2].hi)
+				Fail(std::string(c.text) + ": split along c, which it never reads");
+
+		for (size_t i = 0; i < 4000; i++)
+		{
+			std::array<float, SLOTS> p = { Random(-2.0f, 2.0f), Random(-2.0f, 2.0f), Random(-5.0f, 5.0f) };
+			std::array<float, SLOTS> q = p;
+			q[i % 2] = Random(-2.0f, 2.0f);
+			int side_p = Side(evaluator.Evaluate(p), c.threshold), side_q = Side(evaluator.Evaluate(q), c.threshold);
+			if (side_p == side_q)
+				continue;
+			// bisect p..q down to neighbouring floats on different sides, or a point on the threshold
+			size_t axis = i % 2;
+			while (side_p != 0 && side_q != 0 && std::nextafter(p[axis], q[axis]) != q[axis])
+			{
+				std::array<float, SLOTS> m = p;
+				m[axis] = p[axis] + (q[axis] - p[axis]) * 0.5f;
+				if (m[axis] == p[axis] || m[axis] == q[axis])
+					break;
+				int side_m = Side(evaluator.Evaluate(m), c.threshold);
+				if (side_m == side_p)
+					p = m;
+				else
+				{
+					q = m;
+					side_q = side_m;
+				}
+			}
+			crossings++;
+			bool covered = side_p == 0 ? InLeaf(leaves, p) : side_q == 0 ? InLeaf(leaves, q) : InLeaf(leaves, p) || InLeaf(leaves, q);
+			if (!covered)
+				Fail(std::string(c.text) + ": crosses " + std::to_string(c.threshold) + " between " + ToString(p) + " and " + ToString(q)
+					+ " outside every leaf");
+		}
+	}
+
+	std::printf("interval: %zu expressions, %zu samples, %zu crossings, %zu failures\n", corpus.size(), samples, crossings, failures);
+	return failures ? 1 : 0;
+}
+#endif
@@ -0,0 +1,117 @@
+// comment out the below definition if using elsewhere
+// uncomment out below definition to run the long expression test
+//#define MATH_EVAL_LONG_EXPRESSIONS_TEST_MAIN
+#ifdef MATH_EVAL_LONG_EXPRESSIONS_TEST_MAIN
+#include "../include/ExpressionEvaluation.h"
+#include "test_util.h"
+#include <array>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+ generated chains of a few hundred thousand terms, a+a+...+a parses into a tree as deep as it is long, so any pass
+ that recursed once per node (folding, hash-consing, lowering) would run out of stack long before the end
+ every path gets the default 8MB stack of the main thread, sums of ones are exact in float so results are compared
+ with ==
+ a*2+(a*3+(...)) nested up to the parser's limit keeps a register live per level, past a hundred or so the jit's
+ batch frame wouldn't fit in a page and past about a thousand the scalar one wouldn't either, the jit has to leave
+ those to the interpreter (a program without register reuse gets there on any long chain)
+*/
+
+namespace
+{
+	using namespace MathEvalTest;
+
+	static const size_t TERMS = 200000;
+
+	void Check(const char* what, float expected, float got)
+	{
+		if (expected == got)
+			return;
+		char message[64];
+		std::snprintf(message, sizeof(message), ": %.9g instead of %.9g", got, expected);
+		Fail(what + std::string(message));
+	}
+
+	std::string Chain(const std::string& term, const char* op)
+	{
+		std::string text = term;
+		text.reserve((term.size() + 1) * TERMS);
+		for (size_t i = 1; i < TERMS; i++)
+		{
+			text += op;
+			text += term;
+		}
+		return text;
+	}
+}
+
+int main()
+{
+	std::unordered_map<std::string, size_t> definition = { { "a", 0 }, { "b", 1 } };
+	const float count = static_cast<float>(TERMS);
+
+	struct test_case
+	{
+		const char* name;
+		std::string text;
+		float expected; // at a = 1, b = 2
+	};
+	std::vector<test_case> cases = {
+		{ "a+a+...", Chain("a", "+"), count },
+		{ "a*1+...", Chain("a*1", "+"), count }, // every term gets folded
+		{ "a*b-...", Chain("a*b", "-"), 2.0f - 2.0f * (count - 1.0f) }, // one shared term
+		{ "cos(a-a)+...", Chain("cos(a-a)", "+"), count },
+		{ "a*a*...", Chain("a", "*"), 1.0f },
+	};
+
+	for (const test_case& c : cases)
+	{
+		for (bool jit : { false, true })
+		{
+			MathEvaluator<2> evaluator(c.text, definition, Options(true, jit));
+			std::array<float, 2> point = { 1.0f, 2.0f };
+			Check(c.name, c.expected, evaluator.Evaluate(point));
+
+			std::vector<float> a(19, 1.0f), b(19, 2.0f), output(19);
+			evaluator.EvaluateBatch({ a.data(), b.data() }, output.data(), output.size());
+			for (float value : output)
+				Check(c.name, c.expected, value);
+		}
+	}
+
+	// a register live per level of nesting
+	for (size_t depth : { size_t(50), size_t(150), size_t(999) })
+	{
+		std::string text;
+		float expected = 2.0f;
+		for (size_t k = 2; k < depth + 2; k++)
+		{
+			text += "a*" + std::to_string(k) + "+(";
+			expected += static_cast<float>(k);
+		}
+		text += "b" + std::string(depth, ')');
+		std::string name = "a*2+(...) " + std::to_string(depth) + " deep";
+		MathEvaluator<2> evaluator(text, definition, Options(true, true));
+		std::array<float, 2> point = { 1.0f, 2.0f };
+		Check(name.c_str(), expected, evaluator.Evaluate(point));
+		std::vector<float> a(19, 1.0f), b(19, 2.0f), output(19);
+		evaluator.EvaluateBatch({ a.data(), b.data() }, output.data(), output.size());
+		for (float value : output)
+			Check(name.c_str(), expected, value);
+	}
+
+	// one register per instruction
+	{
+		MathEvaluator<2> evaluator(Chain("a", "+"), definition, Options(true, false));
+		MathEval::jit_program jit;
+		if (jit.Compile(evaluator.GetGradientProgram()))
+			Fail("jit compiled a program with " + std::to_string(evaluator.GetGradientProgram().GetNumOfRegisters()) + " registers");
+	}
+
+	std::printf("long expressions: %zu chains of %zu terms, %zu failures\n", cases.size(), TERMS, failures);
+	return failures ? 1 : 0;
+}
+#endif
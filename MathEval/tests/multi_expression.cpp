@@ -0,0 +1,175 @@
+// comment out the below definition if using elsewhere
+// uncomment out below definition to run the multi expression test
+//#define MATH_EVAL_MULTI_EXPRESSION_TEST_MAIN
+#ifdef MATH_EVAL_MULTI_EXPRESSION_TEST_MAIN
+#include "../include/ExpressionEvaluation.h"
+#include "test_util.h"
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+
+/*
+ MultiMathEvaluator against one MathEvaluator per expression built with the same options, output k against
+ expression k bit for bit:
+   Evaluate against Evaluate, EvaluateBatch against EvaluateBatch (same kernels), in every precision, with the
+   optimizer on and off, over awkward values (+-0, +-inf, NaN, denormals) and a count off the simd block
+ sets with shared subtrees, repeats of one expression, constants, a single expression, 1 to 40 expressions
+ sharing has to pay off: fewer shared nodes than separate ones when subtrees repeat, never more
+ a bad expression anywhere in the set throws what MathEvaluator would
+*/
+
+namespace
+{
+	using namespace MathEvalTest;
+
+	static const size_t SLOTS = 3;
+
+	size_t compared = 0;
+
+	void Check(const std::string& text, const char* path, const std::array<float, SLOTS>& point, float expected, float got)
+	{
+		compared++;
+		if (Same(expected, got))
+			return;
+		char message[256];
+		std::snprintf(message, sizeof(message), "%s: %s at (%g, %g, %g) gives %.9g, a separate evaluator %.9g", text.c_str(), path,
+			point[0], point[1], point[2], got, expected);
+		Fail(message);
+	}
+
+	std::vector<std::vector<std::string>> Sets()
+	{
+		std::vector<std::vector<std::string>> sets = {
+			{ "sin(a*b)*c" },
+			{ "sin(a*b)*c", "sin(a*b) + exp(c/(1+a*a))", "a/(1+c*c) - sin(a*b)", "exp(c/(1+a*a))*a/(1+c*c)" },
+			{ "a+b", "a+b", "a+b" },
+			{ "2*3", "a*0 + 1", "c", "exp(1)*b" },
+			{ "a^2 + b^-1", "a^2 * sqrt(c)", "pow(a, b) - a^2", "tan(a)*arctan(b) - arcsin(c/8) + arccos(c/8)" },
+			{ "-a", "--a", "-(a*b)", "-a*b" },
+		};
+		// many expressions that share a prefix of terms
+		std::vector<std::string> wide;
+		std::string sum = "sin(a)";
+		for (int k = 1; k <= 40; k++)
+		{
+			sum += k % 2 ? " + cos(b*" + std::to_string(k) + ")" : " - c/" + std::to_string(k);
+			wide.push_back(sum);
+		}
+		sets.push_back(wide);
+		return sets;
+	}
+}
+
+int main()
+{
+	std::unordered_map<std::string, size_t> definition = { { "a", 0 }, { "b", 1 }, { "c", 2 } };
+	const std::vector<float> values = { 0.0f, -0.0f, 1.0f, -1.0f, 0.5f, -2.5f, 3.0f, 100.0f, 1e-40f, 1e30f, -1e30f,
+		INFINITY, -INFINITY, NAN };
+
+	// every combination over the 3 slots, as points and as columns
+	size_t count = values.size() * values.size() * values.size();
+	std::vector<std::array<float, SLOTS>> points(count);
+	std::vector<float> columns[SLOTS];
+	for (size_t s = 0; s < SLOTS; s++)
+		columns[s].resize(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		size_t rest = i;
+		for (size_t s = 0; s < SLOTS; s++)
+		{
+			points[i][s] = columns[s][i] = values[rest % values.size()];
+			rest /= values.size();
+		}
+	}
+	std::array<const float*, SLOTS> column_pointers = { columns[0].data(), columns[1].data(), columns[2].data() };
+
+	size_t sets = 0;
+	for (const std::vector<std::string>& set : Sets())
+	{
+		sets++;
+		for (bool optimize : { true, false })
+		{
+			for (MathEval::precision precision : { MathEval::precision::DEFAULT, MathEval::precision::EXACT, MathEval::precision::ULP1,
+				MathEval::precision::ULP4 })
+			{
+				MathEvaluatorOptions options = Options(optimize, false, precision);
+				MultiMathEvaluator<SLOTS> multi(set, definition, options);
+				if (multi.GetNumOfOutputs() != set.size())
+					Fail(set[0] + "...: " + std::to_string(multi.GetNumOfOutputs()) + " outputs for " + std::to_string(set.size()) + " expressions");
+				if (multi.GetSharedNodes() > multi.GetSeparateNodes())
+					Fail(set[0] + "...: " + std::to_string(multi.GetSharedNodes()) + " shared nodes against " + std::to_string(multi.GetSeparateNodes())
+						+ " separate ones");
+
+				std::vector<std::unique_ptr<MathEvaluator<SLOTS>>> separate;
+				for (const std::string& text : set)
+					separate.emplace_back(new MathEvaluator<SLOTS>(text, definition, options));
+
+				std::vector<float> outputs(set.size());
+				for (size_t i = 0; i < count; i++)
+				{
+					multi.Evaluate(points[i], outputs.data());
+					for (size_t k = 0; k < set.size(); k++)
+						Check(set[k], "Evaluate", points[i], separate[k]->Evaluate(points[i]), outputs[k]);
+				}
+
+				// one short of the full count so the tail is a partial block
+				size_t batch = count - 1;
+				std::vector<std::vector<float>> columns_out(set.size(), std::vector<float>(batch)), expected(set.size(), std::vector<float>(batch));
+				std::vector<float*> output_pointers;
+				for (auto& column : columns_out)
+					output_pointers.push_back(column.data());
+				multi.EvaluateBatch(column_pointers, output_pointers.data(), batch);
+				for (size_t k = 0; k < set.size(); k++)
+				{
+					separate[k]->EvaluateBatch(column_pointers, expected[k].data(), batch);
+					for (size_t i = 0; i < batch; i++)
+						Check(set[k], "EvaluateBatch", points[i], expected[k][i], columns_out[k][i]);
+				}
+			}
+		}
+	}
+
+	// subtrees that repeat across the set are computed once
+	{
+		MultiMathEvaluator<SLOTS> multi({ "sin(a*b)*c", "sin(a*b) + c", "sin(a*b) - c" }, definition, Options(true, false));
+		if (multi.GetSharedNodes() >= multi.GetSeparateNodes())
+			Fail("sin(a*b) in three expressions: " + std::to_string(multi.GetSharedNodes()) + " shared nodes, "
+				+ std::to_string(multi.GetSeparateNodes()) + " separate ones");
+	}
+
+	// a bad expression anywhere fails the whole set, with the exception its own evaluator throws
+	struct bad_set
+	{
+		std::vector<std::string> set;
+		std::string bad;
+	};
+	for (const bad_set& b : std::vector<bad_set>{ { { "a+b", "a+)" }, "a+)" }, { { "d*2", "a" }, "d*2" }, { { "a", "b", "sin(" }, "sin(" } })
+	{
+		auto thrown = [](auto make) -> std::string
+		{
+			try
+			{
+				make();
+			}
+			catch (const std::exception& e)
+			{
+				return typeid(e).name();
+			}
+			return "nothing";
+		};
+		std::string expected = thrown([&] { MathEvaluator<SLOTS>(b.bad, definition, Options(true, false)); });
+		std::string got = thrown([&] { MultiMathEvaluator<SLOTS>(b.set, definition, Options(true, false)); });
+		if (expected == "nothing" || got != expected)
+			Fail(b.bad + " in a set: threw " + got + ", on its own " + expected);
+	}
+
+	std::printf("multi expression: %zu sets, %zu outputs compared, %zu failures\n", sets, compared, failures);
+	return failures ? 1 : 0;
+}
+#endif
@@ -0,0 +1,252 @@
+// comment out the below definition if using elsewhere
+// uncomment out below definition to run the power test
+//#define MATH_EVAL_POWER_TEST_MAIN
+#ifdef MATH_EVAL_POWER_TEST_MAIN
+#include "../include/ExpressionEvaluation.h"
+#include "test_util.h"
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+ x^y and the functions that came with it:
+   - a constant exponent (lowered by program::EmitPower) against the same exponent read at run time (POW, MathEval::Power),
+     EvaluateTree, folding, the jit and EvaluateBatch, bit for bit, over a sweep of integer chains, -1, 0.5 and powf exponents
+   - every one of those against pow in double, within |n| + 1 ulp for a chain of n and 1 ulp otherwise
+   - the instructions a constant exponent turns into, chains and 0.5 never leave a POW behind
+   - parsing: ^ is right associative, binds tighter than * and unary minus, the exponent may carry its own sign
+   - tan/arcsin/arccos/arctan on Evaluate, EvaluateTree and the jit against libm, the batch polynomials within 3 ulp
+     of the exact result
+ a NaN only has to be a NaN
+*/
+
+namespace
+{
+	using namespace MathEvalTest;
+
+	void Mismatch(const std::string& text, const char* what, float x, float expected, float got)
+	{
+		char message[128];
+		std::snprintf(message, sizeof(message), " at %.9g gives %.9g, expected %.9g", x, got, expected);
+		Fail(text + ": " + what + message);
+	}
+
+	void CheckSame(const std::string& text, const char* what, float x, float expected, float got)
+	{
+		if (!Same(expected, got))
+			Mismatch(text, what, x, expected, got);
+	}
+
+	// distance from the double result in units of the float ulp there, infinities and NaN have to match exactly
+	void CheckUlps(const std::string& text, const char* what, float x, double expected, float got, double ulps)
+	{
+		float rounded = static_cast<float>(expected);
+		if (!std::isfinite(rounded) || !std::isfinite(got))
+		{
+			CheckSame(text, what, x, rounded, got);
+			return;
+		}
+		float magnitude = std::fabs(rounded);
+		double ulp = static_cast<double>(std::nextafter(magnitude, INFINITY)) - magnitude;
+		if (std::fabs(static_cast<double>(got) - expected) > ulps * ulp)
+			Mismatch(text, what, x, rounded, got);
+	}
+
+	// the lexer has no exponent notation, as few fixed digits as give value back
+	std::string ToText(float value)
+	{
+		char text[64];
+		for (int digits = 1;; digits++)
+		{
+			std::snprintf(text, sizeof(text), "%.*f", digits, value);
+			if (std::strtof(text, nullptr) == value)
+				return text;
+		}
+	}
+
+	size_t Count(const MathEval::program& prog, MathEval::opcode op)
+	{
+		size_t count = 0;
+		for (size_t i = 0; i < prog.GetNumOfInstructions(); i++)
+			count += prog.GetInstructions()[i].op == op;
+		return count;
+	}
+}
+
+int main()
+{
+	MathEvaluator<2>::Setup();
+	std::unordered_map<std::string, size_t> definition = { { "a", 0 }, { "b", 1 } };
+
+	std::vector<float> exponents;
+	for (int n = -MathEval::MAX_POWER_CHAIN - 2; n <= MathEval::MAX_POWER_CHAIN + 2; n++)
+		exponents.push_back(static_cast<float>(n));
+	for (float y : { 0.5f, -0.5f, 1.5f, 2.5f, -2.5f, 0.25f, 1.0f / 3.0f, 0.1f, 3.75f })
+		exponents.push_back(y);
+
+	std::vector<float> bases = { 0.0f, -0.0f, 1.0f, -1.0f, 0.3f, -0.3f, 1.7f, -1.7f, 2.0f, -2.5f, 7.0f, 0.001f, 1.0001f,
+		9.5f, -13.0f, 1e-20f, INFINITY, -INFINITY, NAN };
+	std::vector<float> column(bases.size()), output(bases.size());
+
+	for (float y : exponents)
+	{
+		// negative exponents are wrapped, a^(-2) and a^-2 parse the same
+		std::string text = "a^(" + ToText(y) + ")";
+		MathEvaluator<2> runtime("a^b", definition, Options(true, false));
+		MathEvaluator<2> tree(text, definition, Options(false, false));
+		bool chain = MathEval::IsPowerChain(y);
+		for (bool jit : { false, true })
+		{
+			MathEvaluator<2> constant(text, definition, Options(true, jit));
+			MathEvaluator<2> unfolded(text, definition, Options(false, jit));
+			const MathEval::program& prog = constant.GetCompiled()->prog;
+			if ((chain || y == 0.5f) && Count(prog, MathEval::opcode::POW) != 0)
+				Mismatch(text, "a POW left after strength reduction", 0.0f, 0.0f, static_cast<float>(Count(prog, MathEval::opcode::POW)));
+			if (jit && (chain || y == 0.5f || y == 1.0f || y == 0.0f) && !constant.IsJitCompiled())
+				Mismatch(text, "not jit compiled", 0.0f, 1.0f, 0.0f);
+
+			for (float x : bases)
+			{
+				float expected = MathEval::Power(x, y);
+				float direct = runtime.Evaluate({ x, y });
+				CheckSame(text, "a^b at run time", x, expected, direct);
+				CheckSame(text, "EvaluateTree", x, expected, tree.EvaluateTree({ x, 0.0f }));
+				CheckSame(text, "unfolded", x, expected, unfolded.Evaluate({ x, 0.0f }));
+				// the optimizer drops x^1 and x^0, 1 and x are what powf gives there anyway
+				CheckSame(text, jit ? "jit Evaluate" : "Evaluate", x, expected, constant.Evaluate({ x, 0.0f }));
+				if (std::isfinite(x))
+					CheckSame(text, "folded", x, expected,
+						MathEvaluator<2>("(" + ToText(x) + ")" + text.substr(1), definition, Options(true, jit)).Evaluate({ 0.0f, 0.0f }));
+
+				// sqrt parts with powf at -0 and -inf (fast_math.h)
+				if (!std::isfinite(x) || x == 0.0f)
+					CheckSame(text, "against powf", x, y == 0.5f ? sqrtf(x) : powf(x, y), expected);
+				else
+				{
+					double ulps = chain ? std::fabs(y) + 1.0 : 1.0;
+					CheckUlps(text, "against pow", x, std::pow(static_cast<double>(x), static_cast<double>(y)), expected, ulps);
+				}
+			}
+
+			std::copy(bases.begin(), bases.end(), column.begin());
+			constant.EvaluateBatch({ column.data(), nullptr }, output.data(), output.size());
+			for (size_t i = 0; i < bases.size(); i++)
+				CheckSame(text, jit ? "jit EvaluateBatch" : "EvaluateBatch", bases[i], MathEval::Power(bases[i], y), output[i]);
+		}
+	}
+
+	// the chains are square and multiply, 1/chain for a negative n, 0.5 is one sqrt
+	struct lowering
+	{
+		const char* text;
+		size_t mults, divs, sqrts, pows;
+	};
+	for (const lowering& l : std::vector<lowering>{
+		{ "a^2", 1, 0, 0, 0 }, { "a^3", 2, 0, 0, 0 }, { "a^8", 3, 0, 0, 0 }, { "a^15", 6, 0, 0, 0 }, { "a^16", 4, 0, 0, 0 },
+		{ "a^-1", 0, 1, 0, 0 }, { "a^-4", 2, 1, 0, 0 }, { "a^0.5", 0, 0, 1, 0 }, { "a^17", 0, 0, 0, 1 }, { "a^-0.5", 0, 0, 0, 1 },
+		{ "a^b", 0, 0, 0, 1 }, { "pow(a, 3)", 2, 0, 0, 0 }, { "(a+b)^4", 2, 0, 0, 0 } })
+	{
+		MathEvaluator<2> evaluator(l.text, definition, Options(true, false));
+		const MathEval::program& prog = evaluator.GetCompiled()->prog;
+		if (Count(prog, MathEval::opcode::MULT) != l.mults || Count(prog, MathEval::opcode::DIV) != l.divs
+			|| Count(prog, MathEval::opcode::SQRT) != l.sqrts || Count(prog, MathEval::opcode::POW) != l.pows)
+		{
+			char message[160];
+			std::snprintf(message, sizeof(message), "%s: lowered into %zu MULT, %zu DIV, %zu SQRT, %zu POW instead of %zu, %zu, %zu, %zu", l.text,
+				Count(prog, MathEval::opcode::MULT), Count(prog, MathEval::opcode::DIV), Count(prog, MathEval::opcode::SQRT),
+				Count(prog, MathEval::opcode::POW), l.mults, l.divs, l.sqrts, l.pows);
+			Fail(message);
+		}
+	}
+
+	// associativity and binding, at a = 2, b = 3
+	struct parse_case
+	{
+		const char* text;
+		float expected;
+	};
+	for (const parse_case& c : std::vector<parse_case>{
+		{ "a^b^2", 512.0f }, // a^(b^2)
+		{ "(a^b)^2", 64.0f },
+		{ "a^b^a^0", 8.0f }, // a^(b^(a^0)) = 2^3
+		{ "-a^2", -4.0f }, // -(a^2)
+		{ "(-a)^2", 4.0f },
+		{ "-b^a^-1", -1.7320508f }, // -(b^(a^-1))
+		{ "2^-a*b", 0.75f }, // (2^-a)*b
+		{ "2^-a^2", 0.0625f }, // 2^(-(a^2))
+		{ "a^--b", 8.0f },
+		{ "a*b^2", 18.0f },
+		{ "a/b^2*a", 2.0f * 2.0f / 9.0f },
+		{ "a^b/a", 4.0f },
+		{ "a^(b-1)", 4.0f },
+		{ "pow(a, b)^2", 64.0f },
+		{ "pow(-b, 2) - b^2", 0.0f },
+		{ "a^0.5*a^0.5", 2.0000000f },
+		{ "sqrt(a)^2", 2.0000000f },
+	})
+	{
+		MathEvaluator<2> tree(c.text, definition, Options(false, false));
+		float expected = tree.EvaluateTree({ 2.0f, 3.0f });
+		if (std::fabs(expected - c.expected) > 1e-6f * std::fabs(c.expected))
+			Mismatch(c.text, "EvaluateTree", 2.0f, c.expected, expected);
+		for (bool jit : { false, true })
+		{
+			MathEvaluator<2> evaluator(c.text, definition, Options(true, jit));
+			CheckSame(c.text, jit ? "jit Evaluate" : "Evaluate", 2.0f, expected, evaluator.Evaluate({ 2.0f, 3.0f }));
+		}
+	}
+
+	// the unary functions the power operator came with
+	struct function_case
+	{
+		const char* text;
+		double (*reference)(double);
+		float (*libm)(float);
+		float lo, hi;
+	};
+	std::vector<function_case> functions = {
+		{ "tan(a)", std::tan, tanf, -1.5f, 1.5f },
+		{ "arcsin(a)", std::asin, asinf, -1.0f, 1.0f },
+		{ "arccos(a)", std::acos, acosf, -1.0f, 1.0f },
+		{ "arctan(a)", std::atan, atanf, -200.0f, 200.0f },
+	};
+	const size_t POINTS = 4001;
+	std::vector<float> points(POINTS + 4), batch(POINTS + 4), exact(POINTS + 4);
+	for (const function_case& f : functions)
+	{
+		for (size_t i = 0; i < POINTS; i++)
+			points[i] = f.lo + (f.hi - f.lo) * static_cast<float>(i) / static_cast<float>(POINTS - 1);
+		// outside the domain and the specials
+		points[POINTS] = 2.0f;
+		points[POINTS + 1] = -0.0f;
+		points[POINTS + 2] = INFINITY;
+		points[POINTS + 3] = NAN;
+
+		MathEvaluator<2> tree(f.text, definition, Options(false, false));
+		for (bool jit : { false, true })
+		{
+			MathEvaluator<2> evaluator(f.text, definition, Options(true, jit));
+			MathEvaluator<2> libm(f.text, definition, Options(true, jit, MathEval::precision::EXACT));
+			evaluator.EvaluateBatch({ points.data(), nullptr }, batch.data(), points.size());
+			libm.EvaluateBatch({ points.data(), nullptr }, exact.data(), points.size());
+			for (size_t i = 0; i < points.size(); i++)
+			{
+				float x = points[i];
+				float expected = f.libm(x);
+				CheckSame(f.text, jit ? "jit Evaluate" : "Evaluate", x, expected, evaluator.Evaluate({ x, 0.0f }));
+				CheckSame(f.text, "EvaluateTree", x, expected, tree.EvaluateTree({ x, 0.0f }));
+				CheckSame(f.text, jit ? "jit EvaluateBatch EXACT" : "EvaluateBatch EXACT", x, expected, exact[i]);
+				CheckUlps(f.text, jit ? "jit EvaluateBatch" : "EvaluateBatch", x, f.reference(static_cast<double>(x)), batch[i], 3.0);
+			}
+		}
+	}
+
+	std::printf("power: %zu exponents over %zu bases, %zu functions, %zu failures\n", exponents.size(), bases.size(), functions.size(), failures);
+	return failures ? 1 : 0;
+}
+#endif
@@ -0,0 +1,278 @@
+// comment out the below definition if using elsewhere
+// uncomment out below definition to run the profiler test
+//#define MATH_EVAL_PROFILER_TEST_MAIN
+#ifdef MATH_EVAL_PROFILER_TEST_MAIN
+#include "../include/ExpressionEvaluation.h"
+#include "test_util.h"
+#include "../src/profiler.h"
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/*
+ expression_profiler on the programs MathEvaluator compiles (it doesn't need MATH_EVAL_PROFILE to be used directly):
+   - Evaluate gives the same bits as MathEvaluator::Evaluate without jit, timed or not
+   - evaluations count every call, from several threads too, samples are one in sample_period of them
+   - ExplainJson adds up to the program: instructions over the tree nodes are the program's, instructions per
+     opcode are the program's per opcode, executions are instructions times evaluations, the self ns of the nodes,
+     the ns of the opcodes and the total ns of the root are all ns_per_evaluation
+   - Explain reports the same evaluations and samples, Reset takes everything back to 0
+ cmake builds this one with MATH_EVAL_PROFILE for MathEvaluator's hooks too: the cache counts of a profile stay right
+ through a ClearCache while it runs, and after it stopped
+*/
+
+namespace
+{
+	using namespace MathEvalTest;
+
+	static const size_t SLOTS = 3;
+
+	// ns are printed with 6 digits, sums of them only agree that far
+	bool Close(double x, double y)
+	{
+		return std::fabs(x - y) <= 1e-4 * std::fmax(std::fabs(x), std::fabs(y)) + 1e-9;
+	}
+
+	// the number after "key": starting at from, npos when there's none before end
+	size_t Find(const std::string& json, const std::string& key, size_t from, size_t end)
+	{
+		size_t at = json.find("\"" + key + "\": ", from);
+		return at < end ? at + key.size() + 4 : std::string::npos;
+	}
+
+	double Number(const std::string& json, size_t at)
+	{
+		return std::strtod(json.c_str() + at, nullptr);
+	}
+
+	// the first "key": in the report, before the tree
+	double Field(const std::string& json, const std::string& key)
+	{
+		size_t at = Find(json, key, 0, json.find("\"tree\": "));
+		if (at == std::string::npos)
+		{
+			Fail("no " + key + " in " + json.substr(0, 80) + "...");
+			return 0.0;
+		}
+		return Number(json, at);
+	}
+
+	// every "key": between from and end summed
+	double Sum(const std::string& json, const std::string& key, size_t from, size_t end)
+	{
+		double sum = 0.0;
+		for (size_t at = Find(json, key, from, end); at != std::string::npos; at = Find(json, key, at, end))
+			sum += Number(json, at);
+		return sum;
+	}
+
+	void CheckReport(const std::string& text, const MathEval::expression_profiler& profiler, const MathEval::program& prog,
+		uint64_t evaluations)
+	{
+		std::string json = profiler.ExplainJson();
+		size_t tree = json.find("\"tree\": "), opcodes = json.find("\"opcodes\": [");
+		if (tree == std::string::npos || opcodes == std::string::npos)
+		{
+			Fail(text + ": no tree or opcodes in " + json);
+			return;
+		}
+		if (Field(json, "evaluations") != static_cast<double>(evaluations) || Field(json, "samples") != static_cast<double>(profiler.GetNumOfSamples()))
+			Fail(text + ": json has other evaluations or samples than the profiler");
+		double total = Field(json, "ns_per_evaluation");
+		if (!(total >= 0.0))
+			Fail(text + ": " + std::to_string(total) + " ns per evaluation");
+
+		// over the tree
+		double instructions = Sum(json, "instructions", tree, opcodes);
+		if (instructions != static_cast<double>(prog.GetNumOfInstructions()))
+			Fail(text + ": tree nodes hold " + std::to_string(instructions) + " instructions, the program has "
+				+ std::to_string(prog.GetNumOfInstructions()));
+		if (Sum(json, "executions", tree, opcodes) != instructions * evaluations)
+			Fail(text + ": executions over the tree aren't instructions times evaluations");
+		double self = Sum(json, "self_ns", tree, opcodes);
+		if (!Close(self, total))
+			Fail(text + ": self ns of the nodes add up to " + std::to_string(self) + ", " + std::to_string(total) + " per evaluation");
+		size_t root = Find(json, "total_ns", tree, opcodes);
+		if (root == std::string::npos || !Close(Number(json, root), total))
+			Fail(text + ": total ns of the root isn't the ns per evaluation");
+		for (size_t at = Find(json, "self_ns", tree, opcodes); at != std::string::npos; at = Find(json, "self_ns", at, opcodes))
+			if (Number(json, at) < 0.0)
+				Fail(text + ": a node costs " + std::to_string(Number(json, at)) + " ns");
+
+		// per opcode, against the program
+		double opcode_ns = 0.0;
+		for (size_t op = 0; op <= static_cast<size_t>(MathEval::LAST_OPCODE); op++)
+		{
+			size_t count = 0;
+			for (size_t i = 0; i < prog.GetNumOfInstructions(); i++)
+				count += static_cast<size_t>(prog.GetInstructions()[i].op) == op;
+			std::string name = MathEval::GetOpcodeName(static_cast<MathEval::opcode>(op));
+			size_t entry = json.find("{\"op\": \"" + name + "\", ", opcodes);
+			if (entry == std::string::npos)
+			{
+				if (count)
+					Fail(text + ": " + name + " runs " + std::to_string(count) + " times and isn't in the opcodes");
+				continue;
+			}
+			size_t entry_end = json.find('}', entry);
+			double reported = Number(json, Find(json, "instructions", entry, entry_end));
+			if (reported != static_cast<double>(count) || Number(json, Find(json, "executions", entry, entry_end)) != reported * evaluations)
+				Fail(text + ": " + name + " reported " + std::to_string(reported) + " times, the program has it " + std::to_string(count));
+			opcode_ns += Number(json, Find(json, "ns", entry, entry_end));
+		}
+		if (!Close(opcode_ns, total))
+			Fail(text + ": ns of the opcodes add up to " + std::to_string(opcode_ns) + ", " + std::to_string(total) + " per evaluation");
+
+		std::string report = profiler.Explain();
+		char header[128];
+		std::snprintf(header, sizeof(header), "profile: %llu evaluations, %llu timed", static_cast<unsigned long long>(evaluations),
+			static_cast<unsigned long long>(profiler.GetNumOfSamples()));
+		if (report.compare(0, std::strlen(header), header) != 0 || report.find("by opcode:\n") == std::string::npos)
+			Fail(text + ": Explain starts " + report.substr(0, report.find('\n')));
+	}
+}
+
+int main()
+{
+	std::unordered_map<std::string, size_t> definition = { { "a", 0 }, { "b", 1 }, { "c", 2 } };
+	const std::vector<const char*> corpus = {
+		"a",
+		"2*3",
+		"a+b*c",
+		"sin(a*b)*c + sin(a*b)*c*c",
+		"exp(c)*cos(a+b) - sqrt(b*b + 1)",
+		"a^2 + b^-1 - tan(c/4) + arctan(a*c)",
+		"arcsin(c/9) * a^b / (1 + a*a)",
+	};
+	const std::vector<float> values = { 0.0f, -0.0f, 1.0f, -1.0f, 0.5f, -2.5f, 3.0f, 100.0f, 1e-40f, INFINITY, NAN };
+
+	size_t profiled = 0;
+	for (const char* text : corpus)
+	{
+		for (bool optimize : { true, false })
+		{
+			MathEvaluator<SLOTS> evaluator(text, definition, Options(optimize, false));
+			const MathEval::program& prog = evaluator.GetCompiled()->prog;
+			for (uint32_t period : { 1u, 7u, MathEval::expression_profiler::DEFAULT_SAMPLE_PERIOD })
+			{
+				std::string name = std::string(text) + (optimize ? "" : ", unoptimized") + ", 1 in " + std::to_string(period);
+				MathEval::expression_profiler profiler(evaluator.GetCompiled(), period);
+				profiled++;
+
+				uint64_t evaluations = 0;
+				for (float a : values)
+				{
+					for (float b : values)
+					{
+						for (float c : values)
+						{
+							std::array<float, SLOTS> point = { a, b, c };
+							float got = profiler.Evaluate(point.data());
+							evaluations++;
+							if (!Same(got, evaluator.Evaluate(point)))
+							{
+								char message[256];
+								std::snprintf(message, sizeof(message), "%s: (%g, %g, %g) gives %.9g, Evaluate %.9g", name.c_str(), a, b, c, got,
+									evaluator.Evaluate(point));
+								Fail(message);
+							}
+						}
+					}
+				}
+				if (profiler.GetNumOfEvaluations() != evaluations || profiler.GetNumOfSamples() != (evaluations + period - 1) / period)
+					Fail(name + ": " + std::to_string(profiler.GetNumOfEvaluations()) + " evaluations, " + std::to_string(profiler.GetNumOfSamples())
+						+ " samples after " + std::to_string(evaluations) + " calls");
+				CheckReport(name, profiler, prog, evaluations);
+
+				profiler.Reset();
+				if (profiler.GetNumOfEvaluations() != 0 || profiler.GetNumOfSamples() != 0)
+					Fail(name + ": counts left after Reset");
+				std::string json = profiler.ExplainJson();
+				if (Field(json, "ns_per_evaluation") != 0.0)
+					Fail(name + ": time left after Reset");
+				CheckReport(name + " after Reset", profiler, prog, 0);
+			}
+		}
+	}
+
+	// several threads on one profiler, none of the calls gets lost
+	{
+		MathEvaluator<SLOTS> evaluator("sin(a*b)*c + exp(a)", definition, Options(true, false));
+		MathEval::expression_profiler profiler(evaluator.GetCompiled(), 5);
+		const size_t THREADS = 4, CALLS = 5000;
+		std::vector<std::thread> threads;
+		for (size_t t = 0; t < THREADS; t++)
+		{
+			threads.emplace_back([&profiler, t]()
+			{
+				for (size_t i = 0; i < CALLS; i++)
+				{
+					std::array<float, SLOTS> point = { static_cast<float>(i) * 0.01f, static_cast<float>(t), 0.5f };
+					profiler.Evaluate(point.data());
+				}
+			});
+		}
+		for (std::thread& thread : threads)
+			thread.join();
+		if (profiler.GetNumOfEvaluations() != THREADS * CALLS || profiler.GetNumOfSamples() != THREADS * CALLS / 5)
+			Fail("threads: " + std::to_string(profiler.GetNumOfEvaluations()) + " evaluations, " + std::to_string(profiler.GetNumOfSamples())
+				+ " samples after " + std::to_string(THREADS * CALLS) + " calls");
+		CheckReport("threads", profiler, evaluator.GetCompiled()->prog, THREADS * CALLS);
+	}
+
+#ifdef MATH_EVAL_PROFILE
+	// MathEvaluator's hooks: the cache counts over the profile survive ClearCache in the middle of it
+	{
+		MathEvaluatorOptions options = Options(true, false);
+		options.cache_capacity = 256;
+		MathEvaluator<SLOTS> evaluator("sin(a*b)*c + exp(a)", definition, options);
+		evaluator.Evaluate({ 9.0f, 9.0f, 9.0f }, true); // before the profile, not counted
+		evaluator.StartProfiling(1);
+		auto twice = [&](size_t points)
+		{
+			for (int round = 0; round < 2; round++)
+				for (size_t i = 0; i < points; i++)
+					evaluator.Evaluate({ static_cast<float>(i), 0.5f, 2.0f }, true);
+		};
+		twice(10);
+		evaluator.ClearCache();
+		twice(3);
+		auto counted = [&](const char* when)
+		{
+			std::string json = evaluator.Explain(true);
+			double hits = Field(json, "hits"), misses = Field(json, "misses"), evictions = Field(json, "evictions");
+			if (hits != 13.0 || misses != 13.0 || evictions != 0.0)
+				Fail(std::string("ClearCache while profiling, ") + when + ": " + std::to_string(hits) + " hits, " + std::to_string(misses)
+					+ " misses, " + std::to_string(evictions) + " evictions, expected 13, 13 and 0");
+			if (evaluator.Explain().find("cache: 13 hits, 13 misses") == std::string::npos)
+				Fail(std::string("ClearCache while profiling, ") + when + ": Explain has other cache counts");
+		};
+		counted("profiling");
+		evaluator.StopProfiling();
+		evaluator.ClearCache();
+		twice(2);
+		counted("stopped");
+	}
+#endif
+
+	// nothing to profile
+	try
+	{
+		MathEval::expression_profiler profiler(nullptr);
+		Fail("no compiled expression: nothing thrown");
+	}
+	catch (const std::invalid_argument&)
+	{
+	}
+
+	std::printf("profiler: %zu profiles, %zu failures\n", profiled, failures);
+	return failures ? 1 : 0;
+}
+#endif
@@ -0,0 +1,213 @@
+// comment out the below definition if using elsewhere
+// uncomment out below definition to run the archive test
+//#define MATH_EVAL_SERIALIZE_TEST_MAIN
+#ifdef MATH_EVAL_SERIALIZE_TEST_MAIN
+#include "../include/ExpressionEvaluation.h"
+#include "test_util.h"
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+ archives (serialize.h):
+   round trip, an evaluator built from a loaded record gives the same bits as the one it was saved from, scalar and
+   batch, with and without jit, for every precision
+   damage, a record with a register count it can't have is refused, and records with 1-3 random bits flipped either
+   throw std::runtime_error or load into something that evaluates without crashing (run it under asan to mean it)
+*/
+
+namespace
+{
+	using namespace MathEvalTest;
+
+	static const size_t SLOTS = 4;
+	static const size_t POINTS = 37; // not a multiple of any kernel's width, so the batch tails run too
+	// offsets into a record of the register counts of the program and the gradient program (SerializeExpression)
+	static const size_t PROGRAM_REGISTERS = 32;
+	static const size_t GRADIENT_REGISTERS = 44;
+
+	std::unordered_map<std::string, size_t> Definition()
+	{
+		return { { "a", 0 }, { "b", 1 }, { "c", 2 }, { "d", 3 } };
+	}
+
+	std::vector<std::string> Corpus()
+	{
+		return {
+			"a+b",
+			"a * sin(3.14) - cos(2)",
+			"sin(a*b)*c + sin(a*b)*d + exp(c/(1+d*d)) - a/b",
+			"a^4 - 3*b^3 + c^-2 + d^0.5",
+			"tan(a)*arctan(b) + sqrt(c*c + d*d) - arcsin(a/4) + -arccos(b/4)",
+			"3",
+		};
+	}
+
+	void PutU32(std::string& record, size_t offset, uint32_t value)
+	{
+		for (int i = 0; i < 4; i++)
+			record[offset + i] = static_cast<char>(value >> (8 * i));
+	}
+
+	// everything an evaluator can do with a compiled expression, the results don't matter here
+	float Exercise(const std::shared_ptr<const MathEval::compiled_expression>& compiled, const std::array<const float*, SLOTS>& columns,
+		float* output)
+	{
+		MathEvaluatorOptions options;
+		options.cache_capacity = 0;
+		MathEvaluator<SLOTS> evaluator(compiled, options);
+		std::array<float, SLOTS> point = { 0.5f, -1.0f, 2.0f, 3.0f };
+		std::array<float, SLOTS> gradient;
+		float sum = evaluator.Evaluate(point) + evaluator.EvaluateTree(point) + evaluator.EvaluateWithGradient(point, gradient);
+		evaluator.EvaluateBatch(columns, output, POINTS);
+		return sum + output[0];
+	}
+}
+
+int main()
+{
+	MathEvaluator<SLOTS>::Setup();
+	std::unordered_map<std::string, size_t> definition = Definition();
+
+	float values[SLOTS][POINTS];
+	std::array<const float*, SLOTS> columns;
+	for (size_t s = 0; s < SLOTS; s++)
+	{
+		for (size_t i = 0; i < POINTS; i++)
+			values[s][i] = i % 11 == 3 ? -0.0f : std::sin(static_cast<float>(i * 7 + s)) * 3.0f;
+		columns[s] = values[s];
+	}
+	float expected[POINTS], output[POINTS];
+
+	// round trip through a whole archive
+	MathEval::archive_writer writer;
+	std::vector<std::shared_ptr<const MathEval::compiled_expression>> saved;
+	std::vector<std::string> records;
+	for (const std::string& text : Corpus())
+	{
+		for (bool jit : { false, true })
+		{
+			for (MathEval::precision precision : { MathEval::precision::DEFAULT, MathEval::precision::EXACT, MathEval::precision::ULP1,
+				MathEval::precision::ULP2, MathEval::precision::ULP4 })
+			{
+				MathEvaluator<SLOTS> evaluator(text, definition, Options(true, jit, precision));
+				writer.Add(std::to_string(saved.size()), *evaluator.GetCompiled());
+				saved.push_back(evaluator.GetCompiled());
+				records.emplace_back();
+				MathEval::SerializeExpression(*evaluator.GetCompiled(), records.back());
+			}
+		}
+	}
+	std::string file = writer.Finish();
+	MathEval::expression_archive archive(file.data(), file.size());
+	for (size_t k = 0; k < saved.size(); k++)
+	{
+		MathEvaluatorOptions options;
+		options.cache_capacity = 0;
+		MathEvaluator<SLOTS> original(saved[k], options), loaded(archive.Load(std::to_string(k)), options);
+		if (loaded.IsJitCompiled() != original.IsJitCompiled())
+			Fail("record " + std::to_string(k) + ": jit lost on the way");
+		for (size_t i = 0; i < POINTS; i++)
+		{
+			std::array<float, SLOTS> point = { values[0][i], values[1][i], values[2][i], values[3][i] };
+			if (!Same(original.Evaluate(point), loaded.Evaluate(point)))
+				Fail("record " + std::to_string(k) + ": Evaluate differs after loading at point " + std::to_string(i));
+		}
+		original.EvaluateBatch(columns, expected, POINTS);
+		loaded.EvaluateBatch(columns, output, POINTS);
+		for (size_t i = 0; i < POINTS; i++)
+		{
+			if (!Same(expected[i], output[i]))
+				Fail("record " + std::to_string(k) + ": EvaluateBatch differs after loading at point " + std::to_string(i));
+		}
+	}
+
+	// the registry hands out copies by text, one compiled for 3 inputs mustn't come back for 2 and end up in an
+	// archive a 2 input evaluator can't load
+	{
+		std::unordered_map<std::string, size_t> two = { { "a", 0 }, { "b", 1 } };
+		MathEvaluator<3> three_inputs("a+b", two);
+		MathEvaluator<2> two_inputs("a+b", two);
+		MathEval::archive_writer small_writer;
+		small_writer.Add("a+b", *two_inputs.GetCompiled());
+		std::string small_file = small_writer.Finish();
+		MathEval::expression_archive small_archive(small_file.data(), small_file.size());
+		try
+		{
+			MathEvaluator<2> loaded_two(small_archive.Load("a+b"));
+			if (loaded_two.Evaluate({ 1.0f, 2.0f }) != 3.0f)
+				Fail("a+b loaded for 2 inputs gives the wrong result");
+		}
+		catch (const std::invalid_argument& e)
+		{
+			Fail(std::string("a+b compiled for 2 inputs won't load into 2: ") + e.what());
+		}
+	}
+
+	// register counts past the instruction count, the jit would size its stack frame from them
+	for (size_t offset : { PROGRAM_REGISTERS, GRADIENT_REGISTERS })
+	{
+		for (uint32_t registers : { 524545u, 0xfffffff0u, 0xffffffffu })
+		{
+			std::string record = records[2];
+			PutU32(record, offset, registers);
+			try
+			{
+				MathEval::DeserializeExpression(record.data(), record.size());
+				Fail("a record with " + std::to_string(registers) + " registers loaded");
+			}
+			catch (const std::runtime_error&)
+			{
+			}
+		}
+	}
+
+	// random damage, every record gets the same number of tries
+	uint32_t state = 2463534242u;
+	auto next = [&]() { state ^= state << 13; state ^= state >> 17; state ^= state << 5; return state; };
+	size_t refused = 0, loaded = 0;
+	float sink = 0.0f;
+	for (int round = 0; round < 2000; round++)
+	{
+		for (const std::string& original : records)
+		{
+			std::string record = original;
+			int flips = 1 + next() % 3;
+			for (int f = 0; f < flips; f++)
+			{
+				uint32_t bit = next() % (record.size() * 8);
+				record[bit / 8] ^= static_cast<char>(1 << (bit % 8));
+			}
+			std::shared_ptr<const MathEval::compiled_expression> compiled;
+			try
+			{
+				compiled = MathEval::DeserializeExpression(record.data(), record.size());
+			}
+			catch (const std::runtime_error&)
+			{
+				refused++;
+				continue;
+			}
+			loaded++;
+			try
+			{
+				sink += Exercise(compiled, columns, output);
+			}
+			catch (const std::invalid_argument&)
+			{
+				// compiled for more than SLOTS inputs
+			}
+		}
+	}
+
+	std::printf("serialize: %zu records round tripped, fuzz refused %zu and loaded %zu (%g), %zu failures\n",
+		saved.size(), refused, loaded, sink, failures);
+	return failures ? 1 : 0;
+}
+#endif
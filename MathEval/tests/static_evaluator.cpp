@@ -0,0 +1,219 @@
+// comment out the below definition if using elsewhere
+// uncomment out below definition to run the compile time front end test
+//#define MATH_EVAL_STATIC_EVALUATOR_TEST_MAIN
+#ifdef MATH_EVAL_STATIC_EVALUATOR_TEST_MAIN
+#include "../include/ExpressionEvaluation.h"
+#include "test_util.h"
+#include "../src/decimal.h"
+#include <array>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/*
+ the two front ends have to agree:
+   number literals, Lexer::ParseNumber (decimal.h) against strtof bit for bit, on random digit strings, the exact
+   decimal value of every kind of float rounding midpoint (ties go to even), the values either side of them, and
+   subnormals, overflow and long runs of digits
+   StaticMathEvaluator against MathEvaluator::Evaluate (DEFAULT, folding on) bit for bit, Evaluate and EvaluateBatch,
+   over every combination of awkward inputs in 4 slots
+ a NaN result only has to be a NaN
+*/
+
+namespace
+{
+	using namespace MathEvalTest;
+
+	static const size_t SLOTS = 4;
+
+	// a few literals at compile time, same function the static parser calls
+	static_assert(Lexer::ParseNumber("0.1") == 0.1f, "ParseNumber(0.1)");
+	static_assert(Lexer::ParseNumber("16777217") == 16777216.0f, "ParseNumber rounds a tie to even");
+
+	size_t literals = 0;
+
+	void CheckLiteral(const std::string& lexeme)
+	{
+		literals++;
+		float expected = std::strtof(lexeme.c_str(), nullptr);
+		float got = Lexer::ParseNumber(lexeme);
+		if (Same(expected, got))
+			return;
+		char message[96];
+		std::snprintf(message, sizeof(message), ") gives %.9g, strtof %.9g", got, expected);
+		Fail("ParseNumber(" + lexeme + message);
+	}
+
+	// exact decimal expansion of a double, glibc prints every digit asked for
+	std::string Exact(double v)
+	{
+		char buffer[512];
+		std::snprintf(buffer, sizeof(buffer), "%.170f", v);
+		std::string text = buffer;
+		// trailing zeros make no difference, dropping them keeps the short cases short
+		while (text.size() > 1 && text.back() == '0')
+			text.pop_back();
+		if (text.back() == '.')
+			text.pop_back();
+		return text;
+	}
+
+	std::vector<float> Values()
+	{
+		return { 0.0f, -0.0f, 1.0f, -1.0f, 0.5f, -2.5f, 3.0f, 100.0f, 1e-40f, -1e-40f, 1e30f, -1e30f,
+			INFINITY, -INFINITY, NAN };
+	}
+
+	struct polynomial
+	{
+		static constexpr std::string_view text = "a^4 - 3*b^3 + c^-2 + d^0.5 + a^b";
+		static constexpr std::string_view vars[] = { "a", "b", "c", "d" };
+	};
+	struct trig
+	{
+		static constexpr std::string_view text = "sin(a)*cos(b) + exp(a/10) - a*b/(1+a*a)";
+		static constexpr std::string_view vars[] = { "a", "b", "c", "d" };
+	};
+	struct shared
+	{
+		static constexpr std::string_view text = "sin(a*b)*c + sin(a*b)*d + exp(c/(1+d*d)) - a/b";
+		static constexpr std::string_view vars[] = { "a", "b", "c", "d" };
+	};
+	struct inverse
+	{
+		static constexpr std::string_view text = "tan(a)*arctan(b) + sqrt(c*c + d*d) - arcsin(a/4) + -arccos(b/4)";
+		static constexpr std::string_view vars[] = { "a", "b", "c", "d" };
+	};
+	struct identities
+	{
+		static constexpr std::string_view text = "a*1 + 0*b - (c-0) + d/1 + -(-a) + --b + a^b + b^0 + c^1 + d^2";
+		static constexpr std::string_view vars[] = { "a", "b", "c", "d" };
+	};
+	struct literals_text
+	{
+		static constexpr std::string_view text = "0.1*a + 16777217*b - 3.14159265358979323846*c + 0.000000000000000000000000000000000000000000001*d";
+		static constexpr std::string_view vars[] = { "a", "b", "c", "d" };
+	};
+	struct constant
+	{
+		static constexpr std::string_view text = "2*3 + 4/8 - exp(0) + sin(1)";
+		static constexpr std::string_view vars[] = { "a" };
+	};
+
+	template <class E>
+	void CheckEvaluator(std::unordered_map<std::string, size_t>& definition, const std::vector<std::array<float, SLOTS>>& points,
+		const std::array<const float*, SLOTS>& columns)
+	{
+		std::string text(E::text);
+		MathEvaluator<SLOTS> runtime(text, definition, Options(true, false));
+		std::vector<float> output(points.size());
+		StaticMathEvaluator<E, SLOTS>::EvaluateBatch(columns, output.data(), output.size());
+		for (size_t i = 0; i < points.size(); i++)
+		{
+			float expected = runtime.Evaluate(points[i]);
+			float scalar = StaticMathEvaluator<E, SLOTS>::Evaluate(points[i]);
+			for (float got : { scalar, output[i] })
+			{
+				if (Same(expected, got))
+					continue;
+				char message[192];
+				std::snprintf(message, sizeof(message), ": StaticMathEvaluator at (%g, %g, %g, %g) gives %.9g, MathEvaluator %.9g",
+					points[i][0], points[i][1], points[i][2], points[i][3], got, expected);
+				Fail(text + message);
+			}
+		}
+	}
+}
+
+int main()
+{
+	// random digit strings, up to 60 digits with the '.' anywhere (or nowhere)
+	uint32_t state = 88172645u;
+	auto next = [&]() { state ^= state << 13; state ^= state >> 17; state ^= state << 5; return state; };
+	for (int k = 0; k < 200000; k++)
+	{
+		size_t length = 1 + next() % 60;
+		std::string lexeme;
+		size_t zeros = next() % 4 == 0 ? next() % 50 : 0; // push some into the subnormals
+		size_t dot = next() % (length + 2);
+		for (size_t i = 0; i < length; i++)
+		{
+			if (i == dot)
+			{
+				lexeme += '.';
+				lexeme.append(zeros, '0');
+			}
+			lexeme += static_cast<char>('0' + next() % 10);
+		}
+		CheckLiteral(lexeme);
+	}
+
+	// rounding midpoints, halfway between two floats is exact in a double, so are its neighbours one double away
+	for (int k = 0; k < 100000; k++)
+	{
+		uint32_t bits = next() & 0x7f7fffffu; // finite, below FLT_MAX's exponent so the next float up is finite
+		if (k % 4 == 0)
+			bits &= 0x007fffffu; // subnormals
+		float below;
+		std::memcpy(&below, &bits, sizeof(float));
+		float above = std::nextafterf(below, INFINITY);
+		double middle = (static_cast<double>(below) + static_cast<double>(above)) / 2.0;
+		CheckLiteral(Exact(middle));
+		CheckLiteral(Exact(std::nextafter(middle, 0.0)));
+		CheckLiteral(Exact(std::nextafter(middle, INFINITY)));
+	}
+
+	// the edges, FLT_MAX and the overflow midpoint above it, the smallest subnormal and half of it
+	double max_middle = static_cast<double>(FLT_MAX) + std::ldexp(1.0, 103);
+	for (double v : { static_cast<double>(FLT_MAX), max_middle, std::nextafter(max_middle, 0.0), std::nextafter(max_middle, INFINITY),
+		std::ldexp(1.0, -149), std::ldexp(1.0, -150), std::nextafter(std::ldexp(1.0, -150), 0.0), std::nextafter(std::ldexp(1.0, -150), 1.0),
+		1e39, 0.0 })
+		CheckLiteral(Exact(v));
+	for (const char* lexeme : { "0", "00000", ".5", "5.", "1.", "0.0000000000000000000000000000000000000000000014012984643248170709",
+		"340282356779733661637539395458142568448", "340282356779733661637539395458142568447.999999",
+		"1.00000005960464477539062500000000000000000000000000000000000000000000000000000000000000000000000000000000001",
+		"1.000000059604644775390625", "1.2.3" })
+		CheckLiteral(lexeme);
+
+	// the evaluators
+	std::unordered_map<std::string, size_t> definition = { { "a", 0 }, { "b", 1 }, { "c", 2 }, { "d", 3 } };
+	std::vector<float> values = Values();
+	size_t count = 1;
+	for (size_t s = 0; s < SLOTS; s++)
+		count *= values.size();
+	std::vector<std::array<float, SLOTS>> points(count);
+	std::vector<float> columns[SLOTS];
+	for (size_t s = 0; s < SLOTS; s++)
+		columns[s].resize(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		size_t rest = i;
+		for (size_t s = 0; s < SLOTS; s++)
+		{
+			points[i][s] = columns[s][i] = values[rest % values.size()];
+			rest /= values.size();
+		}
+	}
+	std::array<const float*, SLOTS> column_pointers;
+	for (size_t s = 0; s < SLOTS; s++)
+		column_pointers[s] = columns[s].data();
+
+	CheckEvaluator<polynomial>(definition, points, column_pointers);
+	CheckEvaluator<trig>(definition, points, column_pointers);
+	CheckEvaluator<shared>(definition, points, column_pointers);
+	CheckEvaluator<inverse>(definition, points, column_pointers);
+	CheckEvaluator<identities>(definition, points, column_pointers);
+	CheckEvaluator<literals_text>(definition, points, column_pointers);
+	CheckEvaluator<constant>(definition, points, column_pointers);
+
+	std::printf("static evaluator: %zu literals, %zu points, %zu failures\n", literals, count, failures);
+	return failures ? 1 : 0;
+}
+#endif
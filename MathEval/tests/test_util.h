@@ -0,0 +1,51 @@
+#pragma once
+#ifndef TEST_UTIL_H
+#define TEST_UTIL_H
+
+#include "../include/ExpressionEvaluation.h"
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+/*
+ what every test under MathEval/tests shares: the failure count main returns on with the first few failures
+ printed, bit for bit comparison of results, and evaluator options that keep each evaluator to itself (no
+ cache, no registry) so a test sees exactly the path it asked for
+ inline so the visual studio project, which links every test into one binary, gets one copy
+*/
+namespace MathEvalTest
+{
+	inline size_t failures = 0;
+
+	// counts it, prints the first 10
+	inline void Fail(const std::string& what)
+	{
+		if (failures++ < 10)
+			std::printf("%s\n", what.c_str());
+	}
+
+	// same bits, except a NaN only has to be a NaN (its sign and payload are whatever the hardware made of it)
+	inline bool Same(float x, float y)
+	{
+		if (std::isnan(x) || std::isnan(y))
+			return std::isnan(x) && std::isnan(y);
+		return std::memcmp(&x, &y, sizeof(float)) == 0;
+	}
+
+	// optimize turns constant folding and common subexpressions on or off together
+	inline MathEvaluatorOptions Options(bool optimize, bool jit, MathEval::precision precision = MathEval::precision::DEFAULT)
+	{
+		MathEvaluatorOptions options;
+		options.fold_constants = optimize;
+		options.eliminate_common_subexpressions = optimize;
+		options.jit = jit;
+		options.precision = precision;
+		options.cache_capacity = 0;
+		options.registry = nullptr;
+		return options;
+	}
+};
+
+#endif // TEST_UTIL_H
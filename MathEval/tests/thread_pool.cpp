@@ -0,0 +1,222 @@
+// comment out the below definition if using elsewhere
+// uncomment out below definition to run the thread pool test
+//#define MATH_EVAL_THREAD_POOL_TEST_MAIN
+#ifdef MATH_EVAL_THREAD_POOL_TEST_MAIN
+#include "../src/thread_pool.h"
+#include "test_util.h"
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ thread_pool::ParallelFor on its own:
+   - every index of [0, count) runs exactly once, in chunks of the asked size (the last one short), for pools of
+     1 to 7 threads and chunk sizes that don't divide the count, with some chunks hundreds of times slower than
+     the rest so the other threads have to steal them
+   - a ParallelFor from inside a chunk runs inline on the thread that called it
+   - ParallelFor called from several threads at once on one pool, run_lock lets one job run at a time, a chunk
+     never sees a chunk of another caller's job in flight (a pool of 1 runs every caller inline, they only have to
+     cover their own indices there)
+   - an exception thrown by a chunk comes out of ParallelFor in the caller, the pool still works afterwards
+   - AutoChunkSize gives whole multiples of 64
+*/
+
+namespace
+{
+	using namespace MathEvalTest;
+
+	MathEval::thread_pool_options PoolOptions(size_t threads)
+	{
+		MathEval::thread_pool_options options;
+		options.threads = threads;
+		return options;
+	}
+
+	// spins instead of sleeping so a slow chunk keeps its thread busy
+	void Spin(size_t iterations)
+	{
+		volatile size_t sink = 0;
+		for (size_t i = 0; i < iterations; i++)
+			sink = sink + i;
+	}
+
+	void Coverage(MathEval::thread_pool& pool, size_t count, size_t chunk)
+	{
+		std::string name = std::to_string(pool.GetNumOfThreads()) + " threads, count " + std::to_string(count) + ", chunk " + std::to_string(chunk);
+		size_t expected_chunk = chunk ? chunk : (count + pool.GetNumOfThreads() - 1) / pool.GetNumOfThreads();
+		std::unique_ptr<std::atomic<uint32_t>[]> seen(new std::atomic<uint32_t>[count]);
+		for (size_t i = 0; i < count; i++)
+			seen[i].store(0);
+		std::atomic<size_t> bad_ranges{ 0 };
+		pool.ParallelFor(count, chunk, [&](size_t begin, size_t end)
+		{
+			if (begin >= end || end > count || begin % expected_chunk != 0 || (end - begin != expected_chunk && end != count))
+				bad_ranges++;
+			// uneven chunks, every fifth one takes far longer
+			if ((begin / expected_chunk) % 5 == 0)
+				Spin(20000);
+			for (size_t i = begin; i < end && i < count; i++)
+				seen[i].fetch_add(1);
+		});
+		if (bad_ranges.load())
+			Fail(name + ": " + std::to_string(bad_ranges.load()) + " ranges off the chunk grid");
+		for (size_t i = 0; i < count; i++)
+		{
+			if (seen[i].load() != 1)
+			{
+				Fail(name + ": index " + std::to_string(i) + " ran " + std::to_string(seen[i].load()) + " times");
+				break;
+			}
+		}
+	}
+
+	void Nested(MathEval::thread_pool& pool)
+	{
+		const size_t OUTER = 64, INNER = 100;
+		std::vector<std::atomic<uint32_t>> seen(OUTER * INNER);
+		std::atomic<size_t> moved{ 0 };
+		pool.ParallelFor(OUTER, 4, [&](size_t begin, size_t end)
+		{
+			for (size_t o = begin; o < end; o++)
+			{
+				std::thread::id caller = std::this_thread::get_id();
+				pool.ParallelFor(INNER, 7, [&](size_t inner_begin, size_t inner_end)
+				{
+					if (std::this_thread::get_id() != caller)
+						moved++;
+					for (size_t i = inner_begin; i < inner_end; i++)
+						seen[o * INNER + i].fetch_add(1);
+				});
+			}
+		});
+		if (moved.load())
+			Fail("nested: " + std::to_string(moved.load()) + " inner chunks left the thread that called them");
+		for (size_t i = 0; i < seen.size(); i++)
+		{
+			if (seen[i].load() != 1)
+			{
+				Fail("nested: index " + std::to_string(i) + " ran " + std::to_string(seen[i].load()) + " times");
+				break;
+			}
+		}
+	}
+
+	void Concurrent(MathEval::thread_pool& pool)
+	{
+		const size_t CALLERS = 4, ROUNDS = 40, COUNT = 2000;
+		std::vector<std::atomic<int>> in_flight(CALLERS);
+		std::atomic<size_t> overlaps{ 0 }, lost{ 0 };
+		std::vector<std::thread> callers;
+		for (size_t me = 0; me < CALLERS; me++)
+		{
+			callers.emplace_back([&, me]
+			{
+				std::vector<std::atomic<uint32_t>> seen(COUNT);
+				for (size_t round = 0; round < ROUNDS; round++)
+				{
+					for (auto& s : seen)
+						s.store(0);
+					pool.ParallelFor(COUNT, 37, [&](size_t begin, size_t end)
+					{
+						in_flight[me]++;
+						for (size_t other = 0; other < CALLERS; other++)
+							if (other != me && in_flight[other].load() != 0 && pool.GetNumOfThreads() > 1)
+								overlaps++;
+						Spin(500);
+						for (size_t i = begin; i < end; i++)
+							seen[i].fetch_add(1);
+						in_flight[me]--;
+					});
+					for (auto& s : seen)
+						if (s.load() != 1)
+							lost++;
+				}
+			});
+		}
+		for (std::thread& caller : callers)
+			caller.join();
+		if (overlaps.load())
+			Fail("concurrent: " + std::to_string(overlaps.load()) + " chunks ran next to another caller's job");
+		if (lost.load())
+			Fail("concurrent: " + std::to_string(lost.load()) + " indices not run exactly once");
+	}
+
+	void Exceptions(MathEval::thread_pool& pool)
+	{
+		std::string name = "exceptions, " + std::to_string(pool.GetNumOfThreads()) + " threads";
+		// one throwing chunk, then several, then one thrown from a nested call
+		for (size_t throwing : { size_t(1), size_t(5) })
+		{
+			std::atomic<size_t> ran{ 0 };
+			try
+			{
+				pool.ParallelFor(1000, 10, [&](size_t begin, size_t)
+				{
+					ran++;
+					if (begin / 10 % (100 / throwing) == 3)
+						throw std::runtime_error("chunk " + std::to_string(begin / 10));
+				});
+				Fail(name + ": nothing thrown from " + std::to_string(throwing) + " throwing chunks");
+			}
+			catch (const std::runtime_error& e)
+			{
+				std::string message = e.what();
+				if (message.compare(0, 6, "chunk ") != 0 || std::stoul(message.substr(6)) % (100 / throwing) != 3)
+					Fail(name + ": caught \"" + message + "\"");
+			}
+			if (ran.load() == 0)
+				Fail(name + ": no chunk ran");
+		}
+		try
+		{
+			pool.ParallelFor(100, 10, [&](size_t begin, size_t)
+			{
+				pool.ParallelFor(10, 3, [&](size_t inner, size_t)
+				{
+					if (begin == 50 && inner == 6)
+						throw std::out_of_range("inner");
+				});
+			});
+			Fail(name + ": nothing thrown from a nested call");
+		}
+		catch (const std::out_of_range& e)
+		{
+			if (std::string(e.what()) != "inner")
+				Fail(name + ": caught \"" + std::string(e.what()) + "\" from a nested call");
+		}
+		// the failure doesn't stick to the next job
+		Coverage(pool, 10007, 13);
+	}
+}
+
+int main()
+{
+	for (size_t threads : { size_t(1), size_t(2), size_t(4), size_t(7) })
+	{
+		MathEval::thread_pool pool(PoolOptions(threads));
+		if (pool.GetNumOfThreads() != threads)
+			Fail(std::to_string(pool.GetNumOfThreads()) + " threads instead of " + std::to_string(threads));
+		for (size_t count : { size_t(1), size_t(63), size_t(64), size_t(1000), size_t(100003) })
+			for (size_t chunk : { size_t(0), size_t(1), size_t(7), size_t(64), size_t(1000), count + 1 })
+				Coverage(pool, count, chunk);
+		Nested(pool);
+		Concurrent(pool);
+		Exceptions(pool);
+	}
+
+	for (size_t count : { size_t(1), size_t(100), size_t(4096), size_t(1000000) })
+		for (double ns : { 0.0, 1.0, 40.0, 5000.0 })
+		{
+			size_t chunk = MathEval::AutoChunkSize(ns, count, 8);
+			if (chunk == 0 || chunk % 64 != 0)
+				Fail("AutoChunkSize(" + std::to_string(ns) + ", " + std::to_string(count) + ", 8) = " + std::to_string(chunk));
+		}
+
+	std::printf("thread pool: %zu failures\n", failures);
+	return failures ? 1 : 0;
+}
+#endif